@@ -1,11 +1,12 @@
 #include "GL.h"
+#include "scene.h"
+#include "raster.h"
 #include <algorithm>
+#include <cmath>
+#include <cstring>
 
 void line(int x0, int y0, int x1, int y1, TGAImage& image, TGAColor color)
 {
-    int endx = x1;
-    int endy = y1;
-
     bool steepCurve = false;
 
     if (std::abs(x1 - x0) < std::abs(y1 - y0))
@@ -52,23 +53,6 @@ void line(Vec2i a, Vec2i b, TGAImage& image, TGAColor color)
     line(a.x, a.y, b.x, b.y, image, color);
 }
 
-void boundingbox(Vec3f t0, Vec3f t1, Vec3f t2, Vec2i windowSize, Vec2i& min, Vec2i& max)
-{
-    min = { std::numeric_limits<int>::max(), std::numeric_limits<int>::max() };
-    max = { 0, 0 };
-
-    min = { std::min((int)t0.x, min.x), std::min((int)t0.y, min.y) };
-    min = { std::min((int)t1.x, min.x), std::min((int)t1.y, min.y) };
-    min = { std::min((int)t2.x, min.x), std::min((int)t2.y, min.y) };
-
-    max = { std::max((int)t0.x, max.x), std::max((int)t0.y, max.y) };
-    max = { std::max((int)t1.x, max.x), std::max((int)t1.y, max.y) };
-    max = { std::max((int)t2.x, max.x), std::max((int)t2.y, max.y) };
-
-    min = { std::clamp(min.x, 0, windowSize.x - 1), std::clamp(min.y, 0, windowSize.y - 1) };
-    max = { std::clamp(max.x, 0, windowSize.x - 1), std::clamp(max.y, 0, windowSize.y - 1) };
-}
-
 int dot(const Vec2i& a, const Vec2i& b)
 {
     return a.x * b.x + a.y * b.y;
@@ -88,11 +72,22 @@ bool insideTriangle(Vec2i point, Vec2i t[3])
     return a == b && b == c;
 }
 
-GraphicsLibrary::GraphicsLibrary(int width, int height) : Output(width, height, TGAImage::RGB)
+GraphicsLibrary::GraphicsLibrary(int width, int height, SimdLevel simd) :
+    Output(width, height, TGAImage::RGB),
+    Kernels(&GetKernels(simd)),
+    occlusion(width, height),
+    fragmentX(width),
+    fragmentAlpha(width),
+    fragmentBeta(width),
+    fragmentDepth(width),
+    blockDepth((size_t)((width + BlockSize - 1) / BlockSize) * ((height + BlockSize - 1) / BlockSize))
 {
     ZBuffer = new float[width * height];
-    for (int i = 0; i < width * height; ++i)
-        ZBuffer[i] = std::numeric_limits<float>::lowest();
+    blockState.resize(blockDepth.size());
+    blockPlane.resize(blockDepth.size());
+    clearedRow.resize(width);
+    blockScratch.resize(BlockSize * BlockSize);
+    Clear();
 }
 
 GraphicsLibrary::~GraphicsLibrary()
@@ -100,9 +95,268 @@ GraphicsLibrary::~GraphicsLibrary()
     delete[] ZBuffer;
 }
 
+void GraphicsLibrary::Clear()
+{
+    float cleared = std::numeric_limits<float>::lowest();
+    uint32_t clearedBits;
+    std::memcpy(&clearedBits, &cleared, sizeof(cleared));
+
+    // Only the block states are cleared, ZBuffer is written when blocks are expanded. Unorm buffers clear to 0.
+    Arena.Reset();
+    std::fill(blockState.begin(), blockState.end(), BlockState::Cleared);
+    Kernels->Fill32(clearedRow.data(), clearedRow.size(), depthFormat == DepthFormat::Float32 ? clearedBits : 0);
+    Kernels->Fill32((uint32_t*)blockDepth.data(), blockDepth.size(), clearedBits);
+    Output.clear();
+    if (!DepthCompression)
+        DecompressDepth();
+
+    if (sampleCount > 1)
+    {
+        Kernels->Fill32((uint32_t*)sampleDepth.data(), sampleDepth.size(), clearedBits);
+        Kernels->Fill32(sampleColor.data(), sampleColor.size(), 0);
+    }
+
+    // Zero bits are a zero float and a zero half.
+    Kernels->Fill32((uint32_t*)floatColor.data(), floatColor.size(), 0);
+    Kernels->Fill32((uint32_t*)halfColor.data(), halfColor.size() / 2, 0);
+}
+
+namespace
+{
+    // Standard Direct3D sample positions, in sixteenths of a pixel around the pixel position.
+    const int samplePattern2[2][2] = { { 4, 4 }, { -4, -4 } };
+    const int samplePattern4[4][2] = { { -2, -6 }, { 6, -2 }, { -6, 2 }, { 2, 6 } };
+    const int samplePattern8[8][2] = { { 1, -3 }, { -1, 3 }, { 5, 1 }, { -3, -5 }, { -5, 5 }, { -7, -1 }, { 3, 7 }, { 7, -7 } };
+
+    const int (*samplePattern(int count))[2]
+    {
+        return count == 8 ? samplePattern8 : count == 4 ? samplePattern4 : samplePattern2;
+    }
+}
+
+bool GraphicsLibrary::SetSampleCount(int count)
+{
+    if (count != 1 && count != 2 && count != 4 && count != 8)
+        return false;
+    if (count > 1 && (depthFormat != DepthFormat::Float32 || colorFormat != ColorFormat::Rgba8))
+        return false;
+
+    int width = Output.get_width();
+    int height = Output.get_height();
+
+    // Planes a multiple of 4 KiB apart would put the samples of a pixel in the same cache set, each one is shifted
+    // by seven more cache lines.
+    sampleCount = count;
+    samplePlane = (size_t)width * height + 7 * 16;
+    if (count > 1)
+    {
+        sampleDepth.resize(samplePlane * count);
+        sampleColor.resize(samplePlane * count);
+        resolvedRow.resize(width);
+        fragmentMask.resize(width);
+        pixelAlpha.resize(width);
+        pixelBeta.resize(width);
+        fragmentSampleDepth.resize((size_t)width * count);
+    }
+    else
+    {
+        sampleDepth = std::vector<float>();
+        sampleColor = std::vector<uint32_t>();
+    }
+
+    Clear();
+    return true;
+}
+
+bool GraphicsLibrary::SetDepthFormat(DepthFormat format)
+{
+    if (format != DepthFormat::Float32 && sampleCount > 1)
+        return false;
+
+    depthFormat = format;
+    depthMax = format == DepthFormat::Unorm16 ? 65535.0f : format == DepthFormat::Unorm24Stencil8 ? 16777215.0f : 0.0f;
+    Clear();
+    return true;
+}
+
+bool GraphicsLibrary::SetColorFormat(ColorFormat format)
+{
+    if (format != ColorFormat::Rgba8 && sampleCount > 1)
+        return false;
+
+    // A pixel takes four values, halves are cleared in pairs.
+    size_t values = (size_t)Output.get_width() * Output.get_height() * 4;
+    colorFormat = format;
+    floatColor = format == ColorFormat::Rgba32F ? std::vector<float>(values) : std::vector<float>();
+    halfColor = format == ColorFormat::Rgba16F ? std::vector<uint16_t>(values) : std::vector<uint16_t>();
+    if (format != ColorFormat::Rgba8)
+    {
+        resolvedRow.resize(Output.get_width());
+        toneMapRow.resize((size_t)Output.get_width() * 4);
+    }
+    Clear();
+    return true;
+}
+
+void GraphicsLibrary::storeRow(int y, const uint32_t* colors)
+{
+    int width = Output.get_width();
+    int bytespp = Output.get_bytespp();
+    unsigned char* out = Output.buffer() + (size_t)y * width * bytespp;
+    for (int x = 0; x < width; ++x, out += bytespp)
+    {
+        uint32_t color = colors[x];
+        for (int byte = 0; byte < bytespp; ++byte)
+            out[byte] = (unsigned char)(color >> (byte * 8));
+    }
+}
+
+void GraphicsLibrary::Resolve()
+{
+    if (colorFormat != ColorFormat::Rgba8)
+    {
+        toneMap();
+        return;
+    }
+
+    if (sampleCount == 1)
+        return;
+
+    int width = Output.get_width();
+    int height = Output.get_height();
+    size_t plane = samplePlane;
+
+    for (int y = 0; y < height; ++y)
+    {
+        size_t first = (size_t)y * width;
+        Kernels->ResolveSamples(sampleColor.data() + first, plane, sampleCount, resolvedRow.data(), width);
+        storeRow(y, resolvedRow.data());
+
+        for (int x = 0; x < width; ++x)
+        {
+            float closest = sampleDepth[first + x];
+            for (int s = 1; s < sampleCount; ++s)
+                closest = std::max(closest, sampleDepth[s * plane + first + x]);
+            ZBuffer[first + x] = closest;
+        }
+    }
+
+    std::fill(blockState.begin(), blockState.end(), BlockState::Pixels);
+}
+
+void GraphicsLibrary::toneMap()
+{
+    int width = Output.get_width();
+    int height = Output.get_height();
+    float inverseWhite2 = WhitePoint > 0.0f ? 1.0f / (WhitePoint * WhitePoint) : 0.0f;
+    for (int y = 0; y < height; ++y)
+    {
+        size_t first = (size_t)y * width * 4;
+        const float* row = floatColor.data() + first;
+        if (colorFormat == ColorFormat::Rgba16F)
+        {
+            Kernels->HalfToFloatRow(halfColor.data() + first, toneMapRow.data(), (size_t)width * 4);
+            row = toneMapRow.data();
+        }
+        Kernels->ToneMapRow(row, Exposure, inverseWhite2, resolvedRow.data(), width);
+        storeRow(y, resolvedRow.data());
+    }
+}
+
+void GraphicsLibrary::blendColor(size_t pixel, const Vec4f& color)
+{
+    // Fragment colors are red first, the framebuffer blue first.
+    float source[4] = { color.z, color.y, color.x, color.w };
+    float destination[4];
+    if (Blend == BlendMode::Replace)
+        std::memcpy(destination, source, sizeof(source));
+    else
+    {
+        for (int i = 0; i < 4; ++i)
+            destination[i] = colorFormat == ColorFormat::Rgba16F ? HalfToFloat(halfColor[pixel * 4 + i]) : floatColor[pixel * 4 + i];
+
+        float alpha = source[3];
+        for (int i = 0; i < 4; ++i)
+        {
+            if (Blend == BlendMode::Add)
+                destination[i] += source[i];
+            else
+                destination[i] = (i == 3 ? alpha : source[i] * alpha) + destination[i] * (1.0f - alpha);
+        }
+    }
+
+    for (int i = 0; i < 4; ++i)
+    {
+        if (colorFormat == ColorFormat::Rgba16F)
+            halfColor[pixel * 4 + i] = FloatToHalf(destination[i]);
+        else
+            floatColor[pixel * 4 + i] = destination[i];
+    }
+}
+
+void GraphicsLibrary::BeginFrame()
+{
+    Profile.BeginFrame();
+}
+
+void GraphicsLibrary::EndFrame()
+{
+    uint64_t covered = 0;
+    if (Profiler::Enabled)
+    {
+        // Compressed blocks take their state byte, planes their DepthPlane as well.
+        int width = Output.get_width();
+        int height = Output.get_height();
+        int blocksX = (width + BlockSize - 1) / BlockSize;
+        uint64_t bytesPerPixel = depthFormat == DepthFormat::Unorm16 ? 2 : 4;
+        uint64_t stored = blockState.size();
+        for (int block = 0; block < (int)blockState.size(); ++block)
+        {
+            int x0 = block % blocksX * BlockSize, y0 = block / blocksX * BlockSize;
+            int right = std::min(x0 + BlockSize, width), top = std::min(y0 + BlockSize, height);
+            uint64_t pixels = (uint64_t)(right - x0) * (top - y0);
+
+            if (blockState[block] == BlockState::Cleared)
+                PROFILE_COUNT(Profile, DepthBlocksCleared, 1);
+            else if (blockState[block] == BlockState::Plane)
+            {
+                PROFILE_COUNT(Profile, DepthBlocksPlane, 1);
+                stored += sizeof(DepthPlane);
+                covered += pixels;
+            }
+            else
+            {
+                PROFILE_COUNT(Profile, DepthBlocksPixels, 1);
+                stored += pixels * bytesPerPixel;
+                for (int y = y0; y < top; ++y)
+                    for (int x = x0; x < right; ++x)
+                        covered += Depth(x, y) != std::numeric_limits<float>::lowest();
+            }
+        }
+
+        PROFILE_COUNT(Profile, DepthBytesStored, stored);
+        PROFILE_COUNT(Profile, DepthBytesFull, (uint64_t)width * height * bytesPerPixel);
+    }
+
+    Profile.EndFrame(covered);
+    Arena.Reset();
+}
+
 void GraphicsLibrary::SetViewport(int x, int y, int w, int h, float depth)
 {
-    Viewport = Mat4::GetViewport(x, y, w, h, depth);
+    viewportX = x;
+    viewportY = y;
+    viewportWidth = w;
+    viewportHeight = h;
+    viewportDepth = depth;
+    Viewport = Mat4::GetViewport(x - regionX, y - regionY, w, h, depth);
+}
+
+void GraphicsLibrary::SetRegion(int x, int y)
+{
+    regionX = x;
+    regionY = y;
+    SetViewport(viewportX, viewportY, viewportWidth, viewportHeight, viewportDepth);
 }
 
 void GraphicsLibrary::SetProjection(float center)
@@ -110,9 +364,15 @@ void GraphicsLibrary::SetProjection(float center)
     Projection = Mat4::GetProjection(center);
 }
 
+void GraphicsLibrary::SetOrthographic(float halfExtent)
+{
+    Projection = Mat4::GetOrthographic(halfExtent);
+}
+
 void GraphicsLibrary::LookAt(const Vec3f& position, const Vec3f& target, const Vec3f& up)
 {
-    ModelView = Mat4::LookAt(position, target, up);
+    View = Mat4::LookAt(position, target, up);
+    ModelView = View;
 }
 
 Vec3f perspectiveProject(const Vec4f& vec)
@@ -120,51 +380,1034 @@ Vec3f perspectiveProject(const Vec4f& vec)
     return { vec.x / vec.w, vec.y / vec.w, vec.z / vec.w };
 }
 
-void GraphicsLibrary::Triangle(Vertex vertices[3], Model& model, IShader& shader, Vec3f lightDirection)
+namespace
 {
-    shader.GL = this;
+    // Narrows [min, max] to [clipMin, clipMax], returns false when nothing is left.
+    bool clip(Vec2i& min, Vec2i& max, const Vec2i& clipMin, const Vec2i& clipMax)
+    {
+        min.x = std::max(min.x, clipMin.x);
+        min.y = std::max(min.y, clipMin.y);
+        max.x = std::min(max.x, clipMax.x);
+        max.y = std::min(max.y, clipMax.y);
+        return min.x <= max.x && min.y <= max.y;
+    }
+}
 
-    if (vertices[2].Pos.y == vertices[0].Pos.y)
-        std::swap(vertices[0], vertices[1]);
+namespace
+{
+    // Shade functor of depth only drawing: fragments pass unshaded, and no color is written for them.
+    struct DepthOnlyShade
+    {
+        bool operator()(const Vec3f&, TGAColor&) const { return true; }
+    };
 
-    Vec2i min, max;
-    Vec3f a = perspectiveProject(shader.VertexStage(vertices[0], 0));
-    Vec3f b = perspectiveProject(shader.VertexStage(vertices[1], 1));
-    Vec3f c = perspectiveProject(shader.VertexStage(vertices[2], 2));
+    template <class Shade>
+    constexpr bool writesColor = !std::is_same<std::decay_t<Shade>, DepthOnlyShade>::value;
+
+    // Shade functors of float framebuffers give Vec4f colors.
+    template <class Shade>
+    constexpr bool writesFloatColor = std::is_invocable<Shade&, const Vec3f&, Vec4f&>::value;
+
+    // How each depth format is laid out and tested. Values are what the buffer holds, as floats, which is exact for
+    // the unorm formats.
+    template <DepthFormat Format>
+    struct DepthTraits;
+
+    template <>
+    struct DepthTraits<DepthFormat::Float32>
+    {
+        using Stored = float;
+
+        static int RasterRow(const KernelTable& kernels, const RasterRow& row, const Stored* depthRow, RowFragments& out)
+        {
+            return kernels.RasterRow(row, depthRow, out);
+        }
+
+        static float Value(Stored stored) { return stored; }
+        static Stored Write(Stored, float value, uint32_t, uint32_t) { return value; }
+    };
+
+    template <>
+    struct DepthTraits<DepthFormat::Unorm16>
+    {
+        using Stored = uint16_t;
+
+        static int RasterRow(const KernelTable& kernels, const ::RasterRow& row, const Stored* depthRow, RowFragments& out)
+        {
+            return kernels.RasterRowUnorm16(row, depthRow, out);
+        }
+
+        static float Value(Stored stored) { return stored; }
+        static Stored Write(Stored, float value, uint32_t, uint32_t) { return (Stored)value; }
+    };
+
+    // The stencil takes the top byte. Writes keep the stencil bits of keep and set those of stencil.
+    template <>
+    struct DepthTraits<DepthFormat::Unorm24Stencil8>
+    {
+        using Stored = uint32_t;
+
+        static int RasterRow(const KernelTable& kernels, const ::RasterRow& row, const Stored* depthRow, RowFragments& out)
+        {
+            return kernels.RasterRowUnorm24Stencil8(row, depthRow, out);
+        }
+
+        static float Value(Stored stored) { return (float)(stored & 0xffffff); }
+        static Stored Write(Stored stored, float value, uint32_t keep, uint32_t stencil) { return (stored & keep) | stencil | (Stored)value; }
+    };
+}
+
+namespace
+{
+    // alpha and beta are the barycentric weights of b and c, both affine in x along a row. Drawing and expanding
+    // depth planes set rows up the same way, so that both get the same depths.
+    RasterRow triangleRow(const Vec3f& a, const Vec3f& b, const Vec3f& c, float denominator)
+    {
+        RasterRow row;
+        row.AlphaDx = -(c.y - a.y) / denominator;
+        row.BetaDx = (b.y - a.y) / denominator;
+        row.ZA = a.z;
+        row.ZB = b.z;
+        row.ZC = c.z;
+        row.StencilMask = 0;
+        row.StencilReference = 0;
+        return row;
+    }
+
+    void startRow(RasterRow& row, const Vec3f& a, const Vec3f& b, const Vec3f& c, float denominator, int y)
+    {
+        row.AlphaY = ((y - a.y) * (c.x - a.x) + a.x * (c.y - a.y)) / denominator;
+        row.BetaY = -((y - a.y) * (b.x - a.x) + a.x * (b.y - a.y)) / denominator;
+    }
+
+    // Depths of row against a row that passes everywhere, as the format stores them.
+    int evaluateRow(const KernelTable& kernels, DepthFormat format, const RasterRow& row, const uint32_t* cleared, RowFragments& out)
+    {
+        switch (format)
+        {
+        case DepthFormat::Unorm16:
+            return kernels.RasterRowUnorm16(row, (const uint16_t*)cleared, out);
+        case DepthFormat::Unorm24Stencil8:
+            return kernels.RasterRowUnorm24Stencil8(row, cleared, out);
+        default:
+            return kernels.RasterRow(row, (const float*)cleared, out);
+        }
+    }
+}
+
+template <DepthFormat Format>
+void GraphicsLibrary::decompressBlock(int block)
+{
+    using Traits = DepthTraits<Format>;
+    using Stored = typename Traits::Stored;
+
+    int width = Output.get_width();
+    int blocksX = (width + BlockSize - 1) / BlockSize;
+    int x0 = block % blocksX * BlockSize, y0 = block / blocksX * BlockSize;
+    int right = std::min(x0 + BlockSize, width), top = std::min(y0 + BlockSize, Output.get_height());
+    Stored* depthBuffer = (Stored*)ZBuffer;
+    const Stored* cleared = (const Stored*)clearedRow.data();
+
+    if (blockState[block] == BlockState::Cleared)
+    {
+        for (int y = y0; y < top; ++y)
+            std::fill(depthBuffer + y * width + x0, depthBuffer + y * width + right, cleared[0]);
+    }
+    else if (blockState[block] == BlockState::Plane)
+    {
+        const DepthPlane& plane = blockPlane[block];
+        RasterRow row = triangleRow(plane.A, plane.B, plane.C, plane.Denominator);
+        row.DepthScale = depthScale();
+        row.DepthMax = depthMax;
+        row.MinX = x0;
+        row.MaxX = right - 1;
+
+        RowFragments fragments = { fragmentX.data(), fragmentAlpha.data(), fragmentBeta.data(), fragmentDepth.data() };
+        for (int y = y0; y < top; ++y)
+        {
+            startRow(row, plane.A, plane.B, plane.C, plane.Denominator, y);
+            int count = Traits::RasterRow(*Kernels, row, cleared, fragments);
+            for (int i = 0; i < count; ++i)
+                depthBuffer[y * width + fragments.X[i]] = Traits::Write(0, fragments.Depth[i], 0, 0);
+        }
+    }
+
+    blockState[block] = BlockState::Pixels;
+    PROFILE_COUNT(Profile, DepthBlocksExpanded, 1);
+}
+
+float GraphicsLibrary::Depth(int x, int y) const
+{
+    int width = Output.get_width();
+    size_t pixel = (size_t)y * width + x;
+    int block = y / BlockSize * ((width + BlockSize - 1) / BlockSize) + x / BlockSize;
+    if (blockState[block] == BlockState::Cleared)
+        return std::numeric_limits<float>::lowest();
+
+    uint32_t value;
+    if (blockState[block] == BlockState::Plane)
+    {
+        const DepthPlane& plane = blockPlane[block];
+        RasterRow row = triangleRow(plane.A, plane.B, plane.C, plane.Denominator);
+        row.DepthScale = depthScale();
+        row.DepthMax = depthMax;
+        row.MinX = row.MaxX = x;
+        startRow(row, plane.A, plane.B, plane.C, plane.Denominator, y);
+
+        int fragmentX;
+        float alpha, beta, depth;
+        RowFragments fragment = { &fragmentX, &alpha, &beta, &depth };
+        evaluateRow(*Kernels, depthFormat, row, clearedRow.data(), fragment);
+        if (depthFormat == DepthFormat::Float32)
+            return depth;
+        value = (uint32_t)depth;
+    }
+    else if (depthFormat == DepthFormat::Float32)
+        return ZBuffer[pixel];
+    else if (depthFormat == DepthFormat::Unorm16)
+        value = ((const uint16_t*)ZBuffer)[pixel];
+    else
+        value = ((const uint32_t*)ZBuffer)[pixel] & 0xffffff;
+
+    float scale = depthScale();
+    if (value == 0)
+        return std::numeric_limits<float>::lowest();
+    return scale > 0.0f ? (value - 1) / scale : 0.0f;
+}
+
+void GraphicsLibrary::DepthRow(int y, float* depths) const
+{
+    int width = Output.get_width();
+    size_t first = (size_t)y * width;
+    if (depthFormat == DepthFormat::Float32)
+    {
+        std::copy(ZBuffer + first, ZBuffer + first + width, depths);
+        return;
+    }
+
+    const float cleared = std::numeric_limits<float>::lowest();
+    float scale = depthScale();
+    for (int x = 0; x < width; ++x)
+    {
+        uint32_t value = depthFormat == DepthFormat::Unorm16 ? ((const uint16_t*)ZBuffer)[first + x]
+            : ((const uint32_t*)ZBuffer)[first + x] & 0xffffff;
+        depths[x] = value == 0 ? cleared : scale > 0.0f ? (value - 1) / scale : 0.0f;
+    }
+}
+
+bool GraphicsLibrary::DepthBounds(int minX, int minY, int maxX, int maxY, float& farthest, float& nearest) const
+{
+    const float cleared = std::numeric_limits<float>::lowest();
+    int width = Output.get_width();
+    minX = std::max(minX, 0);
+    minY = std::max(minY, 0);
+    maxX = std::min(maxX, width - 1);
+    maxY = std::min(maxY, Output.get_height() - 1);
+
+    farthest = std::numeric_limits<float>::max();
+    nearest = cleared;
+    auto add = [&](float depth)
+    {
+        if (depth == cleared)
+            return;
+        farthest = std::min(farthest, depth);
+        nearest = std::max(nearest, depth);
+    };
+
+    if (sampleCount > 1)
+    {
+        for (int s = 0; s < sampleCount; ++s)
+        {
+            for (int y = minY; y <= maxY; ++y)
+            {
+                const float* row = sampleDepth.data() + s * samplePlane + (size_t)y * width;
+                for (int x = minX; x <= maxX; ++x)
+                    add(row[x]);
+            }
+        }
+        return nearest != cleared;
+    }
+
+    // The depths of a plane are affine, their bounds are at the corners.
+    int blocksX = (width + BlockSize - 1) / BlockSize;
+    for (int blockY = minY / BlockSize; blockY <= maxY / BlockSize; ++blockY)
+    {
+        int y0 = std::max(minY, blockY * BlockSize);
+        int y1 = std::min(maxY, blockY * BlockSize + BlockSize - 1);
+        for (int blockX = minX / BlockSize; blockX <= maxX / BlockSize; ++blockX)
+        {
+            int x0 = std::max(minX, blockX * BlockSize);
+            int x1 = std::min(maxX, blockX * BlockSize + BlockSize - 1);
+            BlockState state = blockState[blockY * blocksX + blockX];
+            if (state == BlockState::Cleared)
+                continue;
+
+            if (state == BlockState::Plane)
+            {
+                add(Depth(x0, y0));
+                add(Depth(x1, y0));
+                add(Depth(x0, y1));
+                add(Depth(x1, y1));
+                continue;
+            }
+
+            for (int y = y0; y <= y1; ++y)
+            {
+                if (depthFormat == DepthFormat::Float32)
+                {
+                    const float* row = ZBuffer + (size_t)y * width;
+                    for (int x = x0; x <= x1; ++x)
+                        add(row[x]);
+                }
+                else
+                {
+                    // Raw values, as Depth converts them.
+                    float scale = depthScale();
+                    for (int x = x0; x <= x1; ++x)
+                    {
+                        size_t pixel = (size_t)y * width + x;
+                        uint32_t value = depthFormat == DepthFormat::Unorm16 ? ((const uint16_t*)ZBuffer)[pixel]
+                            : ((const uint32_t*)ZBuffer)[pixel] & 0xffffff;
+                        if (value != 0)
+                            add(scale > 0.0f ? (value - 1) / scale : 0.0f);
+                    }
+                }
+            }
+        }
+    }
+
+    // Unorm values are clamped to the viewport's depth range, those at its ends stand for anything beyond.
+    if (depthFormat != DepthFormat::Float32 && nearest != cleared)
+    {
+        if (farthest <= 0.0f)
+            farthest = cleared;
+        if (nearest >= viewportDepth)
+            nearest = std::numeric_limits<float>::max();
+    }
+    return nearest != cleared;
+}
+
+void GraphicsLibrary::DecompressDepth()
+{
+    for (int block = 0; block < (int)blockState.size(); ++block)
+    {
+        if (blockState[block] == BlockState::Pixels)
+            continue;
+
+        switch (depthFormat)
+        {
+        case DepthFormat::Unorm16:
+            decompressBlock<DepthFormat::Unorm16>(block);
+            break;
+        case DepthFormat::Unorm24Stencil8:
+            decompressBlock<DepthFormat::Unorm24Stencil8>(block);
+            break;
+        default:
+            decompressBlock<DepthFormat::Float32>(block);
+            break;
+        }
+    }
+}
+
+template <class Shade>
+void GraphicsLibrary::rasterize(const Vec3f& a, const Vec3f& b, const Vec3f& c, const FixedTriangle& fixed, float denominator, const Vec2i& clipMin, const Vec2i& clipMax, Shade& shade)
+{
+    switch (depthFormat)
+    {
+    case DepthFormat::Unorm16:
+        rasterizeDepth<DepthFormat::Unorm16>(a, b, c, fixed, denominator, clipMin, clipMax, shade);
+        break;
+    case DepthFormat::Unorm24Stencil8:
+        rasterizeDepth<DepthFormat::Unorm24Stencil8>(a, b, c, fixed, denominator, clipMin, clipMax, shade);
+        break;
+    default:
+        rasterizeDepth<DepthFormat::Float32>(a, b, c, fixed, denominator, clipMin, clipMax, shade);
+        break;
+    }
+}
+
+template <DepthFormat Format, class Shade>
+void GraphicsLibrary::rasterizeDepth(const Vec3f& a, const Vec3f& b, const Vec3f& c, const FixedTriangle& fixed, float denominator, const Vec2i& clipMin, const Vec2i& clipMax, Shade& shade)
+{
+    using Traits = DepthTraits<Format>;
+    using Stored = typename Traits::Stored;
 
     int width = Output.get_width();
     int height = Output.get_height();
 
-    boundingbox(a, b, c, { width, height }, min, max);
+    Vec2i min, max;
+    if (!fixed.Bounds(width, height, 0, min.x, min.y, max.x, max.y) || !clip(min, max, clipMin, clipMax))
+        return;
 
-    float alphaDenominator = ((b.y - a.y) * (c.x - a.x) - (b.x - a.x) * (c.y - a.y));
-    float betaDenominator = (c.y - a.y);
+    PROFILE_SCOPE(Profile, Raster);
 
-    if (std::isnormal(alphaDenominator))
+    RasterRow row = triangleRow(a, b, c, denominator);
+    row.DepthScale = depthScale();
+    row.DepthMax = depthMax;
+    row.StencilMask = (uint32_t)StencilTestMask << 24;
+    row.StencilReference = (uint32_t)(StencilReference & StencilTestMask) << 24;
+    uint32_t stencilKeep = ~((uint32_t)StencilWriteMask << 24) & 0xff000000;
+    uint32_t stencilBits = (uint32_t)(StencilReference & StencilWriteMask) << 24;
+
+    RowFragments fragments = { fragmentX.data(), fragmentAlpha.data(), fragmentBeta.data(), fragmentDepth.data() };
+    Stored* depthBuffer = (Stored*)ZBuffer;
+    const Stored* cleared = (const Stored*)clearedRow.data();
+    int blocksX = (width + BlockSize - 1) / BlockSize;
+
+    // Shades the pixels [minX, maxX] of row y that pass the depth test against testRow, writes the depths of those
+    // drawn to writeRow[x - writeX] and returns how many were.
+    auto drawSpan = [&](int y, int minX, int maxX, const Stored* testRow, Stored* writeRow, int writeX)
     {
-        for (int x = min.x; x <= max.x; ++x)
+        row.MinX = minX;
+        row.MaxX = maxX;
+        startRow(row, a, b, c, denominator, y);
+
+        int count = Traits::RasterRow(*Kernels, row, testRow, fragments);
+        PROFILE_COUNT(Profile, PixelsPassed, count);
+
+        if constexpr (!writesColor<Shade>)
         {
-            for (int y = min.y; y <= max.y; ++y)
+            for (int i = 0; i < count; ++i)
             {
-                float alpha = (a.x * (c.y - a.y) + (y - a.y) * (c.x - a.x) - x * (c.y - a.y)) / alphaDenominator;
-                float beta = (y - a.y - alpha * (b.y - a.y)) / betaDenominator;
-                float sigma = 1.0f - alpha - beta;
+                Stored& stored = writeRow[fragments.X[i] - writeX];
+                stored = Traits::Write(stored, fragments.Depth[i], stencilKeep, stencilBits);
+            }
+            return count;
+        }
+
+        PROFILE_COUNT(Profile, PixelsShaded, count);
+        PROFILE_SCOPE(Profile, Shade);
+
+        int written = 0;
+        for (int i = 0; i < count; ++i)
+        {
+            float alpha = fragments.Alpha[i];
+            float beta = fragments.Beta[i];
+
+            std::conditional_t<writesFloatColor<Shade>, Vec4f, TGAColor> fragmentColor;
+            if (shade(Vec3f(1.0f - alpha - beta, alpha, beta), fragmentColor))
+            {
+                Stored& stored = writeRow[fragments.X[i] - writeX];
+                stored = Traits::Write(stored, fragments.Depth[i], stencilKeep, stencilBits);
+                if constexpr (writesFloatColor<Shade>)
+                    blendColor((size_t)y * width + fragments.X[i], fragmentColor);
+                else
+                    Output.set(fragments.X[i], y, fragmentColor);
+                ++written;
+            }
+        }
+
+        return written;
+    };
+
+    auto drawPixels = [&](int y, int minX, int maxX)
+    {
+        Stored* depthRow = depthBuffer + y * width;
+        return drawSpan(y, minX, maxX, depthRow, depthRow, 0);
+    };
+
+    if (max.x - min.x < BlockSize && max.y - min.y < BlockSize)
+    {
+        for (int by = min.y / BlockSize; by <= max.y / BlockSize; ++by)
+            for (int bx = min.x / BlockSize; bx <= max.x / BlockSize; ++bx)
+                if (blockState[by * blocksX + bx] != BlockState::Pixels)
+                    decompressBlock<Format>(by * blocksX + bx);
+
+        PROFILE_COUNT(Profile, PixelsTested, (uint64_t)(max.x - min.x + 1) * (max.y - min.y + 1));
+        for (int y = min.y; y <= max.y; ++y)
+        {
+            int spanMinX = min.x, spanMaxX = max.x;
+            if (fixed.Span(y, 0, 0, spanMinX, spanMaxX))
+                drawPixels(y, spanMinX, spanMaxX);
+        }
+        return;
+    }
+
+    // Larger triangles go block by block. Blocks outside the triangle or behind the farthest depth already in them
+    // are skipped, rows of blocks inside it need no span. Blocks it covers whole and lies in front of, cleared ones
+    // or planes farther than it, are drawn without reading their depths and become its plane.
+    float zMax = std::max({ a.z, b.z, c.z });
+    float zMin = std::min({ a.z, b.z, c.z });
+    float zMargin = std::max({ std::abs(a.z), std::abs(b.z), std::abs(c.z) }) * 1e-5f;
+    float zLimit = zMax + zMargin;
+    float zNear = zMin - zMargin;
+    if (Format != DepthFormat::Float32)
+    {
+        zLimit = std::floor(std::min(std::max(zLimit * row.DepthScale + 1.5f, 1.0f), depthMax));
+        zNear = std::floor(std::min(std::max(zNear * row.DepthScale + 1.5f, 1.0f), depthMax));
+    }
+    bool keepsStencil = Format != DepthFormat::Unorm24Stencil8 || (StencilReference & (StencilTestMask | StencilWriteMask)) == 0;
 
-                if (sigma >= 0.0f && alpha >= 0.0f && beta >= 0.0f)
+    for (int by = min.y / BlockSize; by <= max.y / BlockSize; ++by)
+    {
+        for (int bx = min.x / BlockSize; bx <= max.x / BlockSize; ++bx)
+        {
+            int x0 = std::max(bx * BlockSize, min.x), x1 = std::min(bx * BlockSize + BlockSize - 1, max.x);
+            int y0 = std::max(by * BlockSize, min.y), y1 = std::min(by * BlockSize + BlockSize - 1, max.y);
+            int right = std::min(bx * BlockSize + BlockSize, width);
+            int top = std::min(by * BlockSize + BlockSize, height);
+
+            int block = by * blocksX + bx;
+            float& farthest = blockDepth[block];
+            if (zLimit <= farthest)
+                continue;
+
+            Visibility visibility = fixed.ClassifyBlock(x0, y0, x1, y1);
+            if (visibility == Visibility::Outside)
+                continue;
+
+            PROFILE_COUNT(Profile, PixelsTested, (uint64_t)(x1 - x0 + 1) * (y1 - y0 + 1));
+
+            BlockState& state = blockState[block];
+            bool whole = visibility == Visibility::Inside && x0 == bx * BlockSize && x1 == right - 1 && y0 == by * BlockSize && y1 == top - 1;
+            if (whole && keepsStencil && DepthCompression && (state == BlockState::Cleared || (state == BlockState::Plane && zNear > blockPlane[block].Nearest)))
+            {
+                // Every pixel passes, their depths go to the scratch block. Unless the shader discarded some, the
+                // block only needs the plane.
+                Stored* scratch = (Stored*)blockScratch.data();
+                std::fill(scratch, scratch + BlockSize * BlockSize, cleared[0]);
+
+                int written = 0;
+                for (int y = y0; y <= y1; ++y)
+                    written += drawSpan(y, x0, x1, cleared, scratch + (y - y0) * BlockSize, x0);
+                if (written == 0)
+                    continue;
+
+                // The depths drawn are in front of those they replace, the farthest one stays a valid bound.
+                if (written < (x1 - x0 + 1) * (y1 - y0 + 1))
                 {
-                    float depth = a.z * sigma + alpha * b.z + beta * c.z;
+                    decompressBlock<Format>(block);
+                    for (int y = y0; y <= y1; ++y)
+                        for (int x = x0; x <= x1; ++x)
+                            if (scratch[(y - y0) * BlockSize + x - x0] != cleared[0])
+                                depthBuffer[y * width + x] = scratch[(y - y0) * BlockSize + x - x0];
+                    continue;
+                }
 
-                    if (ZBuffer[y * width + x] < depth)
+                float nearest = std::numeric_limits<float>::lowest();
+                float blockFarthest = std::numeric_limits<float>::max();
+                for (int y = y0; y <= y1; ++y)
+                {
+                    for (int x = x0; x <= x1; ++x)
                     {
-                        TGAColor fragmentColor;
-                        if (shader.FragmentStage({ sigma, alpha, beta }, fragmentColor))
-                        {
-                            ZBuffer[y * width + x] = depth;
-                            Output.set(x, y, fragmentColor);
-                        }
+                        float value = Traits::Value(scratch[(y - y0) * BlockSize + x - x0]);
+                        nearest = std::max(nearest, value);
+                        blockFarthest = std::min(blockFarthest, value);
                     }
                 }
+
+                state = BlockState::Plane;
+                blockPlane[block] = { a, b, c, denominator, nearest };
+                farthest = blockFarthest;
+                continue;
+            }
+
+            if (state != BlockState::Pixels)
+                decompressBlock<Format>(block);
+
+            int written = 0;
+            for (int y = y0; y <= y1; ++y)
+            {
+                int spanMinX = x0, spanMaxX = x1;
+                if (visibility == Visibility::Inside || fixed.Span(y, 0, 0, spanMinX, spanMaxX))
+                    written += drawPixels(y, spanMinX, spanMaxX);
+            }
+
+            // Only a block the triangle covers whole can have its farthest depth raised.
+            if (visibility == Visibility::Inside && written > 0)
+            {
+                float blockFarthest = std::numeric_limits<float>::max();
+                for (int y = by * BlockSize; y < top; ++y)
+                    for (int x = bx * BlockSize; x < right; ++x)
+                        blockFarthest = std::min(blockFarthest, Traits::Value(depthBuffer[y * width + x]));
+                farthest = blockFarthest;
+            }
+        }
+    }
+}
+
+template <class Shade>
+void GraphicsLibrary::rasterizeMultisample(const Vec3f& a, const Vec3f& b, const Vec3f& c, const FixedTriangle& fixed, float denominator, const Vec2i& clipMin, const Vec2i& clipMax, Shade& shade)
+{
+    int width = Output.get_width();
+    int height = Output.get_height();
+    size_t plane = samplePlane;
+    const int (*pattern)[2] = samplePattern(sampleCount);
+
+    // Samples are less than half a pixel away from the pixel position, pattern offsets are sixteenths of a pixel.
+    const int subpixelsPerOffset = FixedTriangle::SubpixelScale / 16;
+    Vec2i min, max;
+    if (!fixed.Bounds(width, height, FixedTriangle::SubpixelScale / 2, min.x, min.y, max.x, max.y) || !clip(min, max, clipMin, clipMax))
+        return;
+
+    PROFILE_COUNT(Profile, PixelsTested, (uint64_t)(max.x - min.x + 1) * (max.y - min.y + 1));
+    PROFILE_SCOPE(Profile, Raster);
+
+    RasterRow row;
+    row.AlphaDx = -(c.y - a.y) / denominator;
+    row.BetaDx = (b.y - a.y) / denominator;
+    row.ZA = a.z;
+    row.ZB = b.z;
+    row.ZC = c.z;
+
+    auto alphaAt = [&](float y) { return ((y - a.y) * (c.x - a.x) + a.x * (c.y - a.y)) / denominator; };
+    auto betaAt = [&](float y) { return -((y - a.y) * (b.x - a.x) + a.x * (b.y - a.y)) / denominator; };
+
+    RowFragments fragments = { fragmentX.data(), fragmentAlpha.data(), fragmentBeta.data(), fragmentDepth.data() };
+    unsigned char* mask = fragmentMask.data();
+
+    for (int y = min.y; y <= max.y; ++y)
+    {
+        std::fill(mask + min.x, mask + max.x + 1, 0);
+
+        // Each sample is a row of its own plane, shifted by the sample offset. The weights of the first sample that
+        // passes in a pixel are kept in case the pixel position is outside the triangle.
+        for (int s = 0; s < sampleCount; ++s)
+        {
+            row.MinX = min.x;
+            row.MaxX = max.x;
+            if (!fixed.Span(y, pattern[s][0] * subpixelsPerOffset, pattern[s][1] * subpixelsPerOffset, row.MinX, row.MaxX))
+                continue;
+
+            float dx = pattern[s][0] / 16.0f;
+            float dy = pattern[s][1] / 16.0f;
+            row.AlphaY = alphaAt(y + dy) + dx * row.AlphaDx;
+            row.BetaY = betaAt(y + dy) + dx * row.BetaDx;
+
+            int count = Kernels->RasterRow(row, sampleDepth.data() + s * plane + (size_t)y * width, fragments);
+            for (int i = 0; i < count; ++i)
+            {
+                int x = fragments.X[i];
+                if (!mask[x])
+                {
+                    pixelAlpha[x] = fragments.Alpha[i];
+                    pixelBeta[x] = fragments.Beta[i];
+                }
+                mask[x] |= (unsigned char)(1 << s);
+                fragmentSampleDepth[(size_t)x * sampleCount + s] = fragments.Depth[i];
+            }
+        }
+
+        PROFILE_SCOPE(Profile, Shade);
+
+        float alphaY = alphaAt((float)y);
+        float betaY = betaAt((float)y);
+        uint64_t shaded = 0;
+
+        for (int x = min.x; x <= max.x; ++x)
+        {
+            if (!mask[x])
+                continue;
+            ++shaded;
+
+            // Shade at the pixel position when the triangle covers it so that the result matches single sampling
+            // inside triangles, at the first visible sample otherwise so that attributes are not extrapolated.
+            float alpha = alphaY + x * row.AlphaDx;
+            float beta = betaY + x * row.BetaDx;
+            if (!fixed.Covers((int64_t)x * FixedTriangle::SubpixelScale, (int64_t)y * FixedTriangle::SubpixelScale))
+            {
+                alpha = pixelAlpha[x];
+                beta = pixelBeta[x];
+            }
+
+            TGAColor fragmentColor;
+            if (!shade(Vec3f(1.0f - alpha - beta, alpha, beta), fragmentColor))
+                continue;
+
+            size_t pixel = (size_t)y * width + x;
+            const float* depths = fragmentSampleDepth.data() + (size_t)x * sampleCount;
+            for (int s = 0; s < sampleCount; ++s)
+            {
+                if (mask[x] & (1 << s))
+                {
+                    sampleDepth[s * plane + pixel] = depths[s];
+                    if constexpr (writesColor<Shade>)
+                        sampleColor[s * plane + pixel] = fragmentColor.val;
+                }
             }
         }
+
+        PROFILE_COUNT(Profile, PixelsPassed, shaded);
+        if constexpr (writesColor<Shade>)
+            PROFILE_COUNT(Profile, PixelsShaded, shaded);
+    }
+}
+
+void GraphicsLibrary::Triangle(Vertex vertices[3], Model& model, IShader& shader, Vec3f lightDirection)
+{
+    shader.GL = this;
+    PROFILE_COUNT(Profile, TrianglesSubmitted, 1);
+
+    Vec3f a, b, c;
+    {
+        PROFILE_SCOPE(Profile, Vertex);
+        a = perspectiveProject(shader.VertexStage(vertices[0], 0));
+        b = perspectiveProject(shader.VertexStage(vertices[1], 1));
+        c = perspectiveProject(shader.VertexStage(vertices[2], 2));
     }
-}
\ No newline at end of file
+
+    PROFILE_SCOPE(Profile, Setup);
+
+    int width = Output.get_width();
+    int height = Output.get_height();
+
+    // Coverage comes from the snapped triangle, attributes are interpolated from the snapped positions too.
+    FixedTriangle fixed;
+    if (!fixed.Setup(a, b, c))
+    {
+        PROFILE_COUNT(Profile, TrianglesCulled, 1);
+        return;
+    }
+
+    float denominator = ((b.y - a.y) * (c.x - a.x) - (b.x - a.x) * (c.y - a.y));
+    PROFILE_COUNT(Profile, TrianglesRasterized, 1);
+
+    if (bins)
+    {
+        binTriangle(a, b, c, fixed, denominator, shader);
+        return;
+    }
+
+    Vec2i clipMax(width - 1, height - 1);
+    if (DepthOnly)
+    {
+        DepthOnlyShade depthOnly;
+        if (sampleCount > 1)
+            rasterizeMultisample(a, b, c, fixed, denominator, Vec2i(), clipMax, depthOnly);
+        else
+            rasterize(a, b, c, fixed, denominator, Vec2i(), clipMax, depthOnly);
+        return;
+    }
+
+    // Float framebuffers are single sampled.
+    if (colorFormat != ColorFormat::Rgba8)
+    {
+        auto shadeFloat = [&](const Vec3f& bar, Vec4f& color) { return shader.FragmentStageHdr(bar, color); };
+        rasterize(a, b, c, fixed, denominator, Vec2i(), clipMax, shadeFloat);
+        return;
+    }
+
+    auto shade = [&](const Vec3f& bar, TGAColor& color) { return shader.FragmentStage(bar, color); };
+    if (sampleCount > 1)
+        rasterizeMultisample(a, b, c, fixed, denominator, Vec2i(), clipMax, shade);
+    else
+        rasterize(a, b, c, fixed, denominator, Vec2i(), clipMax, shade);
+}
+
+void GraphicsLibrary::binTriangle(const Vec3f& a, const Vec3f& b, const Vec3f& c, const FixedTriangle& fixed, float denominator, IShader& shader)
+{
+    if (shader.VaryingSize() == 0)
+        return;
+
+    if (&shader != binnedShader)
+    {
+        binnedShader = &shader;
+        binnedUniforms = bins->AddData(shader.UniformData(), shader.UniformSize());
+    }
+
+    // Samples are at most half a pixel away from their pixel, tiles are tested grown by a pixel on every side.
+    Vec2i min, max;
+    if (!fixed.Bounds(bins->Width(), bins->Height(), FixedTriangle::SubpixelScale / 2, min.x, min.y, max.x, max.y))
+        return;
+
+    const BinnedTriangle* binned = bins->AddTriangle({ a, b, c, fixed, denominator, &shader, binnedUniforms, bins->AddData(shader.VaryingData(), shader.VaryingSize()) });
+    const int tile = FrameBins::TileSize;
+    for (int ty = min.y / tile; ty <= max.y / tile; ++ty)
+    {
+        for (int tx = min.x / tile; tx <= max.x / tile; ++tx)
+        {
+            if (fixed.ClassifyBlock(tx * tile - 1, ty * tile - 1, tx * tile + tile, ty * tile + tile) != Visibility::Outside)
+                bins->AddToTile(tx, ty, binned);
+        }
+    }
+}
+
+void GraphicsLibrary::BeginBinning(FrameBins& frameBins)
+{
+    bins = &frameBins;
+    bins->Reset(Output.get_width(), Output.get_height());
+    binnedShader = nullptr;
+}
+
+void GraphicsLibrary::EndBinning()
+{
+    bins = nullptr;
+    binnedShader = nullptr;
+}
+
+void GraphicsLibrary::RasterizeBins(const FrameBins& frameBins)
+{
+    const int tile = FrameBins::TileSize;
+    int width = std::min(frameBins.Width(), Output.get_width());
+    int height = std::min(frameBins.Height(), Output.get_height());
+
+    for (int ty = 0; ty < frameBins.TilesY(); ++ty)
+    {
+        for (int tx = 0; tx < frameBins.TilesX(); ++tx)
+        {
+            Vec2i clipMin(tx * tile, ty * tile);
+            Vec2i clipMax(std::min(clipMin.x + tile, width) - 1, std::min(clipMin.y + tile, height) - 1);
+
+            for (const BinnedTriangle* binned : frameBins.Tile(tx, ty))
+            {
+                const BinnedTriangle& triangle = *binned;
+                if (DepthOnly)
+                {
+                    DepthOnlyShade depthOnly;
+                    if (sampleCount > 1)
+                        rasterizeMultisample(triangle.A, triangle.B, triangle.C, triangle.Fixed, triangle.Denominator, clipMin, clipMax, depthOnly);
+                    else
+                        rasterize(triangle.A, triangle.B, triangle.C, triangle.Fixed, triangle.Denominator, clipMin, clipMax, depthOnly);
+                    continue;
+                }
+
+                if (colorFormat != ColorFormat::Rgba8)
+                {
+                    auto shadeFloat = [&](const Vec3f& bar, Vec4f& color) { return triangle.Shader->DeferredFragmentStageHdr(triangle.Uniforms, triangle.Varyings, bar, color); };
+                    rasterize(triangle.A, triangle.B, triangle.C, triangle.Fixed, triangle.Denominator, clipMin, clipMax, shadeFloat);
+                    continue;
+                }
+
+                auto shade = [&](const Vec3f& bar, TGAColor& color) { return triangle.Shader->DeferredFragmentStage(triangle.Uniforms, triangle.Varyings, bar, color); };
+
+                if (sampleCount > 1)
+                    rasterizeMultisample(triangle.A, triangle.B, triangle.C, triangle.Fixed, triangle.Denominator, clipMin, clipMax, shade);
+                else
+                    rasterize(triangle.A, triangle.B, triangle.C, triangle.Fixed, triangle.Denominator, clipMin, clipMax, shade);
+            }
+        }
+    }
+}
+
+namespace
+{
+    // Draws the triangles of index slots [first, last), fetch gives the vertex of a slot.
+    template <class Fetch>
+    void drawTriangles(GraphicsLibrary& GL, Model& model, IShader& shader, size_t first, size_t last, Fetch&& fetch)
+    {
+        Vertex vertices[3];
+        for (size_t i = first; i + 2 < last; i += 3)
+        {
+            for (int j = 0; j < 3; j++)
+                vertices[j] = fetch(i + j);
+
+            GL.Triangle(vertices, model, shader, Vec3f());
+        }
+    }
+
+    // Decoded vertices by index. Faces are ordered for vertex reuse, so most fetches hit and decoding a vertex,
+    // normalization included, happens about once rather than for every triangle using it.
+    template <class Index>
+    class DecodeCache
+    {
+    public:
+        DecodeCache(const QuantizedMesh& mesh, const Index* indices) : mesh(mesh), indices(indices)
+        {
+            std::fill(tags, tags + Size, -1);
+        }
+
+        const Vertex& operator()(size_t slot)
+        {
+            int index = (int)indices[slot];
+            int line = index & (Size - 1);
+            if (tags[line] != index)
+            {
+                tags[line] = index;
+                decoded[line] = mesh.Decode(mesh.Vertices[index]);
+            }
+            return decoded[line];
+        }
+
+    private:
+        static constexpr int Size = 64;
+
+        const QuantizedMesh& mesh;
+        const Index* indices;
+        int tags[Size];
+        Vertex decoded[Size];
+    };
+
+    // Index slots of the full detail mesh for lod 0, of lods()[lod - 1] otherwise. Quantized vertices are decoded
+    // as they are fetched.
+    void drawIndexed(GraphicsLibrary& GL, Model& model, IShader& shader, int lod, size_t first, size_t last)
+    {
+        if (!model.quantized())
+        {
+            const Vertex* vertices = model.vertices().data();
+            const int* indices = lod > 0 ? model.lods()[lod - 1].Indices.data() : model.indices().data();
+            drawTriangles(GL, model, shader, first, last, [=](size_t i) { return vertices[indices[i]]; });
+            return;
+        }
+
+        const QuantizedMesh& mesh = model.quantizedMesh();
+        const IndexBuffer& buffer = lod > 0 ? mesh.LodIndices[lod - 1] : mesh.Indices;
+        if (!buffer.Short.empty())
+            drawTriangles(GL, model, shader, first, last, DecodeCache<uint16_t>(mesh, buffer.Short.data()));
+        else
+            drawTriangles(GL, model, shader, first, last, DecodeCache<uint32_t>(mesh, buffer.Long.data()));
+    }
+}
+
+void GraphicsLibrary::DrawModel(Model& model, IShader& shader)
+{
+    drawModel(model, shader, false, false);
+}
+
+void GraphicsLibrary::drawModel(Model& model, IShader& shader, bool insideFrustum, bool testOcclusion)
+{
+    shader.GL = this;
+    shader.BeginDraw();
+    binnedShader = nullptr;
+
+    Mat4 toScreen = Viewport * Projection * ModelView;
+
+    // Simplified levels are small on screen, they are drawn whole without culling their clusters.
+    int lod = LodThreshold > 0.0f ? selectLod(model, toScreen) : 0;
+    if (lod > 0)
+    {
+        size_t count = model.quantized() ? model.quantizedMesh().LodIndices[lod - 1].Size() : model.lods()[lod - 1].Indices.size();
+        drawIndexed(*this, model, shader, lod, 0, count);
+        return;
+    }
+
+    const std::vector<Cluster>& clusters = model.clusters();
+    int* visibleClusters = Arena.Allocate<int>(clusters.size());
+    size_t visibleCount = 0;
+    {
+        PROFILE_SCOPE(Profile, Cull);
+
+        bool backfaceCulling = BackfaceCulling && model.closed();
+        Vec3f eye = backfaceCulling ? EyePosition(toScreen) : Vec3f();
+        size_t occluded = 0;
+        auto visit = [&](int index, bool)
+        {
+            if (backfaceCulling && IsBackfacing(clusters[index], eye))
+                return;
+            if (testOcclusion && occlusion.IsOccluded(clusters[index].Box, toScreen))
+            {
+                ++occluded;
+                return;
+            }
+            visibleClusters[visibleCount++] = index;
+        };
+
+        if (FrustumCulling && !insideFrustum)
+        {
+            Frustum frustum = Frustum::FromScreenTransform(toScreen, 0.0f, 0.0f, (float)Output.get_width(), (float)Output.get_height());
+            model.clusterTree().Query(frustum, visit);
+        }
+        else
+        {
+            for (int i = 0; i < (int)clusters.size(); ++i)
+                visit(i, true);
+        }
+
+        // Keep the load order, which is also the order faces are stored in.
+        std::sort(visibleClusters, visibleClusters + visibleCount);
+        PROFILE_COUNT(Profile, ClustersCulled, clusters.size() - visibleCount - occluded);
+        PROFILE_COUNT(Profile, ClustersOccluded, occluded);
+    }
+
+    for (size_t i = 0; i < visibleCount; ++i)
+    {
+        const Cluster& cluster = clusters[visibleClusters[i]];
+        drawIndexed(*this, model, shader, 0, cluster.FirstFace * 3, (cluster.FirstFace + cluster.FaceCount) * 3);
+    }
+}
+
+int GraphicsLibrary::selectLod(const Model& model, const Mat4& toScreen) const
+{
+    const std::vector<LevelOfDetail>& lods = model.lods();
+    const AABB& bounds = model.bounds();
+    if (lods.empty() || bounds.Empty())
+        return 0;
+
+    Vec3f center = bounds.Center();
+    float radius = (bounds.Max - center).norm();
+    Vec4f c = toScreen * Vec4f(center);
+    if (c.w <= 0.0f || radius <= 0.0f)
+        return 0;
+
+    // Screen size of the bounding sphere, from the longest of three of its radii.
+    float projected = 0.0f;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        Vec3f end = center;
+        end.raw[axis] += radius;
+        Vec4f p = toScreen * Vec4f(end);
+        if (p.w <= 0.0f)
+            return 0;
+
+        float dx = p.x / p.w - c.x / c.w;
+        float dy = p.y / p.w - c.y / c.w;
+        projected = std::max(projected, std::sqrt(dx * dx + dy * dy));
+    }
+
+    float pixelsPerUnit = projected / radius;
+    int lod = 0;
+    while (lod < (int)lods.size() && lods[lod].Error * pixelsPerUnit <= LodThreshold)
+        ++lod;
+
+    return lod;
+}
+
+void GraphicsLibrary::DrawScene(Scene& scene)
+{
+    const std::vector<Instance>& instances = scene.Instances();
+
+    // 0 culled, 1 intersecting the frustum, 2 inside it.
+    char* visibleInstances = Arena.Allocate<char>(instances.size());
+    std::fill(visibleInstances, visibleInstances + instances.size(), FrustumCulling ? 0 : 2);
+    if (FrustumCulling)
+    {
+        PROFILE_SCOPE(Profile, Cull);
+
+        Frustum frustum = Frustum::FromScreenTransform(Viewport * Projection * View, 0.0f, 0.0f, (float)Output.get_width(), (float)Output.get_height());
+        int visible = 0;
+        scene.InstanceTree().Query(frustum, [&](int index, bool inside)
+        {
+            visibleInstances[index] = inside ? 2 : 1;
+            ++visible;
+        });
+        PROFILE_COUNT(Profile, InstancesCulled, instances.size() - visible);
+    }
+
+    if (OcclusionCulling)
+    {
+        PROFILE_SCOPE(Profile, Cull);
+
+        Mat4 viewToScreen = Viewport * Projection * View;
+        occlusion.Clear();
+        for (size_t i = 0; i < instances.size(); ++i)
+        {
+            if (visibleInstances[i] && instances[i].Occluder)
+                occlusion.RenderOccluder(*instances[i].Mesh, viewToScreen * scene.WorldTransform(instances[i].Node));
+        }
+
+        // Also brings the instance bounds up to date.
+        scene.InstanceTree();
+
+        int occluded = 0;
+        for (size_t i = 0; i < instances.size(); ++i)
+        {
+            if (visibleInstances[i] && !instances[i].Occluder && occlusion.IsOccluded(scene.InstanceBounds((int)i), viewToScreen))
+            {
+                visibleInstances[i] = 0;
+                ++occluded;
+            }
+        }
+        PROFILE_COUNT(Profile, InstancesOccluded, occluded);
+    }
+
+    for (int index : scene.DrawOrder())
+    {
+        if (!visibleInstances[index])
+            continue;
+
+        const Instance& instance = instances[index];
+        ModelView = View * scene.WorldTransform(instance.Node);
+        drawModel(*instance.Mesh, *instance.Mat.Shader, visibleInstances[index] == 2, OcclusionCulling && !instance.Occluder);
+    }
+
+    ModelView = View;
+}
@@ -4,43 +4,342 @@
 #include "tgaimage.h"
 #include "geometry.h"
 #include "matrix.h"
+#include "profiler.h"
+#include "kernels.h"
+#include "occlusion.h"
+#include "bins.h"
+#include "arena.h"
+#include <type_traits>
+#include <vector>
 
-struct Vertex
+struct IShader;
+class Scene;
+class FixedTriangle;
+
+// Float32 keeps depths as they are. The unorm formats store them as integers spread over the viewport depth range:
+// Unorm16 in half the memory traffic, Unorm24Stencil8 next to an 8-bit stencil.
+enum class DepthFormat
 {
-    Vec3f Pos;
-    Vec3f Normal;
-    Vec2f UV;
+    Float32,
+    Unorm16,
+    Unorm24Stencil8,
 };
 
-struct IShader;
+// Rgba8 shades straight into Output. The float formats accumulate linear colors in a framebuffer of their own, which
+// Resolve tone maps into Output: Rgba16F in half the memory of Rgba32F, with an 11-bit mantissa and values up to 65504.
+enum class ColorFormat
+{
+    Rgba8,
+    Rgba16F,
+    Rgba32F,
+};
+
+// How fragments combine with a float framebuffer: Replace overwrites it, Add sums into it, Alpha blends over it by the
+// fragment's alpha.
+enum class BlendMode
+{
+    Replace,
+    Add,
+    Alpha,
+};
 
 class GraphicsLibrary
 {
 public:
 
+    // Depths of a Float32 buffer. Other formats keep their values in the same memory, Depth reads any of them.
+    // Blocks of it may be compressed, DecompressDepth must be called before reading it directly.
     float* ZBuffer;
     TGAImage Output;
 
+    // View is set by LookAt, ModelView is View times the transform of the model being drawn.
+    Mat4 View;
     Mat4 ModelView;
     Mat4 Viewport;
     Mat4 Projection;
 
-    GraphicsLibrary(int width, int height);
+    Profiler Profile;
+
+    const KernelTable* Kernels;
+
+    // Scratch memory for data that only lives for the frame being drawn, rewound by Clear and EndFrame. Like the
+    // rest of the context it belongs to the one thread drawing with it.
+    FrameArena Arena;
+
+    // Skip instances and mesh clusters outside the viewport, and clusters of closed meshes facing away from the eye:
+    // the back faces of open meshes may be seen.
+    bool FrustumCulling = true;
+    bool BackfaceCulling = true;
+
+    // DrawScene renders the occluder instances into a low resolution depth buffer first, then skips instances and
+    // clusters hidden behind them. Occluders themselves are not tested, their own depths are in that buffer.
+    bool OcclusionCulling = false;
+
+    // Draws depths only: fragments pass the depth test and write their depth, they are neither shaded nor written to
+    // Output. Only the vertex stage of shaders runs, for depth prepasses and shadow maps.
+    bool DepthOnly = false;
+
+    // Keeps cleared blocks of the depth buffer, and blocks covered whole by one triangle, compressed. Turning it off
+    // expands every block at Clear and gives the same images and depths, for comparisons.
+    bool DepthCompression = true;
+
+    // Stencil test of Unorm24Stencil8 buffers: a pixel passes when its stencil bits in StencilTestMask equal those of
+    // StencilReference, and the fragments drawn set the bits of StencilWriteMask to StencilReference's. Clear zeroes
+    // the stencil. The default masks leave it alone.
+    uint8_t StencilReference = 0;
+    uint8_t StencilTestMask = 0;
+    uint8_t StencilWriteMask = 0;
+
+    // Largest simplification error, in pixels, a level of detail may show on screen. 0 always draws full detail.
+    float LodThreshold = 1.0f;
+
+    // Float framebuffers only. Resolve maps each color channel c to x * (1 + x / WhitePoint^2) / (1 + x) with
+    // x = c * Exposure, WhitePoint being the x that reaches white.
+    BlendMode Blend = BlendMode::Replace;
+    float Exposure = 1.0f;
+    float WhitePoint = 4.0f;
+
+    // simd forces a kernel instruction set, it is lowered to what the CPU supports.
+    GraphicsLibrary(int width, int height, SimdLevel simd = SimdLevel::Auto);
     ~GraphicsLibrary();
 
+    void Clear();
+
+    // Samples per pixel: 1, 2, 4 or 8. With more than one, coverage and depth are kept per sample while fragments
+    // are still shaded once per pixel and triangle, and Resolve must be called before reading Output and ZBuffer.
+    bool SetSampleCount(int count);
+    int SampleCount() const { return sampleCount; }
+
+    // Multisampling needs Float32 depths, a format conflicting with the sample count is refused. Clears the buffers.
+    bool SetDepthFormat(DepthFormat format);
+    DepthFormat GetDepthFormat() const { return depthFormat; }
+
+    // Float formats need a single sample, they are refused when multisampling. Clears the buffers.
+    bool SetColorFormat(ColorFormat format);
+    ColorFormat GetColorFormat() const { return colorFormat; }
+
+    // Depth of pixel (x, y), lowest() where nothing was drawn. Unorm values are converted back to viewport depths.
+    float Depth(int x, int y) const;
+    // Depths of row y as Depth returns them, after DecompressDepth.
+    void DepthRow(int y, float* depths) const;
+
+    // Farthest and nearest depths drawn in the pixels minX..maxX, minY..maxY, of every sample when multisampling.
+    // Returns false when nothing was drawn there. Compressed blocks are read without being expanded.
+    bool DepthBounds(int minX, int minY, int maxX, int maxY, float& farthest, float& nearest) const;
+
+    // Expands the compressed blocks of the depth buffer, so that every pixel of ZBuffer holds its value.
+    void DecompressDepth();
+
+    // Averages the samples of each pixel into Output, ZBuffer gets the closest of them. Nothing to do with one sample,
+    // unless the framebuffer is a float one, which is tone mapped into Output.
+    void Resolve();
+
+    void BeginFrame();
+    void EndFrame();
+
     void SetViewport(int x, int y, int w, int h, float depth);
+    float ViewportDepth() const { return viewportDepth; }
+
+    // Restricts drawing to the pixels [x, x + width) x [y, y + height) of a bigger frame, width and height being the
+    // size of this context. Viewport and projection keep describing the whole frame, so that regions drawn by several
+    // contexts can be stitched together.
+    void SetRegion(int x, int y);
+    int RegionX() const { return regionX; }
+    int RegionY() const { return regionY; }
 
     void SetProjection(float center);
 
+    // Parallel projection instead, see Mat4::GetOrthographic.
+    void SetOrthographic(float halfExtent);
+
     void LookAt(const Vec3f& position, const Vec3f& target, const Vec3f& up);
 
 	void Triangle(Vertex vertices[3], Model& model, IShader& shader, Vec3f lightDirection);
+
+    void DrawModel(Model& model, IShader& shader);
+
+    // Draws every instance of the scene, grouped by mesh. World transforms must be up to date.
+    void DrawScene(Scene& scene);
+
+    // Until EndBinning, triangles only go through the vertex stage and setup and are sorted into bins instead of
+    // being drawn. Their shaders must be deferrable, see IShader, triangles of other shaders are dropped.
+    void BeginBinning(FrameBins& bins);
+    void EndBinning();
+
+    // Draws binned triangles, tile by tile. Pixels end up as if the triangles had been drawn directly, in order.
+    // Unorm depths are spread over the viewport depth range of this context, which must match the binning one's.
+    void RasterizeBins(const FrameBins& bins);
+
+private:
+    void drawModel(Model& model, IShader& shader, bool insideFrustum, bool testOcclusion);
+    int selectLod(const Model& model, const Mat4& toScreen) const;
+    void binTriangle(const Vec3f& a, const Vec3f& b, const Vec3f& c, const FixedTriangle& fixed, float denominator, IShader& shader);
+
+    // Draw the pixels of the triangle within [clipMin, clipMax], shade(bar, color) being its fragment stage.
+    template <class Shade>
+    void rasterize(const Vec3f& a, const Vec3f& b, const Vec3f& c, const FixedTriangle& fixed, float denominator, const Vec2i& clipMin, const Vec2i& clipMax, Shade& shade);
+    template <DepthFormat Format>
+    void decompressBlock(int block);
+    template <DepthFormat Format, class Shade>
+    void rasterizeDepth(const Vec3f& a, const Vec3f& b, const Vec3f& c, const FixedTriangle& fixed, float denominator, const Vec2i& clipMin, const Vec2i& clipMax, Shade& shade);
+    template <class Shade>
+    void rasterizeMultisample(const Vec3f& a, const Vec3f& b, const Vec3f& c, const FixedTriangle& fixed, float denominator, const Vec2i& clipMin, const Vec2i& clipMax, Shade& shade);
+
+    // Fragment color of a float framebuffer, then its conversion by Resolve. storeRow writes packed colors to Output.
+    void blendColor(size_t pixel, const Vec4f& color);
+    void toneMap();
+    void storeRow(int y, const uint32_t* colors);
+
+    OcclusionBuffer occlusion;
+
+    // Arguments of SetViewport, Viewport is shifted by the region origin.
+    int viewportX = 0, viewportY = 0, viewportWidth = 0, viewportHeight = 0;
+    float viewportDepth = 0.0f;
+    int regionX = 0, regionY = 0;
+
+    // Uniforms of binnedShader are copied again for the next triangle when it changes or draws another model.
+    FrameBins* bins = nullptr;
+    const IShader* binnedShader = nullptr;
+    const void* binnedUniforms = nullptr;
+
+    std::vector<int> fragmentX;
+    std::vector<float> fragmentAlpha;
+    std::vector<float> fragmentBeta;
+    std::vector<float> fragmentDepth;
+
+    // Unorm values are depth * depthScale() + 1 rounded and clamped to depthMax, 0 when cleared.
+    DepthFormat depthFormat = DepthFormat::Float32;
+    float depthMax = 0.0f;
+    float depthScale() const { return viewportDepth > 0.0f ? (depthMax - 1.0f) / viewportDepth : 0.0f; }
+
+    // Farthest depth in each BlockSize x BlockSize block of ZBuffer, or lower when pixels were drawn since. Unorm
+    // buffers keep their values.
+    static constexpr int BlockSize = 16;
+    std::vector<float> blockDepth;
+
+    // Depth blocks stay compressed while they can: cleared blocks are only marked so, blocks covered whole by one
+    // triangle keep its plane and their nearest value. Such blocks have a zero stencil. Blocks are expanded into
+    // ZBuffer before a triangle draws into them pixel by pixel, clearedRow is a row of cleared values.
+    enum class BlockState : uint8_t
+    {
+        Cleared,
+        Plane,
+        Pixels,
+    };
+
+    struct DepthPlane
+    {
+        Vec3f A, B, C;
+        float Denominator;
+        float Nearest;
+    };
+
+    std::vector<BlockState> blockState;
+    std::vector<DepthPlane> blockPlane;
+    std::vector<uint32_t> clearedRow;
+    std::vector<uint32_t> blockScratch;
+
+    // Blue, green, red and alpha of each pixel of a float framebuffer, like Output, as halves for Rgba16F.
+    ColorFormat colorFormat = ColorFormat::Rgba8;
+    std::vector<float> floatColor;
+    std::vector<uint16_t> halfColor;
+    std::vector<float> toneMapRow;
+
+    // One plane of width * height values per sample, samplePlane apart.
+    int sampleCount = 1;
+    size_t samplePlane = 0;
+    std::vector<float> sampleDepth;
+    std::vector<uint32_t> sampleColor;
+    std::vector<uint32_t> resolvedRow;
+    std::vector<unsigned char> fragmentMask;
+    std::vector<float> pixelAlpha;
+    std::vector<float> pixelBeta;
+    std::vector<float> fragmentSampleDepth;
 };
 
 struct IShader
 {
     GraphicsLibrary* GL;
     virtual ~IShader() {}
+    // Called before a model is drawn, GL->ModelView then holds that model's transform.
+    virtual void BeginDraw() {}
     virtual Vec4f VertexStage(const Vertex& vec, int vertexId) = 0;
     virtual bool FragmentStage(const Vec3f& bar, TGAColor& color) = 0;
+
+    // Deferrable shaders can shade a triangle after the shader has moved on, from copies of the uniform block set
+    // by BeginDraw and of the varying block set by VertexStage. The fragment stage must read nothing else that
+    // changes while frames are drawn. Shaders without blocks are not deferrable.
+    virtual size_t UniformSize() const { return 0; }
+    virtual const void* UniformData() const { return nullptr; }
+    virtual size_t VaryingSize() const { return 0; }
+    virtual const void* VaryingData() const { return nullptr; }
+    virtual bool DeferredFragmentStage(const void* uniforms, const void* varyings, const Vec3f& bar, TGAColor& color) const { return false; }
+
+    // Fragment stages of float framebuffers: color is linear red, green, blue and alpha, 1 standing for 255, and may go
+    // beyond 1. Both default to the colors of the stages above.
+    virtual bool FragmentStageHdr(const Vec3f& bar, Vec4f& color)
+    {
+        TGAColor low;
+        bool drawn = FragmentStage(bar, low);
+        color = HdrColor(low);
+        return drawn;
+    }
+    virtual bool DeferredFragmentStageHdr(const void* uniforms, const void* varyings, const Vec3f& bar, Vec4f& color) const
+    {
+        TGAColor low;
+        bool drawn = DeferredFragmentStage(uniforms, varyings, bar, low);
+        color = HdrColor(low);
+        return drawn;
+    }
+
+    static Vec4f HdrColor(const TGAColor& color)
+    {
+        return Vec4f(color.r / 255.0f, color.g / 255.0f, color.b / 255.0f, color.a / 255.0f);
+    }
+};
+
+// Deferrable shader keeping its state in Uniforms and Varyings, both shaded from by Shade.
+template <class UniformBlock, class VaryingBlock>
+struct DeferrableShader : public IShader
+{
+    static_assert(std::is_trivially_copyable<UniformBlock>::value && std::is_trivially_copyable<VaryingBlock>::value, "Shader blocks are copied as bytes");
+
+    UniformBlock Uniforms;
+    VaryingBlock Varyings;
+
+    virtual bool Shade(const UniformBlock& uniforms, const VaryingBlock& varyings, const Vec3f& bar, TGAColor& color) const = 0;
+
+    // Float framebuffer version of Shade, Shade's color by default.
+    virtual bool ShadeHdr(const UniformBlock& uniforms, const VaryingBlock& varyings, const Vec3f& bar, Vec4f& color) const
+    {
+        TGAColor low;
+        bool drawn = Shade(uniforms, varyings, bar, low);
+        color = HdrColor(low);
+        return drawn;
+    }
+
+    virtual bool FragmentStage(const Vec3f& bar, TGAColor& color) override
+    {
+        return Shade(Uniforms, Varyings, bar, color);
+    }
+
+    virtual bool FragmentStageHdr(const Vec3f& bar, Vec4f& color) override
+    {
+        return ShadeHdr(Uniforms, Varyings, bar, color);
+    }
+
+    virtual size_t UniformSize() const override { return sizeof(UniformBlock); }
+    virtual const void* UniformData() const override { return &Uniforms; }
+    virtual size_t VaryingSize() const override { return sizeof(VaryingBlock); }
+    virtual const void* VaryingData() const override { return &Varyings; }
+
+    virtual bool DeferredFragmentStage(const void* uniforms, const void* varyings, const Vec3f& bar, TGAColor& color) const override
+    {
+        return Shade(*(const UniformBlock*)uniforms, *(const VaryingBlock*)varyings, bar, color);
+    }
+
+    virtual bool DeferredFragmentStageHdr(const void* uniforms, const void* varyings, const Vec3f& bar, Vec4f& color) const override
+    {
+        return ShadeHdr(*(const UniformBlock*)uniforms, *(const VaryingBlock*)varyings, bar, color);
+    }
 };
\ No newline at end of file
@@ -0,0 +1,169 @@
+#include "ambientocclusion.h"
+#include "kernels.h"
+#include "profiler.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+AmbientOcclusion::AmbientOcclusion(int threadCount) : workers(threadCount)
+{
+}
+
+void AmbientOcclusion::resize(int w, int h)
+{
+    // Samples lie within padding of every texel, the plane and the upsampling read one texel beyond.
+    int radius = std::max(1, (int)std::ceil(Radius * 0.5f));
+    if (w == width && h == height && Radius == sampleRadius)
+        return;
+
+    width = w;
+    height = h;
+    coarseWidth = (w + 1) / 2;
+    coarseHeight = (h + 1) / 2;
+    padding = radius;
+    sampleRadius = Radius;
+    stride = (size_t)coarseWidth + 2 * padding;
+
+    size_t size = stride * (coarseHeight + 2 * padding);
+    coarseDepth.assign(size, std::numeric_limits<float>::lowest());
+    coarseOcclusion.assign(size, 1.0f);
+    rows.assign((size_t)workers.ThreadCount() * width, 1.0f);
+
+    // A spiral of samples spreading evenly over the disc.
+    samples.clear();
+    sampleX.clear();
+    sampleY.clear();
+    for (int i = 0; i < SampleCount; ++i)
+    {
+        float angle = 2.39996323f * i;
+        float distance = Radius * 0.5f * std::sqrt((i + 0.5f) / SampleCount);
+        int dx = (int)std::lround(distance * std::cos(angle));
+        int dy = (int)std::lround(distance * std::sin(angle));
+        samples.push_back((ptrdiff_t)dy * (ptrdiff_t)stride + dx);
+        sampleX.push_back((float)dx);
+        sampleY.push_back((float)dy);
+    }
+}
+
+int AmbientOcclusion::Reach() const
+{
+    // Samples within radius texels, the plane one texel beyond them, the upsampling one texel beyond the plane.
+    int radius = std::max(1, (int)std::ceil(Radius * 0.5f));
+    return 2 * (radius + 3);
+}
+
+void AmbientOcclusion::Apply(GraphicsLibrary& GL)
+{
+    PROFILE_SCOPE(GL.Profile, Post);
+
+    int w = GL.Output.get_width();
+    int h = GL.Output.get_height();
+    resize(w, h);
+    GL.DecompressDepth();
+
+    const KernelTable& kernels = *GL.Kernels;
+    const float cleared = std::numeric_limits<float>::lowest();
+    const float* fullDepth = GL.ZBuffer;
+    if (GL.GetDepthFormat() != DepthFormat::Float32)
+    {
+        depth.resize((size_t)w * h);
+        workers.ParallelFor(h, 16, [&](int begin, int end, int)
+        {
+            for (int y = begin; y < end; ++y)
+                GL.DepthRow(y, depth.data() + (size_t)y * w);
+        });
+        fullDepth = depth.data();
+    }
+
+    // Closest of each 2x2 block. The padding stays cleared, what lies beyond the frame occludes nothing.
+    auto coarseRow = [&](std::vector<float>& buffer, int y) { return buffer.data() + (size_t)(y + padding) * stride + padding; };
+    workers.ParallelFor(coarseHeight, 16, [&](int begin, int end, int)
+    {
+        for (int y = begin; y < end; ++y)
+        {
+            const float* row0 = fullDepth + (size_t)(2 * y) * w;
+            const float* row1 = fullDepth + (size_t)std::min(2 * y + 1, h - 1) * w;
+            float* out = coarseRow(coarseDepth, y);
+            for (int x = 0; x < coarseWidth; ++x)
+            {
+                int x0 = 2 * x;
+                int x1 = std::min(x0 + 1, w - 1);
+                out[x] = std::max(std::max(row0[x0], row0[x1]), std::max(row1[x0], row1[x1]));
+            }
+        }
+    });
+
+    OcclusionRow occlusion;
+    occlusion.Stride = (ptrdiff_t)stride;
+    occlusion.Samples = samples.data();
+    occlusion.SampleX = sampleX.data();
+    occlusion.SampleY = sampleY.data();
+    occlusion.SampleCount = SampleCount;
+    occlusion.Width = coarseWidth;
+    occlusion.Bias = Bias;
+    occlusion.InverseRange = 1.0f / Range;
+    occlusion.Scale = Strength / SampleCount;
+    workers.ParallelFor(coarseHeight, 8, [&](int begin, int end, int)
+    {
+        OcclusionRow row = occlusion;
+        for (int y = begin; y < end; ++y)
+        {
+            row.Depth = coarseRow(coarseDepth, y);
+            row.Out = coarseRow(coarseOcclusion, y);
+            kernels.OcclusionRow(row);
+            row.Out[-1] = row.Out[0];
+            row.Out[coarseWidth] = row.Out[coarseWidth - 1];
+        }
+    });
+
+    // Pixel y lies between texel rows (y - 1) / 2 and (y + 1) / 2, 3/4 towards the one covering it.
+    int bytespp = GL.Output.get_bytespp();
+    unsigned char* pixels = GL.Output.buffer();
+    workers.ParallelFor(h, 16, [&](int begin, int end, int thread)
+    {
+        UpsampleRow upsample;
+        upsample.Width = w;
+        upsample.Sharpness = Sharpness;
+        upsample.Out = rows.data() + (size_t)thread * w;
+        for (int y = begin; y < end; ++y)
+        {
+            int nearY = y >> 1;
+            int farY = std::min(std::max(y & 1 ? nearY + 1 : nearY - 1, 0), coarseHeight - 1);
+            upsample.Depth = fullDepth + (size_t)y * w;
+            upsample.CoarseDepth0 = coarseRow(coarseDepth, nearY);
+            upsample.CoarseOcclusion0 = coarseRow(coarseOcclusion, nearY);
+            upsample.CoarseDepth1 = coarseRow(coarseDepth, farY);
+            upsample.CoarseOcclusion1 = coarseRow(coarseOcclusion, farY);
+            upsample.Weight0 = 0.75f;
+            upsample.Weight1 = 0.25f;
+            kernels.UpsampleRow(upsample);
+
+            // In 8.8 fixed point, alpha is left alone. Unoccluded and cleared pixels are skipped.
+            const float* rowDepth = upsample.Depth;
+            const float* shade = upsample.Out;
+            unsigned char* pixel = pixels + (size_t)y * w * bytespp;
+            if (bytespp >= 3)
+            {
+                for (int x = 0; x < w; ++x, pixel += bytespp)
+                {
+                    uint32_t factor = (uint32_t)(int)(shade[x] * 256.0f + 0.5f);
+                    if (factor >= 256 || rowDepth[x] == cleared)
+                        continue;
+                    pixel[0] = (unsigned char)((pixel[0] * factor + 128) >> 8);
+                    pixel[1] = (unsigned char)((pixel[1] * factor + 128) >> 8);
+                    pixel[2] = (unsigned char)((pixel[2] * factor + 128) >> 8);
+                }
+            }
+            else
+            {
+                for (int x = 0; x < w; ++x)
+                {
+                    uint32_t factor = (uint32_t)(int)(shade[x] * 256.0f + 0.5f);
+                    if (factor >= 256 || rowDepth[x] == cleared)
+                        continue;
+                    pixel[x] = (unsigned char)((pixel[x] * factor + 128) >> 8);
+                }
+            }
+        }
+    });
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "GL.h"
+#include "workers.h"
+#include <cstddef>
+#include <vector>
+
+// Screen space ambient occlusion of a drawn frame. The depth buffer is reduced to half resolution, keeping the closest
+// depth of each 2x2 block, where samples around every pixel are compared to the plane of its surface, reconstructed
+// from the depth differences with its neighbours. The result is brought back to full resolution by a bilateral filter
+// that favors texels of depths close to the pixel's, then darkens Output. Rows are split between worker threads and go
+// through the SIMD kernels of GL.
+class AmbientOcclusion
+{
+public:
+    // Sampling radius in pixels of the full resolution.
+    float Radius = 12.0f;
+    // Depth units a sample must be closer by to occlude, then the range over which its occlusion fades out. Samples
+    // beyond that are considered unrelated to the pixel, which keeps edges from darkening what is far behind them.
+    float Bias = 0.5f;
+    float Range = 12.0f;
+    // Darkening of a fully occluded pixel, 1 turns it black.
+    float Strength = 0.8f;
+    // Falloff of the upsampling weights with the depth difference between a pixel and a texel.
+    float Sharpness = 1.0f;
+
+    // threadCount as for WorkerPool.
+    explicit AmbientOcclusion(int threadCount = 0);
+
+    // Darkens Output by the occlusion of GL's depths. Multisampled contexts must have been resolved.
+    void Apply(GraphicsLibrary& GL);
+
+    // Pixels away from a pixel whose depths its occlusion depends on, in x or y, even so that a frame cut that far
+    // before a pixel keeps the 2x2 blocks of the whole frame.
+    int Reach() const;
+
+private:
+    static constexpr int SampleCount = 12;
+
+    void resize(int width, int height);
+
+    WorkerPool workers;
+
+    int width = 0;
+    int height = 0;
+    int coarseWidth = 0;
+    int coarseHeight = 0;
+    int padding = 0;
+    size_t stride = 0;
+    float sampleRadius = 0.0f;
+
+    // Full resolution depths, only for unorm buffers: float ones are read from ZBuffer.
+    std::vector<float> depth;
+    // Half resolution depths and occlusion, padding texels on every side.
+    std::vector<float> coarseDepth;
+    std::vector<float> coarseOcclusion;
+    std::vector<ptrdiff_t> samples;
+    std::vector<float> sampleX;
+    std::vector<float> sampleY;
+    // A full resolution row of occlusion per thread.
+    std::vector<float> rows;
+};
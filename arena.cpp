@@ -0,0 +1,77 @@
+#include "arena.h"
+
+FrameArena::FrameArena(size_t chunkSize) : chunkSize(chunkSize)
+{
+}
+
+FrameArena::~FrameArena()
+{
+    for (Chunk& chunk : chunks)
+        delete[] chunk.Data;
+}
+
+void* FrameArena::Allocate(size_t size, size_t alignment)
+{
+    if (!chunks.empty())
+    {
+        Chunk& chunk = chunks[current];
+        uintptr_t address = (uintptr_t)(chunk.Data + offset);
+        size_t padding = (alignment - address % alignment) % alignment;
+        if (offset + padding + size <= chunk.Size)
+        {
+            offset += padding + size;
+            return (void*)(address + padding);
+        }
+    }
+
+    nextChunk(size, alignment);
+    return Allocate(size, alignment);
+}
+
+void FrameArena::nextChunk(size_t size, size_t alignment)
+{
+    if (!chunks.empty())
+    {
+        used += offset;
+        offset = 0;
+        ++current;
+    }
+
+    // Chunks left over from a bigger frame are reused when large enough.
+    size_t needed = size + alignment;
+    while (current < chunks.size() && chunks[current].Size < needed)
+        ++current;
+
+    if (current >= chunks.size())
+    {
+        size_t chunk = std::max(chunkSize, needed);
+        chunks.push_back({ new unsigned char[chunk], chunk });
+        current = chunks.size() - 1;
+    }
+}
+
+void FrameArena::Reset()
+{
+    // Merges the chunks when several were needed, the next frame then fits in one.
+    if (chunks.size() > 1)
+    {
+        size_t total = Capacity();
+        for (Chunk& chunk : chunks)
+            delete[] chunk.Data;
+
+        chunks.clear();
+        chunks.push_back({ new unsigned char[total], total });
+    }
+
+    current = 0;
+    offset = 0;
+    used = 0;
+}
+
+size_t FrameArena::Capacity() const
+{
+    size_t total = 0;
+    for (const Chunk& chunk : chunks)
+        total += chunk.Size;
+    return total;
+}
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+// Linear allocator for data that only lives for a frame. Allocations are carved out of large chunks one after the
+// other and never freed on their own, Reset releases everything at once. A frame that needed more than one chunk is
+// followed by a single chunk holding all of it, so once frames stop growing they stop allocating from the heap.
+// Not thread safe: each thread uses an arena of its own.
+class FrameArena
+{
+public:
+    explicit FrameArena(size_t chunkSize = 1 << 20);
+    ~FrameArena();
+
+    FrameArena(const FrameArena&) = delete;
+    FrameArena& operator=(const FrameArena&) = delete;
+
+    void* Allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+
+    // Uninitialized storage for count objects, which must not need destruction.
+    template <class T>
+    T* Allocate(size_t count)
+    {
+        static_assert(std::is_trivially_destructible<T>::value, "Arena objects are never destroyed");
+        return (T*)Allocate(sizeof(T) * count, alignof(T));
+    }
+
+    void Reset();
+
+    // Bytes allocated since the last reset, and bytes held in chunks.
+    size_t Used() const { return used + offset; }
+    size_t Capacity() const;
+
+private:
+    struct Chunk
+    {
+        unsigned char* Data;
+        size_t Size;
+    };
+
+    void nextChunk(size_t size, size_t alignment);
+
+    size_t chunkSize;
+    std::vector<Chunk> chunks;
+    size_t current = 0;
+    size_t offset = 0;
+    size_t used = 0;
+};
+
+// Growable list whose elements live in a FrameArena. Elements go in segments of doubling size, so pushing never moves
+// them and a list of any length costs no more than twice its size. The list must not be used once its arena is reset,
+// Clear empties it for a new frame.
+template <class T>
+class ArenaList
+{
+    struct Segment
+    {
+        Segment* Next;
+        uint32_t Count;
+        uint32_t Capacity;
+
+        T* Items() { return (T*)(this + 1); }
+        const T* Items() const { return (const T*)(this + 1); }
+    };
+
+    static_assert(std::is_trivially_copyable<T>::value && alignof(T) <= alignof(Segment), "Arena list elements are copied as bytes");
+
+public:
+    static constexpr uint32_t FirstSegment = 16;
+    static constexpr uint32_t LargestSegment = 4096;
+
+    class Iterator
+    {
+    public:
+        Iterator(const Segment* segment, uint32_t index) : segment(segment), index(index) {}
+
+        const T& operator*() const { return segment->Items()[index]; }
+        bool operator!=(const Iterator& other) const { return segment != other.segment || index != other.index; }
+
+        Iterator& operator++()
+        {
+            if (++index == segment->Count)
+            {
+                segment = segment->Next;
+                index = 0;
+            }
+            return *this;
+        }
+
+    private:
+        const Segment* segment;
+        uint32_t index;
+    };
+
+    void Push(FrameArena& arena, const T& value)
+    {
+        if (!tail || tail->Count == tail->Capacity)
+        {
+            uint32_t capacity = tail ? std::min(tail->Capacity * 2, LargestSegment) : FirstSegment;
+            Segment* segment = (Segment*)arena.Allocate(sizeof(Segment) + sizeof(T) * capacity, alignof(Segment));
+            segment->Next = nullptr;
+            segment->Count = 0;
+            segment->Capacity = capacity;
+            (tail ? tail->Next : head) = segment;
+            tail = segment;
+        }
+
+        tail->Items()[tail->Count++] = value;
+        ++size;
+    }
+
+    void Clear()
+    {
+        head = tail = nullptr;
+        size = 0;
+    }
+
+    size_t Size() const { return size; }
+    bool Empty() const { return size == 0; }
+
+    Iterator begin() const { return Iterator(head, 0); }
+    Iterator end() const { return Iterator(nullptr, 0); }
+
+private:
+    Segment* head = nullptr;
+    Segment* tail = nullptr;
+    size_t size = 0;
+};
@@ -0,0 +1,35 @@
+#include "allocations.h"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+// In a translation unit of their own: where the callers of operator new can see it forward to malloc, GCC warns that
+// what they delete is freed with the mismatched operator delete.
+
+namespace
+{
+    std::atomic<uint64_t> allocationCount(0);
+}
+
+uint64_t AllocationCount()
+{
+    return allocationCount.load();
+}
+
+void* operator new(size_t size)
+{
+    ++allocationCount;
+    if (void* memory = std::malloc(size ? size : 1))
+        return memory;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept
+{
+    std::free(memory);
+}
@@ -0,0 +1,7 @@
+#pragma once
+
+#include <cstdint>
+
+// Number of heap allocations the process made so far. The replacement operator new of allocations.cpp counts every
+// one of them, the renderer's included, in any executable it is linked into.
+uint64_t AllocationCount();
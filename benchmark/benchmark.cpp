@@ -0,0 +1,1247 @@
+#include "allocations.h"
+#include "GL.h"
+#include "ambientocclusion.h"
+#include "kernels.h"
+#include "lights.h"
+#include "matrix.h"
+#include "model.h"
+#include "pipeline.h"
+#include "postprocess.h"
+#include "scene.h"
+#include "shadow.h"
+#include "tgaimage.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Self-contained benchmark runner. Every benchmark body runs a requested number of iterations, the runner
+// calibrates that number to reach --min-time and keeps the best of --repetitions runs.
+// Results are written as JSON (one benchmark per line) and can be compared against a previous run with --baseline.
+// Heap allocations are counted, benchmarks of frames that should not allocate once warmed up fail the run if they do.
+// --allocations only runs that check, CTest does so for the frame benchmarks.
+
+namespace
+{
+    volatile float floatSink;
+    volatile int intSink;
+
+    // Iterations past warm up whose allocations are counted.
+    const int SteadyIterations = 8;
+
+    struct Benchmark
+    {
+        std::string Name;
+        // Runs the body `iterations` times and returns the number of processed items (pixels, vertices...) or 0.
+        std::function<double(int iterations)> Body;
+        // Iterations after which the body must stop allocating, -1 if it may. The allocations of a run of WarmupIterations
+        // and of one SteadyIterations longer must be the same.
+        int WarmupIterations = -1;
+        // Run once before the body when the benchmark is selected, for files and data it reads but does not time.
+        std::function<void()> Setup;
+    };
+
+    struct Result
+    {
+        std::string Name;
+        int Iterations;
+        double NsPerIteration;
+        double ItemsPerSecond;
+        uint64_t SteadyAllocations;
+    };
+
+    struct Options
+    {
+        std::string Filter;
+        std::string OutputPath;
+        std::string BaselinePath;
+        bool AllocationsOnly = false;
+        double MinTime = 0.2;
+        int Repetitions = 3;
+        double Threshold = 10.0;
+    };
+
+    using Clock = std::chrono::steady_clock;
+
+    // Allocations of SteadyIterations iterations past warm up. Both runs set the body up the same way, what the longer
+    // one allocates beyond the other is its steady iterations'.
+    uint64_t CountSteadyAllocations(const Benchmark& benchmark)
+    {
+        std::streambuf* log = std::cerr.rdbuf(nullptr);
+
+        uint64_t start = AllocationCount();
+        benchmark.Body(benchmark.WarmupIterations);
+        uint64_t warm = AllocationCount() - start;
+
+        start = AllocationCount();
+        benchmark.Body(benchmark.WarmupIterations + SteadyIterations);
+        uint64_t steady = AllocationCount() - start;
+
+        std::cerr.rdbuf(log);
+        std::cerr.clear();
+        return steady > warm ? steady - warm : 0;
+    }
+
+    Result Run(const Benchmark& benchmark, const Options& options)
+    {
+        // Model and TGAImage log every load, keep that out of the measurements.
+        std::streambuf* log = std::cerr.rdbuf(nullptr);
+
+        int iterations = 1;
+        double seconds = 0.0;
+        double items = 0.0;
+
+        while (true)
+        {
+            Clock::time_point start = Clock::now();
+            items = benchmark.Body(iterations);
+            seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+            if (seconds >= options.MinTime || iterations >= (1 << 30))
+                break;
+
+            double scale = seconds > 0.0 ? options.MinTime * 1.4 / seconds : 10.0;
+            iterations = (int)std::min(1e9, std::max(iterations * 2.0, iterations * std::min(scale, 100.0)));
+        }
+
+        double best = seconds;
+        for (int i = 1; i < options.Repetitions; ++i)
+        {
+            Clock::time_point start = Clock::now();
+            benchmark.Body(iterations);
+            best = std::min(best, std::chrono::duration<double>(Clock::now() - start).count());
+        }
+
+        std::cerr.rdbuf(log);
+        std::cerr.clear();
+
+        uint64_t steadyAllocations = benchmark.WarmupIterations >= 0 ? CountSteadyAllocations(benchmark) : 0;
+        return { benchmark.Name, iterations, best * 1e9 / iterations, items > 0.0 ? items / best : 0.0, steadyAllocations };
+    }
+
+    // Mesh generators
+
+    Model MakeSphere(int rings, int segments, float radius)
+    {
+        std::vector<Vec3f> verts;
+        std::vector<Vec2f> uv;
+        std::vector<Vec3f> normals;
+        std::vector<std::vector<VertexInfo> > faces;
+
+        // The seam and the poles repeat their positions exactly, so that the sphere is closed.
+        for (int i = 0; i <= rings; ++i)
+        {
+            float theta = 3.14159265f * i / rings;
+            float ring = i == 0 || i == rings ? 0.0f : std::sin(theta);
+            for (int j = 0; j <= segments; ++j)
+            {
+                float phi = 2.0f * 3.14159265f * (j % segments) / segments;
+                Vec3f n(ring * std::cos(phi), std::cos(theta), ring * std::sin(phi));
+                verts.push_back(n * radius);
+                normals.push_back(n);
+                uv.push_back(Vec2f((float)j / segments, 1.0f - (float)i / rings));
+            }
+        }
+
+        for (int i = 0; i < rings; ++i)
+        {
+            for (int j = 0; j < segments; ++j)
+            {
+                int a = i * (segments + 1) + j;
+                int b = a + segments + 1;
+                faces.push_back({ { a, a, a }, { b, b, b }, { a + 1, a + 1, a + 1 } });
+                faces.push_back({ { a + 1, a + 1, a + 1 }, { b, b, b }, { b + 1, b + 1, b + 1 } });
+            }
+        }
+
+        return Model(verts, uv, normals, faces);
+    }
+
+    // Grid in the z = depth plane, spanning [-1, 1] in x and y.
+    void AppendGrid(int cells, float depth, std::vector<Vec3f>& verts, std::vector<Vec2f>& uv, std::vector<Vec3f>& normals,
+        std::vector<std::vector<VertexInfo> >& faces)
+    {
+        int base = (int)verts.size();
+        for (int y = 0; y <= cells; ++y)
+        {
+            for (int x = 0; x <= cells; ++x)
+            {
+                verts.push_back(Vec3f(-1.0f + 2.0f * x / cells, -1.0f + 2.0f * y / cells, depth));
+                normals.push_back(Vec3f(0.0f, 0.0f, 1.0f));
+                uv.push_back(Vec2f((float)x / cells, (float)y / cells));
+            }
+        }
+
+        for (int y = 0; y < cells; ++y)
+        {
+            for (int x = 0; x < cells; ++x)
+            {
+                int a = base + y * (cells + 1) + x;
+                int b = a + cells + 1;
+                faces.push_back({ { a, a, a }, { a + 1, a + 1, a + 1 }, { b, b, b } });
+                faces.push_back({ { a + 1, a + 1, a + 1 }, { b + 1, b + 1, b + 1 }, { b, b, b } });
+            }
+        }
+    }
+
+    Model MakeGrid(int cells)
+    {
+        std::vector<Vec3f> verts;
+        std::vector<Vec2f> uv;
+        std::vector<Vec3f> normals;
+        std::vector<std::vector<VertexInfo> > faces;
+        AppendGrid(cells, 0.0f, verts, uv, normals, faces);
+        return Model(verts, uv, normals, faces);
+    }
+
+    // Full-screen quads drawn back to front, so every layer passes the depth test.
+    Model MakeOverdrawStack(int layers)
+    {
+        std::vector<Vec3f> verts;
+        std::vector<Vec2f> uv;
+        std::vector<Vec3f> normals;
+        std::vector<std::vector<VertexInfo> > faces;
+        for (int i = 0; i < layers; ++i)
+            AppendGrid(1, -0.5f + (float)i / layers, verts, uv, normals, faces);
+        return Model(verts, uv, normals, faces);
+    }
+
+    bool WriteObj(const std::string& path, Model& model)
+    {
+        std::ofstream out(path);
+        if (!out.is_open())
+            return false;
+
+        for (int i = 0; i < model.nverts(); ++i)
+        {
+            Vec3f v = model.vert(i);
+            out << "v " << v.x << " " << v.y << " " << v.z << "\n";
+        }
+        for (int i = 0; i < model.nuv(); ++i)
+        {
+            Vec2f uv = model.uv(i);
+            out << "vt  " << uv.x << " " << uv.y << " 0.0\n";
+        }
+        for (int i = 0; i < model.nverts(); ++i)
+        {
+            Vec3f n = model.normal(i);
+            out << "vn  " << n.x << " " << n.y << " " << n.z << "\n";
+        }
+        for (int i = 0; i < model.nfaces(); ++i)
+        {
+            out << "f";
+            for (const VertexInfo& v : model.face(i))
+                out << " " << v.VertexId + 1 << "/" << v.TexCoordId + 1 << "/" << v.NormalId + 1;
+            out << "\n";
+        }
+
+        return out.good();
+    }
+
+    // Shaders
+
+    // Positions are already in screen space, used to rasterize triangles of a controlled size.
+    struct ScreenSpaceShader : public IShader
+    {
+        virtual Vec4f VertexStage(const Vertex& vec, int vertexId) override
+        {
+            return Vec4f(vec.Pos);
+        }
+
+        virtual bool FragmentStage(const Vec3f& bar, TGAColor& color) override
+        {
+            color = TGAColor(255, 255, 255, 255);
+            return true;
+        }
+    };
+
+    struct LambertShader : public IShader
+    {
+        Vec3f varyingIntensity;
+        Vec3f lightDirection;
+
+        LambertShader(const Vec3f& light) : lightDirection(light) {}
+
+        virtual Vec4f VertexStage(const Vertex& vec, int vertexId) override
+        {
+            varyingIntensity.raw[vertexId] = std::max(0.2f, vec.Normal * lightDirection);
+            return GL->Viewport * GL->Projection * GL->ModelView * Vec4f(vec.Pos);
+        }
+
+        virtual bool FragmentStage(const Vec3f& bar, TGAColor& color) override
+        {
+            color = TGAColor(255, 255, 255, 255) * (bar * varyingIntensity);
+            return true;
+        }
+    };
+
+    void DrawModel(GraphicsLibrary& GL, Model& model, IShader& shader)
+    {
+        Vertex vertices[3];
+        for (int i = 0; i < model.nfaces(); ++i)
+        {
+            const std::vector<VertexInfo>& face = model.face(i);
+            for (int j = 0; j < 3; ++j)
+            {
+                vertices[j].Pos = model.vert(face[j].VertexId);
+                vertices[j].UV = model.uv(face[j].TexCoordId);
+                vertices[j].Normal = model.normal(face[j].NormalId);
+            }
+            GL.Triangle(vertices, model, shader, Vec3f(0.0f, 0.0f, 1.0f));
+        }
+    }
+
+    Mat4 RandomMatrix(unsigned seed)
+    {
+        float data[16];
+        for (int i = 0; i < 16; ++i)
+        {
+            seed = seed * 1664525u + 1013904223u;
+            data[i] = (seed >> 8) / 16777216.0f * 2.0f - 1.0f;
+        }
+        // Keep it well conditioned.
+        for (int i = 0; i < 4; ++i)
+            data[i * 5] += 4.0f;
+        return Mat4(data);
+    }
+
+    // Benchmark registration
+
+    void AddMatrixBenchmarks(std::vector<Benchmark>& benchmarks)
+    {
+        benchmarks.push_back({ "matrix/mat4_mul_mat4", [](int iterations)
+        {
+            Mat4 a = RandomMatrix(1);
+            Mat4 b = RandomMatrix(2);
+            for (int i = 0; i < iterations; ++i)
+            {
+                a = a * b;
+                a.data[0] = floatSink = a.data[0] * 0.5f + 1.0f;
+            }
+            floatSink = a.data[5];
+            return (double)iterations;
+        } });
+
+        benchmarks.push_back({ "matrix/mat4_mul_vec4", [](int iterations)
+        {
+            Mat4 m = RandomMatrix(3);
+            Vec4f v(1.0f, 2.0f, 3.0f, 1.0f);
+            for (int i = 0; i < iterations; ++i)
+            {
+                v = m * v;
+                v.w = 1.0f;
+                v.x = floatSink = v.x * 1e-3f;
+            }
+            floatSink = v.y;
+            return (double)iterations;
+        } });
+
+        benchmarks.push_back({ "matrix/mat4_inverse", [](int iterations)
+        {
+            Mat4 m = RandomMatrix(4);
+            for (int i = 0; i < iterations; ++i)
+            {
+                Mat4 inverse = m.Inverse();
+                m.data[3] = floatSink = inverse.data[3] * 1e-3f;
+            }
+            return (double)iterations;
+        } });
+
+        benchmarks.push_back({ "matrix/mat4_inverse_affine", [](int iterations)
+        {
+            Mat4 m = RandomMatrix(4);
+            m.data[12] = m.data[13] = m.data[14] = 0.0f;
+            m.data[15] = 1.0f;
+            for (int i = 0; i < iterations; ++i)
+            {
+                Mat4 inverse = m.InverseAffine();
+                m.data[3] = floatSink = inverse.data[3] * 1e-3f;
+            }
+            return (double)iterations;
+        } });
+
+        benchmarks.push_back({ "matrix/mat4_transform_1k", [](int iterations)
+        {
+            std::vector<Vec4f> vectors(1024, Vec4f(1.0f, 2.0f, 3.0f, 1.0f));
+            Mat4 m = RandomMatrix(6);
+            for (int i = 0; i < iterations; ++i)
+                m.Transform(vectors.data(), vectors.data(), (int)vectors.size());
+            floatSink = vectors[17].x;
+            return (double)iterations * vectors.size();
+        } });
+    }
+
+    TGAImage MakeTestImage()
+    {
+        TGAImage image(800, 800, TGAImage::RGB);
+        for (int y = 0; y < 800; ++y)
+            for (int x = 0; x < 800; ++x)
+                image.set(x, y, TGAColor((x / 16) & 255, (y / 16) & 255, (x ^ y) & 255, 255));
+        return image;
+    }
+
+    // Files of the IO benchmarks, in a temporary directory removed with the fixture. Each is written by the setup of
+    // the first selected benchmark reading it, a run whose filter leaves the IO benchmarks out writes nothing.
+    class IOFixture
+    {
+    public:
+        ~IOFixture()
+        {
+            std::error_code error;
+            if (!directory.empty())
+                std::filesystem::remove_all(directory, error);
+        }
+
+        // Path of the OBJ file, without its extension. The mesh cache is written next to it with cache.
+        const std::string& SpherePath(bool cache = false)
+        {
+            if (spherePath.empty())
+            {
+                spherePath = path("benchmark_sphere");
+                Model sphere = MakeSphere(128, 256, 1.0f);
+                WriteObj(spherePath + ".obj", sphere);
+            }
+            if (cache && !cacheWritten)
+            {
+                Model sphere(spherePath.c_str());
+                cacheWritten = true;
+            }
+            return spherePath;
+        }
+
+        const std::string& ImagePath(bool rle)
+        {
+            std::string& imagePath = imagePaths[rle];
+            if (imagePath.empty())
+            {
+                imagePath = path(rle ? "benchmark_rle.tga" : "benchmark_raw.tga");
+                MakeTestImage().write_tga_file(imagePath.c_str(), rle);
+            }
+            return imagePath;
+        }
+
+    private:
+        std::string path(const char* name)
+        {
+            if (directory.empty())
+            {
+                directory = std::filesystem::temp_directory_path() / "software-renderer-benchmark";
+                std::filesystem::create_directories(directory);
+            }
+            return (directory / name).string();
+        }
+
+        std::filesystem::path directory;
+        std::string spherePath;
+        bool cacheWritten = false;
+        std::string imagePaths[2];
+    };
+
+    void AddIOBenchmarks(std::vector<Benchmark>& benchmarks)
+    {
+        std::shared_ptr<IOFixture> fixture = std::make_shared<IOFixture>();
+
+        // Parsing and processing the OBJ file every time, then reading back the mesh cache written from it.
+        benchmarks.push_back({ "model/obj_parse_sphere_65k", [fixture](int iterations)
+        {
+            double faces = 0.0;
+            for (int i = 0; i < iterations; ++i)
+            {
+                Model model(fixture->SpherePath().c_str(), false);
+                faces += model.nfaces();
+            }
+            return faces;
+        }, -1, [fixture]() { fixture->SpherePath(); } });
+
+        benchmarks.push_back({ "model/cache_load_sphere_65k", [fixture](int iterations)
+        {
+            double faces = 0.0;
+            for (int i = 0; i < iterations; ++i)
+            {
+                Model model(fixture->SpherePath().c_str());
+                faces += model.nfaces();
+            }
+            return faces;
+        }, -1, [fixture]() { fixture->SpherePath(true); } });
+
+        for (bool rle : { false, true })
+        {
+            std::string suffix = rle ? "rle" : "raw";
+
+            benchmarks.push_back({ "tga/write_800x800_" + suffix, [fixture, rle](int iterations)
+            {
+                TGAImage image = MakeTestImage();
+                for (int i = 0; i < iterations; ++i)
+                    image.write_tga_file(fixture->ImagePath(rle).c_str(), rle);
+                return (double)iterations * 800 * 800;
+            }, -1, [fixture, rle]() { fixture->ImagePath(rle); } });
+
+            benchmarks.push_back({ "tga/read_800x800_" + suffix, [fixture, rle](int iterations)
+            {
+                TGAImage image;
+                for (int i = 0; i < iterations; ++i)
+                    image.read_tga_file(fixture->ImagePath(rle).c_str());
+                intSink = image.get_width();
+                return (double)iterations * 800 * 800;
+            }, -1, [fixture, rle]() { fixture->ImagePath(rle); } });
+        }
+    }
+
+    void AddRasterBenchmarks(std::vector<Benchmark>& benchmarks)
+    {
+        // Right triangles with the given leg length in pixels, laid out on a grid so they don't occlude each other.
+        for (int size : { 2, 8, 32, 128, 512 })
+        {
+            benchmarks.push_back({ "raster/triangle_" + std::to_string(size) + "px", [size](int iterations)
+            {
+                const int resolution = 1024;
+                GraphicsLibrary GL(resolution, resolution);
+                ScreenSpaceShader shader;
+                Model empty{ std::vector<Vec3f>(), std::vector<Vec2f>(), std::vector<Vec3f>(), std::vector<std::vector<VertexInfo> >() };
+
+                int perRow = std::max(1, resolution / (size + 1));
+                double pixels = 0.0;
+                for (int i = 0; i < iterations; ++i)
+                {
+                    int cell = i % (perRow * perRow);
+                    if (cell == 0)
+                        GL.Clear();
+
+                    float x = (float)(cell % perRow) * (size + 1) + 0.5f;
+                    float y = (float)(cell / perRow) * (size + 1) + 0.5f;
+
+                    Vertex vertices[3];
+                    vertices[0].Pos = Vec3f(x, y, 1.0f);
+                    vertices[1].Pos = Vec3f(x + size, y, 1.0f);
+                    vertices[2].Pos = Vec3f(x, y + size, 1.0f);
+                    GL.Triangle(vertices, empty, shader, Vec3f(0.0f, 0.0f, 1.0f));
+                    pixels += size * size * 0.5;
+                }
+                return pixels;
+            } });
+        }
+    }
+
+    // Full screen quads drawn nearest first, so all but the first layer are hidden. Once per depth format.
+    void AddOverdrawBenchmarks(std::vector<Benchmark>& benchmarks)
+    {
+        struct Format
+        {
+            const char* Suffix;
+            DepthFormat Depth;
+        };
+
+        for (Format format : { Format{ "", DepthFormat::Float32 }, Format{ "_unorm16", DepthFormat::Unorm16 }, Format{ "_unorm24s8", DepthFormat::Unorm24Stencil8 } })
+        {
+            benchmarks.push_back({ std::string("raster/fullscreen_8_layers") + format.Suffix, [format](int iterations)
+            {
+                const int resolution = 1024;
+                GraphicsLibrary GL(resolution, resolution);
+                GL.SetViewport(0, 0, resolution, resolution, 255.0f);
+                GL.SetDepthFormat(format.Depth);
+                ScreenSpaceShader shader;
+                Model empty{ std::vector<Vec3f>(), std::vector<Vec2f>(), std::vector<Vec3f>(), std::vector<std::vector<VertexInfo> >() };
+
+                for (int i = 0; i < iterations; ++i)
+                {
+                    GL.Clear();
+                    for (int layer = 0; layer < 8; ++layer)
+                    {
+                        float z = 200.0f - layer * 10.0f;
+                        Vec3f corners[4] = { Vec3f(-1.0f, -1.0f, z), Vec3f(resolution + 1.0f, -1.0f, z),
+                                             Vec3f(resolution + 1.0f, resolution + 1.0f, z), Vec3f(-1.0f, resolution + 1.0f, z) };
+                        Vertex vertices[3];
+                        vertices[0].Pos = corners[0];
+                        vertices[1].Pos = corners[1];
+                        vertices[2].Pos = corners[2];
+                        GL.Triangle(vertices, empty, shader, Vec3f(0.0f, 0.0f, 1.0f));
+                        vertices[1].Pos = corners[2];
+                        vertices[2].Pos = corners[3];
+                        GL.Triangle(vertices, empty, shader, Vec3f(0.0f, 0.0f, 1.0f));
+                    }
+                }
+                return (double)iterations * 8 * resolution * resolution;
+            } });
+        }
+    }
+
+    // Every kernel variant this machine can run, so that they can be compared against each other.
+    void AddKernelBenchmarks(std::vector<Benchmark>& benchmarks)
+    {
+        for (int level = (int)SimdLevel::Scalar; level <= (int)DetectSimdLevel(); ++level)
+        {
+            const KernelTable* kernels = &GetKernels((SimdLevel)level);
+            if (kernels->Level != (SimdLevel)level)
+                continue;
+
+            std::string prefix = std::string("kernels/") + SimdLevelName(kernels->Level) + "/";
+
+            benchmarks.push_back({ prefix + "transform_points_1k", [kernels](int iterations)
+            {
+                std::vector<float> in(3 * 1024), out(4 * 1024);
+                for (size_t i = 0; i < in.size(); ++i)
+                    in[i] = (float)(i % 17) * 0.1f;
+                Mat4 m = RandomMatrix(5);
+
+                for (int i = 0; i < iterations; ++i)
+                    kernels->TransformPoints(m.data, in.data(), out.data(), 1024);
+                floatSink = out[7];
+                return (double)iterations * 1024;
+            } });
+
+            benchmarks.push_back({ prefix + "raster_row_1k", [kernels](int iterations)
+            {
+                const int width = 1024;
+                std::vector<float> depth(width, std::numeric_limits<float>::lowest());
+                std::vector<int> x(width);
+                std::vector<float> alpha(width), beta(width), z(width);
+                RowFragments fragments = { x.data(), alpha.data(), beta.data(), z.data() };
+
+                // Every other pixel is hidden.
+                for (int i = 1; i < width; i += 2)
+                    depth[i] = std::numeric_limits<float>::max();
+                RasterRow row = { 0, width - 1, 0.0f, 1.0f / width, 0.5f, -1.0f / width, 1.0f, 2.0f, 3.0f, 0.0f, 0.0f, 0, 0 };
+                int count = 0;
+                for (int i = 0; i < iterations; ++i)
+                    count += kernels->RasterRow(row, depth.data(), fragments);
+                intSink = count;
+                return (double)iterations * width;
+            } });
+
+            // The same half hidden row against the unorm formats, half the stencil masked out in the second one.
+            benchmarks.push_back({ prefix + "raster_row_unorm16_1k", [kernels](int iterations)
+            {
+                const int width = 1024;
+                std::vector<uint16_t> depth(width, 0);
+                std::vector<int> x(width);
+                std::vector<float> alpha(width), beta(width), z(width);
+                RowFragments fragments = { x.data(), alpha.data(), beta.data(), z.data() };
+
+                for (int i = 1; i < width; i += 2)
+                    depth[i] = 0xffff;
+                RasterRow row = { 0, width - 1, 0.0f, 1.0f / width, 0.5f, -1.0f / width, 1.0f, 2.0f, 3.0f, 65534.0f / 255.0f, 65535.0f, 0, 0 };
+                int count = 0;
+                for (int i = 0; i < iterations; ++i)
+                    count += kernels->RasterRowUnorm16(row, depth.data(), fragments);
+                intSink = count;
+                return (double)iterations * width;
+            } });
+
+            benchmarks.push_back({ prefix + "raster_row_unorm24s8_1k", [kernels](int iterations)
+            {
+                const int width = 1024;
+                std::vector<uint32_t> depth(width, 0);
+                std::vector<int> x(width);
+                std::vector<float> alpha(width), beta(width), z(width);
+                RowFragments fragments = { x.data(), alpha.data(), beta.data(), z.data() };
+
+                for (int i = 0; i < width; ++i)
+                    depth[i] = (i & 1 ? 0xffffffu : 0) | (i & 2 ? 0x01000000u : 0);
+                RasterRow row = { 0, width - 1, 0.0f, 1.0f / width, 0.5f, -1.0f / width, 1.0f, 2.0f, 3.0f, 16777214.0f / 255.0f, 16777215.0f, 0x01000000, 0 };
+                int count = 0;
+                for (int i = 0; i < iterations; ++i)
+                    count += kernels->RasterRowUnorm24Stencil8(row, depth.data(), fragments);
+                intSink = count;
+                return (double)iterations * width;
+            } });
+
+            benchmarks.push_back({ prefix + "fill_800x800", [kernels](int iterations)
+            {
+                std::vector<uint32_t> buffer(800 * 800);
+                for (int i = 0; i < iterations; ++i)
+                    kernels->Fill32(buffer.data(), buffer.size(), (uint32_t)i);
+                intSink = (int)buffer[1234];
+                return (double)iterations * buffer.size();
+            } });
+
+            benchmarks.push_back({ prefix + "resolve_4x_800x800", [kernels](int iterations)
+            {
+                const size_t plane = 800 * 800;
+                std::vector<uint32_t> samples(plane * 4), out(plane);
+                for (size_t i = 0; i < samples.size(); ++i)
+                    samples[i] = (uint32_t)(i * 2654435761u);
+
+                for (int i = 0; i < iterations; ++i)
+                    kernels->ResolveSamples(samples.data(), plane, 4, out.data(), plane);
+                intSink = (int)out[1234];
+                return (double)iterations * plane;
+            } });
+
+            benchmarks.push_back({ prefix + "downsample_800x800", [kernels](int iterations)
+            {
+                std::vector<uint32_t> rows(800 * 800), out(400);
+                for (size_t i = 0; i < rows.size(); ++i)
+                    rows[i] = (uint32_t)(i * 2654435761u);
+
+                for (int i = 0; i < iterations; ++i)
+                {
+                    for (int y = 0; y < 400; ++y)
+                        kernels->DownsampleRow(rows.data() + 2 * y * 800, rows.data() + (2 * y + 1) * 800, out.data(), 400);
+                }
+                intSink = (int)out[123];
+                return (double)iterations * rows.size();
+            } });
+
+            benchmarks.push_back({ prefix + "half_to_float_800x800", [kernels](int iterations)
+            {
+                std::vector<uint16_t> halves(800 * 4);
+                std::vector<float> out(800 * 4);
+                for (size_t i = 0; i < halves.size(); ++i)
+                    halves[i] = FloatToHalf((float)(i % 1000) / 250.0f);
+
+                for (int i = 0; i < iterations; ++i)
+                {
+                    for (int y = 0; y < 800; ++y)
+                        kernels->HalfToFloatRow(halves.data(), out.data(), out.size());
+                }
+                floatSink = out[123];
+                return (double)iterations * 800 * 800;
+            } });
+
+            benchmarks.push_back({ prefix + "tone_map_800x800", [kernels](int iterations)
+            {
+                std::vector<float> colors(800 * 800 * 4);
+                std::vector<uint32_t> out(800);
+                for (size_t i = 0; i < colors.size(); ++i)
+                    colors[i] = (float)(i % 1000) / 250.0f;
+
+                for (int i = 0; i < iterations; ++i)
+                {
+                    for (int y = 0; y < 800; ++y)
+                        kernels->ToneMapRow(colors.data() + (size_t)y * 800 * 4, 1.5f, 1.0f / 16.0f, out.data(), 800);
+                }
+                intSink = (int)out[123];
+                return (double)iterations * 800 * 800;
+            } });
+        }
+    }
+
+    void AddSceneBenchmarks(std::vector<Benchmark>& benchmarks)
+    {
+        struct Scene
+        {
+            std::string Name;
+            std::function<Model()> Make;
+        };
+
+        std::vector<Scene> scenes = {
+            { "sphere_130k", []() { return MakeSphere(256, 256, 0.9f); } },
+            { "grid_32k", []() { return MakeGrid(128); } },
+            { "overdraw_stack_16", []() { return MakeOverdrawStack(16); } },
+        };
+
+        struct Resolution
+        {
+            int Width;
+            int Height;
+        };
+
+        for (const Scene& scene : scenes)
+        {
+            std::shared_ptr<Model> model = std::make_shared<Model>(scene.Make());
+
+            for (Resolution resolution : { Resolution{ 256, 256 }, Resolution{ 800, 800 }, Resolution{ 1920, 1080 } })
+            {
+                std::string name = "scene/" + scene.Name + "/" + std::to_string(resolution.Width) + "x" + std::to_string(resolution.Height);
+                benchmarks.push_back({ name, [model, resolution](int iterations)
+                {
+                    GraphicsLibrary GL(resolution.Width, resolution.Height);
+                    int size = std::min(resolution.Width, resolution.Height);
+                    GL.SetViewport((resolution.Width - size) / 2, (resolution.Height - size) / 2, size, size, 255.0f);
+                    GL.SetProjection(3.0f);
+                    GL.LookAt(Vec3f(0.0f, 0.0f, 3.0f), Vec3f(0.0f, 0.0f, 0.0f), Vec3f(0.0f, 1.0f, 0.0f));
+
+                    LambertShader shader(Vec3f(0.0f, 0.0f, 1.0f));
+                    for (int i = 0; i < iterations; ++i)
+                    {
+                        GL.Clear();
+                        DrawModel(GL, *model, shader);
+                    }
+                    return (double)iterations * model->nfaces();
+                } });
+            }
+        }
+    }
+
+    // Vertex fetch and decode through GraphicsLibrary::DrawModel, at a resolution low enough for the vertex stage to
+    // dominate. Culling and LODs are off so that every face is drawn.
+    void AddVertexFormatBenchmarks(std::vector<Benchmark>& benchmarks)
+    {
+        for (bool quantize : { false, true })
+        {
+            std::shared_ptr<Model> model = std::make_shared<Model>(MakeSphere(256, 256, 0.9f));
+            if (quantize)
+                model->quantize();
+
+            benchmarks.push_back({ std::string("vertex/sphere_130k_") + (quantize ? "quantized" : "float"), [model](int iterations)
+            {
+                GraphicsLibrary GL(256, 256);
+                GL.FrustumCulling = false;
+                GL.BackfaceCulling = false;
+                GL.LodThreshold = 0.0f;
+                GL.SetViewport(0, 0, 256, 256, 255.0f);
+                GL.SetProjection(3.0f);
+                GL.LookAt(Vec3f(0.0f, 0.0f, 3.0f), Vec3f(0.0f, 0.0f, 0.0f), Vec3f(0.0f, 1.0f, 0.0f));
+
+                LambertShader shader(Vec3f(0.0f, 0.0f, 1.0f));
+                for (int i = 0; i < iterations; ++i)
+                {
+                    GL.Clear();
+                    GL.DrawModel(*model, shader);
+                }
+                return (double)iterations * model->nfaces();
+            } });
+        }
+    }
+
+    // The same antialiased sphere with 4x multisampling, and by rendering at twice the resolution and scaling down.
+    void AddAntialiasingBenchmarks(std::vector<Benchmark>& benchmarks)
+    {
+        std::shared_ptr<Model> model = std::make_shared<Model>(MakeSphere(64, 128, 0.9f));
+
+        for (int mode = 0; mode < 3; ++mode)
+        {
+            static const char* names[] = { "aa/sphere_16k_1x", "aa/sphere_16k_msaa4", "aa/sphere_16k_ssaa4" };
+            benchmarks.push_back({ names[mode], [model, mode](int iterations)
+            {
+                const int size = 256;
+                int resolution = mode == 2 ? size * 2 : size;
+                GraphicsLibrary GL(resolution, resolution);
+                GL.SetSampleCount(mode == 1 ? 4 : 1);
+                GL.SetViewport(0, 0, resolution, resolution, 255.0f);
+                GL.SetProjection(3.0f);
+                GL.LookAt(Vec3f(0.0f, 0.0f, 3.0f), Vec3f(0.0f, 0.0f, 0.0f), Vec3f(0.0f, 1.0f, 0.0f));
+
+                LambertShader shader(Vec3f(0.0f, 0.0f, 1.0f));
+                for (int i = 0; i < iterations; ++i)
+                {
+                    GL.Clear();
+                    GL.DrawModel(*model, shader);
+                    GL.Resolve();
+                    if (mode == 2)
+                    {
+                        TGAImage image(GL.Output);
+                        image.scale(size, size);
+                        intSink = image.buffer()[0];
+                    }
+                }
+                return (double)iterations * size * size;
+            } });
+        }
+    }
+
+    struct SphereLight
+    {
+        Vec3f Direction;
+    };
+
+    struct SphereVaryings
+    {
+        Vec3f Intensity;
+    };
+
+    // LambertShader that can be binned.
+    struct DeferredLambertShader : public DeferrableShader<SphereLight, SphereVaryings>
+    {
+        Vec3f lightDirection;
+
+        DeferredLambertShader(const Vec3f& light) : lightDirection(light) {}
+
+        virtual Vec4f VertexStage(const Vertex& vec, int vertexId) override
+        {
+            Varyings.Intensity.raw[vertexId] = std::max(0.2f, vec.Normal * lightDirection);
+            return GL->Viewport * GL->Projection * GL->ModelView * Vec4f(vec.Pos);
+        }
+
+        virtual bool Shade(const SphereLight&, const SphereVaryings& varyings, const Vec3f& bar, TGAColor& color) const override
+        {
+            color = TGAColor(255, 255, 255, 255) * (bar * varyings.Intensity);
+            return true;
+        }
+    };
+
+    // Whole frames of a 4 x 4 grid of spheres: drawn directly, binned then rasterized from the bins, and through the
+    // two thread pipeline, with a few lighting and post-processing variants. None of them may allocate once warm. A set
+    // of bins spills into extra arena chunks on its first frame and gets them merged into one at the start of its
+    // second, it is warm from then on.
+    void AddFrameBenchmarks(std::vector<Benchmark>& benchmarks)
+    {
+        struct Frame
+        {
+            Model Sphere = MakeSphere(48, 96, 0.9f);
+            DeferredLambertShader Shader = DeferredLambertShader(Vec3f(0.0f, 0.0f, 1.0f));
+            Scene Spheres;
+
+            Frame()
+            {
+                for (int y = 0; y < 4; ++y)
+                {
+                    for (int x = 0; x < 4; ++x)
+                    {
+                        Mat4 local;
+                        local.Scale(Vec3f(0.25f, 0.25f, 0.25f));
+                        local.MoveTo(Vec3f(0.5f * x - 0.75f, 0.5f * y - 0.75f, 0.0f));
+                        Spheres.AddInstance(Sphere, Spheres.AddNode(local), { &Shader }, true);
+                    }
+                }
+                Spheres.UpdateTransforms();
+            }
+
+            void SetCamera(GraphicsLibrary& GL) const
+            {
+                GL.SetViewport(0, 0, 512, 512, 255.0f);
+                GL.SetProjection(3.0f);
+                GL.LookAt(Vec3f(0.0f, 0.0f, 3.0f), Vec3f(0.0f, 0.0f, 0.0f), Vec3f(0.0f, 1.0f, 0.0f));
+            }
+        };
+        std::shared_ptr<Frame> frame = std::make_shared<Frame>();
+
+        benchmarks.push_back({ "frame/spheres_16_direct", [frame](int iterations)
+        {
+            GraphicsLibrary GL(512, 512);
+            GL.OcclusionCulling = true;
+            frame->SetCamera(GL);
+
+            for (int i = 0; i < iterations; ++i)
+            {
+                GL.BeginFrame();
+                GL.Clear();
+                GL.DrawScene(frame->Spheres);
+                GL.EndFrame();
+            }
+            return (double)iterations;
+        }, 1 });
+
+        benchmarks.push_back({ "frame/spheres_16_binned", [frame](int iterations)
+        {
+            GraphicsLibrary geometry(512, 512);
+            GraphicsLibrary raster(512, 512);
+            geometry.OcclusionCulling = true;
+            frame->SetCamera(geometry);
+            FrameBins bins;
+
+            for (int i = 0; i < iterations; ++i)
+            {
+                geometry.BeginBinning(bins);
+                geometry.DrawScene(frame->Spheres);
+                geometry.EndBinning();
+                geometry.EndFrame();
+
+                raster.Clear();
+                raster.RasterizeBins(bins);
+            }
+            return (double)iterations;
+        }, 2 });
+
+        // The depth only pass of a shadow map, redrawn every frame as if the light moved.
+        benchmarks.push_back({ "frame/spheres_16_shadow_map", [frame](int iterations)
+        {
+            ShadowMap shadows(512);
+            auto draw = [&](GraphicsLibrary& GL) { GL.DrawScene(frame->Spheres); };
+
+            for (int i = 0; i < iterations; ++i)
+            {
+                shadows.Invalidate();
+                shadows.Update(Vec3f(1.0f, 1.0f, 1.0f), Vec3f(0.0f, 0.0f, 0.0f), 1.5f, 0, draw);
+                floatSink = shadows.Visibility(Vec3f(256.0f, 256.0f, 128.0f));
+            }
+            return (double)iterations;
+        }, 1 });
+
+        // Depth only pass, then 1024 point lights sorted into the tiles of the frame against its depths.
+        benchmarks.push_back({ "frame/spheres_16_tiled_lights_1024", [frame](int iterations)
+        {
+            GraphicsLibrary GL(512, 512);
+            GL.DepthOnly = true;
+            frame->SetCamera(GL);
+
+            std::vector<PointLight> lights;
+            uint32_t seed = 1;
+            auto next = [&]() { seed = seed * 1664525u + 1013904223u; return (seed >> 8) / 16777216.0f; };
+            for (int i = 0; i < 1024; ++i)
+                lights.push_back({ Vec3f(2.0f * next() - 1.0f, 2.0f * next() - 1.0f, next() - 0.5f), 0.1f + 0.2f * next(), Vec3f(1.0f, 1.0f, 1.0f) });
+
+            TiledLights tiles;
+            for (int i = 0; i < iterations; ++i)
+            {
+                GL.BeginFrame();
+                GL.Clear();
+                GL.DrawScene(frame->Spheres);
+                tiles.Build(GL, lights);
+                GL.EndFrame();
+                intSink = (int)tiles.ListedCount();
+            }
+            return (double)iterations;
+        }, 1 });
+
+        // A frame darkened by screen space ambient occlusion.
+        benchmarks.push_back({ "frame/spheres_16_ssao", [frame](int iterations)
+        {
+            GraphicsLibrary GL(512, 512);
+            frame->SetCamera(GL);
+            AmbientOcclusion ambientOcclusion;
+
+            for (int i = 0; i < iterations; ++i)
+            {
+                GL.BeginFrame();
+                GL.Clear();
+                GL.DrawScene(frame->Spheres);
+                ambientOcclusion.Apply(GL);
+                GL.EndFrame();
+                intSink = GL.Output.buffer()[0];
+            }
+            return (double)iterations;
+        }, 1 });
+
+        // A frame drawn into a half float framebuffer, then tone mapped.
+        benchmarks.push_back({ "frame/spheres_16_hdr", [frame](int iterations)
+        {
+            GraphicsLibrary GL(512, 512);
+            GL.SetColorFormat(ColorFormat::Rgba16F);
+            frame->SetCamera(GL);
+
+            for (int i = 0; i < iterations; ++i)
+            {
+                GL.BeginFrame();
+                GL.Clear();
+                GL.DrawScene(frame->Spheres);
+                GL.Resolve();
+                GL.EndFrame();
+                intSink = GL.Output.buffer()[0];
+            }
+            return (double)iterations;
+        }, 1 });
+
+        // A post-processing chain of every operator over a drawn frame, the frame drawn once.
+        benchmarks.push_back({ "frame/spheres_16_post_chain", [frame](int iterations)
+        {
+            GraphicsLibrary GL(512, 512);
+            frame->SetCamera(GL);
+            GL.Clear();
+            GL.DrawScene(frame->Spheres);
+
+            unsigned char curve[256];
+            for (int i = 0; i < 256; ++i)
+                curve[i] = (unsigned char)(255 - i);
+            PostProcess post;
+            post.ToneMap(2.0f);
+            post.Lut(curve, curve, curve);
+            post.Downsample();
+            post.Gamma(2.2f);
+            TGAImage image;
+
+            for (int i = 0; i < iterations; ++i)
+            {
+                post.Apply(GL, image);
+                intSink = image.buffer()[0];
+            }
+            return (double)iterations;
+        }, 1 });
+
+        // The two sets of bins take turns, the pipeline is warm from frame 4.
+        benchmarks.push_back({ "frame/spheres_16_pipelined", [frame](int iterations)
+        {
+            GraphicsLibrary geometry(512, 512);
+            GraphicsLibrary raster(512, 512);
+            geometry.OcclusionCulling = true;
+            frame->SetCamera(geometry);
+
+            FramePipeline::Stages stages;
+            stages.Geometry = [&](GraphicsLibrary& GL, int)
+            {
+                GL.DrawScene(frame->Spheres);
+            };
+            stages.Output = [](GraphicsLibrary& GL, int)
+            {
+                intSink = GL.Output.buffer()[0];
+                return true;
+            };
+
+            FramePipeline pipeline(geometry, raster);
+            pipeline.Run(iterations, stages);
+            return (double)iterations;
+        }, 4 });
+    }
+
+    // Output
+
+    std::string JsonEscape(const std::string& s)
+    {
+        std::string result;
+        for (char c : s)
+        {
+            if (c == '"' || c == '\\')
+                result += '\\';
+            result += c;
+        }
+        return result;
+    }
+
+    void WriteJson(std::ostream& s, const std::vector<Result>& results)
+    {
+        s << "{\n\"context\": {\"date\": \"" << __DATE__ << " " << __TIME__ << "\", \"compiler\": \""
+#if defined(__clang__)
+          << "clang " << __clang_version__
+#elif defined(__GNUC__)
+          << "gcc " << __VERSION__
+#elif defined(_MSC_VER)
+          << "msvc " << _MSC_VER
+#endif
+          << "\"},\n\"benchmarks\": [\n";
+
+        for (size_t i = 0; i < results.size(); ++i)
+        {
+            const Result& r = results[i];
+            s << "{\"name\": \"" << JsonEscape(r.Name) << "\", \"iterations\": " << r.Iterations << ", \"real_time\": " << r.NsPerIteration
+              << ", \"time_unit\": \"ns\", \"items_per_second\": " << r.ItemsPerSecond << ", \"steady_allocations\": " << r.SteadyAllocations << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+        }
+
+        s << "]\n}\n";
+    }
+
+    // Reads back files produced by WriteJson, one benchmark per line.
+    std::map<std::string, double> ReadBaseline(const std::string& path)
+    {
+        std::map<std::string, double> baseline;
+        std::ifstream in(path);
+        std::string line;
+        while (std::getline(in, line))
+        {
+            size_t name = line.find("\"name\": \"");
+            size_t time = line.find("\"real_time\": ");
+            if (name == std::string::npos || time == std::string::npos)
+                continue;
+
+            name += 9;
+            baseline[line.substr(name, line.find('"', name) - name)] = std::atof(line.c_str() + time + 13);
+        }
+        return baseline;
+    }
+
+    void PrintUsage(const char* program)
+    {
+        std::cerr << "Usage: " << program << " [--filter <substring>] [--out <json>] [--baseline <json>] [--threshold <percent>]"
+                  << " [--min-time <seconds>] [--repetitions <count>] [--allocations]" << std::endl;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    Options options;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--filter" && i + 1 < argc)
+            options.Filter = argv[++i];
+        else if (arg == "--out" && i + 1 < argc)
+            options.OutputPath = argv[++i];
+        else if (arg == "--baseline" && i + 1 < argc)
+            options.BaselinePath = argv[++i];
+        else if (arg == "--threshold" && i + 1 < argc)
+            options.Threshold = std::atof(argv[++i]);
+        else if (arg == "--min-time" && i + 1 < argc)
+            options.MinTime = std::atof(argv[++i]);
+        else if (arg == "--repetitions" && i + 1 < argc)
+            options.Repetitions = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--allocations")
+            options.AllocationsOnly = true;
+        else
+        {
+            PrintUsage(argv[0]);
+            return 1;
+        }
+    }
+
+    std::vector<Benchmark> benchmarks;
+    AddMatrixBenchmarks(benchmarks);
+    AddIOBenchmarks(benchmarks);
+    AddKernelBenchmarks(benchmarks);
+    AddRasterBenchmarks(benchmarks);
+    AddOverdrawBenchmarks(benchmarks);
+    AddSceneBenchmarks(benchmarks);
+    AddVertexFormatBenchmarks(benchmarks);
+    AddAntialiasingBenchmarks(benchmarks);
+    AddFrameBenchmarks(benchmarks);
+
+    std::vector<Result> results;
+    int allocating = 0;
+    for (const Benchmark& benchmark : benchmarks)
+    {
+        if (!options.Filter.empty() && benchmark.Name.find(options.Filter) == std::string::npos)
+            continue;
+
+        if (benchmark.Setup)
+        {
+            std::streambuf* log = std::cerr.rdbuf(nullptr);
+            benchmark.Setup();
+            std::cerr.rdbuf(log);
+            std::cerr.clear();
+        }
+
+        if (options.AllocationsOnly)
+        {
+            if (benchmark.WarmupIterations < 0)
+                continue;
+            uint64_t steadyAllocations = CountSteadyAllocations(benchmark);
+            std::fprintf(stderr, "%-44s %llu allocations in %d iterations after warm up%s\n", benchmark.Name.c_str(),
+                (unsigned long long)steadyAllocations, SteadyIterations, steadyAllocations > 0 ? "  ALLOCATES" : "");
+            allocating += steadyAllocations > 0;
+            continue;
+        }
+
+        Result result = Run(benchmark, options);
+        std::fprintf(stderr, "%-44s %14.1f ns %12d iterations %14.4g items/s\n", result.Name.c_str(), result.NsPerIteration, result.Iterations, result.ItemsPerSecond);
+        if (result.SteadyAllocations > 0)
+        {
+            std::fprintf(stderr, "%-44s %llu allocations in %d iterations after warm up  ALLOCATES\n", result.Name.c_str(), (unsigned long long)result.SteadyAllocations, SteadyIterations);
+            ++allocating;
+        }
+        results.push_back(result);
+    }
+
+    if (options.AllocationsOnly)
+        return allocating > 0 ? 3 : 0;
+
+    if (options.OutputPath.empty())
+    {
+        WriteJson(std::cout, results);
+    }
+    else
+    {
+        std::ofstream out(options.OutputPath);
+        WriteJson(out, results);
+    }
+
+    int regressions = 0;
+    if (!options.BaselinePath.empty())
+    {
+        std::map<std::string, double> baseline = ReadBaseline(options.BaselinePath);
+        for (const Result& result : results)
+        {
+            auto previous = baseline.find(result.Name);
+            if (previous == baseline.end() || previous->second <= 0.0)
+                continue;
+
+            double change = (result.NsPerIteration / previous->second - 1.0) * 100.0;
+            bool regressed = change > options.Threshold;
+            regressions += regressed;
+            std::fprintf(stderr, "%-44s %+8.1f%%%s\n", result.Name.c_str(), change, regressed ? "  REGRESSION" : "");
+        }
+    }
+
+    if (regressions > 0)
+        return 2;
+    return allocating > 0 ? 3 : 0;
+}
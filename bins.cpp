@@ -0,0 +1,31 @@
+#include "bins.h"
+#include <cstring>
+
+void FrameBins::Reset(int w, int h)
+{
+    width = w;
+    height = h;
+    tilesX = (w + TileSize - 1) / TileSize;
+    tilesY = (h + TileSize - 1) / TileSize;
+
+    triangleCount = 0;
+    arena.Reset();
+    tiles.resize((size_t)tilesX * tilesY);
+    for (ArenaList<const BinnedTriangle*>& tile : tiles)
+        tile.Clear();
+}
+
+const void* FrameBins::AddData(const void* source, size_t size)
+{
+    void* data = arena.Allocate(size, 16);
+    std::memcpy(data, source, size);
+    return data;
+}
+
+const BinnedTriangle* FrameBins::AddTriangle(const BinnedTriangle& triangle)
+{
+    BinnedTriangle* copy = arena.Allocate<BinnedTriangle>(1);
+    *copy = triangle;
+    ++triangleCount;
+    return copy;
+}
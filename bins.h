@@ -0,0 +1,62 @@
+#pragma once
+
+#include "geometry.h"
+#include "raster.h"
+#include "arena.h"
+#include <cstdint>
+#include <vector>
+
+struct IShader;
+
+// Triangle past setup, waiting to be rasterized. Uniforms and Varyings point to copies of the shader's blocks.
+struct BinnedTriangle
+{
+    Vec3f A, B, C;
+    FixedTriangle Fixed;
+    float Denominator;
+    const IShader* Shader;
+    const void* Uniforms;
+    const void* Varyings;
+};
+
+// Triangles of a frame sorted into TileSize x TileSize screen tiles, each tile listing them in submission order.
+// Everything a triangle needs to be rasterized and shaded is copied in, so the bins of a frame can be rasterized
+// while the geometry of the next one is binned into another set. Triangles, shader blocks and tile lists all live in
+// the bins' own arena, which Reset rewinds.
+class FrameBins
+{
+public:
+    static constexpr int TileSize = 64;
+
+    // Empties the bins for a screen of the given size, keeping their memory.
+    void Reset(int width, int height);
+
+    // Memory used by the current frame and held for the next ones.
+    size_t BytesUsed() const { return arena.Used(); }
+    size_t BytesReserved() const { return arena.Capacity(); }
+
+    int Width() const { return width; }
+    int Height() const { return height; }
+    int TilesX() const { return tilesX; }
+    int TilesY() const { return tilesY; }
+    size_t TriangleCount() const { return triangleCount; }
+
+    // Copies size bytes, 16 byte aligned.
+    const void* AddData(const void* data, size_t size);
+
+    const BinnedTriangle* AddTriangle(const BinnedTriangle& triangle);
+
+    void AddToTile(int tileX, int tileY, const BinnedTriangle* triangle) { tiles[tileY * tilesX + tileX].Push(arena, triangle); }
+    const ArenaList<const BinnedTriangle*>& Tile(int tileX, int tileY) const { return tiles[tileY * tilesX + tileX]; }
+
+private:
+    int width = 0;
+    int height = 0;
+    int tilesX = 0;
+    int tilesY = 0;
+
+    size_t triangleCount = 0;
+
+    FrameArena arena;
+    std::vector<ArenaList<const BinnedTriangle*> > tiles;
+};
@@ -0,0 +1,190 @@
+#include "culling.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+AABB::AABB() :
+    Min(std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max()),
+    Max(std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest())
+{
+}
+
+void AABB::Extend(const Vec3f& point)
+{
+    for (int i = 0; i < 3; ++i)
+    {
+        Min.raw[i] = std::min(Min.raw[i], point.raw[i]);
+        Max.raw[i] = std::max(Max.raw[i], point.raw[i]);
+    }
+}
+
+void AABB::Extend(const AABB& box)
+{
+    if (box.Empty())
+        return;
+
+    Extend(box.Min);
+    Extend(box.Max);
+}
+
+AABB AABB::Transform(const Mat4& mat) const
+{
+    AABB result;
+    if (Empty())
+        return result;
+
+    for (int i = 0; i < 8; ++i)
+    {
+        Vec3f corner((i & 1) ? Max.x : Min.x, (i & 2) ? Max.y : Min.y, (i & 4) ? Max.z : Min.z);
+        Vec4f p = mat * Vec4f(corner);
+        result.Extend(Vec3f(p.x / p.w, p.y / p.w, p.z / p.w));
+    }
+
+    return result;
+}
+
+static Vec4f row(const Mat4& m, int y)
+{
+    return Vec4f(m.Get(0, y), m.Get(1, y), m.Get(2, y), m.Get(3, y));
+}
+
+static Vec4f combine(const Vec4f& a, float scaleA, const Vec4f& b, float scaleB)
+{
+    return Vec4f(a.x * scaleA + b.x * scaleB, a.y * scaleA + b.y * scaleB, a.z * scaleA + b.z * scaleB, a.w * scaleA + b.w * scaleB);
+}
+
+Frustum Frustum::FromScreenTransform(const Mat4& transform, float minX, float minY, float maxX, float maxY)
+{
+    // Screen x = X / W, so minX <= x <= maxX with W > 0 becomes X - minX * W >= 0 and maxX * W - X >= 0.
+    Vec4f x = row(transform, 0);
+    Vec4f y = row(transform, 1);
+    Vec4f w = row(transform, 3);
+
+    Frustum frustum;
+    frustum.Planes[0] = combine(x, 1.0f, w, -minX);
+    frustum.Planes[1] = combine(w, maxX, x, -1.0f);
+    frustum.Planes[2] = combine(y, 1.0f, w, -minY);
+    frustum.Planes[3] = combine(w, maxY, y, -1.0f);
+    frustum.Planes[4] = w;
+
+    return frustum;
+}
+
+Visibility Frustum::Classify(const AABB& box) const
+{
+    if (box.Empty())
+        return Visibility::Outside;
+
+    Visibility result = Visibility::Inside;
+    for (const Vec4f& plane : Planes)
+    {
+        // Corners furthest along and against the plane normal.
+        float far = plane.w, near = plane.w;
+        for (int i = 0; i < 3; ++i)
+        {
+            float a = plane.raw[i] * box.Min.raw[i];
+            float b = plane.raw[i] * box.Max.raw[i];
+            far += std::max(a, b);
+            near += std::min(a, b);
+        }
+
+        if (far < 0.0f)
+            return Visibility::Outside;
+        if (near < 0.0f)
+            result = Visibility::Intersecting;
+    }
+
+    return result;
+}
+
+Vec3f EyePosition(const Mat4& transform)
+{
+    // The eye projects to (0, 0, z, 0), any z.
+    Vec4f eye = transform.Inverse() * Vec4f(0.0f, 0.0f, 1.0f, 0.0f);
+    if (eye.w == 0.0f)
+        return Vec3f(eye.x, eye.y, eye.z) * std::numeric_limits<float>::max();
+
+    return Vec3f(eye.x / eye.w, eye.y / eye.w, eye.z / eye.w);
+}
+
+bool IsBackfacing(const Cluster& cluster, const Vec3f& eye)
+{
+    const NormalCone& cone = cluster.Cone;
+    if (cone.Cutoff <= 0.0f)
+        return false;
+
+    Vec3f toCluster = cluster.Center - eye;
+    float distance = toCluster.norm();
+    if (distance <= cluster.Radius)
+        return false;
+
+    // Every view direction is within asin(radius / distance) of the direction to the center, every normal within
+    // acos(cutoff) of the axis. When those angles and the one between axis and center stay below 90 degrees, each
+    // face normal points away from the eye.
+    float sinView = cluster.Radius / distance;
+    float cosView = std::sqrt(1.0f - sinView * sinView);
+    float sinCone = std::sqrt(1.0f - cone.Cutoff * cone.Cutoff);
+    float sinSum = sinCone * cosView + cone.Cutoff * sinView;
+
+    // The sum of both angles must itself be below 90 degrees.
+    if (cone.Cutoff * cosView - sinCone * sinView <= 0.0f)
+        return false;
+
+    return (toCluster * cone.Axis) > sinSum * distance;
+}
+
+void BVH::Build(const std::vector<AABB>& boxes, int leafSize)
+{
+    Nodes.clear();
+    Items.resize(boxes.size());
+    if (boxes.empty())
+        return;
+
+    std::vector<Vec3f> centers(boxes.size());
+    for (size_t i = 0; i < boxes.size(); ++i)
+    {
+        Items[i] = (int)i;
+        centers[i] = boxes[i].Center();
+    }
+
+    leafSize = std::max(1, leafSize);
+    Nodes.reserve(2 * boxes.size() / leafSize + 1);
+    Nodes.push_back(Node());
+    BuildNode(boxes, centers, 0, 0, (int)boxes.size(), leafSize);
+}
+
+void BVH::BuildNode(const std::vector<AABB>& boxes, const std::vector<Vec3f>& centers, int index, int begin, int end, int leafSize)
+{
+    AABB box, centerBox;
+    for (int i = begin; i < end; ++i)
+    {
+        box.Extend(boxes[Items[i]]);
+        centerBox.Extend(centers[Items[i]]);
+    }
+
+    Nodes[index].Box = box;
+    if (end - begin <= leafSize)
+    {
+        Nodes[index].First = begin;
+        Nodes[index].Count = end - begin;
+        return;
+    }
+
+    // Median split along the axis where the item centers spread the most.
+    Vec3f extent = centerBox.Max - centerBox.Min;
+    int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+    int middle = (begin + end) / 2;
+    std::nth_element(Items.begin() + begin, Items.begin() + middle, Items.begin() + end, [&](int a, int b)
+    {
+        return centers[a].raw[axis] < centers[b].raw[axis];
+    });
+
+    int children = (int)Nodes.size();
+    Nodes[index].First = children;
+    Nodes[index].Count = 0;
+    Nodes.push_back(Node());
+    Nodes.push_back(Node());
+
+    BuildNode(boxes, centers, children, begin, middle, leafSize);
+    BuildNode(boxes, centers, children + 1, middle, end, leafSize);
+}
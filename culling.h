@@ -0,0 +1,137 @@
+#pragma once
+
+#include "geometry.h"
+#include "matrix.h"
+#include <vector>
+
+struct AABB
+{
+    Vec3f Min;
+    Vec3f Max;
+
+    AABB();
+    AABB(const Vec3f& min, const Vec3f& max) : Min(min), Max(max) {}
+
+    bool Empty() const { return Min.x > Max.x; }
+    Vec3f Center() const { return (Min + Max) * 0.5f; }
+
+    void Extend(const Vec3f& point);
+    void Extend(const AABB& box);
+
+    // Bounds of the eight transformed corners.
+    AABB Transform(const Mat4& mat) const;
+};
+
+// Directions of a group of faces: every face normal is within acos(Cutoff) of Axis.
+// Cutoff <= 0 means the faces span a half space or more and the cone can't be used for culling.
+struct NormalCone
+{
+    Vec3f Axis;
+    float Cutoff;
+};
+
+// Contiguous range of faces of a mesh, kept spatially coherent so it can be culled as a whole.
+struct Cluster
+{
+    int FirstFace;
+    int FaceCount;
+    AABB Box;
+    Vec3f Center;
+    float Radius;
+    NormalCone Cone;
+};
+
+enum class Visibility
+{
+    Outside,
+    Intersecting,
+    Inside
+};
+
+// Screen rectangle seen through a transform to screen space (Viewport * Projection * ModelView), in the space the
+// transform starts from. Planes are (a, b, c, d) with a * x + b * y + c * z + d >= 0 inside, the fifth plane rejects
+// what is behind the eye.
+struct Frustum
+{
+    Vec4f Planes[5];
+
+    static Frustum FromScreenTransform(const Mat4& transform, float minX, float minY, float maxX, float maxY);
+
+    Visibility Classify(const AABB& box) const;
+};
+
+// Point in the space the transform starts from that projects to infinity: the eye of a perspective projection.
+Vec3f EyePosition(const Mat4& transform);
+
+// True when every face of the cluster faces away from the eye.
+bool IsBackfacing(const Cluster& cluster, const Vec3f& eye);
+
+// Bounding volume hierarchy over boxes. Leaves reference a few item indices.
+class BVH
+{
+public:
+    struct Node
+    {
+        AABB Box;
+        int First;  // First child for inner nodes, first entry of Items for leaves.
+        int Count;  // Number of items, 0 for inner nodes which have children First and First + 1.
+    };
+
+    std::vector<Node> Nodes;
+    std::vector<int> Items;
+
+    void Build(const std::vector<AABB>& boxes, int leafSize = 4);
+
+    bool Empty() const { return Nodes.empty(); }
+
+    // Calls visit(item, fullyInside) for every item whose node is not outside the frustum.
+    template <class Visitor>
+    void Query(const Frustum& frustum, Visitor visit) const;
+
+private:
+    void BuildNode(const std::vector<AABB>& boxes, const std::vector<Vec3f>& centers, int index, int begin, int end, int leafSize);
+};
+
+template <class Visitor>
+void BVH::Query(const Frustum& frustum, Visitor visit) const
+{
+    if (Nodes.empty())
+        return;
+
+    // Node index and whether it is already known to be inside.
+    int stack[64][2];
+    int size = 0;
+    stack[size][0] = 0;
+    stack[size][1] = 0;
+    ++size;
+
+    while (size > 0)
+    {
+        --size;
+        const Node& node = Nodes[stack[size][0]];
+        bool inside = stack[size][1] != 0;
+
+        if (!inside)
+        {
+            Visibility visibility = frustum.Classify(node.Box);
+            if (visibility == Visibility::Outside)
+                continue;
+            inside = visibility == Visibility::Inside;
+        }
+
+        if (node.Count > 0)
+        {
+            for (int i = 0; i < node.Count; ++i)
+                visit(Items[node.First + i], inside);
+        }
+        else
+        {
+            stack[size][0] = node.First;
+            stack[size][1] = inside;
+            ++size;
+            stack[size][0] = node.First + 1;
+            stack[size][1] = inside;
+            ++size;
+        }
+    }
+}
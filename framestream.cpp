@@ -0,0 +1,154 @@
+#include "framestream.h"
+#include <iostream>
+#include <string>
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#endif
+
+FrameStream::FrameStream() : file(nullptr), ownsFile(false), submitIndex(0), stopping(false), failed(false)
+{
+}
+
+FrameStream::~FrameStream()
+{
+    Close();
+}
+
+bool FrameStream::Open(const char* path)
+{
+    Close();
+
+    if (std::string(path) == "-")
+    {
+#ifdef _WIN32
+        _setmode(_fileno(stdout), _O_BINARY);
+#endif
+        file = stdout;
+        ownsFile = false;
+    }
+    else
+    {
+        file = std::fopen(path, "wb");
+        ownsFile = true;
+        if (!file)
+        {
+            std::cerr << "can't open frame stream " << path << "\n";
+            return false;
+        }
+    }
+
+    submitIndex = 0;
+    stopping = false;
+    failed = false;
+    for (Slot& slot : slots)
+        slot.Ready = false;
+
+    writer = std::thread(&FrameStream::WriterLoop, this);
+    return true;
+}
+
+void FrameStream::Close()
+{
+    if (!file)
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    condition.notify_all();
+    writer.join();
+
+    if (ownsFile)
+        std::fclose(file);
+    else
+        std::fflush(file);
+
+    file = nullptr;
+}
+
+bool FrameStream::Submit(TGAImage& image)
+{
+    if (!file)
+        return false;
+
+    Slot& slot = slots[submitIndex];
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        condition.wait(lock, [&] { return !slot.Ready || failed; });
+        if (failed)
+            return false;
+    }
+
+    int width = image.get_width();
+    int height = image.get_height();
+    int bytespp = image.get_bytespp();
+    const unsigned char* source = image.buffer();
+
+    slot.Data.resize((size_t)width * height * 3);
+    unsigned char* destination = slot.Data.data();
+
+    // The renderer's origin is bottom-left, video frames are top-down.
+    for (int y = height - 1; y >= 0; --y)
+    {
+        const unsigned char* row = source + (size_t)y * width * bytespp;
+        for (int x = 0; x < width; ++x, row += bytespp, destination += 3)
+        {
+            if (bytespp == TGAImage::GRAYSCALE)
+            {
+                destination[0] = destination[1] = destination[2] = row[0];
+            }
+            else
+            {
+                destination[0] = row[2];
+                destination[1] = row[1];
+                destination[2] = row[0];
+            }
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        slot.Ready = true;
+    }
+    condition.notify_all();
+
+    submitIndex ^= 1;
+    return true;
+}
+
+void FrameStream::WriterLoop()
+{
+    int writeIndex = 0;
+
+    while (true)
+    {
+        Slot& slot = slots[writeIndex];
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            condition.wait(lock, [&] { return slot.Ready || stopping; });
+            if (!slot.Ready)
+                return;
+        }
+
+        bool ok = std::fwrite(slot.Data.data(), 1, slot.Data.size(), file) == slot.Data.size();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            slot.Ready = false;
+            if (!ok)
+            {
+                std::cerr << "can't write to frame stream\n";
+                failed = true;
+            }
+        }
+        condition.notify_all();
+
+        if (!ok)
+            return;
+
+        writeIndex ^= 1;
+    }
+}
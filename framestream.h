@@ -0,0 +1,47 @@
+#pragma once
+
+#include "tgaimage.h"
+#include <cstdio>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+
+// Streams successive frames as raw top-down RGB24 (e.g. for "ffmpeg -f rawvideo -pix_fmt rgb24").
+// Two frame buffers are used so the next frame can be rendered while a background thread writes the previous one.
+class FrameStream
+{
+public:
+    FrameStream();
+    ~FrameStream();
+
+    // "-" writes to stdout, anything else is opened as a file (which may be a named pipe).
+    bool Open(const char* path);
+    void Close();
+
+    bool IsOpen() const { return file != nullptr; }
+
+    // Copies the image into a free buffer and queues it for writing. Blocks only while both buffers are in flight.
+    bool Submit(TGAImage& image);
+
+private:
+    struct Slot
+    {
+        std::vector<unsigned char> Data;
+        bool Ready = false;
+    };
+
+    void WriterLoop();
+
+    FILE* file;
+    bool ownsFile;
+
+    Slot slots[2];
+    int submitIndex;
+    bool stopping;
+    bool failed;
+
+    std::thread writer;
+    std::mutex mutex;
+    std::condition_variable condition;
+};
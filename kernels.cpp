@@ -0,0 +1,117 @@
+#include "kernels.h"
+#include <cstring>
+
+#if defined(KERNELS_X86) && defined(_MSC_VER)
+#include <intrin.h>
+#include <immintrin.h>
+#elif defined(KERNELS_X86)
+#include <cpuid.h>
+#endif
+
+#ifdef KERNELS_X86
+static void cpuid(unsigned leaf, unsigned subleaf, unsigned regs[4])
+{
+#ifdef _MSC_VER
+    int info[4];
+    __cpuidex(info, (int)leaf, (int)subleaf);
+    for (int i = 0; i < 4; ++i)
+        regs[i] = (unsigned)info[i];
+#else
+    __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+static unsigned long long xgetbv0()
+{
+#ifdef _MSC_VER
+    return _xgetbv(0);
+#else
+    unsigned eax, edx;
+    __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return ((unsigned long long)edx << 32) | eax;
+#endif
+}
+#endif
+
+SimdLevel DetectSimdLevel()
+{
+#ifdef KERNELS_X86
+    unsigned regs[4];
+    cpuid(0, 0, regs);
+    unsigned maxLeaf = regs[0];
+
+    cpuid(1, 0, regs);
+    bool sse2 = (regs[3] >> 26) & 1;
+    bool osxsave = (regs[2] >> 27) & 1;
+    bool avx = (regs[2] >> 28) & 1;
+    bool f16c = (regs[2] >> 29) & 1;
+
+    if (!sse2)
+        return SimdLevel::Scalar;
+
+    if (!osxsave || !avx || maxLeaf < 7)
+        return SimdLevel::SSE2;
+
+    // The OS has to save the ymm (and zmm) registers on context switches.
+    unsigned long long xcr0 = xgetbv0();
+    if ((xcr0 & 0x6) != 0x6)
+        return SimdLevel::SSE2;
+
+    cpuid(7, 0, regs);
+    bool avx2 = (regs[1] >> 5) & 1;
+    bool avx512f = (regs[1] >> 16) & 1;
+    bool avx512dq = (regs[1] >> 17) & 1;
+    bool avx512bw = (regs[1] >> 30) & 1;
+    bool avx512vl = (regs[1] >> 31) & 1;
+
+    // The AVX2 kernels convert half floats with F16C.
+    if (!avx2 || !f16c)
+        return SimdLevel::SSE2;
+
+    if (avx512f && avx512dq && avx512bw && avx512vl && (xcr0 & 0xe6) == 0xe6)
+        return SimdLevel::AVX512;
+
+    return SimdLevel::AVX2;
+#else
+    return SimdLevel::Scalar;
+#endif
+}
+
+static const char* levelNames[] = { "scalar", "sse2", "avx2", "avx512", "auto" };
+
+const char* SimdLevelName(SimdLevel level)
+{
+    return levelNames[(int)level];
+}
+
+bool ParseSimdLevel(const char* name, SimdLevel& level)
+{
+    for (int i = 0; i <= (int)SimdLevel::Auto; ++i)
+    {
+        if (std::strcmp(name, levelNames[i]) == 0)
+        {
+            level = (SimdLevel)i;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+const KernelTable& GetKernels(SimdLevel level)
+{
+    static const SimdLevel detected = DetectSimdLevel();
+
+    if (level == SimdLevel::Auto || level > detected)
+        level = detected;
+
+    const KernelTable* (*factories[])() = { GetScalarKernels, GetSSE2Kernels, GetAVX2Kernels, GetAVX512Kernels };
+
+    for (int i = (int)level; i > 0; --i)
+    {
+        if (const KernelTable* table = factories[i]())
+            return *table;
+    }
+
+    return *GetScalarKernels();
+}
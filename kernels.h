@@ -0,0 +1,207 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Hot loops of the renderer compiled for several instruction sets. The table is picked once at runtime with cpuid,
+// so a single binary can use AVX-512 where available and still run on SSE2-only machines.
+// Every variant produces bit-identical results, kernel sources are built without floating point contraction.
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define KERNELS_X86 1
+#endif
+
+enum class SimdLevel
+{
+    Scalar,
+    SSE2,
+    AVX2,
+    AVX512,
+    Auto
+};
+
+// Highest level supported by both the CPU and the OS.
+SimdLevel DetectSimdLevel();
+
+const char* SimdLevelName(SimdLevel level);
+bool ParseSimdLevel(const char* name, SimdLevel& level);
+
+// Pixels MinX..MaxX of a row, all covered by a triangle: the barycentric weights of its second and third vertices are
+// affine in x.
+// Unorm depth buffers store min(max(depth * DepthScale + 1.5, 1), DepthMax) truncated, 0 being the cleared value.
+// With a stencil, pixels whose stencil bits masked by StencilMask differ from StencilReference are rejected. Both are
+// in place, in the top byte.
+struct RasterRow
+{
+    int MinX;
+    int MaxX;
+    float AlphaY;
+    float AlphaDx;
+    float BetaY;
+    float BetaDx;
+    float ZA;
+    float ZB;
+    float ZC;
+    float DepthScale;
+    float DepthMax;
+    uint32_t StencilMask;
+    uint32_t StencilReference;
+};
+
+// Structure of arrays receiving the fragments of a row, each array holds at least the row width.
+struct RowFragments
+{
+    int* X;
+    float* Alpha;
+    float* Beta;
+    float* Depth;
+};
+
+// Ambient occlusion of Width pixels of a row of depths starting at Depth, rows Stride floats apart. Samples holds
+// SampleCount offsets, in floats, from a pixel to the depths sampled around it, SampleX and SampleY the same offsets
+// in pixels. Samples and the neighbours of every pixel must all be readable.
+// The surface of a pixel is the plane of its depth and of the smaller of its one-sided depth differences along x and
+// y. A sample closer than that plane by diff > Bias occludes the pixel by max(1 - (diff - Bias) * InverseRange, 0),
+// Out receives 1 - Scale * the sum of those.
+struct OcclusionRow
+{
+    const float* Depth;
+    ptrdiff_t Stride;
+    const ptrdiff_t* Samples;
+    const float* SampleX;
+    const float* SampleY;
+    int SampleCount;
+    int Width;
+    float Bias;
+    float InverseRange;
+    float Scale;
+    float* Out;
+};
+
+// Depth aware upsampling of half resolution occlusion into Width pixels of a row. Pixel x blends texel x / 2 of the
+// coarse rows and its neighbour on the side of x, weighted 3/4 and 1/4, the rows weighted Weight0 and Weight1. Each
+// weight is divided by 1 + min(|Depth[x] - coarse depth| * Sharpness, 1e6). Coarse rows are read from -1 to
+// (Width + 1) / 2.
+struct UpsampleRow
+{
+    const float* Depth;
+    const float* CoarseDepth0;
+    const float* CoarseOcclusion0;
+    const float* CoarseDepth1;
+    const float* CoarseOcclusion1;
+    int Width;
+    float Weight0;
+    float Weight1;
+    float Sharpness;
+    float* Out;
+};
+
+struct KernelTable
+{
+    SimdLevel Level;
+
+    // out[i] = matrix * (in[i], 1). The matrix is row-major like Mat4::data, in is xyz triplets and out xyzw.
+    void (*TransformPoints)(const float* matrix, const float* in, float* out, int count);
+
+    // Writes the pixels of the row whose depth is greater than depthRow[x], returns how many were written.
+    int (*RasterRow)(const RasterRow& row, const float* depthRow, RowFragments& out);
+
+    // The same against 16-bit unorm depths and 24-bit unorm depths under an 8-bit stencil. out.Depth receives the
+    // depths converted to the buffer's values, which floats hold exactly.
+    int (*RasterRowUnorm16)(const ::RasterRow& row, const uint16_t* depthRow, RowFragments& out);
+    int (*RasterRowUnorm24Stencil8)(const ::RasterRow& row, const uint32_t* depthRow, RowFragments& out);
+
+    void (*Fill32)(uint32_t* destination, size_t count, uint32_t value);
+
+    // Averages each byte of the sampleCount values samples[s * planeStride + i] into out[i], rounding to nearest.
+    // sampleCount is 1, 2, 4 or 8.
+    void (*ResolveSamples)(const uint32_t* samples, size_t planeStride, int sampleCount, uint32_t* out, size_t count);
+
+    void (*OcclusionRow)(const ::OcclusionRow& row);
+    void (*UpsampleRow)(const ::UpsampleRow& row);
+
+    // Grey pixels of depths: out[i] = 0xff000000 | g * 0x010101, g = (int)min(max((depth[i] - offset) * scale + 0.5, 0),
+    // 255). scale >= 0, cleared depths and those below offset are black.
+    void (*DepthToGrayRow)(const float* depth, float offset, float scale, uint32_t* out, size_t count);
+
+    // Each byte of out[i] is the average of those of row0[2i], row0[2i + 1], row1[2i] and row1[2i + 1], rounding to
+    // nearest, ties up.
+    void (*DownsampleRow)(const uint32_t* row0, const uint32_t* row1, uint32_t* out, size_t count);
+
+    // out[i] = HalfToFloat(in[i]).
+    void (*HalfToFloatRow)(const uint16_t* in, float* out, size_t count);
+
+    // count pixels of blue, green, red and alpha floats into 8-bit pixels. Colors c become x * (1 + x * inverseWhite2) /
+    // (1 + x), x = max(c, 0) * exposure, alpha is kept. Each channel v is then stored as (int)min(max(v * 255 + 0.5, 0),
+    // 255), where max and min return their second argument when the first is NaN.
+    void (*ToneMapRow)(const float* in, float exposure, float inverseWhite2, uint32_t* out, size_t count);
+};
+
+// IEEE half precision conversions. FloatToHalf rounds to nearest even, like the F16C instructions.
+inline uint16_t FloatToHalf(float value)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    uint32_t sign = (bits >> 16) & 0x8000;
+    uint32_t magnitude = bits & 0x7fffffff;
+
+    if (magnitude > 0x7f800000)
+        return (uint16_t)(sign | 0x7e00 | ((magnitude >> 13) & 0x3ff));
+    // 65520 and above round to infinity.
+    if (magnitude >= 0x477ff000)
+        return (uint16_t)(sign | 0x7c00);
+
+    uint32_t half, remainder, halfway;
+    if (magnitude >= 0x38800000)
+    {
+        half = (magnitude - 0x38000000) >> 13;
+        remainder = magnitude & 0x1fff;
+        halfway = 0x1000;
+    }
+    else
+    {
+        // Subnormal halves, in units of 2^-24.
+        int shift = 126 - (int)(magnitude >> 23);
+        if (shift > 24)
+            return (uint16_t)sign;
+        uint32_t mantissa = (magnitude & 0x7fffff) | 0x800000;
+        half = mantissa >> shift;
+        remainder = mantissa & ((1u << shift) - 1);
+        halfway = 1u << (shift - 1);
+    }
+    half += remainder > halfway || (remainder == halfway && (half & 1));
+    return (uint16_t)(sign | half);
+}
+
+inline float HalfToFloat(uint16_t half)
+{
+    uint32_t sign = (uint32_t)(half & 0x8000) << 16;
+    uint32_t exponent = (half >> 10) & 0x1f;
+    uint32_t mantissa = half & 0x3ff;
+
+    uint32_t bits;
+    if (exponent == 0)
+    {
+        // Subnormals and zeros: the product is exact.
+        float magnitude = mantissa * 5.9604644775390625e-8f;
+        std::memcpy(&bits, &magnitude, sizeof(bits));
+        bits |= sign;
+    }
+    else if (exponent == 31)
+        bits = sign | 0x7f800000 | (mantissa << 13) | (mantissa ? 0x400000 : 0);
+    else
+        bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// Best table not above the requested level and supported by this CPU. Auto picks the detected level.
+const KernelTable& GetKernels(SimdLevel level = SimdLevel::Auto);
+
+const KernelTable* GetScalarKernels();
+const KernelTable* GetSSE2Kernels();
+const KernelTable* GetAVX2Kernels();
+const KernelTable* GetAVX512Kernels();
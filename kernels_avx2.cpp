@@ -0,0 +1,474 @@
+#include "kernels.h"
+
+#ifdef KERNELS_X86
+#include <immintrin.h>
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    // Two points per iteration, one in each 128-bit lane.
+    void TransformPoints(const float* m, const float* in, float* out, int count)
+    {
+        __m256 c0 = _mm256_setr_ps(m[0], m[4], m[8], m[12], m[0], m[4], m[8], m[12]);
+        __m256 c1 = _mm256_setr_ps(m[1], m[5], m[9], m[13], m[1], m[5], m[9], m[13]);
+        __m256 c2 = _mm256_setr_ps(m[2], m[6], m[10], m[14], m[2], m[6], m[10], m[14]);
+        __m256 c3 = _mm256_setr_ps(m[3], m[7], m[11], m[15], m[3], m[7], m[11], m[15]);
+
+        int i = 0;
+        for (; i + 2 <= count; i += 2, in += 6, out += 8)
+        {
+            __m256 x = _mm256_setr_ps(in[0], in[0], in[0], in[0], in[3], in[3], in[3], in[3]);
+            __m256 y = _mm256_setr_ps(in[1], in[1], in[1], in[1], in[4], in[4], in[4], in[4]);
+            __m256 z = _mm256_setr_ps(in[2], in[2], in[2], in[2], in[5], in[5], in[5], in[5]);
+            __m256 r = _mm256_add_ps(_mm256_mul_ps(c0, x), _mm256_mul_ps(c1, y));
+            r = _mm256_add_ps(r, _mm256_mul_ps(c2, z));
+            _mm256_storeu_ps(out, _mm256_add_ps(r, c3));
+        }
+
+        if (i < count)
+            GetScalarKernels()->TransformPoints(m, in, out, count - i);
+    }
+
+    int RasterRow(const ::RasterRow& row, const float* depthRow, RowFragments& out)
+    {
+        const __m256 one = _mm256_set1_ps(1.0f);
+        const __m256 lanes = _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f);
+        const __m256 alphaY = _mm256_set1_ps(row.AlphaY);
+        const __m256 alphaDx = _mm256_set1_ps(row.AlphaDx);
+        const __m256 betaY = _mm256_set1_ps(row.BetaY);
+        const __m256 betaDx = _mm256_set1_ps(row.BetaDx);
+        const __m256 za = _mm256_set1_ps(row.ZA);
+        const __m256 zb = _mm256_set1_ps(row.ZB);
+        const __m256 zc = _mm256_set1_ps(row.ZC);
+
+        alignas(32) float alphas[8], betas[8], depths[8];
+
+        int count = 0;
+        int x = row.MinX;
+        for (; x + 7 <= row.MaxX; x += 8)
+        {
+            __m256 xs = _mm256_add_ps(_mm256_set1_ps((float)x), lanes);
+            __m256 alpha = _mm256_add_ps(alphaY, _mm256_mul_ps(xs, alphaDx));
+            __m256 beta = _mm256_add_ps(betaY, _mm256_mul_ps(xs, betaDx));
+            __m256 sigma = _mm256_sub_ps(_mm256_sub_ps(one, alpha), beta);
+            __m256 depth = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(za, sigma), _mm256_mul_ps(alpha, zb)), _mm256_mul_ps(beta, zc));
+
+            __m256 passed = _mm256_cmp_ps(_mm256_loadu_ps(depthRow + x), depth, _CMP_LT_OQ);
+
+            int mask = _mm256_movemask_ps(passed);
+            if (!mask)
+                continue;
+
+            _mm256_store_ps(alphas, alpha);
+            _mm256_store_ps(betas, beta);
+            _mm256_store_ps(depths, depth);
+            while (mask)
+            {
+                int i = 0;
+                while (!(mask & (1 << i)))
+                    ++i;
+                mask &= mask - 1;
+
+                out.X[count] = x + i;
+                out.Alpha[count] = alphas[i];
+                out.Beta[count] = betas[i];
+                out.Depth[count] = depths[i];
+                ++count;
+            }
+        }
+
+        if (x <= row.MaxX)
+        {
+            ::RasterRow tail = row;
+            tail.MinX = x;
+            RowFragments tailOut = { out.X + count, out.Alpha + count, out.Beta + count, out.Depth + count };
+            count += GetScalarKernels()->RasterRow(tail, depthRow, tailOut);
+        }
+
+        return count;
+    }
+
+    // 16-bit depths are widened to 32 bits, 24-bit ones are masked out of their stencil. Both compare as signed integers
+    // since they stay below 2^24.
+    template <class Stored>
+    int rasterRowUnorm(const ::RasterRow& row, const Stored* depthRow, RowFragments& out)
+    {
+        const __m256 one = _mm256_set1_ps(1.0f);
+        const __m256 half = _mm256_set1_ps(1.5f);
+        const __m256 lanes = _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f);
+        const __m256 alphaY = _mm256_set1_ps(row.AlphaY);
+        const __m256 alphaDx = _mm256_set1_ps(row.AlphaDx);
+        const __m256 betaY = _mm256_set1_ps(row.BetaY);
+        const __m256 betaDx = _mm256_set1_ps(row.BetaDx);
+        const __m256 za = _mm256_set1_ps(row.ZA);
+        const __m256 zb = _mm256_set1_ps(row.ZB);
+        const __m256 zc = _mm256_set1_ps(row.ZC);
+        const __m256 depthScale = _mm256_set1_ps(row.DepthScale);
+        const __m256 depthMax = _mm256_set1_ps(row.DepthMax);
+        const __m256i depthBits = _mm256_set1_epi32(0xffffff);
+        const __m256i stencilMask = _mm256_set1_epi32((int)row.StencilMask);
+        const __m256i stencilReference = _mm256_set1_epi32((int)row.StencilReference);
+
+        alignas(32) float alphas[8], betas[8], depths[8];
+
+        int count = 0;
+        int x = row.MinX;
+        for (; x + 7 <= row.MaxX; x += 8)
+        {
+            __m256 xs = _mm256_add_ps(_mm256_set1_ps((float)x), lanes);
+            __m256 alpha = _mm256_add_ps(alphaY, _mm256_mul_ps(xs, alphaDx));
+            __m256 beta = _mm256_add_ps(betaY, _mm256_mul_ps(xs, betaDx));
+            __m256 sigma = _mm256_sub_ps(_mm256_sub_ps(one, alpha), beta);
+            __m256 depth = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(za, sigma), _mm256_mul_ps(alpha, zb)), _mm256_mul_ps(beta, zc));
+            __m256i value = _mm256_cvttps_epi32(_mm256_min_ps(_mm256_max_ps(_mm256_add_ps(_mm256_mul_ps(depth, depthScale), half), one), depthMax));
+
+            __m256i passed;
+            if constexpr (sizeof(Stored) == 2)
+            {
+                __m256i stored = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(depthRow + x)));
+                passed = _mm256_cmpgt_epi32(value, stored);
+            }
+            else
+            {
+                __m256i stored = _mm256_loadu_si256((const __m256i*)(depthRow + x));
+                passed = _mm256_and_si256(_mm256_cmpgt_epi32(value, _mm256_and_si256(stored, depthBits)),
+                    _mm256_cmpeq_epi32(_mm256_and_si256(stored, stencilMask), stencilReference));
+            }
+
+            int mask = _mm256_movemask_ps(_mm256_castsi256_ps(passed));
+            if (!mask)
+                continue;
+
+            _mm256_store_ps(alphas, alpha);
+            _mm256_store_ps(betas, beta);
+            _mm256_store_ps(depths, _mm256_cvtepi32_ps(value));
+            while (mask)
+            {
+                int i = 0;
+                while (!(mask & (1 << i)))
+                    ++i;
+                mask &= mask - 1;
+
+                out.X[count] = x + i;
+                out.Alpha[count] = alphas[i];
+                out.Beta[count] = betas[i];
+                out.Depth[count] = depths[i];
+                ++count;
+            }
+        }
+
+        if (x <= row.MaxX)
+        {
+            ::RasterRow tail = row;
+            tail.MinX = x;
+            RowFragments tailOut = { out.X + count, out.Alpha + count, out.Beta + count, out.Depth + count };
+            if constexpr (sizeof(Stored) == 2)
+                count += GetScalarKernels()->RasterRowUnorm16(tail, depthRow, tailOut);
+            else
+                count += GetScalarKernels()->RasterRowUnorm24Stencil8(tail, depthRow, tailOut);
+        }
+
+        return count;
+    }
+
+    int RasterRowUnorm16(const ::RasterRow& row, const uint16_t* depthRow, RowFragments& out)
+    {
+        return rasterRowUnorm(row, depthRow, out);
+    }
+
+    int RasterRowUnorm24Stencil8(const ::RasterRow& row, const uint32_t* depthRow, RowFragments& out)
+    {
+        return rasterRowUnorm(row, depthRow, out);
+    }
+
+    void Fill32(uint32_t* destination, size_t count, uint32_t value)
+    {
+        __m256i v = _mm256_set1_epi32((int)value);
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8)
+            _mm256_storeu_si256((__m256i*)(destination + i), v);
+        for (; i < count; ++i)
+            destination[i] = value;
+    }
+
+    // Eight pixels per iteration, unpacking and packing within 128-bit lanes keeps them in place.
+    void ResolveSamples(const uint32_t* samples, size_t planeStride, int sampleCount, uint32_t* out, size_t count)
+    {
+        int shift = sampleCount == 8 ? 3 : sampleCount == 4 ? 2 : sampleCount == 2 ? 1 : 0;
+        __m128i shiftCount = _mm_cvtsi32_si128(shift);
+        __m256i round = _mm256_set1_epi16((short)((1 << shift) >> 1));
+        __m256i zero = _mm256_setzero_si256();
+
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8)
+        {
+            __m256i lo = round, hi = round;
+            for (int s = 0; s < sampleCount; ++s)
+            {
+                __m256i v = _mm256_loadu_si256((const __m256i*)(samples + s * planeStride + i));
+                lo = _mm256_add_epi16(lo, _mm256_unpacklo_epi8(v, zero));
+                hi = _mm256_add_epi16(hi, _mm256_unpackhi_epi8(v, zero));
+            }
+            lo = _mm256_srl_epi16(lo, shiftCount);
+            hi = _mm256_srl_epi16(hi, shiftCount);
+            _mm256_storeu_si256((__m256i*)(out + i), _mm256_packus_epi16(lo, hi));
+        }
+        for (; i < count; ++i)
+        {
+            uint32_t result = 0;
+            for (int byte = 0; byte < 32; byte += 8)
+            {
+                uint32_t sum = (1u << shift) >> 1;
+                for (int s = 0; s < sampleCount; ++s)
+                    sum += (samples[s * planeStride + i] >> byte) & 0xff;
+                result |= (sum >> shift) << byte;
+            }
+            out[i] = result;
+        }
+    }
+
+    void OcclusionRow(const ::OcclusionRow& row)
+    {
+        const __m256 zero = _mm256_setzero_ps();
+        const __m256 one = _mm256_set1_ps(1.0f);
+        const __m256 bias = _mm256_set1_ps(row.Bias);
+        const __m256 inverseRange = _mm256_set1_ps(row.InverseRange);
+        const __m256 scale = _mm256_set1_ps(row.Scale);
+        const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+
+        auto smaller = [&](__m256 a, __m256 b)
+        {
+            return _mm256_blendv_ps(b, a, _mm256_cmp_ps(_mm256_and_ps(a, absMask), _mm256_and_ps(b, absMask), _CMP_LT_OQ));
+        };
+
+        int x = 0;
+        for (; x + 8 <= row.Width; x += 8)
+        {
+            const float* depth = row.Depth + x;
+            __m256 center = _mm256_loadu_ps(depth);
+            __m256 gradientX = smaller(_mm256_sub_ps(center, _mm256_loadu_ps(depth - 1)), _mm256_sub_ps(_mm256_loadu_ps(depth + 1), center));
+            __m256 gradientY = smaller(_mm256_sub_ps(center, _mm256_loadu_ps(depth - row.Stride)), _mm256_sub_ps(_mm256_loadu_ps(depth + row.Stride), center));
+            __m256 occlusion = zero;
+            for (int s = 0; s < row.SampleCount; ++s)
+            {
+                __m256 plane = _mm256_add_ps(_mm256_add_ps(center, _mm256_mul_ps(gradientX, _mm256_set1_ps(row.SampleX[s]))), _mm256_mul_ps(gradientY, _mm256_set1_ps(row.SampleY[s])));
+                __m256 diff = _mm256_sub_ps(_mm256_loadu_ps(depth + row.Samples[s]), plane);
+                __m256 amount = _mm256_max_ps(zero, _mm256_sub_ps(one, _mm256_mul_ps(_mm256_sub_ps(diff, bias), inverseRange)));
+                occlusion = _mm256_add_ps(occlusion, _mm256_and_ps(_mm256_cmp_ps(diff, bias, _CMP_GT_OQ), amount));
+            }
+            _mm256_storeu_ps(row.Out + x, _mm256_sub_ps(one, _mm256_mul_ps(occlusion, scale)));
+        }
+        for (; x < row.Width; ++x)
+        {
+            const float* depth = row.Depth + x;
+            float left = depth[0] - depth[-1], right = depth[1] - depth[0];
+            float up = depth[0] - depth[-row.Stride], down = depth[row.Stride] - depth[0];
+            float gradientX = std::fabs(left) < std::fabs(right) ? left : right;
+            float gradientY = std::fabs(up) < std::fabs(down) ? up : down;
+            float occlusion = 0.0f;
+            for (int s = 0; s < row.SampleCount; ++s)
+            {
+                float diff = depth[row.Samples[s]] - (depth[0] + gradientX * row.SampleX[s] + gradientY * row.SampleY[s]);
+                occlusion += diff > row.Bias ? std::max(0.0f, 1.0f - (diff - row.Bias) * row.InverseRange) : 0.0f;
+            }
+            row.Out[x] = 1.0f - occlusion * row.Scale;
+        }
+    }
+
+    // Eight pixels per iteration, see the SSE2 version. Four texels are loaded and spread over their pixel pairs.
+    void UpsampleRow(const ::UpsampleRow& row)
+    {
+        float nearWeight0 = row.Weight0 * 0.75f, farWeight0 = row.Weight0 * 0.25f;
+        float nearWeight1 = row.Weight1 * 0.75f, farWeight1 = row.Weight1 * 0.25f;
+        const __m256 one = _mm256_set1_ps(1.0f);
+        const __m256 clampWeight = _mm256_set1_ps(1e6f);
+        const __m256 sharpness = _mm256_set1_ps(row.Sharpness);
+        const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+        const __m256i spread = _mm256_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3);
+        const __m256 nearW0 = _mm256_set1_ps(nearWeight0), farW0 = _mm256_set1_ps(farWeight0);
+        const __m256 nearW1 = _mm256_set1_ps(nearWeight1), farW1 = _mm256_set1_ps(farWeight1);
+
+        auto pairs = [&](const float* p) { return _mm256_permutevar8x32_ps(_mm256_castps128_ps256(_mm_loadu_ps(p)), spread); };
+        auto nearFar = [&](const float* coarse, int i, __m256& nearValue, __m256& farValue)
+        {
+            nearValue = pairs(coarse + i);
+            farValue = _mm256_blend_ps(pairs(coarse + i - 1), pairs(coarse + i + 1), 0xaa);
+        };
+        auto weight = [&](__m256 bilinear, __m256 depth, __m256 coarse)
+        {
+            __m256 distance = _mm256_and_ps(_mm256_sub_ps(depth, coarse), absMask);
+            return _mm256_div_ps(bilinear, _mm256_add_ps(one, _mm256_min_ps(_mm256_mul_ps(distance, sharpness), clampWeight)));
+        };
+
+        int x = 0;
+        for (; x + 8 <= row.Width; x += 8)
+        {
+            int i = x >> 1;
+            __m256 depth = _mm256_loadu_ps(row.Depth + x);
+            __m256 nearDepth0, farDepth0, nearDepth1, farDepth1, nearOcclusion0, farOcclusion0, nearOcclusion1, farOcclusion1;
+            nearFar(row.CoarseDepth0, i, nearDepth0, farDepth0);
+            nearFar(row.CoarseDepth1, i, nearDepth1, farDepth1);
+            nearFar(row.CoarseOcclusion0, i, nearOcclusion0, farOcclusion0);
+            nearFar(row.CoarseOcclusion1, i, nearOcclusion1, farOcclusion1);
+
+            __m256 wa = weight(nearW0, depth, nearDepth0);
+            __m256 wb = weight(farW0, depth, farDepth0);
+            __m256 wc = weight(nearW1, depth, nearDepth1);
+            __m256 wd = weight(farW1, depth, farDepth1);
+            __m256 total = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(wa, wb), wc), wd);
+            __m256 sum = _mm256_add_ps(_mm256_mul_ps(wa, nearOcclusion0), _mm256_mul_ps(wb, farOcclusion0));
+            sum = _mm256_add_ps(sum, _mm256_mul_ps(wc, nearOcclusion1));
+            sum = _mm256_add_ps(sum, _mm256_mul_ps(wd, farOcclusion1));
+            _mm256_storeu_ps(row.Out + x, _mm256_div_ps(sum, total));
+        }
+        for (; x < row.Width; ++x)
+        {
+            int nearX = x >> 1;
+            int farX = x & 1 ? nearX + 1 : nearX - 1;
+            float depth = row.Depth[x];
+            float wa = nearWeight0 / (1.0f + std::min(std::fabs(depth - row.CoarseDepth0[nearX]) * row.Sharpness, 1e6f));
+            float wb = farWeight0 / (1.0f + std::min(std::fabs(depth - row.CoarseDepth0[farX]) * row.Sharpness, 1e6f));
+            float wc = nearWeight1 / (1.0f + std::min(std::fabs(depth - row.CoarseDepth1[nearX]) * row.Sharpness, 1e6f));
+            float wd = farWeight1 / (1.0f + std::min(std::fabs(depth - row.CoarseDepth1[farX]) * row.Sharpness, 1e6f));
+            float total = wa + wb + wc + wd;
+            float sum = wa * row.CoarseOcclusion0[nearX] + wb * row.CoarseOcclusion0[farX] + wc * row.CoarseOcclusion1[nearX] + wd * row.CoarseOcclusion1[farX];
+            row.Out[x] = sum / total;
+        }
+    }
+
+    void DepthToGrayRow(const float* depth, float offset, float scale, uint32_t* out, size_t count)
+    {
+        const __m256 offsets = _mm256_set1_ps(offset);
+        const __m256 scales = _mm256_set1_ps(scale);
+        const __m256 half = _mm256_set1_ps(0.5f);
+        const __m256 zero = _mm256_setzero_ps();
+        const __m256 white = _mm256_set1_ps(255.0f);
+        const __m256i alpha = _mm256_set1_epi32((int)0xff000000u);
+        const __m256i spread = _mm256_set1_epi32(0x010101);
+
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8)
+        {
+            __m256 v = _mm256_add_ps(_mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(depth + i), offsets), scales), half);
+            __m256i gray = _mm256_cvttps_epi32(_mm256_min_ps(_mm256_max_ps(v, zero), white));
+            _mm256_storeu_si256((__m256i*)(out + i), _mm256_or_si256(_mm256_mullo_epi32(gray, spread), alpha));
+        }
+        for (; i < count; ++i)
+        {
+            uint32_t gray = (uint32_t)(int)std::min(std::max((depth[i] - offset) * scale + 0.5f, 0.0f), 255.0f);
+            out[i] = 0xff000000u | gray * 0x010101u;
+        }
+    }
+
+    // Eight pixels per iteration, see the SSE2 version. Even input pixels go to the low lane and odd ones to the high
+    // lane, packing interleaves the lanes of the two halves, which the last permutation undoes.
+    void DownsampleRow(const uint32_t* row0, const uint32_t* row1, uint32_t* out, size_t count)
+    {
+        const __m256i evenOdd = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+        const __m256i round = _mm256_set1_epi16(2);
+        auto pairs = [&](const uint32_t* pixels)
+        {
+            __m256i v = _mm256_permutevar8x32_epi32(_mm256_loadu_si256((const __m256i*)pixels), evenOdd);
+            return _mm256_add_epi16(_mm256_cvtepu8_epi16(_mm256_castsi256_si128(v)), _mm256_cvtepu8_epi16(_mm256_extracti128_si256(v, 1)));
+        };
+
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8)
+        {
+            __m256i lo = _mm256_add_epi16(_mm256_add_epi16(pairs(row0 + 2 * i), pairs(row1 + 2 * i)), round);
+            __m256i hi = _mm256_add_epi16(_mm256_add_epi16(pairs(row0 + 2 * i + 8), pairs(row1 + 2 * i + 8)), round);
+            __m256i packed = _mm256_packus_epi16(_mm256_srli_epi16(lo, 2), _mm256_srli_epi16(hi, 2));
+            _mm256_storeu_si256((__m256i*)(out + i), _mm256_permute4x64_epi64(packed, _MM_SHUFFLE(3, 1, 2, 0)));
+        }
+        for (; i < count; ++i)
+        {
+            uint32_t result = 0;
+            for (int byte = 0; byte < 32; byte += 8)
+            {
+                uint32_t sum = 2 + ((row0[2 * i] >> byte) & 0xff) + ((row0[2 * i + 1] >> byte) & 0xff)
+                    + ((row1[2 * i] >> byte) & 0xff) + ((row1[2 * i + 1] >> byte) & 0xff);
+                result |= (sum >> 2) << byte;
+            }
+            out[i] = result;
+        }
+    }
+
+    // With F16C, which every AVX2 processor has.
+    void HalfToFloatRow(const uint16_t* in, float* out, size_t count)
+    {
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8)
+            _mm256_storeu_ps(out + i, _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)(in + i))));
+        for (; i < count; ++i)
+            out[i] = HalfToFloat(in[i]);
+    }
+
+    // Two pixels per register, four per iteration, see the SSE2 version. Packing interleaves the lanes, which the last
+    // permutation undoes.
+    void ToneMapRow(const float* in, float exposure, float inverseWhite2, uint32_t* out, size_t count)
+    {
+        const __m256 zero = _mm256_setzero_ps();
+        const __m256 one = _mm256_set1_ps(1.0f);
+        const __m256 half = _mm256_set1_ps(0.5f);
+        const __m256 white = _mm256_set1_ps(255.0f);
+        const __m256 exposures = _mm256_set1_ps(exposure);
+        const __m256 inverseWhites = _mm256_set1_ps(inverseWhite2);
+        const __m256 alpha = _mm256_castsi256_ps(_mm256_setr_epi32(0, 0, 0, -1, 0, 0, 0, -1));
+        const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4)
+        {
+            __m256i pixels[2];
+            for (int p = 0; p < 2; ++p)
+            {
+                __m256 c = _mm256_loadu_ps(in + 4 * (i + 2 * p));
+                __m256 x = _mm256_mul_ps(_mm256_max_ps(c, zero), exposures);
+                __m256 mapped = _mm256_div_ps(_mm256_mul_ps(x, _mm256_add_ps(one, _mm256_mul_ps(x, inverseWhites))), _mm256_add_ps(one, x));
+                __m256 v = _mm256_blendv_ps(mapped, c, alpha);
+                v = _mm256_add_ps(_mm256_mul_ps(v, white), half);
+                pixels[p] = _mm256_cvttps_epi32(_mm256_min_ps(_mm256_max_ps(v, zero), white));
+            }
+            __m256i packed = _mm256_packs_epi32(pixels[0], pixels[1]);
+            packed = _mm256_packus_epi16(packed, packed);
+            _mm_storeu_si128((__m128i*)(out + i), _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(packed, order)));
+        }
+        for (; i < count; ++i)
+        {
+            const float* pixel = in + 4 * i;
+            uint32_t result = 0;
+            for (int channel = 0; channel < 4; ++channel)
+            {
+                float v = pixel[channel];
+                if (channel < 3)
+                {
+                    float x = (v > 0.0f ? v : 0.0f) * exposure;
+                    v = x * (1.0f + x * inverseWhite2) / (1.0f + x);
+                }
+                v = v * 255.0f + 0.5f;
+                v = v > 0.0f ? v : 0.0f;
+                v = v < 255.0f ? v : 255.0f;
+                result |= (uint32_t)(int)v << (8 * channel);
+            }
+            out[i] = result;
+        }
+    }
+
+    const KernelTable table = { SimdLevel::AVX2, TransformPoints, RasterRow, RasterRowUnorm16, RasterRowUnorm24Stencil8, Fill32, ResolveSamples,
+        OcclusionRow, UpsampleRow, DepthToGrayRow, DownsampleRow, HalfToFloatRow, ToneMapRow };
+}
+
+const KernelTable* GetAVX2Kernels()
+{
+    return &table;
+}
+
+#else
+
+const KernelTable* GetAVX2Kernels()
+{
+    return nullptr;
+}
+
+#endif
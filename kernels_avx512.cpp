@@ -0,0 +1,394 @@
+#include "kernels.h"
+
+#ifdef KERNELS_X86
+// GCC's AVX-512 intrinsics start from a deliberately undefined vector (__Y) that their instruction overwrites. Without
+// LTO, GCC 12 and later report it as uninitialized wherever one is inlined, at the header's lines, where the warning is
+// turned off. This file's own uninitialized values are still reported where it reads them.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#include <immintrin.h>
+#pragma GCC diagnostic pop
+#else
+#include <immintrin.h>
+#endif
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    // Four points per iteration, one in each 128-bit lane.
+    void TransformPoints(const float* m, const float* in, float* out, int count)
+    {
+        __m512 c0 = _mm512_broadcast_f32x4(_mm_setr_ps(m[0], m[4], m[8], m[12]));
+        __m512 c1 = _mm512_broadcast_f32x4(_mm_setr_ps(m[1], m[5], m[9], m[13]));
+        __m512 c2 = _mm512_broadcast_f32x4(_mm_setr_ps(m[2], m[6], m[10], m[14]));
+        __m512 c3 = _mm512_broadcast_f32x4(_mm_setr_ps(m[3], m[7], m[11], m[15]));
+
+        // Lane i of a point reads component 3 * (i / 4) of the 12 floats loaded.
+        const __m512i xIndex = _mm512_setr_epi32(0, 0, 0, 0, 3, 3, 3, 3, 6, 6, 6, 6, 9, 9, 9, 9);
+        const __m512i one = _mm512_set1_epi32(1);
+
+        int i = 0;
+        for (; i + 4 <= count; i += 4, in += 12, out += 16)
+        {
+            __m512 points = _mm512_maskz_loadu_ps(0x0fff, in);
+            __m512 x = _mm512_permutexvar_ps(xIndex, points);
+            __m512 y = _mm512_permutexvar_ps(_mm512_add_epi32(xIndex, one), points);
+            __m512 z = _mm512_permutexvar_ps(_mm512_add_epi32(xIndex, _mm512_add_epi32(one, one)), points);
+            __m512 r = _mm512_add_ps(_mm512_mul_ps(c0, x), _mm512_mul_ps(c1, y));
+            r = _mm512_add_ps(r, _mm512_mul_ps(c2, z));
+            _mm512_storeu_ps(out, _mm512_add_ps(r, c3));
+        }
+
+        if (i < count)
+            GetScalarKernels()->TransformPoints(m, in, out, count - i);
+    }
+
+    int RasterRow(const ::RasterRow& row, const float* depthRow, RowFragments& out)
+    {
+        const __m512 one = _mm512_set1_ps(1.0f);
+        const __m512 lanes = _mm512_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f, 8.0f, 9.0f, 10.0f, 11.0f, 12.0f, 13.0f, 14.0f, 15.0f);
+        const __m512i laneIndices = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+        const __m512 alphaY = _mm512_set1_ps(row.AlphaY);
+        const __m512 alphaDx = _mm512_set1_ps(row.AlphaDx);
+        const __m512 betaY = _mm512_set1_ps(row.BetaY);
+        const __m512 betaDx = _mm512_set1_ps(row.BetaDx);
+        const __m512 za = _mm512_set1_ps(row.ZA);
+        const __m512 zb = _mm512_set1_ps(row.ZB);
+        const __m512 zc = _mm512_set1_ps(row.ZC);
+
+        int count = 0;
+        for (int x = row.MinX; x <= row.MaxX; x += 16)
+        {
+            int remaining = row.MaxX - x + 1;
+            __mmask16 valid = remaining >= 16 ? (__mmask16)0xffff : (__mmask16)((1u << remaining) - 1);
+
+            __m512 xs = _mm512_add_ps(_mm512_set1_ps((float)x), lanes);
+            __m512 alpha = _mm512_add_ps(alphaY, _mm512_mul_ps(xs, alphaDx));
+            __m512 beta = _mm512_add_ps(betaY, _mm512_mul_ps(xs, betaDx));
+            __m512 sigma = _mm512_sub_ps(_mm512_sub_ps(one, alpha), beta);
+            __m512 depth = _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(za, sigma), _mm512_mul_ps(alpha, zb)), _mm512_mul_ps(beta, zc));
+
+            __mmask16 mask = _mm512_mask_cmp_ps_mask(valid, _mm512_maskz_loadu_ps(valid, depthRow + x), depth, _CMP_LT_OQ);
+
+            if (!mask)
+                continue;
+
+            _mm512_mask_compressstoreu_epi32(out.X + count, mask, _mm512_add_epi32(_mm512_set1_epi32(x), laneIndices));
+            _mm512_mask_compressstoreu_ps(out.Alpha + count, mask, alpha);
+            _mm512_mask_compressstoreu_ps(out.Beta + count, mask, beta);
+            _mm512_mask_compressstoreu_ps(out.Depth + count, mask, depth);
+            count += _mm_popcnt_u32(mask);
+        }
+
+        return count;
+    }
+
+    // 16-bit depths are widened to 32 bits, 24-bit ones are masked out of their stencil. Both compare as signed integers
+    // since they stay below 2^24.
+    template <class Stored>
+    int rasterRowUnorm(const ::RasterRow& row, const Stored* depthRow, RowFragments& out)
+    {
+        const __m512 one = _mm512_set1_ps(1.0f);
+        const __m512 half = _mm512_set1_ps(1.5f);
+        const __m512 lanes = _mm512_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f, 8.0f, 9.0f, 10.0f, 11.0f, 12.0f, 13.0f, 14.0f, 15.0f);
+        const __m512i laneIndices = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+        const __m512 alphaY = _mm512_set1_ps(row.AlphaY);
+        const __m512 alphaDx = _mm512_set1_ps(row.AlphaDx);
+        const __m512 betaY = _mm512_set1_ps(row.BetaY);
+        const __m512 betaDx = _mm512_set1_ps(row.BetaDx);
+        const __m512 za = _mm512_set1_ps(row.ZA);
+        const __m512 zb = _mm512_set1_ps(row.ZB);
+        const __m512 zc = _mm512_set1_ps(row.ZC);
+        const __m512 depthScale = _mm512_set1_ps(row.DepthScale);
+        const __m512 depthMax = _mm512_set1_ps(row.DepthMax);
+        const __m512i depthBits = _mm512_set1_epi32(0xffffff);
+        const __m512i stencilMask = _mm512_set1_epi32((int)row.StencilMask);
+        const __m512i stencilReference = _mm512_set1_epi32((int)row.StencilReference);
+
+        int count = 0;
+        for (int x = row.MinX; x <= row.MaxX; x += 16)
+        {
+            int remaining = row.MaxX - x + 1;
+            __mmask16 valid = remaining >= 16 ? (__mmask16)0xffff : (__mmask16)((1u << remaining) - 1);
+
+            __m512 xs = _mm512_add_ps(_mm512_set1_ps((float)x), lanes);
+            __m512 alpha = _mm512_add_ps(alphaY, _mm512_mul_ps(xs, alphaDx));
+            __m512 beta = _mm512_add_ps(betaY, _mm512_mul_ps(xs, betaDx));
+            __m512 sigma = _mm512_sub_ps(_mm512_sub_ps(one, alpha), beta);
+            __m512 depth = _mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(za, sigma), _mm512_mul_ps(alpha, zb)), _mm512_mul_ps(beta, zc));
+            __m512i value = _mm512_cvttps_epi32(_mm512_min_ps(_mm512_max_ps(_mm512_add_ps(_mm512_mul_ps(depth, depthScale), half), one), depthMax));
+
+            __mmask16 mask;
+            if constexpr (sizeof(Stored) == 2)
+            {
+                __m512i stored = _mm512_cvtepu16_epi32(_mm256_maskz_loadu_epi16(valid, depthRow + x));
+                mask = _mm512_mask_cmpgt_epi32_mask(valid, value, stored);
+            }
+            else
+            {
+                __m512i stored = _mm512_maskz_loadu_epi32(valid, depthRow + x);
+                mask = _mm512_mask_cmpgt_epi32_mask(valid, value, _mm512_and_si512(stored, depthBits));
+                mask = _mm512_mask_cmpeq_epi32_mask(mask, _mm512_and_si512(stored, stencilMask), stencilReference);
+            }
+
+            if (!mask)
+                continue;
+
+            _mm512_mask_compressstoreu_epi32(out.X + count, mask, _mm512_add_epi32(_mm512_set1_epi32(x), laneIndices));
+            _mm512_mask_compressstoreu_ps(out.Alpha + count, mask, alpha);
+            _mm512_mask_compressstoreu_ps(out.Beta + count, mask, beta);
+            _mm512_mask_compressstoreu_ps(out.Depth + count, mask, _mm512_cvtepi32_ps(value));
+            count += _mm_popcnt_u32(mask);
+        }
+
+        return count;
+    }
+
+    int RasterRowUnorm16(const ::RasterRow& row, const uint16_t* depthRow, RowFragments& out)
+    {
+        return rasterRowUnorm(row, depthRow, out);
+    }
+
+    int RasterRowUnorm24Stencil8(const ::RasterRow& row, const uint32_t* depthRow, RowFragments& out)
+    {
+        return rasterRowUnorm(row, depthRow, out);
+    }
+
+    void Fill32(uint32_t* destination, size_t count, uint32_t value)
+    {
+        __m512i v = _mm512_set1_epi32((int)value);
+        size_t i = 0;
+        for (; i + 16 <= count; i += 16)
+            _mm512_storeu_si512(destination + i, v);
+        if (i < count)
+            _mm512_mask_storeu_epi32(destination + i, (__mmask16)((1u << (count - i)) - 1), v);
+    }
+
+    // Sixteen pixels per iteration, the tail uses masked loads and stores.
+    void ResolveSamples(const uint32_t* samples, size_t planeStride, int sampleCount, uint32_t* out, size_t count)
+    {
+        int shift = sampleCount == 8 ? 3 : sampleCount == 4 ? 2 : sampleCount == 2 ? 1 : 0;
+        __m128i shiftCount = _mm_cvtsi32_si128(shift);
+        __m512i round = _mm512_set1_epi16((short)((1 << shift) >> 1));
+        __m512i zero = _mm512_setzero_si512();
+
+        for (size_t i = 0; i < count; i += 16)
+        {
+            __mmask16 mask = count - i >= 16 ? (__mmask16)0xffff : (__mmask16)((1u << (count - i)) - 1);
+            __m512i lo = round, hi = round;
+            for (int s = 0; s < sampleCount; ++s)
+            {
+                __m512i v = _mm512_maskz_loadu_epi32(mask, samples + s * planeStride + i);
+                lo = _mm512_add_epi16(lo, _mm512_unpacklo_epi8(v, zero));
+                hi = _mm512_add_epi16(hi, _mm512_unpackhi_epi8(v, zero));
+            }
+            lo = _mm512_srl_epi16(lo, shiftCount);
+            hi = _mm512_srl_epi16(hi, shiftCount);
+            _mm512_mask_storeu_epi32(out + i, mask, _mm512_packus_epi16(lo, hi));
+        }
+    }
+
+    // Sixteen pixels per iteration, the tail uses masked loads and stores.
+    void OcclusionRow(const ::OcclusionRow& row)
+    {
+        const __m512 zero = _mm512_setzero_ps();
+        const __m512 one = _mm512_set1_ps(1.0f);
+        const __m512 bias = _mm512_set1_ps(row.Bias);
+        const __m512 inverseRange = _mm512_set1_ps(row.InverseRange);
+        const __m512 scale = _mm512_set1_ps(row.Scale);
+
+        auto smaller = [&](__m512 a, __m512 b)
+        {
+            return _mm512_mask_blend_ps(_mm512_cmp_ps_mask(_mm512_abs_ps(a), _mm512_abs_ps(b), _CMP_LT_OQ), b, a);
+        };
+
+        for (int x = 0; x < row.Width; x += 16)
+        {
+            __mmask16 mask = row.Width - x >= 16 ? (__mmask16)0xffff : (__mmask16)((1u << (row.Width - x)) - 1);
+            const float* depth = row.Depth + x;
+            __m512 center = _mm512_maskz_loadu_ps(mask, depth);
+            __m512 gradientX = smaller(_mm512_sub_ps(center, _mm512_maskz_loadu_ps(mask, depth - 1)), _mm512_sub_ps(_mm512_maskz_loadu_ps(mask, depth + 1), center));
+            __m512 gradientY = smaller(_mm512_sub_ps(center, _mm512_maskz_loadu_ps(mask, depth - row.Stride)), _mm512_sub_ps(_mm512_maskz_loadu_ps(mask, depth + row.Stride), center));
+            __m512 occlusion = zero;
+            for (int s = 0; s < row.SampleCount; ++s)
+            {
+                __m512 plane = _mm512_add_ps(_mm512_add_ps(center, _mm512_mul_ps(gradientX, _mm512_set1_ps(row.SampleX[s]))), _mm512_mul_ps(gradientY, _mm512_set1_ps(row.SampleY[s])));
+                __m512 diff = _mm512_sub_ps(_mm512_maskz_loadu_ps(mask, depth + row.Samples[s]), plane);
+                __m512 amount = _mm512_max_ps(zero, _mm512_sub_ps(one, _mm512_mul_ps(_mm512_sub_ps(diff, bias), inverseRange)));
+                occlusion = _mm512_add_ps(occlusion, _mm512_maskz_mov_ps(_mm512_cmp_ps_mask(diff, bias, _CMP_GT_OQ), amount));
+            }
+            _mm512_mask_storeu_ps(row.Out + x, mask, _mm512_sub_ps(one, _mm512_mul_ps(occlusion, scale)));
+        }
+    }
+
+    // Sixteen pixels per iteration, see the SSE2 version. Eight texels are loaded and spread over their pixel pairs,
+    // the tail is scalar.
+    void UpsampleRow(const ::UpsampleRow& row)
+    {
+        float nearWeight0 = row.Weight0 * 0.75f, farWeight0 = row.Weight0 * 0.25f;
+        float nearWeight1 = row.Weight1 * 0.75f, farWeight1 = row.Weight1 * 0.25f;
+        const __m512 one = _mm512_set1_ps(1.0f);
+        const __m512 clampWeight = _mm512_set1_ps(1e6f);
+        const __m512 sharpness = _mm512_set1_ps(row.Sharpness);
+        const __m512i spread = _mm512_setr_epi32(0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7);
+        const __m512 nearW0 = _mm512_set1_ps(nearWeight0), farW0 = _mm512_set1_ps(farWeight0);
+        const __m512 nearW1 = _mm512_set1_ps(nearWeight1), farW1 = _mm512_set1_ps(farWeight1);
+
+        auto pairs = [&](const float* p) { return _mm512_permutexvar_ps(spread, _mm512_castps256_ps512(_mm256_loadu_ps(p))); };
+        auto nearFar = [&](const float* coarse, int i, __m512& nearValue, __m512& farValue)
+        {
+            nearValue = pairs(coarse + i);
+            farValue = _mm512_mask_blend_ps((__mmask16)0xaaaa, pairs(coarse + i - 1), pairs(coarse + i + 1));
+        };
+        auto weight = [&](__m512 bilinear, __m512 depth, __m512 coarse)
+        {
+            __m512 distance = _mm512_abs_ps(_mm512_sub_ps(depth, coarse));
+            return _mm512_div_ps(bilinear, _mm512_add_ps(one, _mm512_min_ps(_mm512_mul_ps(distance, sharpness), clampWeight)));
+        };
+
+        int x = 0;
+        for (; x + 16 <= row.Width; x += 16)
+        {
+            int i = x >> 1;
+            __m512 depth = _mm512_loadu_ps(row.Depth + x);
+            __m512 nearDepth0, farDepth0, nearDepth1, farDepth1, nearOcclusion0, farOcclusion0, nearOcclusion1, farOcclusion1;
+            nearFar(row.CoarseDepth0, i, nearDepth0, farDepth0);
+            nearFar(row.CoarseDepth1, i, nearDepth1, farDepth1);
+            nearFar(row.CoarseOcclusion0, i, nearOcclusion0, farOcclusion0);
+            nearFar(row.CoarseOcclusion1, i, nearOcclusion1, farOcclusion1);
+
+            __m512 wa = weight(nearW0, depth, nearDepth0);
+            __m512 wb = weight(farW0, depth, farDepth0);
+            __m512 wc = weight(nearW1, depth, nearDepth1);
+            __m512 wd = weight(farW1, depth, farDepth1);
+            __m512 total = _mm512_add_ps(_mm512_add_ps(_mm512_add_ps(wa, wb), wc), wd);
+            __m512 sum = _mm512_add_ps(_mm512_mul_ps(wa, nearOcclusion0), _mm512_mul_ps(wb, farOcclusion0));
+            sum = _mm512_add_ps(sum, _mm512_mul_ps(wc, nearOcclusion1));
+            sum = _mm512_add_ps(sum, _mm512_mul_ps(wd, farOcclusion1));
+            _mm512_storeu_ps(row.Out + x, _mm512_div_ps(sum, total));
+        }
+        for (; x < row.Width; ++x)
+        {
+            int nearX = x >> 1;
+            int farX = x & 1 ? nearX + 1 : nearX - 1;
+            float depth = row.Depth[x];
+            float wa = nearWeight0 / (1.0f + std::min(std::fabs(depth - row.CoarseDepth0[nearX]) * row.Sharpness, 1e6f));
+            float wb = farWeight0 / (1.0f + std::min(std::fabs(depth - row.CoarseDepth0[farX]) * row.Sharpness, 1e6f));
+            float wc = nearWeight1 / (1.0f + std::min(std::fabs(depth - row.CoarseDepth1[nearX]) * row.Sharpness, 1e6f));
+            float wd = farWeight1 / (1.0f + std::min(std::fabs(depth - row.CoarseDepth1[farX]) * row.Sharpness, 1e6f));
+            float total = wa + wb + wc + wd;
+            float sum = wa * row.CoarseOcclusion0[nearX] + wb * row.CoarseOcclusion0[farX] + wc * row.CoarseOcclusion1[nearX] + wd * row.CoarseOcclusion1[farX];
+            row.Out[x] = sum / total;
+        }
+    }
+
+    // Sixteen pixels per iteration, the tail uses masked loads and stores.
+    void DepthToGrayRow(const float* depth, float offset, float scale, uint32_t* out, size_t count)
+    {
+        const __m512 offsets = _mm512_set1_ps(offset);
+        const __m512 scales = _mm512_set1_ps(scale);
+        const __m512 half = _mm512_set1_ps(0.5f);
+        const __m512 zero = _mm512_setzero_ps();
+        const __m512 white = _mm512_set1_ps(255.0f);
+        const __m512i alpha = _mm512_set1_epi32((int)0xff000000u);
+        const __m512i spread = _mm512_set1_epi32(0x010101);
+
+        for (size_t i = 0; i < count; i += 16)
+        {
+            __mmask16 mask = count - i >= 16 ? (__mmask16)0xffff : (__mmask16)((1u << (count - i)) - 1);
+            __m512 v = _mm512_add_ps(_mm512_mul_ps(_mm512_sub_ps(_mm512_maskz_loadu_ps(mask, depth + i), offsets), scales), half);
+            __m512i gray = _mm512_cvttps_epi32(_mm512_min_ps(_mm512_max_ps(v, zero), white));
+            _mm512_mask_storeu_epi32(out + i, mask, _mm512_or_si512(_mm512_mullo_epi32(gray, spread), alpha));
+        }
+    }
+
+    // Sixteen pixels per iteration, see the AVX2 version. The tail uses masked loads and stores.
+    void DownsampleRow(const uint32_t* row0, const uint32_t* row1, uint32_t* out, size_t count)
+    {
+        const __m512i evenOdd = _mm512_setr_epi32(0, 2, 4, 6, 8, 10, 12, 14, 1, 3, 5, 7, 9, 11, 13, 15);
+        const __m512i order = _mm512_setr_epi64(0, 2, 4, 6, 1, 3, 5, 7);
+        const __m512i round = _mm512_set1_epi16(2);
+        auto pairs = [&](const uint32_t* pixels, __mmask16 mask)
+        {
+            __m512i v = _mm512_permutexvar_epi32(evenOdd, _mm512_maskz_loadu_epi32(mask, pixels));
+            return _mm512_add_epi16(_mm512_cvtepu8_epi16(_mm512_castsi512_si256(v)), _mm512_cvtepu8_epi16(_mm512_extracti64x4_epi64(v, 1)));
+        };
+
+        for (size_t i = 0; i < count; i += 16)
+        {
+            size_t left = count - i;
+            __mmask16 mask = left >= 16 ? (__mmask16)0xffff : (__mmask16)((1u << left) - 1);
+            __mmask16 loMask = left >= 8 ? (__mmask16)0xffff : (__mmask16)((1u << (2 * left)) - 1);
+            __mmask16 hiMask = left >= 16 ? (__mmask16)0xffff : left <= 8 ? (__mmask16)0 : (__mmask16)((1u << (2 * (left - 8))) - 1);
+            __m512i lo = _mm512_add_epi16(_mm512_add_epi16(pairs(row0 + 2 * i, loMask), pairs(row1 + 2 * i, loMask)), round);
+            __m512i hi = _mm512_add_epi16(_mm512_add_epi16(pairs(row0 + 2 * i + 16, hiMask), pairs(row1 + 2 * i + 16, hiMask)), round);
+            __m512i packed = _mm512_packus_epi16(_mm512_srli_epi16(lo, 2), _mm512_srli_epi16(hi, 2));
+            _mm512_mask_storeu_epi32(out + i, mask, _mm512_permutexvar_epi64(order, packed));
+        }
+    }
+
+    // Sixteen values per iteration, the tail uses masked loads and stores.
+    void HalfToFloatRow(const uint16_t* in, float* out, size_t count)
+    {
+        for (size_t i = 0; i < count; i += 16)
+        {
+            __mmask16 mask = count - i >= 16 ? (__mmask16)0xffff : (__mmask16)((1u << (count - i)) - 1);
+            _mm512_mask_storeu_ps(out + i, mask, _mm512_cvtph_ps(_mm256_maskz_loadu_epi16(mask, in + i)));
+        }
+    }
+
+    // Four pixels per register, eight per iteration, see the AVX2 version. The tail uses masked loads and stores.
+    void ToneMapRow(const float* in, float exposure, float inverseWhite2, uint32_t* out, size_t count)
+    {
+        const __m512 zero = _mm512_setzero_ps();
+        const __m512 one = _mm512_set1_ps(1.0f);
+        const __m512 half = _mm512_set1_ps(0.5f);
+        const __m512 white = _mm512_set1_ps(255.0f);
+        const __m512 exposures = _mm512_set1_ps(exposure);
+        const __m512 inverseWhites = _mm512_set1_ps(inverseWhite2);
+        const __mmask16 alpha = 0x8888;
+        const __m512i order = _mm512_setr_epi32(0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15);
+
+        for (size_t i = 0; i < count; i += 8)
+        {
+            size_t left = count - i;
+            __mmask8 mask = left >= 8 ? (__mmask8)0xff : (__mmask8)((1u << left) - 1);
+            __m512i pixels[2];
+            for (int p = 0; p < 2; ++p)
+            {
+                size_t first = std::min<size_t>(left, 4 * p);
+                size_t pixelCount = std::min<size_t>(left - first, 4);
+                __mmask16 loadMask = (__mmask16)((1u << (4 * pixelCount)) - 1);
+                __m512 c = _mm512_maskz_loadu_ps(loadMask, in + 4 * (i + first));
+                __m512 x = _mm512_mul_ps(_mm512_max_ps(c, zero), exposures);
+                __m512 mapped = _mm512_div_ps(_mm512_mul_ps(x, _mm512_add_ps(one, _mm512_mul_ps(x, inverseWhites))), _mm512_add_ps(one, x));
+                __m512 v = _mm512_mask_blend_ps(alpha, mapped, c);
+                v = _mm512_add_ps(_mm512_mul_ps(v, white), half);
+                pixels[p] = _mm512_cvttps_epi32(_mm512_min_ps(_mm512_max_ps(v, zero), white));
+            }
+            __m512i packed = _mm512_packs_epi32(pixels[0], pixels[1]);
+            packed = _mm512_packus_epi16(packed, packed);
+            _mm256_mask_storeu_epi32(out + i, mask, _mm512_castsi512_si256(_mm512_permutexvar_epi32(order, packed)));
+        }
+    }
+
+    const KernelTable table = { SimdLevel::AVX512, TransformPoints, RasterRow, RasterRowUnorm16, RasterRowUnorm24Stencil8, Fill32, ResolveSamples,
+        OcclusionRow, UpsampleRow, DepthToGrayRow, DownsampleRow, HalfToFloatRow, ToneMapRow };
+}
+
+const KernelTable* GetAVX512Kernels()
+{
+    return &table;
+}
+
+#else
+
+const KernelTable* GetAVX512Kernels()
+{
+    return nullptr;
+}
+
+#endif
@@ -0,0 +1,198 @@
+#include "kernels.h"
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    void TransformPoints(const float* m, const float* in, float* out, int count)
+    {
+        for (int i = 0; i < count; ++i, in += 3, out += 4)
+        {
+            for (int row = 0; row < 4; ++row)
+                out[row] = m[row * 4 + 0] * in[0] + m[row * 4 + 1] * in[1] + m[row * 4 + 2] * in[2] + m[row * 4 + 3];
+        }
+    }
+
+    int RasterRow(const ::RasterRow& row, const float* depthRow, RowFragments& out)
+    {
+        int count = 0;
+        for (int x = row.MinX; x <= row.MaxX; ++x)
+        {
+            float alpha = row.AlphaY + (float)x * row.AlphaDx;
+            float beta = row.BetaY + (float)x * row.BetaDx;
+            float sigma = 1.0f - alpha - beta;
+            float depth = row.ZA * sigma + alpha * row.ZB + beta * row.ZC;
+
+            if (depthRow[x] < depth)
+            {
+                out.X[count] = x;
+                out.Alpha[count] = alpha;
+                out.Beta[count] = beta;
+                out.Depth[count] = depth;
+                ++count;
+            }
+        }
+
+        return count;
+    }
+
+    // Shared by the unorm formats, stored(x) returns the depth bits of pixel x and stencil(x) whether it passes the
+    // stencil test.
+    template <class Stored, class Stencil>
+    int rasterRowUnorm(const ::RasterRow& row, Stored&& stored, Stencil&& stencil, RowFragments& out)
+    {
+        int count = 0;
+        for (int x = row.MinX; x <= row.MaxX; ++x)
+        {
+            float alpha = row.AlphaY + (float)x * row.AlphaDx;
+            float beta = row.BetaY + (float)x * row.BetaDx;
+            float sigma = 1.0f - alpha - beta;
+            float depth = row.ZA * sigma + alpha * row.ZB + beta * row.ZC;
+            int32_t value = (int32_t)std::min(std::max(depth * row.DepthScale + 1.5f, 1.0f), row.DepthMax);
+
+            if ((int32_t)stored(x) < value && stencil(x))
+            {
+                out.X[count] = x;
+                out.Alpha[count] = alpha;
+                out.Beta[count] = beta;
+                out.Depth[count] = (float)value;
+                ++count;
+            }
+        }
+
+        return count;
+    }
+
+    int RasterRowUnorm16(const ::RasterRow& row, const uint16_t* depthRow, RowFragments& out)
+    {
+        return rasterRowUnorm(row, [=](int x) { return depthRow[x]; }, [](int) { return true; }, out);
+    }
+
+    int RasterRowUnorm24Stencil8(const ::RasterRow& row, const uint32_t* depthRow, RowFragments& out)
+    {
+        return rasterRowUnorm(row, [=](int x) { return depthRow[x] & 0xffffff; },
+            [&](int x) { return (depthRow[x] & row.StencilMask) == row.StencilReference; }, out);
+    }
+
+    void Fill32(uint32_t* destination, size_t count, uint32_t value)
+    {
+        for (size_t i = 0; i < count; ++i)
+            destination[i] = value;
+    }
+
+    void ResolveSamples(const uint32_t* samples, size_t planeStride, int sampleCount, uint32_t* out, size_t count)
+    {
+        int shift = sampleCount == 8 ? 3 : sampleCount == 4 ? 2 : sampleCount == 2 ? 1 : 0;
+        uint32_t round = (1u << shift) >> 1;
+        for (size_t i = 0; i < count; ++i)
+        {
+            uint32_t result = 0;
+            for (int byte = 0; byte < 32; byte += 8)
+            {
+                uint32_t sum = round;
+                for (int s = 0; s < sampleCount; ++s)
+                    sum += (samples[s * planeStride + i] >> byte) & 0xff;
+                result |= (sum >> shift) << byte;
+            }
+            out[i] = result;
+        }
+    }
+
+    void OcclusionRow(const ::OcclusionRow& row)
+    {
+        for (int x = 0; x < row.Width; ++x)
+        {
+            const float* depth = row.Depth + x;
+            float left = depth[0] - depth[-1], right = depth[1] - depth[0];
+            float up = depth[0] - depth[-row.Stride], down = depth[row.Stride] - depth[0];
+            float gradientX = std::fabs(left) < std::fabs(right) ? left : right;
+            float gradientY = std::fabs(up) < std::fabs(down) ? up : down;
+            float occlusion = 0.0f;
+            for (int s = 0; s < row.SampleCount; ++s)
+            {
+                float diff = depth[row.Samples[s]] - (depth[0] + gradientX * row.SampleX[s] + gradientY * row.SampleY[s]);
+                occlusion += diff > row.Bias ? std::max(0.0f, 1.0f - (diff - row.Bias) * row.InverseRange) : 0.0f;
+            }
+            row.Out[x] = 1.0f - occlusion * row.Scale;
+        }
+    }
+
+    void UpsampleRow(const ::UpsampleRow& row)
+    {
+        float nearWeight0 = row.Weight0 * 0.75f, farWeight0 = row.Weight0 * 0.25f;
+        float nearWeight1 = row.Weight1 * 0.75f, farWeight1 = row.Weight1 * 0.25f;
+        for (int x = 0; x < row.Width; ++x)
+        {
+            int nearX = x >> 1;
+            int farX = x & 1 ? nearX + 1 : nearX - 1;
+            float depth = row.Depth[x];
+            float wa = nearWeight0 / (1.0f + std::min(std::fabs(depth - row.CoarseDepth0[nearX]) * row.Sharpness, 1e6f));
+            float wb = farWeight0 / (1.0f + std::min(std::fabs(depth - row.CoarseDepth0[farX]) * row.Sharpness, 1e6f));
+            float wc = nearWeight1 / (1.0f + std::min(std::fabs(depth - row.CoarseDepth1[nearX]) * row.Sharpness, 1e6f));
+            float wd = farWeight1 / (1.0f + std::min(std::fabs(depth - row.CoarseDepth1[farX]) * row.Sharpness, 1e6f));
+            float total = wa + wb + wc + wd;
+            float sum = wa * row.CoarseOcclusion0[nearX] + wb * row.CoarseOcclusion0[farX] + wc * row.CoarseOcclusion1[nearX] + wd * row.CoarseOcclusion1[farX];
+            row.Out[x] = sum / total;
+        }
+    }
+
+    void DepthToGrayRow(const float* depth, float offset, float scale, uint32_t* out, size_t count)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            uint32_t gray = (uint32_t)(int)std::min(std::max((depth[i] - offset) * scale + 0.5f, 0.0f), 255.0f);
+            out[i] = 0xff000000u | gray * 0x010101u;
+        }
+    }
+
+    void DownsampleRow(const uint32_t* row0, const uint32_t* row1, uint32_t* out, size_t count)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            uint32_t result = 0;
+            for (int byte = 0; byte < 32; byte += 8)
+            {
+                uint32_t sum = 2 + ((row0[2 * i] >> byte) & 0xff) + ((row0[2 * i + 1] >> byte) & 0xff)
+                    + ((row1[2 * i] >> byte) & 0xff) + ((row1[2 * i + 1] >> byte) & 0xff);
+                result |= (sum >> 2) << byte;
+            }
+            out[i] = result;
+        }
+    }
+
+    void HalfToFloatRow(const uint16_t* in, float* out, size_t count)
+    {
+        for (size_t i = 0; i < count; ++i)
+            out[i] = HalfToFloat(in[i]);
+    }
+
+    void ToneMapRow(const float* in, float exposure, float inverseWhite2, uint32_t* out, size_t count)
+    {
+        for (size_t i = 0; i < count; ++i, in += 4)
+        {
+            uint32_t result = 0;
+            for (int channel = 0; channel < 4; ++channel)
+            {
+                float v = in[channel];
+                if (channel < 3)
+                {
+                    float x = (v > 0.0f ? v : 0.0f) * exposure;
+                    v = x * (1.0f + x * inverseWhite2) / (1.0f + x);
+                }
+                v = v * 255.0f + 0.5f;
+                v = v > 0.0f ? v : 0.0f;
+                v = v < 255.0f ? v : 255.0f;
+                result |= (uint32_t)(int)v << (8 * channel);
+            }
+            out[i] = result;
+        }
+    }
+
+    const KernelTable table = { SimdLevel::Scalar, TransformPoints, RasterRow, RasterRowUnorm16, RasterRowUnorm24Stencil8, Fill32, ResolveSamples,
+        OcclusionRow, UpsampleRow, DepthToGrayRow, DownsampleRow, HalfToFloatRow, ToneMapRow };
+}
+
+const KernelTable* GetScalarKernels()
+{
+    return &table;
+}
@@ -0,0 +1,458 @@
+#include "kernels.h"
+
+#ifdef KERNELS_X86
+#include <emmintrin.h>
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    void TransformPoints(const float* m, const float* in, float* out, int count)
+    {
+        __m128 c0 = _mm_setr_ps(m[0], m[4], m[8], m[12]);
+        __m128 c1 = _mm_setr_ps(m[1], m[5], m[9], m[13]);
+        __m128 c2 = _mm_setr_ps(m[2], m[6], m[10], m[14]);
+        __m128 c3 = _mm_setr_ps(m[3], m[7], m[11], m[15]);
+
+        for (int i = 0; i < count; ++i, in += 3, out += 4)
+        {
+            __m128 r = _mm_add_ps(_mm_mul_ps(c0, _mm_set1_ps(in[0])), _mm_mul_ps(c1, _mm_set1_ps(in[1])));
+            r = _mm_add_ps(r, _mm_mul_ps(c2, _mm_set1_ps(in[2])));
+            _mm_storeu_ps(out, _mm_add_ps(r, c3));
+        }
+    }
+
+    int RasterRow(const ::RasterRow& row, const float* depthRow, RowFragments& out)
+    {
+        const __m128 one = _mm_set1_ps(1.0f);
+        const __m128 lanes = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+        const __m128 alphaY = _mm_set1_ps(row.AlphaY);
+        const __m128 alphaDx = _mm_set1_ps(row.AlphaDx);
+        const __m128 betaY = _mm_set1_ps(row.BetaY);
+        const __m128 betaDx = _mm_set1_ps(row.BetaDx);
+        const __m128 za = _mm_set1_ps(row.ZA);
+        const __m128 zb = _mm_set1_ps(row.ZB);
+        const __m128 zc = _mm_set1_ps(row.ZC);
+
+        alignas(16) float alphas[4], betas[4], depths[4];
+
+        int count = 0;
+        int x = row.MinX;
+        for (; x + 3 <= row.MaxX; x += 4)
+        {
+            __m128 xs = _mm_add_ps(_mm_set1_ps((float)x), lanes);
+            __m128 alpha = _mm_add_ps(alphaY, _mm_mul_ps(xs, alphaDx));
+            __m128 beta = _mm_add_ps(betaY, _mm_mul_ps(xs, betaDx));
+            __m128 sigma = _mm_sub_ps(_mm_sub_ps(one, alpha), beta);
+            __m128 depth = _mm_add_ps(_mm_add_ps(_mm_mul_ps(za, sigma), _mm_mul_ps(alpha, zb)), _mm_mul_ps(beta, zc));
+
+            __m128 passed = _mm_cmplt_ps(_mm_loadu_ps(depthRow + x), depth);
+
+            int mask = _mm_movemask_ps(passed);
+            if (!mask)
+                continue;
+
+            _mm_store_ps(alphas, alpha);
+            _mm_store_ps(betas, beta);
+            _mm_store_ps(depths, depth);
+            for (int i = 0; i < 4; ++i)
+            {
+                if (mask & (1 << i))
+                {
+                    out.X[count] = x + i;
+                    out.Alpha[count] = alphas[i];
+                    out.Beta[count] = betas[i];
+                    out.Depth[count] = depths[i];
+                    ++count;
+                }
+            }
+        }
+
+        if (x <= row.MaxX)
+        {
+            ::RasterRow tail = row;
+            tail.MinX = x;
+            RowFragments tailOut = { out.X + count, out.Alpha + count, out.Beta + count, out.Depth + count };
+            count += GetScalarKernels()->RasterRow(tail, depthRow, tailOut);
+        }
+
+        return count;
+    }
+
+    // 16-bit depths are widened to 32 bits, 24-bit ones are masked out of their stencil. Both compare as signed integers
+    // since they stay below 2^24.
+    template <class Stored>
+    int rasterRowUnorm(const ::RasterRow& row, const Stored* depthRow, RowFragments& out)
+    {
+        const __m128 one = _mm_set1_ps(1.0f);
+        const __m128 half = _mm_set1_ps(1.5f);
+        const __m128 lanes = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+        const __m128 alphaY = _mm_set1_ps(row.AlphaY);
+        const __m128 alphaDx = _mm_set1_ps(row.AlphaDx);
+        const __m128 betaY = _mm_set1_ps(row.BetaY);
+        const __m128 betaDx = _mm_set1_ps(row.BetaDx);
+        const __m128 za = _mm_set1_ps(row.ZA);
+        const __m128 zb = _mm_set1_ps(row.ZB);
+        const __m128 zc = _mm_set1_ps(row.ZC);
+        const __m128 depthScale = _mm_set1_ps(row.DepthScale);
+        const __m128 depthMax = _mm_set1_ps(row.DepthMax);
+        const __m128i depthBits = _mm_set1_epi32(0xffffff);
+        const __m128i stencilMask = _mm_set1_epi32((int)row.StencilMask);
+        const __m128i stencilReference = _mm_set1_epi32((int)row.StencilReference);
+
+        alignas(16) float alphas[4], betas[4], depths[4];
+
+        int count = 0;
+        int x = row.MinX;
+        for (; x + 3 <= row.MaxX; x += 4)
+        {
+            __m128 xs = _mm_add_ps(_mm_set1_ps((float)x), lanes);
+            __m128 alpha = _mm_add_ps(alphaY, _mm_mul_ps(xs, alphaDx));
+            __m128 beta = _mm_add_ps(betaY, _mm_mul_ps(xs, betaDx));
+            __m128 sigma = _mm_sub_ps(_mm_sub_ps(one, alpha), beta);
+            __m128 depth = _mm_add_ps(_mm_add_ps(_mm_mul_ps(za, sigma), _mm_mul_ps(alpha, zb)), _mm_mul_ps(beta, zc));
+            __m128i value = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(_mm_add_ps(_mm_mul_ps(depth, depthScale), half), one), depthMax));
+
+            __m128i passed;
+            if constexpr (sizeof(Stored) == 2)
+            {
+                __m128i stored = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i*)(depthRow + x)), _mm_setzero_si128());
+                passed = _mm_cmplt_epi32(stored, value);
+            }
+            else
+            {
+                __m128i stored = _mm_loadu_si128((const __m128i*)(depthRow + x));
+                passed = _mm_and_si128(_mm_cmplt_epi32(_mm_and_si128(stored, depthBits), value),
+                    _mm_cmpeq_epi32(_mm_and_si128(stored, stencilMask), stencilReference));
+            }
+
+            int mask = _mm_movemask_ps(_mm_castsi128_ps(passed));
+            if (!mask)
+                continue;
+
+            _mm_store_ps(alphas, alpha);
+            _mm_store_ps(betas, beta);
+            _mm_store_ps(depths, _mm_cvtepi32_ps(value));
+            for (int i = 0; i < 4; ++i)
+            {
+                if (mask & (1 << i))
+                {
+                    out.X[count] = x + i;
+                    out.Alpha[count] = alphas[i];
+                    out.Beta[count] = betas[i];
+                    out.Depth[count] = depths[i];
+                    ++count;
+                }
+            }
+        }
+
+        if (x <= row.MaxX)
+        {
+            ::RasterRow tail = row;
+            tail.MinX = x;
+            RowFragments tailOut = { out.X + count, out.Alpha + count, out.Beta + count, out.Depth + count };
+            if constexpr (sizeof(Stored) == 2)
+                count += GetScalarKernels()->RasterRowUnorm16(tail, depthRow, tailOut);
+            else
+                count += GetScalarKernels()->RasterRowUnorm24Stencil8(tail, depthRow, tailOut);
+        }
+
+        return count;
+    }
+
+    int RasterRowUnorm16(const ::RasterRow& row, const uint16_t* depthRow, RowFragments& out)
+    {
+        return rasterRowUnorm(row, depthRow, out);
+    }
+
+    int RasterRowUnorm24Stencil8(const ::RasterRow& row, const uint32_t* depthRow, RowFragments& out)
+    {
+        return rasterRowUnorm(row, depthRow, out);
+    }
+
+    void Fill32(uint32_t* destination, size_t count, uint32_t value)
+    {
+        __m128i v = _mm_set1_epi32((int)value);
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4)
+            _mm_storeu_si128((__m128i*)(destination + i), v);
+        for (; i < count; ++i)
+            destination[i] = value;
+    }
+
+    // Four pixels per iteration, bytes widened to 16 bits so that eight samples can be summed.
+    void ResolveSamples(const uint32_t* samples, size_t planeStride, int sampleCount, uint32_t* out, size_t count)
+    {
+        int shift = sampleCount == 8 ? 3 : sampleCount == 4 ? 2 : sampleCount == 2 ? 1 : 0;
+        __m128i shiftCount = _mm_cvtsi32_si128(shift);
+        __m128i round = _mm_set1_epi16((short)((1 << shift) >> 1));
+        __m128i zero = _mm_setzero_si128();
+
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4)
+        {
+            __m128i lo = round, hi = round;
+            for (int s = 0; s < sampleCount; ++s)
+            {
+                __m128i v = _mm_loadu_si128((const __m128i*)(samples + s * planeStride + i));
+                lo = _mm_add_epi16(lo, _mm_unpacklo_epi8(v, zero));
+                hi = _mm_add_epi16(hi, _mm_unpackhi_epi8(v, zero));
+            }
+            lo = _mm_srl_epi16(lo, shiftCount);
+            hi = _mm_srl_epi16(hi, shiftCount);
+            _mm_storeu_si128((__m128i*)(out + i), _mm_packus_epi16(lo, hi));
+        }
+        for (; i < count; ++i)
+        {
+            uint32_t result = 0;
+            for (int byte = 0; byte < 32; byte += 8)
+            {
+                uint32_t sum = (1u << shift) >> 1;
+                for (int s = 0; s < sampleCount; ++s)
+                    sum += (samples[s * planeStride + i] >> byte) & 0xff;
+                result |= (sum >> shift) << byte;
+            }
+            out[i] = result;
+        }
+    }
+
+    void OcclusionRow(const ::OcclusionRow& row)
+    {
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 one = _mm_set1_ps(1.0f);
+        const __m128 bias = _mm_set1_ps(row.Bias);
+        const __m128 inverseRange = _mm_set1_ps(row.InverseRange);
+        const __m128 scale = _mm_set1_ps(row.Scale);
+        const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+
+        // The one-sided difference of smaller magnitude, the second one when they are equal.
+        auto smaller = [&](__m128 a, __m128 b)
+        {
+            __m128 mask = _mm_cmplt_ps(_mm_and_ps(a, absMask), _mm_and_ps(b, absMask));
+            return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+        };
+
+        int x = 0;
+        for (; x + 4 <= row.Width; x += 4)
+        {
+            const float* depth = row.Depth + x;
+            __m128 center = _mm_loadu_ps(depth);
+            __m128 gradientX = smaller(_mm_sub_ps(center, _mm_loadu_ps(depth - 1)), _mm_sub_ps(_mm_loadu_ps(depth + 1), center));
+            __m128 gradientY = smaller(_mm_sub_ps(center, _mm_loadu_ps(depth - row.Stride)), _mm_sub_ps(_mm_loadu_ps(depth + row.Stride), center));
+            __m128 occlusion = zero;
+            for (int s = 0; s < row.SampleCount; ++s)
+            {
+                __m128 plane = _mm_add_ps(_mm_add_ps(center, _mm_mul_ps(gradientX, _mm_set1_ps(row.SampleX[s]))), _mm_mul_ps(gradientY, _mm_set1_ps(row.SampleY[s])));
+                __m128 diff = _mm_sub_ps(_mm_loadu_ps(depth + row.Samples[s]), plane);
+                __m128 amount = _mm_max_ps(zero, _mm_sub_ps(one, _mm_mul_ps(_mm_sub_ps(diff, bias), inverseRange)));
+                occlusion = _mm_add_ps(occlusion, _mm_and_ps(_mm_cmpgt_ps(diff, bias), amount));
+            }
+            _mm_storeu_ps(row.Out + x, _mm_sub_ps(one, _mm_mul_ps(occlusion, scale)));
+        }
+        for (; x < row.Width; ++x)
+        {
+            const float* depth = row.Depth + x;
+            float left = depth[0] - depth[-1], right = depth[1] - depth[0];
+            float up = depth[0] - depth[-row.Stride], down = depth[row.Stride] - depth[0];
+            float gradientX = std::fabs(left) < std::fabs(right) ? left : right;
+            float gradientY = std::fabs(up) < std::fabs(down) ? up : down;
+            float occlusion = 0.0f;
+            for (int s = 0; s < row.SampleCount; ++s)
+            {
+                float diff = depth[row.Samples[s]] - (depth[0] + gradientX * row.SampleX[s] + gradientY * row.SampleY[s]);
+                occlusion += diff > row.Bias ? std::max(0.0f, 1.0f - (diff - row.Bias) * row.InverseRange) : 0.0f;
+            }
+            row.Out[x] = 1.0f - occlusion * row.Scale;
+        }
+    }
+
+    // Four pixels per iteration, they use two texels of each coarse row. Each texel goes to the pixel pair it covers,
+    // the far texels are those of the pairs on either side, even pixels take the left one.
+    void UpsampleRow(const ::UpsampleRow& row)
+    {
+        float nearWeight0 = row.Weight0 * 0.75f, farWeight0 = row.Weight0 * 0.25f;
+        float nearWeight1 = row.Weight1 * 0.75f, farWeight1 = row.Weight1 * 0.25f;
+        const __m128 one = _mm_set1_ps(1.0f);
+        const __m128 clampWeight = _mm_set1_ps(1e6f);
+        const __m128 sharpness = _mm_set1_ps(row.Sharpness);
+        const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+        const __m128 oddMask = _mm_castsi128_ps(_mm_setr_epi32(0, -1, 0, -1));
+        const __m128 nearW0 = _mm_set1_ps(nearWeight0), farW0 = _mm_set1_ps(farWeight0);
+        const __m128 nearW1 = _mm_set1_ps(nearWeight1), farW1 = _mm_set1_ps(farWeight1);
+
+        auto pair = [](const float* p) { __m128 v = _mm_castpd_ps(_mm_load_sd((const double*)p)); return _mm_unpacklo_ps(v, v); };
+        auto nearFar = [&](const float* coarse, int i, __m128& nearValue, __m128& farValue)
+        {
+            nearValue = pair(coarse + i);
+            farValue = _mm_or_ps(_mm_and_ps(oddMask, pair(coarse + i + 1)), _mm_andnot_ps(oddMask, pair(coarse + i - 1)));
+        };
+        auto weight = [&](__m128 bilinear, __m128 depth, __m128 coarse)
+        {
+            __m128 distance = _mm_and_ps(_mm_sub_ps(depth, coarse), absMask);
+            return _mm_div_ps(bilinear, _mm_add_ps(one, _mm_min_ps(_mm_mul_ps(distance, sharpness), clampWeight)));
+        };
+
+        int x = 0;
+        for (; x + 4 <= row.Width; x += 4)
+        {
+            int i = x >> 1;
+            __m128 depth = _mm_loadu_ps(row.Depth + x);
+            __m128 nearDepth0, farDepth0, nearDepth1, farDepth1, nearOcclusion0, farOcclusion0, nearOcclusion1, farOcclusion1;
+            nearFar(row.CoarseDepth0, i, nearDepth0, farDepth0);
+            nearFar(row.CoarseDepth1, i, nearDepth1, farDepth1);
+            nearFar(row.CoarseOcclusion0, i, nearOcclusion0, farOcclusion0);
+            nearFar(row.CoarseOcclusion1, i, nearOcclusion1, farOcclusion1);
+
+            __m128 wa = weight(nearW0, depth, nearDepth0);
+            __m128 wb = weight(farW0, depth, farDepth0);
+            __m128 wc = weight(nearW1, depth, nearDepth1);
+            __m128 wd = weight(farW1, depth, farDepth1);
+            __m128 total = _mm_add_ps(_mm_add_ps(_mm_add_ps(wa, wb), wc), wd);
+            __m128 sum = _mm_add_ps(_mm_mul_ps(wa, nearOcclusion0), _mm_mul_ps(wb, farOcclusion0));
+            sum = _mm_add_ps(sum, _mm_mul_ps(wc, nearOcclusion1));
+            sum = _mm_add_ps(sum, _mm_mul_ps(wd, farOcclusion1));
+            _mm_storeu_ps(row.Out + x, _mm_div_ps(sum, total));
+        }
+        for (; x < row.Width; ++x)
+        {
+            int nearX = x >> 1;
+            int farX = x & 1 ? nearX + 1 : nearX - 1;
+            float depth = row.Depth[x];
+            float wa = nearWeight0 / (1.0f + std::min(std::fabs(depth - row.CoarseDepth0[nearX]) * row.Sharpness, 1e6f));
+            float wb = farWeight0 / (1.0f + std::min(std::fabs(depth - row.CoarseDepth0[farX]) * row.Sharpness, 1e6f));
+            float wc = nearWeight1 / (1.0f + std::min(std::fabs(depth - row.CoarseDepth1[nearX]) * row.Sharpness, 1e6f));
+            float wd = farWeight1 / (1.0f + std::min(std::fabs(depth - row.CoarseDepth1[farX]) * row.Sharpness, 1e6f));
+            float total = wa + wb + wc + wd;
+            float sum = wa * row.CoarseOcclusion0[nearX] + wb * row.CoarseOcclusion0[farX] + wc * row.CoarseOcclusion1[nearX] + wd * row.CoarseOcclusion1[farX];
+            row.Out[x] = sum / total;
+        }
+    }
+
+    void DepthToGrayRow(const float* depth, float offset, float scale, uint32_t* out, size_t count)
+    {
+        const __m128 offsets = _mm_set1_ps(offset);
+        const __m128 scales = _mm_set1_ps(scale);
+        const __m128 half = _mm_set1_ps(0.5f);
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 white = _mm_set1_ps(255.0f);
+        const __m128i alpha = _mm_set1_epi32((int)0xff000000u);
+
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4)
+        {
+            __m128 v = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(depth + i), offsets), scales), half);
+            __m128i gray = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(v, zero), white));
+            gray = _mm_or_si128(_mm_or_si128(gray, _mm_slli_epi32(gray, 8)), _mm_or_si128(_mm_slli_epi32(gray, 16), alpha));
+            _mm_storeu_si128((__m128i*)(out + i), gray);
+        }
+        for (; i < count; ++i)
+        {
+            uint32_t gray = (uint32_t)(int)std::min(std::max((depth[i] - offset) * scale + 0.5f, 0.0f), 255.0f);
+            out[i] = 0xff000000u | gray * 0x010101u;
+        }
+    }
+
+    // Four pixels per iteration. Even input pixels are shuffled into the low half of each register and odd ones into
+    // the high half, so that widening both halves and adding them sums the pairs.
+    void DownsampleRow(const uint32_t* row0, const uint32_t* row1, uint32_t* out, size_t count)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i round = _mm_set1_epi16(2);
+        auto pairs = [&](const uint32_t* pixels)
+        {
+            __m128i v = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)pixels), _MM_SHUFFLE(3, 1, 2, 0));
+            return _mm_add_epi16(_mm_unpacklo_epi8(v, zero), _mm_unpackhi_epi8(v, zero));
+        };
+
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4)
+        {
+            __m128i lo = _mm_add_epi16(_mm_add_epi16(pairs(row0 + 2 * i), pairs(row1 + 2 * i)), round);
+            __m128i hi = _mm_add_epi16(_mm_add_epi16(pairs(row0 + 2 * i + 4), pairs(row1 + 2 * i + 4)), round);
+            _mm_storeu_si128((__m128i*)(out + i), _mm_packus_epi16(_mm_srli_epi16(lo, 2), _mm_srli_epi16(hi, 2)));
+        }
+        for (; i < count; ++i)
+        {
+            uint32_t result = 0;
+            for (int byte = 0; byte < 32; byte += 8)
+            {
+                uint32_t sum = 2 + ((row0[2 * i] >> byte) & 0xff) + ((row0[2 * i + 1] >> byte) & 0xff)
+                    + ((row1[2 * i] >> byte) & 0xff) + ((row1[2 * i + 1] >> byte) & 0xff);
+                result |= (sum >> 2) << byte;
+            }
+            out[i] = result;
+        }
+    }
+
+    // SSE2 has no half precision conversions.
+    void HalfToFloatRow(const uint16_t* in, float* out, size_t count)
+    {
+        for (size_t i = 0; i < count; ++i)
+            out[i] = HalfToFloat(in[i]);
+    }
+
+    // A pixel per register, alpha is picked back from the input after the curve.
+    void ToneMapRow(const float* in, float exposure, float inverseWhite2, uint32_t* out, size_t count)
+    {
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 one = _mm_set1_ps(1.0f);
+        const __m128 half = _mm_set1_ps(0.5f);
+        const __m128 white = _mm_set1_ps(255.0f);
+        const __m128 exposures = _mm_set1_ps(exposure);
+        const __m128 inverseWhites = _mm_set1_ps(inverseWhite2);
+        const __m128 alpha = _mm_castsi128_ps(_mm_setr_epi32(0, 0, 0, -1));
+
+        size_t i = 0;
+        for (; i + 2 <= count; i += 2)
+        {
+            __m128i pixels[2];
+            for (int p = 0; p < 2; ++p)
+            {
+                __m128 c = _mm_loadu_ps(in + 4 * (i + p));
+                __m128 x = _mm_mul_ps(_mm_max_ps(c, zero), exposures);
+                __m128 mapped = _mm_div_ps(_mm_mul_ps(x, _mm_add_ps(one, _mm_mul_ps(x, inverseWhites))), _mm_add_ps(one, x));
+                __m128 v = _mm_or_ps(_mm_and_ps(alpha, c), _mm_andnot_ps(alpha, mapped));
+                v = _mm_add_ps(_mm_mul_ps(v, white), half);
+                pixels[p] = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(v, zero), white));
+            }
+            __m128i packed = _mm_packs_epi32(pixels[0], pixels[1]);
+            _mm_storel_epi64((__m128i*)(out + i), _mm_packus_epi16(packed, packed));
+        }
+        for (; i < count; ++i)
+        {
+            const float* pixel = in + 4 * i;
+            uint32_t result = 0;
+            for (int channel = 0; channel < 4; ++channel)
+            {
+                float v = pixel[channel];
+                if (channel < 3)
+                {
+                    float x = (v > 0.0f ? v : 0.0f) * exposure;
+                    v = x * (1.0f + x * inverseWhite2) / (1.0f + x);
+                }
+                v = v * 255.0f + 0.5f;
+                v = v > 0.0f ? v : 0.0f;
+                v = v < 255.0f ? v : 255.0f;
+                result |= (uint32_t)(int)v << (8 * channel);
+            }
+            out[i] = result;
+        }
+    }
+
+    const KernelTable table = { SimdLevel::SSE2, TransformPoints, RasterRow, RasterRowUnorm16, RasterRowUnorm24Stencil8, Fill32, ResolveSamples,
+        OcclusionRow, UpsampleRow, DepthToGrayRow, DownsampleRow, HalfToFloatRow, ToneMapRow };
+}
+
+const KernelTable* GetSSE2Kernels()
+{
+    return &table;
+}
+
+#else
+
+const KernelTable* GetSSE2Kernels()
+{
+    return nullptr;
+}
+
+#endif
@@ -0,0 +1,129 @@
+#include "lights.h"
+#include "matrix.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+template <class Visit>
+void TiledLights::forEachOverlap(Visit visit) const
+{
+    for (const LightBounds& light : bounds)
+    {
+        for (int ty = light.MinTileY; ty <= light.MaxTileY; ++ty)
+        {
+            for (int tx = light.MinTileX; tx <= light.MaxTileX; ++tx)
+            {
+                int tile = ty * tilesX + tx;
+                if (light.Nearest >= tileFarthest[tile] && light.Farthest <= tileNearest[tile])
+                    visit(tile, light.Light);
+            }
+        }
+    }
+}
+
+void TiledLights::Build(const GraphicsLibrary& GL, const std::vector<PointLight>& pointLights)
+{
+    int width = GL.Output.get_width();
+    int height = GL.Output.get_height();
+    tilesX = (width + TileSize - 1) / TileSize;
+    tilesY = (height + TileSize - 1) / TileSize;
+    int tileCount = tilesX * tilesY;
+    lights = pointLights;
+
+    tileFarthest.resize(tileCount);
+    tileNearest.resize(tileCount);
+    for (int ty = 0; ty < tilesY; ++ty)
+    {
+        for (int tx = 0; tx < tilesX; ++tx)
+        {
+            int tile = ty * tilesX + tx;
+            if (!GL.DepthBounds(tx * TileSize, ty * TileSize, tx * TileSize + TileSize - 1, ty * TileSize + TileSize - 1, tileFarthest[tile], tileNearest[tile]))
+            {
+                tileFarthest[tile] = std::numeric_limits<float>::max();
+                tileNearest[tile] = std::numeric_limits<float>::lowest();
+            }
+        }
+    }
+
+    // The view space box around each sphere projects inside the hull of its projected corners, as long as they are
+    // all in front of the eye. Spheres reaching behind it cover the whole screen and every depth.
+    Mat4 toScreen = GL.Viewport * GL.Projection;
+    bounds.clear();
+    for (int index = 0; index < (int)lights.size(); ++index)
+    {
+        const PointLight& light = lights[index];
+        Vec4f center = GL.View * Vec4f(light.Position);
+        float minX = std::numeric_limits<float>::max(), minY = minX, farthest = minX;
+        float maxX = std::numeric_limits<float>::lowest(), maxY = maxX, nearest = maxX;
+        bool inFront = true;
+        for (int corner = 0; corner < 8 && inFront; ++corner)
+        {
+            Vec4f position(center.x + (corner & 1 ? light.Radius : -light.Radius), center.y + (corner & 2 ? light.Radius : -light.Radius),
+                center.z + (corner & 4 ? light.Radius : -light.Radius), 1.0f);
+            Vec4f screen = toScreen * position;
+            inFront = screen.w > 1e-6f;
+            minX = std::min(minX, screen.x / screen.w);
+            maxX = std::max(maxX, screen.x / screen.w);
+            minY = std::min(minY, screen.y / screen.w);
+            maxY = std::max(maxY, screen.y / screen.w);
+            farthest = std::min(farthest, screen.z / screen.w);
+            nearest = std::max(nearest, screen.z / screen.w);
+        }
+
+        LightBounds lightBounds = { index, 0, 0, tilesX - 1, tilesY - 1, std::numeric_limits<float>::lowest(), std::numeric_limits<float>::max() };
+        if (inFront)
+        {
+            if (maxX < 0 || maxY < 0 || minX >= width || minY >= height)
+                continue;
+            lightBounds.MinTileX = std::max((int)minX, 0) / TileSize;
+            lightBounds.MinTileY = std::max((int)minY, 0) / TileSize;
+            lightBounds.MaxTileX = std::min((int)maxX, width - 1) / TileSize;
+            lightBounds.MaxTileY = std::min((int)maxY, height - 1) / TileSize;
+            lightBounds.Farthest = farthest;
+            lightBounds.Nearest = nearest;
+        }
+        bounds.push_back(lightBounds);
+    }
+
+    // Counted first, then written into each tile's range.
+    offsets.assign(tileCount + 1, 0);
+    forEachOverlap([&](int tile, int) { ++offsets[tile + 1]; });
+    for (int tile = 0; tile < tileCount; ++tile)
+        offsets[tile + 1] += offsets[tile];
+
+    indices.resize(offsets[tileCount]);
+    nextIndex.assign(offsets.begin(), offsets.end() - 1);
+    forEachOverlap([&](int tile, int light) { indices[nextIndex[tile]++] = light; });
+}
+
+TiledLights::TileList TiledLights::Tile(int x, int y) const
+{
+    int tx = std::min(std::max(x / TileSize, 0), tilesX - 1);
+    int ty = std::min(std::max(y / TileSize, 0), tilesY - 1);
+    int tile = ty * tilesX + tx;
+    return { indices.data() + offsets[tile], offsets[tile + 1] - offsets[tile] };
+}
+
+Vec3f TiledLights::Shade(int x, int y, const Vec3f& position, const Vec3f& normal) const
+{
+    Vec3f received;
+    TileList tile = Tile(x, y);
+    for (int i = 0; i < tile.Count; ++i)
+    {
+        const PointLight& light = lights[tile.Indices[i]];
+        Vec3f toLight = light.Position - position;
+        float distance2 = toLight * toLight;
+        float radius2 = light.Radius * light.Radius;
+        if (distance2 >= radius2)
+            continue;
+
+        float facing = normal * toLight;
+        if (facing <= 0.0f)
+            continue;
+
+        // Smooth falloff reaching 0 at the radius.
+        float falloff = 1.0f - distance2 / radius2;
+        received = received + light.Color * (facing / std::sqrt(distance2) * falloff * falloff);
+    }
+    return received;
+}
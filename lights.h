@@ -0,0 +1,71 @@
+#pragma once
+
+#include "GL.h"
+#include "geometry.h"
+#include <vector>
+
+struct PointLight
+{
+    Vec3f Position;
+    // Distance at which the light has faded out, it reaches nothing beyond.
+    float Radius;
+    // Red, green and blue intensities, 1 lights a surface facing it up to its diffuse color.
+    Vec3f Color;
+};
+
+// Point lights sorted into the screen tiles they may reach, for forward shading with many lights. Build bounds each
+// light's sphere on screen and in depth, and lists it in the tiles it overlaps whose drawn depths it also overlaps,
+// so the depths of the frame must be drawn first, with a depth only pass for instance. Fragment shaders then only go
+// through the lights of their own tile.
+class TiledLights
+{
+public:
+    static constexpr int TileSize = 16;
+
+    struct TileList
+    {
+        const int* Indices;
+        int Count;
+    };
+
+    // Lights are in world space, GL's View, Projection and Viewport are those of the frame.
+    void Build(const GraphicsLibrary& GL, const std::vector<PointLight>& lights);
+
+    // Lights listed for the tile of pixel (x, y).
+    TileList Tile(int x, int y) const;
+
+    const PointLight& Light(int index) const { return lights[index]; }
+
+    // Diffuse light received at pixel (x, y) by a surface at position with the given unit normal, both in world space.
+    Vec3f Shade(int x, int y, const Vec3f& position, const Vec3f& normal) const;
+
+    int TileCount() const { return tilesX * tilesY; }
+    // Lights listed over every tile, lights per tile once divided by TileCount.
+    size_t ListedCount() const { return indices.size(); }
+
+private:
+    // Tiles and depths a light may reach, lights entirely off screen have none.
+    struct LightBounds
+    {
+        int Light;
+        int MinTileX, MinTileY, MaxTileX, MaxTileY;
+        float Farthest, Nearest;
+    };
+
+    template <class Visit>
+    void forEachOverlap(Visit visit) const;
+
+    int tilesX = 0;
+    int tilesY = 0;
+    std::vector<PointLight> lights;
+    std::vector<LightBounds> bounds;
+
+    // Depth range drawn in each tile, tiles where nothing was drawn get an empty one.
+    std::vector<float> tileFarthest;
+    std::vector<float> tileNearest;
+
+    // Tile t lists indices[offsets[t]] to indices[offsets[t + 1]].
+    std::vector<int> offsets;
+    std::vector<int> indices;
+    std::vector<int> nextIndex;
+};
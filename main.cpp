@@ -1,8 +1,22 @@
 ﻿#include "GL.h"
+#include "ambientocclusion.h"
+#include "lights.h"
 #include "matrix.h"
+#include "framestream.h"
+#include "pipeline.h"
+#include "postprocess.h"
+#include "scene.h"
+#include "shadow.h"
+#include "splitframe.h"
 #include <iostream>
 #include <algorithm>
 #include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <random>
+#include <string>
 
 const TGAColor white = TGAColor(255, 255, 255, 255);
 const TGAColor red = TGAColor(255, 0, 0, 255);
@@ -81,66 +95,312 @@ public:
     }
 };
 
-struct PhongShader : public IShader
+struct PhongUniforms
 {
-protected:
-    Vec2f varyingUV[3];
-    Vec3f varyingNormal[3];
+    Mat4 ModelViewInverseTranspose;
+    Vec3f LightDirection;
+    Mat4 ModelToShadow;
+    const ShadowMap* Shadows;
+    Mat4 ModelToWorld;
+    Mat4 ModelToWorldInverseTranspose;
+    const TiledLights* Lights;
+};
 
-    Vec3f lightDirection;
-    Model& model;
+struct PhongVaryings
+{
+    Vec2f UV[3];
+    Vec3f Normal[3];
+    Vec3f ShadowPosition[3];
+    Vec3f WorldPosition[3];
+    Vec2f ScreenPosition[3];
+};
 
-    Mat4 uniformModelView;
-    Mat4 uniformModelViewInverseTranspose;
+struct PhongShader : public DeferrableShader<PhongUniforms, PhongVaryings>
+{
+protected:
+    Vec3f light;
+    Model& model;
+    const ShadowMap* shadows;
+    const TiledLights* lights;
 
 public:
-    PhongShader(const Vec3f& light, Model& model, const Mat4& modelView, const Mat4& modelViewInverseTranspose) : 
-        lightDirection(light), 
+    PhongShader(const Vec3f& light, Model& model, const ShadowMap* shadows = nullptr, const TiledLights* lights = nullptr) : 
+        light(light), 
         model(model),
-        uniformModelView(modelView),
-        uniformModelViewInverseTranspose(modelViewInverseTranspose)
+        shadows(shadows),
+        lights(lights)
     {
-        Vec4f vec = modelView * lightDirection;
-        lightDirection = {vec.x, vec.y, vec.z};
+    }
+
+    virtual void BeginDraw() override
+    {
+        Mat4 modelView = GL->Projection * GL->ModelView;
+        Uniforms.ModelViewInverseTranspose = Mat4::Transpose(modelView.Inverse());
+
+        Vec4f vec = modelView * light;
+        Uniforms.LightDirection = {vec.x, vec.y, vec.z};
+
+        // Back to world space, then into the light's map.
+        Uniforms.Shadows = shadows;
+        Uniforms.Lights = lights;
+        if (shadows || lights)
+            Uniforms.ModelToWorld = GL->View.InverseAffine() * GL->ModelView;
+        if (shadows)
+            Uniforms.ModelToShadow = shadows->WorldToMap() * Uniforms.ModelToWorld;
+        if (lights)
+            Uniforms.ModelToWorldInverseTranspose = Mat4::Transpose(Uniforms.ModelToWorld.Inverse());
     }
 
     virtual Vec4f VertexStage(const Vertex& vec, int vertexId) override
     {
-        varyingUV[vertexId] = vec.UV;
-        varyingNormal[vertexId] = vec.Normal;
-        return GL->Viewport * GL->Projection * GL->ModelView * Vec4f(vec.Pos);
+        Varyings.UV[vertexId] = vec.UV;
+        Varyings.Normal[vertexId] = vec.Normal;
+        if (shadows)
+        {
+            Vec4f shadowPosition = Uniforms.ModelToShadow * Vec4f(vec.Pos);
+            Varyings.ShadowPosition[vertexId] = { shadowPosition.x, shadowPosition.y, shadowPosition.z };
+        }
+
+        Vec4f screen = GL->Viewport * GL->Projection * GL->ModelView * Vec4f(vec.Pos);
+        if (lights)
+        {
+            Vec4f world = Uniforms.ModelToWorld * Vec4f(vec.Pos);
+            Varyings.WorldPosition[vertexId] = { world.x, world.y, world.z };
+            Varyings.ScreenPosition[vertexId] = { screen.x / screen.w, screen.y / screen.w };
+        }
+        return screen;
     }
 
-    virtual bool FragmentStage(const Vec3f& bar, TGAColor& color) override
+    virtual bool Shade(const PhongUniforms& uniforms, const PhongVaryings& varyings, const Vec3f& bar, TGAColor& color) const override
     {
-        Vec2f uv = varyingUV[0] * bar.x + varyingUV[1] * bar.y + varyingUV[2] * bar.z;
-        Vec4f tmp = uniformModelViewInverseTranspose * model.normal(uv);
+        TGAColor diffuseColor;
+        float intensity[3];
+        lighting(uniforms, varyings, bar, diffuseColor, intensity);
+        TGAColor ambientColor = TGAColor(0, 0 ,0, 255);
+
+        for (int i = 0; i < 3; ++i)
+            color.raw[i] = std::min((int)(ambientColor.raw[i] + diffuseColor.raw[i] * intensity[i]), 255);
+
+        return true;
+    }
+
+    // Unclamped, highlights go over 1 and are left to the tone mapping.
+    virtual bool ShadeHdr(const PhongUniforms& uniforms, const PhongVaryings& varyings, const Vec3f& bar, Vec4f& color) const override
+    {
+        TGAColor diffuseColor;
+        float intensity[3];
+        lighting(uniforms, varyings, bar, diffuseColor, intensity);
+
+        float channels[3];
+        for (int i = 0; i < 3; ++i)
+            channels[i] = diffuseColor.raw[i] * intensity[i] / 255.f;
+
+        color = Vec4f(channels[2], channels[1], channels[0], 1.f);
+        return true;
+    }
+
+private:
+    // Light received by each channel, in blue, green, red order like the color.
+    void lighting(const PhongUniforms& uniforms, const PhongVaryings& varyings, const Vec3f& bar, TGAColor& diffuseColor, float* intensity) const
+    {
+        Vec2f uv = varyings.UV[0] * bar.x + varyings.UV[1] * bar.y + varyings.UV[2] * bar.z;
+        Vec4f tmp = uniforms.ModelViewInverseTranspose * model.normal(uv);
         Vec3f normal = Vec3f{ tmp.x, tmp.y, tmp.z };
         normal = normal.normalize();
 
+        const Vec3f& lightDirection = uniforms.LightDirection;
         Vec3f r = (normal * (normal * lightDirection * 2.0f) - lightDirection).normalize();
         
         float specular = std::pow(std::max(r.y, 0.0f), model.specular(uv));
 
         float diffuse = std::max(0.f, normal * lightDirection);
-        TGAColor ambientColor = TGAColor(0, 0 ,0, 255);
 
-        TGAColor diffuseColor = model.diffuse(uv);
+        diffuseColor = model.diffuse(uv);
 
-        for (int i = 0; i < 3; ++i)
-            color.raw[i] = std::min((int)(ambientColor.raw[i] + diffuseColor.raw[i] * (diffuse + 0.7f * specular)), 255);
+        float visibility = 1.f;
+        if (uniforms.Shadows)
+            visibility = uniforms.Shadows->Visibility(varyings.ShadowPosition[0] * bar.x + varyings.ShadowPosition[1] * bar.y + varyings.ShadowPosition[2] * bar.z);
 
-        return true;
+        // Point lights of the fragment's tile.
+        float pointLight[3] = { 0.f, 0.f, 0.f };
+        if (uniforms.Lights)
+        {
+            Vec3f position = varyings.WorldPosition[0] * bar.x + varyings.WorldPosition[1] * bar.y + varyings.WorldPosition[2] * bar.z;
+            Vec2f screen = varyings.ScreenPosition[0] * bar.x + varyings.ScreenPosition[1] * bar.y + varyings.ScreenPosition[2] * bar.z;
+            Vec4f world = uniforms.ModelToWorldInverseTranspose * model.normal(uv);
+            Vec3f received = uniforms.Lights->Shade((int)(screen.x + 0.5f), (int)(screen.y + 0.5f), position, Vec3f(world.x, world.y, world.z).normalize());
+            pointLight[0] = received.z;
+            pointLight[1] = received.y;
+            pointLight[2] = received.x;
+        }
+
+        for (int i = 0; i < 3; ++i)
+            intensity[i] = (diffuse + 0.7f * specular) * visibility + pointLight[i];
     }
 };
 
 
+bool parseColorFormat(const std::string& name, ColorFormat& format)
+{
+    if (name == "16f")
+        format = ColorFormat::Rgba16F;
+    else if (name == "32f")
+        format = ColorFormat::Rgba32F;
+    else
+        return false;
+    return true;
+}
+
+bool parseDepthFormat(const std::string& name, DepthFormat& format)
+{
+    if (name == "float32")
+        format = DepthFormat::Float32;
+    else if (name == "unorm16")
+        format = DepthFormat::Unorm16;
+    else if (name == "unorm24s8")
+        format = DepthFormat::Unorm24Stencil8;
+    else
+        return false;
+    return true;
+}
+
 int main(int argc, char** argv)
 {
-    const int windowWidth = 800;
-    const int windowHeight = 800;
+    int windowWidth = 800;
+    int windowHeight = 800;
+
+    const char* streamPath = nullptr;
+    const char* profilePath = nullptr;
+    int frameCount = 1;
+    int crowd = 0;
+    bool occlusion = false;
+    bool quantize = false;
+    int samples = 1;
+    bool pipelined = false;
+    int split = 1;
+    DepthFormat depthFormat = DepthFormat::Float32;
+    int shadowSize = 0;
+    int lightCount = 0;
+    bool ssao = false;
+    ColorFormat colorFormat = ColorFormat::Rgba8;
+    SimdLevel simd = SimdLevel::Auto;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--stream" && i + 1 < argc)
+            streamPath = argv[++i];
+        else if (arg == "--frames" && i + 1 < argc)
+            frameCount = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--profile" && i + 1 < argc)
+            profilePath = argv[++i];
+        else if (arg == "--simd" && i + 1 < argc && ParseSimdLevel(argv[i + 1], simd))
+            ++i;
+        else if (arg == "--crowd" && i + 1 < argc)
+            crowd = std::max(0, std::atoi(argv[++i]));
+        else if (arg == "--occlusion")
+            occlusion = true;
+        else if (arg == "--quantize")
+            quantize = true;
+        else if (arg == "--msaa" && i + 1 < argc)
+            samples = std::atoi(argv[++i]);
+        else if (arg == "--pipeline")
+            pipelined = true;
+        else if (arg == "--size" && i + 1 < argc && std::sscanf(argv[i + 1], "%dx%d", &windowWidth, &windowHeight) == 2 && windowWidth > 0 && windowHeight > 0)
+            ++i;
+        else if (arg == "--split" && i + 1 < argc)
+            split = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--depth" && i + 1 < argc && parseDepthFormat(argv[i + 1], depthFormat))
+            ++i;
+        else if (arg == "--shadows" && i + 1 < argc)
+            shadowSize = std::max(0, std::atoi(argv[++i]));
+        else if (arg == "--lights" && i + 1 < argc)
+            lightCount = std::max(0, std::atoi(argv[++i]));
+        else if (arg == "--ssao")
+            ssao = true;
+        else if (arg == "--hdr" && i + 1 < argc && parseColorFormat(argv[i + 1], colorFormat))
+            ++i;
+        else
+        {
+            std::cerr << "Usage: " << argv[0] << " [--stream <file|pipe|->] [--frames <count>] [--profile <json>]"
+                      << " [--simd <scalar|sse2|avx2|avx512|auto>] [--crowd <size>] [--occlusion] [--quantize]"
+                      << " [--msaa <1|2|4|8>] [--pipeline] [--size <width>x<height>] [--split <workers>]"
+                      << " [--depth <float32|unorm16|unorm24s8>] [--shadows <map size>]"
+                      << " [--lights <point lights>] [--ssao] [--hdr <16f|32f>]" << std::endl;
+            return 1;
+        }
+    }
+
+    if (split > 1 && streamPath)
+    {
+        std::cerr << "--split renders a single frame, it can't be used with --stream" << std::endl;
+        return 1;
+    }
+
+    if (lightCount > 0 && pipelined)
+    {
+        std::cerr << "--lights needs the depths of a frame before shading it, it can't be used with --pipeline" << std::endl;
+        return 1;
+    }
 
-    GraphicsLibrary GL(windowWidth, windowHeight);
+    // --ssao darkens each frame by its ambient occlusion once resolved.
+    AmbientOcclusion ambientOcclusion;
+
+    // --split draws a single frame in horizontal bands, one per worker process, the context only holds a band. With
+    // --ssao, bands are drawn with the rows around them its samples reach.
+    int bandHeight = (windowHeight + split - 1) / split;
+    int bandOverlap = 0;
+    if (split > 1 && ssao)
+    {
+        bandOverlap = ambientOcclusion.Reach();
+        bandHeight = std::min(bandHeight + (bandHeight & 1) + 2 * bandOverlap, windowHeight);
+    }
+    GraphicsLibrary GL(windowWidth, bandHeight, simd);
+    std::cerr << "Using " << SimdLevelName(GL.Kernels->Level) << " kernels" << std::endl;
+    GL.OcclusionCulling = occlusion;
+    if (!GL.SetSampleCount(samples))
+    {
+        std::cerr << "Unsupported sample count " << samples << ", use 1, 2, 4 or 8" << std::endl;
+        return 1;
+    }
+    if (!GL.SetDepthFormat(depthFormat))
+    {
+        std::cerr << "Multisampling needs float32 depths" << std::endl;
+        return 1;
+    }
+    if (!GL.SetColorFormat(colorFormat))
+    {
+        std::cerr << "Float framebuffers can't be multisampled" << std::endl;
+        return 1;
+    }
+
+    std::ofstream profileFile;
+    if (profilePath)
+    {
+        if (!Profiler::Enabled)
+            std::cerr << "Profiling is disabled in this build, define ENABLE_PROFILER to enable it" << std::endl;
+        else
+            profileFile.open(profilePath);
+    }
+
+    auto report = [&](const FrameStats& stats)
+    {
+        if (Profiler::Enabled)
+        {
+            stats.WriteText(std::cerr);
+            if (profileFile.is_open())
+            {
+                stats.WriteJson(profileFile);
+                profileFile << "\n";
+            }
+        }
+    };
+
+    auto endFrame = [&]()
+    {
+        GL.EndFrame();
+        report(GL.Profile.Last);
+    };
 
     Vec3f lightDirection = { 1.f, -1.f, 1.f };
     lightDirection.normalize();
@@ -156,60 +416,209 @@ int main(int argc, char** argv)
     GL.LookAt(cameraPos, target, up);
     Mat4 modelMatrix;
 
-    Model model("african_head");
-    if (!model.diffuseLoaded() || !model.normalLoaded() || !model.specularLoaded() || model.nverts() == 0)
+    GL.BeginFrame();
+
+    Model model = [&]()
+    {
+        PROFILE_SCOPE(GL.Profile, Load);
+        Model loaded("african_head");
+        if (quantize)
+            loaded.quantize();
+        return loaded;
+    }();
+    if (!model.diffuseLoaded() || !model.normalLoaded() || !model.specularLoaded() || model.nfaces() == 0)
     {
         std::cerr << "Error while loading model" << std::endl;
         return 1;
     }
 
-    Mat4 inverseTranspose = Mat4::Transpose((GL.Projection * GL.ModelView).Inverse());
+    // --shadows n gives the light a depth map of n x n texels.
+    std::unique_ptr<ShadowMap> shadowMap;
+    if (shadowSize > 0)
+        shadowMap = std::make_unique<ShadowMap>(shadowSize, simd);
 
-    GouraudShader shader(lightDirection);
-    TexturedGouraudShader texturedGouraud(lightDirection, model);
-    BandShader bandShader(lightDirection);
-    PhongShader phongShader(lightDirection, model, GL.Projection * GL.ModelView, inverseTranspose);
+    // --lights n scatters n point lights around the scene, shaded through per tile light lists.
+    std::vector<PointLight> pointLights;
+    std::mt19937 random(1);
+    auto uniform = [&](float min, float max) { return min + (max - min) * (float)(random() / 4294967296.0); };
+    for (int i = 0; i < lightCount; ++i)
+    {
+        Vec3f position(uniform(-1.2f, 1.2f), uniform(-1.2f, 1.2f), uniform(-1.2f, 1.2f));
+        Vec3f color(uniform(0.f, 1.f), uniform(0.f, 1.f), uniform(0.f, 1.f));
+        pointLights.push_back({ position, uniform(0.2f, 0.5f), color });
+    }
+    TiledLights tiledLights;
 
-    Vertex vertices[3];
-    for (int i = 0; i < model.nfaces(); i++) 
+    PhongShader phongShader(lightDirection, model, shadowMap.get(), lightCount > 0 ? &tiledLights : nullptr);
+
+    // --crowd n draws an n x n grid of instances of the model, scaled down to the size of a single one.
+    Scene scene;
+    if (crowd > 0)
     {
-        std::vector<VertexInfo> face = model.face(i);
+        Mat4 root;
+        root.Scale(Vec3f(1.0f / crowd, 1.0f / crowd, 1.0f / crowd));
+        int rootNode = scene.AddNode(root);
 
-        for (int j = 0; j < 3; j++) 
+        for (int z = 0; z < crowd; ++z)
         {
-            vertices[j].Pos = model.vert(face[j].VertexId);
-            vertices[j].UV = model.uv(face[j].TexCoordId);
-            vertices[j].Normal = model.normal(face[j].NormalId);
+            for (int x = 0; x < crowd; ++x)
+            {
+                Mat4 local;
+                local.MoveTo(Vec3f(2.0f * x - (crowd - 1), 0.0f, 2.0f * z - (crowd - 1)));
+                scene.AddInstance(model, scene.AddNode(local, rootNode), { &phongShader }, true);
+            }
         }
 
-        GL.Triangle(vertices, model, phongShader, lightDirection);
+        scene.UpdateTransforms();
     }
 
-    GL.Output.flip_vertically();
-    GL.Output.write_tga_file("output.tga");
+    auto drawScene = [&](GraphicsLibrary& target)
+    {
+        if (crowd > 0)
+            target.DrawScene(scene);
+        else
+            target.DrawModel(model, phongShader);
+    };
+
+    // With point lights, a depth only pass gives the depths the lights are sorted against, then the frame is drawn
+    // again, shaded.
+    auto render = [&](GraphicsLibrary& target)
+    {
+        if (!pointLights.empty())
+        {
+            target.DepthOnly = true;
+            drawScene(target);
+            tiledLights.Build(target, pointLights);
+            target.DepthOnly = false;
+            target.Clear();
+        }
+        drawScene(target);
+    };
 
-    TGAImage zbuffer(windowWidth, windowHeight, TGAImage::RGB);
+    auto post = [&](GraphicsLibrary& target)
+    {
+        if (ssao)
+            ambientOcclusion.Apply(target);
+    };
 
-    float min = 100;
-    float max = -100;
+    // The light and the geometry don't move, the map is drawn once and reused by every frame. Both scenes fit in the
+    // cube of half size 1 around the target.
+    auto updateShadows = [&]()
+    {
+        if (shadowMap)
+            shadowMap->Update(lightDirection, target, std::sqrt(3.f), scene.Version(), drawScene);
+    };
 
-    for (int y = 0; y < windowHeight; ++y)
+    if (streamPath)
     {
-        for (int x = 0; x < windowWidth; ++x)
+        FrameStream stream;
+        if (!stream.Open(streamPath))
+            return 1;
+
+        // Turntable: orbit the camera around the target at its initial height and distance.
+        float radius = std::sqrt(cameraPos.x * cameraPos.x + cameraPos.z * cameraPos.z);
+        float startAngle = std::atan2(cameraPos.x, cameraPos.z);
+
+        auto framePosition = [&](int frame)
+        {
+            float angle = startAngle + 2.0f * 3.14159265f * frame / frameCount;
+            return Vec3f(radius * std::sin(angle), cameraPos.y, radius * std::cos(angle));
+        };
+
+        // --pipeline bins the geometry of each frame with GL while another context draws the previous one.
+        if (pipelined)
+        {
+            GraphicsLibrary rasterGL(windowWidth, windowHeight, simd);
+            rasterGL.SetSampleCount(samples);
+            rasterGL.SetDepthFormat(depthFormat);
+            rasterGL.SetColorFormat(colorFormat);
+            rasterGL.SetViewport(windowWidth / 8, windowHeight / 8, windowWidth * 3 / 4, windowHeight * 3 / 4, 255.f);
+
+            FramePipeline::Stages stages;
+            stages.Geometry = [&](GraphicsLibrary& geometry, int frame)
+            {
+                geometry.LookAt(framePosition(frame), target, up);
+                render(geometry);
+            };
+            stages.Output = [&](GraphicsLibrary& raster, int)
+            {
+                raster.Resolve();
+                post(raster);
+                return stream.Submit(raster.Output);
+            };
+            stages.Report = report;
+
+            updateShadows();
+            FramePipeline pipeline(GL, rasterGL);
+            bool completed = pipeline.Run(frameCount, stages);
+            stream.Close();
+            return completed ? 0 : 1;
+        }
+
+        for (int frame = 0; frame < frameCount; ++frame)
         {
-            unsigned char depth = (unsigned char)GL.ZBuffer[windowWidth * y + x];
-            if (depth < min)
-                min = depth;
+            if (frame > 0)
+                GL.BeginFrame();
 
-            if (depth > max)
-                max = depth;
+            updateShadows();
+            GL.Clear();
+            GL.LookAt(framePosition(frame), target, up);
 
-            zbuffer.set(x, y, TGAColor(depth, depth, depth, 255));
+            render(GL);
+
+            {
+                PROFILE_SCOPE(GL.Profile, Output);
+                GL.Resolve();
+                post(GL);
+                if (!stream.Submit(GL.Output))
+                    return 1;
+            }
+
+            endFrame();
         }
+
+        stream.Close();
+        return 0;
+    }
+
+    GouraudShader shader(lightDirection);
+    TexturedGouraudShader texturedGouraud(lightDirection, model);
+    BandShader bandShader(lightDirection);
+
+    if (split > 1)
+    {
+        updateShadows();
+        TGAImage image(windowWidth, windowHeight, TGAImage::RGB);
+        if (!RenderSplitFrame(GL, render, image, post, bandOverlap))
+            return 1;
+
+        image.flip_vertically();
+        image.write_tga_file("output.tga");
+        return 0;
+    }
+
+    updateShadows();
+    render(GL);
+    if (lightCount > 0)
+        std::cerr << lightCount << " point lights, " << (float)tiledLights.ListedCount() / tiledLights.TileCount() << " per tile" << std::endl;
+
+    {
+        PROFILE_SCOPE(GL.Profile, Output);
+
+        GL.Resolve();
+        post(GL);
+        GL.Output.flip_vertically();
+        GL.Output.write_tga_file("output.tga");
+
+        PostProcess depthView;
+        depthView.Source = PostSource::Depth;
+        TGAImage zbuffer;
+        depthView.Apply(GL, zbuffer);
+        zbuffer.flip_vertically();
+        zbuffer.write_tga_file("depthbuffer.tga");
     }
 
-    zbuffer.flip_vertically();
-    zbuffer.write_tga_file("depthbuffer.tga");
+    endFrame();
 
     return 0;
 }
\ No newline at end of file
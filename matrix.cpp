@@ -1,8 +1,14 @@
 #include "matrix.h"
 #include "geometry.h"
+#include "kernels.h"
 #include <ostream>
 #include <iostream>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MATRIX_SSE 1
+#include <emmintrin.h>
+#endif
+
 void Mat4::MoveTo(const Vec3f& pos)
 {
 	Set(3, 0, pos.x);
@@ -20,13 +26,20 @@ void Mat4::Scale(const Vec3f& scale)
 Vec4f Mat4::operator*(const Vec4f& vec) const
 {
 	Vec4f result;
+#ifdef MATRIX_SSE
+	// Columns scaled by the vector components, summed in the same order as the scalar path.
+	__m128 r = _mm_mul_ps(_mm_setr_ps(data[0], data[4], data[8], data[12]), _mm_set1_ps(vec.x));
+	r = _mm_add_ps(r, _mm_mul_ps(_mm_setr_ps(data[1], data[5], data[9], data[13]), _mm_set1_ps(vec.y)));
+	r = _mm_add_ps(r, _mm_mul_ps(_mm_setr_ps(data[2], data[6], data[10], data[14]), _mm_set1_ps(vec.z)));
+	r = _mm_add_ps(r, _mm_mul_ps(_mm_setr_ps(data[3], data[7], data[11], data[15]), _mm_set1_ps(vec.w)));
+	_mm_storeu_ps(result.raw, r);
+#else
 	for (int y = 0; y < 4; ++y)
 	{
-		for (int x = 0; x < 4; ++x)
-		{
-			result.raw[y] += Get(x, y) * vec.raw[x];
-		}
+		const float* row = data + y * 4;
+		result.raw[y] = row[0] * vec.x + row[1] * vec.y + row[2] * vec.z + row[3] * vec.w;
 	}
+#endif
 
 	return result;
 }
@@ -34,20 +47,57 @@ Vec4f Mat4::operator*(const Vec4f& vec) const
 Mat4 Mat4::operator*(const Mat4& mat) const
 {
 	Mat4 result;
-	for (int x = 0; x < 4; ++x)
+#ifdef MATRIX_SSE
+	__m128 rows[4];
+	for (int i = 0; i < 4; ++i)
+		rows[i] = _mm_loadu_ps(mat.data + i * 4);
+
+	for (int y = 0; y < 4; ++y)
 	{
-		for (int y = 0; y < 4; ++y)
-		{
-			float value = 0.0f;
+		const float* row = data + y * 4;
+		__m128 r = _mm_mul_ps(_mm_set1_ps(row[0]), rows[0]);
+		r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(row[1]), rows[1]));
+		r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(row[2]), rows[2]));
+		r = _mm_add_ps(r, _mm_mul_ps(_mm_set1_ps(row[3]), rows[3]));
+		_mm_storeu_ps(result.data + y * 4, r);
+	}
+#else
+	for (int y = 0; y < 4; ++y)
+	{
+		const float* row = data + y * 4;
+		for (int x = 0; x < 4; ++x)
+			result.data[y * 4 + x] = row[0] * mat.data[x] + row[1] * mat.data[4 + x] + row[2] * mat.data[8 + x] + row[3] * mat.data[12 + x];
+	}
+#endif
 
-			for (int i = 0; i < 4; ++i)
-				value += Get(i, y) * mat.Get(x, i);
+	return result;
+}
 
-			result.Set(x, y, value);
-		}
+void Mat4::Transform(const Vec4f* in, Vec4f* out, int count) const
+{
+#ifdef MATRIX_SSE
+	__m128 c0 = _mm_setr_ps(data[0], data[4], data[8], data[12]);
+	__m128 c1 = _mm_setr_ps(data[1], data[5], data[9], data[13]);
+	__m128 c2 = _mm_setr_ps(data[2], data[6], data[10], data[14]);
+	__m128 c3 = _mm_setr_ps(data[3], data[7], data[11], data[15]);
+
+	for (int i = 0; i < count; ++i)
+	{
+		__m128 r = _mm_mul_ps(c0, _mm_set1_ps(in[i].x));
+		r = _mm_add_ps(r, _mm_mul_ps(c1, _mm_set1_ps(in[i].y)));
+		r = _mm_add_ps(r, _mm_mul_ps(c2, _mm_set1_ps(in[i].z)));
+		r = _mm_add_ps(r, _mm_mul_ps(c3, _mm_set1_ps(in[i].w)));
+		_mm_storeu_ps(out[i].raw, r);
 	}
+#else
+	for (int i = 0; i < count; ++i)
+		out[i] = *this * in[i];
+#endif
+}
 
-	return result;
+void Mat4::TransformPoints(const Vec3f* in, Vec4f* out, int count) const
+{
+	GetKernels().TransformPoints(data, in[0].raw, out[0].raw, count);
 }
 
 float Mat3::Determinant() const
@@ -84,76 +134,105 @@ void Mat3::Dump()
 	std::cout << std::endl;
 }
 
-Mat3 Cofactor(int column, int line, const Mat4& mat)
+// 2x2 minors of the upper and lower row pairs, shared by the determinant and the inverse.
+struct Minors
 {
-	Mat3 ret;
-	int i = 0;
+	float s[6];
+	float c[6];
 
-	for (int y = 0; y < 4; ++y)
+	Minors(const float* m)
 	{
-		if (y != line)
-		{
-			for (int x = 0; x < 4; ++x)
-			{
-				if (x != column)
-				{
-					ret.data[i] = mat.Get(x, y);
-					++i;
-				}
-			}
-		}
+		s[0] = m[0] * m[5] - m[4] * m[1];
+		s[1] = m[0] * m[6] - m[4] * m[2];
+		s[2] = m[0] * m[7] - m[4] * m[3];
+		s[3] = m[1] * m[6] - m[5] * m[2];
+		s[4] = m[1] * m[7] - m[5] * m[3];
+		s[5] = m[2] * m[7] - m[6] * m[3];
+
+		c[0] = m[8] * m[13] - m[12] * m[9];
+		c[1] = m[8] * m[14] - m[12] * m[10];
+		c[2] = m[8] * m[15] - m[12] * m[11];
+		c[3] = m[9] * m[14] - m[13] * m[10];
+		c[4] = m[9] * m[15] - m[13] * m[11];
+		c[5] = m[10] * m[15] - m[14] * m[11];
 	}
 
-	return ret;
-}
-
-float Mat4::Determinant() const
-{
-	float ret = 0.0f;
-	float sign = 1.0;
-	for (int i = 0; i < 4; ++i)
+	float Determinant() const
 	{
-		float value = sign * Get(0, i) * Cofactor(0, i, *this).Determinant();
-		ret += value;
-		sign *= -1.0f;
+		return s[0] * c[5] - s[1] * c[4] + s[2] * c[3] + s[3] * c[2] - s[4] * c[1] + s[5] * c[0];
 	}
+};
 
-	return ret;
+float Mat4::Determinant() const
+{
+	return Minors(data).Determinant();
 }
 
-float sign(int i)
+Mat4 Mat4::Inverse() const
 {
-	if (i % 2 == 0)
-		return 1.0f;
-	else
-		return -1.0f;
+	const float* m = data;
+	Minors minors(m);
+	const float* s = minors.s;
+	const float* c = minors.c;
+
+	float invDeterminant = 1.0f / minors.Determinant();
+
+	float inverse[16] = {
+		 m[5] * c[5] - m[6] * c[4] + m[7] * c[3],
+		-m[1] * c[5] + m[2] * c[4] - m[3] * c[3],
+		 m[13] * s[5] - m[14] * s[4] + m[15] * s[3],
+		-m[9] * s[5] + m[10] * s[4] - m[11] * s[3],
+
+		-m[4] * c[5] + m[6] * c[2] - m[7] * c[1],
+		 m[0] * c[5] - m[2] * c[2] + m[3] * c[1],
+		-m[12] * s[5] + m[14] * s[2] - m[15] * s[1],
+		 m[8] * s[5] - m[10] * s[2] + m[11] * s[1],
+
+		 m[4] * c[4] - m[5] * c[2] + m[7] * c[0],
+		-m[0] * c[4] + m[1] * c[2] - m[3] * c[0],
+		 m[12] * s[4] - m[13] * s[2] + m[15] * s[0],
+		-m[8] * s[4] + m[9] * s[2] - m[11] * s[0],
+
+		-m[4] * c[3] + m[5] * c[1] - m[6] * c[0],
+		 m[0] * c[3] - m[1] * c[1] + m[2] * c[0],
+		-m[12] * s[3] + m[13] * s[1] - m[14] * s[0],
+		 m[8] * s[3] - m[9] * s[1] + m[10] * s[0]
+	};
+
+	for (int i = 0; i < 16; ++i)
+		inverse[i] *= invDeterminant;
+
+	return Mat4(inverse);
 }
 
-Mat4 Mat4::Inverse() const
+Mat4 Mat4::InverseAffine() const
 {
-	float determinant = Determinant();
-	
-	Mat4 mat;
+	const float* m = data;
 
-	for (int y = 0; y < 4; ++y)
-	{
-		for (int x = 0; x < 4; ++x)
-		{
-			mat.Set(x, y, sign(x + y) * Cofactor(x, y, *this).Determinant());
-		}
-	}
+	// Inverse of the upper 3x3 block from its cofactors.
+	float r00 = m[5] * m[10] - m[6] * m[9];
+	float r01 = m[2] * m[9] - m[1] * m[10];
+	float r02 = m[1] * m[6] - m[2] * m[5];
+	float r10 = m[6] * m[8] - m[4] * m[10];
+	float r11 = m[0] * m[10] - m[2] * m[8];
+	float r12 = m[2] * m[4] - m[0] * m[6];
+	float r20 = m[4] * m[9] - m[5] * m[8];
+	float r21 = m[1] * m[8] - m[0] * m[9];
+	float r22 = m[0] * m[5] - m[1] * m[4];
 
-	mat = Transpose(mat);
+	float invDeterminant = 1.0f / (m[0] * r00 + m[1] * r10 + m[2] * r20);
 
-	for (int y = 0; y < 4; ++y)
-	{
-		for (int x = 0; x < 4; ++x)
-		{
-			mat.Set(x, y, mat.Get(x, y) / determinant);
-		}
-	}
-	
-	return mat;
+	Mat4 result;
+	float* r = result.data;
+	r[0] = r00 * invDeterminant; r[1] = r01 * invDeterminant; r[2] = r02 * invDeterminant;
+	r[4] = r10 * invDeterminant; r[5] = r11 * invDeterminant; r[6] = r12 * invDeterminant;
+	r[8] = r20 * invDeterminant; r[9] = r21 * invDeterminant; r[10] = r22 * invDeterminant;
+
+	r[3] = -(r[0] * m[3] + r[1] * m[7] + r[2] * m[11]);
+	r[7] = -(r[4] * m[3] + r[5] * m[7] + r[6] * m[11]);
+	r[11] = -(r[8] * m[3] + r[9] * m[7] + r[10] * m[11]);
+
+	return result;
 }
 
 Mat4 Mat4::Transpose(const Mat4& mat)
@@ -197,6 +276,13 @@ Mat4 Mat4::GetProjection(float targetDistance)
 	return Mat4(projectionData);
 }
 
+Mat4 Mat4::GetOrthographic(float halfExtent)
+{
+	Mat4 m;
+	m.Scale(Vec3f(1.0f / halfExtent, 1.0f / halfExtent, 1.0f / halfExtent));
+	return m;
+}
+
 Mat4 Mat4::LookAt(const Vec3f& position, const Vec3f& target, const Vec3f& up)
 {
 	Vec3f z = (position - target).normalize();
@@ -72,16 +72,28 @@ public:
 
 	Mat4 operator*(const Mat4& mat) const;
 
+	// out[i] = *this * in[i]. in and out may be the same array.
+	void Transform(const Vec4f* in, Vec4f* out, int count) const;
+
+	// out[i] = *this * (in[i], 1), using the runtime selected SIMD kernel.
+	void TransformPoints(const Vec3f* in, Vec4f* out, int count) const;
+
 	float Determinant() const;
 
 	Mat4 Inverse() const;
 
+	// Faster inverse for matrices whose last row is (0, 0, 0, 1).
+	Mat4 InverseAffine() const;
+
 	static Mat4 Transpose(const Mat4& mat);
 
 	static Mat4 GetViewport(int x, int y, int w, int h, float depth);
 
 	static Mat4 GetProjection(float center);
 
+	// Parallel projection of the cube of half size halfExtent around the view target, for directional lights.
+	static Mat4 GetOrthographic(float halfExtent);
+
 	static Mat4 LookAt(const Vec3f& position, const Vec3f& target, const Vec3f& up);
 };
 
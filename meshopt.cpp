@@ -0,0 +1,187 @@
+#include "meshopt.h"
+#include <algorithm>
+#include <cmath>
+
+float ComputeACMR(const int* indices, int indexCount, int cacheSize)
+{
+    if (indexCount < 3)
+        return 0.0f;
+
+    // Most recently used first.
+    std::vector<int> cache;
+    cache.reserve(cacheSize + 1);
+    int misses = 0;
+
+    for (int i = 0; i < indexCount; ++i)
+    {
+        auto hit = std::find(cache.begin(), cache.end(), indices[i]);
+        if (hit != cache.end())
+            cache.erase(hit);
+        else
+            ++misses;
+
+        cache.insert(cache.begin(), indices[i]);
+        if ((int)cache.size() > cacheSize)
+            cache.pop_back();
+    }
+
+    return (float)misses / (indexCount / 3);
+}
+
+namespace
+{
+    const float cacheDecayPower = 1.5f;
+    const float lastTriangleScore = 0.75f;
+    const float valenceBoostScale = 2.0f;
+    const float valenceBoostPower = 0.5f;
+
+    // Vertices in the cache score by recency, the three of the last triangle a bit less so its neighbours don't
+    // immediately repeat it. Vertices with few triangles left are boosted to finish them off before they are evicted.
+    float vertexScore(int cachePosition, int remainingTriangles)
+    {
+        if (remainingTriangles == 0)
+            return -1.0f;
+
+        float score = 0.0f;
+        if (cachePosition >= 0)
+        {
+            if (cachePosition < 3)
+                score = lastTriangleScore;
+            else
+                score = std::pow(1.0f - (float)(cachePosition - 3) / (VertexCacheSize - 3), cacheDecayPower);
+        }
+
+        return score + valenceBoostScale * std::pow((float)remainingTriangles, -valenceBoostPower);
+    }
+}
+
+void OptimizeVertexCache(const int* indices, int triangleCount, int* triangleOrder)
+{
+    int indexCount = triangleCount * 3;
+
+    // Work on vertices numbered 0..n-1 within this range.
+    std::vector<int> unique(indices, indices + indexCount);
+    std::sort(unique.begin(), unique.end());
+    unique.erase(std::unique(unique.begin(), unique.end()), unique.end());
+    int vertexCount = (int)unique.size();
+
+    std::vector<int> local(indexCount);
+    for (int i = 0; i < indexCount; ++i)
+        local[i] = (int)(std::lower_bound(unique.begin(), unique.end(), indices[i]) - unique.begin());
+
+    // Triangles of each vertex; the first remaining[v] entries are those not emitted yet.
+    std::vector<int> remaining(vertexCount, 0);
+    for (int i = 0; i < indexCount; ++i)
+        ++remaining[local[i]];
+
+    std::vector<int> offsets(vertexCount + 1, 0);
+    for (int v = 0; v < vertexCount; ++v)
+        offsets[v + 1] = offsets[v] + remaining[v];
+
+    std::vector<int> adjacency(indexCount);
+    std::vector<int> filled(offsets.begin(), offsets.end() - 1);
+    for (int i = 0; i < indexCount; ++i)
+        adjacency[filled[local[i]]++] = i / 3;
+
+    std::vector<int> cachePosition(vertexCount, -1);
+    std::vector<float> score(vertexCount);
+    for (int v = 0; v < vertexCount; ++v)
+        score[v] = vertexScore(-1, remaining[v]);
+
+    std::vector<float> triangleScore(triangleCount);
+    std::vector<char> emitted(triangleCount, 0);
+    for (int t = 0; t < triangleCount; ++t)
+        triangleScore[t] = score[local[t * 3]] + score[local[t * 3 + 1]] + score[local[t * 3 + 2]];
+
+    // The three vertices of the emitted triangle enter before the cache is trimmed back.
+    std::vector<int> cache, nextCache;
+    cache.reserve(VertexCacheSize + 3);
+    nextCache.reserve(VertexCacheSize + 3);
+
+    int best = triangleCount > 0 ? (int)(std::max_element(triangleScore.begin(), triangleScore.end()) - triangleScore.begin()) : -1;
+
+    for (int count = 0; count < triangleCount; ++count)
+    {
+        if (best < 0)
+        {
+            // Nothing in the cache leads anywhere, start again from the best triangle left.
+            float bestScore = -1.0f;
+            for (int t = 0; t < triangleCount; ++t)
+            {
+                if (!emitted[t] && triangleScore[t] > bestScore)
+                {
+                    bestScore = triangleScore[t];
+                    best = t;
+                }
+            }
+        }
+
+        triangleOrder[count] = best;
+        emitted[best] = 1;
+
+        nextCache.clear();
+        for (int j = 0; j < 3; ++j)
+        {
+            int v = local[best * 3 + j];
+            int* begin = adjacency.data() + offsets[v];
+            int* end = begin + remaining[v];
+            std::iter_swap(std::find(begin, end, best), end - 1);
+            --remaining[v];
+            nextCache.push_back(v);
+        }
+
+        for (int v : cache)
+        {
+            if (std::find(nextCache.begin(), nextCache.end(), v) == nextCache.end())
+                nextCache.push_back(v);
+        }
+
+        for (int i = 0; i < (int)nextCache.size(); ++i)
+            cachePosition[nextCache[i]] = i < VertexCacheSize ? i : -1;
+
+        // Rescore what moved in the cache, including what just fell out, and pick the best triangle they touch.
+        for (int v : nextCache)
+            score[v] = vertexScore(cachePosition[v], remaining[v]);
+
+        best = -1;
+        float bestScore = -1.0f;
+        for (int v : nextCache)
+        {
+            for (int k = 0; k < remaining[v]; ++k)
+            {
+                int t = adjacency[offsets[v] + k];
+                triangleScore[t] = score[local[t * 3]] + score[local[t * 3 + 1]] + score[local[t * 3 + 2]];
+                if (triangleScore[t] > bestScore)
+                {
+                    bestScore = triangleScore[t];
+                    best = t;
+                }
+            }
+        }
+
+        if ((int)nextCache.size() > VertexCacheSize)
+            nextCache.resize(VertexCacheSize);
+        cache.swap(nextCache);
+    }
+}
+
+std::vector<int> OptimizeVertexFetch(const std::vector<int>& indices, int vertexCount)
+{
+    std::vector<int> remap(vertexCount, -1);
+    int next = 0;
+
+    for (int index : indices)
+    {
+        if (remap[index] < 0)
+            remap[index] = next++;
+    }
+
+    // Vertices no triangle uses go last.
+    for (int& index : remap)
+    {
+        if (index < 0)
+            index = next++;
+    }
+
+    return remap;
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include "geometry.h"
+#include <vector>
+
+// Entries of the post-transform vertex cache the reordering aims for and ACMR is measured against.
+const int VertexCacheSize = 32;
+
+// Average number of vertices transformed per triangle with an LRU cache of cacheSize vertices. 3 without any reuse,
+// close to 0.5 for a well ordered regular grid.
+float ComputeACMR(const int* indices, int indexCount, int cacheSize = VertexCacheSize);
+
+// Orders triangles for post-transform cache hits, Tom Forsyth's linear-speed vertex cache optimization.
+// Writes the new order of the triangleCount triangles of indices into triangleOrder.
+void OptimizeVertexCache(const int* indices, int triangleCount, int* triangleOrder);
+
+// New index of each of the vertexCount vertices, numbered in order of first use so fetches walk memory forward.
+std::vector<int> OptimizeVertexFetch(const std::vector<int>& indices, int vertexCount);
@@ -3,16 +3,85 @@
 #include <fstream>
 #include <sstream>
 #include <vector>
+#include <algorithm>
+#include <numeric>
 #include "model.h"
+#include "meshopt.h"
+#include "simplify.h"
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <limits>
 
-Model::Model(const char *filename) : verts_(), faces_(), diffuseLoaded_(false) {
-    std::ifstream in;
+// Clusters end up with between half and all of this many faces.
+static const int maxClusterFaces = 128;
+
+static const int maxLods = 4;
+static const int minLodTriangles = 64;
+
+// Bumped whenever what the cache stores, or how it is computed, changes.
+static const char cacheMagic[8] = { 'S', 'R', 'M', 'E', 'S', 'H', 0, 1 };
 
+Model::Model(const char *filename, bool useCache) : verts_(), faces_(), diffuseLoaded_(false) {
     std::string path = filename;
     path.append(".obj");
+    std::string cachePath = filename;
+    cachePath.append(".mesh");
+
+    if (!useCache || !cacheIsCurrent(path, cachePath) || !readCache(cachePath)) {
+        if (!readObj(path)) return;
+        std::cerr << "# v# " << verts_.size() << "# uv# " << uv_.size() << " f# " << faces_.size() << std::endl;
+
+        weld();
+        float loadedACMR = ComputeACMR(indices_.data(), (int)indices_.size());
+        buildClusters();
+        optimize();
+        std::cerr << "# welded vertices " << vertices_.size() << " ACMR " << loadedACMR << " -> " << ComputeACMR(indices_.data(), (int)indices_.size()) << std::endl;
+
+        buildLods();
+        if (useCache && !writeCache(cachePath))
+            std::cerr << "Couldn't write mesh cache " << cachePath << std::endl;
+    } else {
+        std::cerr << "# v# " << verts_.size() << "# uv# " << uv_.size() << " f# " << faces_.size() << " from " << cachePath << std::endl;
+    }
+    buildClusterTree();
+    findClosed();
+
+    std::string diffusePath = filename;
+    diffusePath.append("_diffuse.tga");
+
+    diffuseLoaded_ = true;
+    if (!diffuse_.read_tga_file(diffusePath.c_str()))
+    {
+        std::cerr << "Couldn't read diffuse map " << diffusePath << std::endl;
+        diffuseLoaded_ = false;
+    }
+
+    std::string normalPath = filename;
+    normalPath.append("_normal.tga");
+    normalLoaded_ = true;
+    if (!normal_.read_tga_file(normalPath.c_str()))
+    {
+        std::cerr << "Couldn't read normal map " << normalPath << std::endl;
+        normalLoaded_ = false;
+    }
+
+    std::string specularPath = filename;
+    specularPath.append("_spec.tga");
+    specularLoaded_ = true;
+    if (!specular_.read_tga_file(specularPath.c_str()))
+    {
+        std::cerr << "Couldn't read specular map " << specularPath << std::endl;
+        specularLoaded_ = false;
+    }
+}
 
+bool Model::readObj(const std::string& path) {
+    std::ifstream in;
     in.open (path.c_str(), std::ifstream::in);
-    if (in.fail()) return;
+    if (in.fail()) return false;
     std::string line;
     while (!in.eof()) {
         std::getline(in, line);
@@ -25,13 +94,19 @@ Model::Model(const char *filename) : verts_(), faces_(), diffuseLoaded_(false) {
             verts_.push_back(v);
         } else if (!line.compare(0, 2, "f ")) {
             std::vector<VertexInfo> f;
-            VertexInfo vertex;
+            std::string corner;
             iss >> trash;
-            while (iss >> vertex.VertexId >> trash >> vertex.TexCoordId >> trash >> vertex.NormalId) {
-                vertex.VertexId--; // in wavefront obj all indices start at 1, not zero
-                vertex.TexCoordId--;
-                vertex.NormalId--;
-                f.push_back(vertex);
+            // v, v/vt, v//vn or v/vt/vn, ids left out become -1, missing for weld
+            while (iss >> corner) {
+                int ids[3] = { 0, 0, 0 };
+                const char* field = corner.c_str();
+                for (int i = 0; i < 3 && field; i++) {
+                    ids[i] = std::atoi(field);
+                    field = std::strchr(field, '/');
+                    if (field) field++;
+                }
+                // in wavefront obj all indices start at 1, not zero
+                f.push_back({ ids[0] - 1, ids[1] - 1, ids[2] - 1 });
             }
             faces_.push_back(f);
         } else if (!line.compare(0, 3, "vt ")) {
@@ -53,39 +128,250 @@ Model::Model(const char *filename) : verts_(), faces_(), diffuseLoaded_(false) {
             normals_.push_back(normal);
         }
     }
-    std::cerr << "# v# " << verts_.size() << "# uv# " << uv_.size() << " f# " << faces_.size() << std::endl;
+    return true;
+}
 
+Model::Model(const std::vector<Vec3f>& verts, const std::vector<Vec2f>& uv, const std::vector<Vec3f>& normals, const std::vector<std::vector<VertexInfo> >& faces) :
+    verts_(verts), faces_(faces), uv_(uv), normals_(normals), diffuseLoaded_(false), normalLoaded_(false), specularLoaded_(false) {
+    weld();
+    buildClusters();
+    optimize();
+    buildLods();
+    buildClusterTree();
+    findClosed();
+}
 
-    std::string diffusePath = filename;
-    diffusePath.append("_diffuse.tga");
+Model::~Model() {
+}
 
-    diffuseLoaded_ = true;
-    if (!diffuse_.read_tga_file(diffusePath.c_str()))
-    {
-        std::cerr << "Couldn't read diffuse map " << diffusePath << std::endl;
-        diffuseLoaded_ = false;
+// Median split of face centers along their widest axis until ranges are small enough to be clusters.
+static void splitFaces(std::vector<int>& order, const std::vector<Vec3f>& centers, int begin, int end, std::vector<int>& clusterStarts) {
+    if (end - begin <= maxClusterFaces) {
+        clusterStarts.push_back(begin);
+        return;
     }
 
-    std::string normalPath = filename;
-    normalPath.append("_normal.tga");
-    normalLoaded_ = true;
-    if (!normal_.read_tga_file(normalPath.c_str()))
-    {
-        std::cerr << "Couldn't read normal map " << normalPath << std::endl;
-        normalLoaded_ = false;
+    AABB box;
+    for (int i = begin; i < end; i++) box.Extend(centers[order[i]]);
+
+    Vec3f extent = box.Max - box.Min;
+    int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+    int middle = (begin + end) / 2;
+    std::nth_element(order.begin() + begin, order.begin() + middle, order.begin() + end, [&](int a, int b) {
+        return centers[a].raw[axis] < centers[b].raw[axis];
+    });
+
+    splitFaces(order, centers, begin, middle, clusterStarts);
+    splitFaces(order, centers, middle, end, clusterStarts);
+}
+
+void Model::weld() {
+    // Only the first three corners of a face are drawn, and faces need three.
+    faces_.erase(std::remove_if(faces_.begin(), faces_.end(), [](const std::vector<VertexInfo>& face) { return face.size() < 3; }), faces_.end());
+
+    auto corner = [this](int index) -> const VertexInfo& { return faces_[index / 3][index % 3]; };
+    auto less = [](const VertexInfo& a, const VertexInfo& b) {
+        if (a.VertexId != b.VertexId) return a.VertexId < b.VertexId;
+        if (a.TexCoordId != b.TexCoordId) return a.TexCoordId < b.TexCoordId;
+        return a.NormalId < b.NormalId;
+    };
+
+    std::vector<int> corners(faces_.size() * 3);
+    std::iota(corners.begin(), corners.end(), 0);
+    std::sort(corners.begin(), corners.end(), [&](int a, int b) { return less(corner(a), corner(b)); });
+
+    vertices_.clear();
+    indices_.resize(corners.size());
+    for (size_t i = 0; i < corners.size(); i++) {
+        const VertexInfo& info = corner(corners[i]);
+        if (i == 0 || less(corner(corners[i - 1]), info)) {
+            Vertex vertex;
+            vertex.Pos = verts_[info.VertexId];
+            if (info.NormalId >= 0 && info.NormalId < (int)normals_.size()) vertex.Normal = normals_[info.NormalId];
+            if (info.TexCoordId >= 0 && info.TexCoordId < (int)uv_.size()) vertex.UV = uv_[info.TexCoordId];
+            vertices_.push_back(vertex);
+        }
+        indices_[corners[i]] = (int)vertices_.size() - 1;
     }
+}
 
-    std::string specularPath = filename;
-    specularPath.append("_spec.tga");
-    specularLoaded_ = true;
-    if (!specular_.read_tga_file(specularPath.c_str()))
-    {
-        std::cerr << "Couldn't read specular map " << specularPath << std::endl;
-        specularLoaded_ = false;
+void Model::reorderFaces(const std::vector<int>& order) {
+    std::vector<std::vector<VertexInfo> > faces(faces_.size());
+    std::vector<int> indices(indices_.size());
+    for (size_t i = 0; i < order.size(); i++) {
+        faces[i].swap(faces_[order[i]]);
+        for (int j = 0; j < 3; j++) indices[i * 3 + j] = indices_[order[i] * 3 + j];
     }
+    faces_.swap(faces);
+    indices_.swap(indices);
 }
 
-Model::~Model() {
+void Model::buildClusters() {
+    bounds_ = AABB();
+    for (const Vec3f& v : verts_) bounds_.Extend(v);
+
+    std::vector<Vec3f> centers(faces_.size());
+    for (size_t i = 0; i < faces_.size(); i++) {
+        Vec3f sum;
+        for (const VertexInfo& vertex : faces_[i]) sum = sum + verts_[vertex.VertexId];
+        centers[i] = faces_[i].empty() ? sum : sum * (1.0f / faces_[i].size());
+    }
+
+    std::vector<int> order(faces_.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::vector<int> clusterStarts;
+    if (!faces_.empty()) splitFaces(order, centers, 0, (int)faces_.size(), clusterStarts);
+    clusterStarts.push_back((int)faces_.size());
+
+    reorderFaces(order);
+
+    clusters_.clear();
+    for (size_t c = 0; c + 1 < clusterStarts.size(); c++) {
+        Cluster cluster;
+        cluster.FirstFace = clusterStarts[c];
+        cluster.FaceCount = clusterStarts[c + 1] - clusterStarts[c];
+
+        // Normal cone from the geometric normals, which decide what faces the eye, not the shading normals.
+        Vec3f normalSum;
+        std::vector<Vec3f> normals;
+        for (int i = cluster.FirstFace; i < cluster.FirstFace + cluster.FaceCount; i++) {
+            const std::vector<VertexInfo>& face = faces_[i];
+            for (const VertexInfo& vertex : face) cluster.Box.Extend(verts_[vertex.VertexId]);
+            if (face.size() < 3) continue;
+
+            Vec3f a = verts_[face[0].VertexId];
+            Vec3f n = (verts_[face[1].VertexId] - a) ^ (verts_[face[2].VertexId] - a);
+            float length = n.norm();
+            if (length > 0.0f) {
+                normals.push_back(n * (1.0f / length));
+                normalSum = normalSum + normals.back();
+            }
+        }
+
+        cluster.Center = cluster.Box.Center();
+        cluster.Radius = 0.0f;
+        for (int i = cluster.FirstFace; i < cluster.FirstFace + cluster.FaceCount; i++)
+            for (const VertexInfo& vertex : faces_[i])
+                cluster.Radius = std::max(cluster.Radius, (verts_[vertex.VertexId] - cluster.Center).norm());
+
+        cluster.Cone.Axis = normalSum;
+        cluster.Cone.Cutoff = -1.0f;
+        float axisLength = normalSum.norm();
+        if (axisLength > 1e-6f) {
+            cluster.Cone.Axis = normalSum * (1.0f / axisLength);
+            cluster.Cone.Cutoff = 1.0f;
+            for (const Vec3f& n : normals) cluster.Cone.Cutoff = std::min(cluster.Cone.Cutoff, n * cluster.Cone.Axis);
+        }
+
+        clusters_.push_back(cluster);
+    }
+}
+
+void Model::optimize() {
+    // Vertex cache order within each cluster, which keeps clusters contiguous for culling.
+    std::vector<int> cacheOrder(faces_.size());
+    for (const Cluster& cluster : clusters_) {
+        int* order = cacheOrder.data() + cluster.FirstFace;
+        OptimizeVertexCache(indices_.data() + cluster.FirstFace * 3, cluster.FaceCount, order);
+        for (int i = 0; i < cluster.FaceCount; i++) order[i] += cluster.FirstFace;
+    }
+
+    // Clusters far out along their own normals tend to be in front of the rest of the mesh from wherever it is seen,
+    // drawing them first lets the depth test reject more of what follows.
+    Vec3f centroid;
+    for (const Cluster& cluster : clusters_) centroid = centroid + cluster.Center * (float)cluster.FaceCount;
+    if (!faces_.empty()) centroid = centroid * (1.0f / faces_.size());
+
+    std::vector<int> clusterOrder(clusters_.size());
+    std::iota(clusterOrder.begin(), clusterOrder.end(), 0);
+    std::stable_sort(clusterOrder.begin(), clusterOrder.end(), [&](int a, int b) {
+        return (clusters_[a].Center - centroid) * clusters_[a].Cone.Axis > (clusters_[b].Center - centroid) * clusters_[b].Cone.Axis;
+    });
+
+    std::vector<int> faceOrder;
+    std::vector<Cluster> sortedClusters;
+    faceOrder.reserve(faces_.size());
+    sortedClusters.reserve(clusters_.size());
+    for (int index : clusterOrder) {
+        Cluster cluster = clusters_[index];
+        faceOrder.insert(faceOrder.end(), cacheOrder.begin() + cluster.FirstFace, cacheOrder.begin() + cluster.FirstFace + cluster.FaceCount);
+        cluster.FirstFace = (int)faceOrder.size() - cluster.FaceCount;
+        sortedClusters.push_back(cluster);
+    }
+    clusters_.swap(sortedClusters);
+    reorderFaces(faceOrder);
+
+    std::vector<int> remap = OptimizeVertexFetch(indices_, (int)vertices_.size());
+    std::vector<Vertex> fetchOrdered(vertices_.size());
+    for (size_t i = 0; i < vertices_.size(); i++) fetchOrdered[remap[i]] = vertices_[i];
+    vertices_.swap(fetchOrdered);
+    for (int& index : indices_) index = remap[index];
+}
+
+void Model::buildClusterTree() {
+    std::vector<AABB> boxes;
+    for (const Cluster& cluster : clusters_) boxes.push_back(cluster.Box);
+    clusterTree_.Build(boxes, 2);
+}
+
+void Model::findClosed() {
+    // Vertices split by UV or normal seams are joined again by position.
+    std::vector<int> byPosition(vertices_.size());
+    std::iota(byPosition.begin(), byPosition.end(), 0);
+    auto less = [&](int a, int b) {
+        const Vec3f& p = vertices_[a].Pos;
+        const Vec3f& q = vertices_[b].Pos;
+        return p.x != q.x ? p.x < q.x : p.y != q.y ? p.y < q.y : p.z < q.z;
+    };
+    std::sort(byPosition.begin(), byPosition.end(), less);
+    std::vector<int> position(vertices_.size());
+    for (size_t i = 0; i < byPosition.size(); i++)
+        position[byPosition[i]] = i > 0 && !less(byPosition[i - 1], byPosition[i]) ? position[byPosition[i - 1]] : (int)i;
+
+    // Each directed edge once, and its reverse, degenerate triangles aside.
+    std::vector<uint64_t> edges;
+    edges.reserve(indices_.size());
+    for (size_t i = 0; i + 2 < indices_.size(); i += 3) {
+        int corners[3] = { position[indices_[i]], position[indices_[i + 1]], position[indices_[i + 2]] };
+        if (corners[0] == corners[1] || corners[1] == corners[2] || corners[2] == corners[0]) continue;
+        for (int j = 0; j < 3; j++) edges.push_back((uint64_t)corners[j] << 32 | (uint32_t)corners[(j + 1) % 3]);
+    }
+    std::sort(edges.begin(), edges.end());
+    closed_ = !edges.empty() && std::adjacent_find(edges.begin(), edges.end()) == edges.end();
+    for (size_t i = 0; closed_ && i < edges.size(); i++) {
+        uint64_t reverse = edges[i] << 32 | edges[i] >> 32;
+        closed_ = std::binary_search(edges.begin(), edges.end(), reverse);
+    }
+}
+
+void Model::buildLods() {
+    // Each level halves the previous one, until too few triangles are left or seams and borders stop the collapses.
+    lods_.clear();
+    lods_.reserve(maxLods);
+    const std::vector<int>* previous = &indices_;
+    float error = 0.0f;
+
+    while ((int)lods_.size() < maxLods && (int)previous->size() / 3 >= 2 * minLodTriangles) {
+        int previousTriangles = (int)previous->size() / 3;
+        float levelError = 0.0f;
+        std::vector<int> indices = SimplifyMesh(*previous, vertices_, previousTriangles / 2, levelError);
+        int triangles = (int)indices.size() / 3;
+        if (triangles > previousTriangles * 3 / 4) break;
+
+        std::vector<int> order(triangles);
+        OptimizeVertexCache(indices.data(), triangles, order.data());
+
+        LevelOfDetail lod;
+        lod.Indices.resize(indices.size());
+        for (int i = 0; i < triangles; i++)
+            for (int j = 0; j < 3; j++) lod.Indices[i * 3 + j] = indices[order[i] * 3 + j];
+
+        // Errors of successive levels add up, each one is measured against the level before.
+        error += levelError;
+        lod.Error = error;
+        lods_.push_back(lod);
+        previous = &lods_.back().Indices;
+    }
 }
 
 int Model::nverts() {
@@ -93,7 +379,7 @@ int Model::nverts() {
 }
 
 int Model::nfaces() {
-    return (int)faces_.size();
+    return quantized() ? (int)(quantized_.Indices.Size() / 3) : (int)faces_.size();
 }
 
 int Model::nuv()
@@ -101,7 +387,7 @@ int Model::nuv()
     return (int)uv_.size();
 }
 
-std::vector<VertexInfo> Model::face(int idx) {
+const std::vector<VertexInfo>& Model::face(int idx) {
     return faces_[idx];
 }
 
@@ -141,3 +427,215 @@ float Model::specular(Vec2f uv)
     return color.b;
 }
 
+
+template <class T> static void writeArray(std::ofstream& out, const std::vector<T>& data) {
+    uint64_t count = data.size();
+    out.write((const char*)&count, sizeof(count));
+    out.write((const char*)data.data(), (std::streamsize)(count * sizeof(T)));
+}
+
+// Counts beyond what is left of the file are refused before anything is allocated for them.
+template <class T> static bool readArray(std::ifstream& in, std::vector<T>& data) {
+    uint64_t count = 0;
+    if (!in.read((char*)&count, sizeof(count)) || count > (uint64_t(1) << 32)) return false;
+    std::streampos position = in.tellg();
+    in.seekg(0, std::ios::end);
+    std::streamoff remaining = in.tellg() - position;
+    in.seekg(position);
+    if (!in || count * sizeof(T) > (uint64_t)remaining) return false;
+    data.resize((size_t)count);
+    return (bool)in.read((char*)data.data(), (std::streamsize)(count * sizeof(T)));
+}
+
+static bool indicesInRange(const std::vector<int>& indices, size_t vertexCount) {
+    if (indices.size() % 3 != 0) return false;
+    for (int index : indices) {
+        if (index < 0 || (size_t)index >= vertexCount) return false;
+    }
+    return true;
+}
+
+bool Model::cacheIsCurrent(const std::string& objPath, const std::string& cachePath) {
+    std::error_code error;
+    auto cacheTime = std::filesystem::last_write_time(cachePath, error);
+    if (error) return false;
+    auto objTime = std::filesystem::last_write_time(objPath, error);
+    return error || cacheTime >= objTime;
+}
+
+bool Model::writeCache(const std::string& path) const {
+    std::ofstream out(path.c_str(), std::ios::binary);
+    if (!out) return false;
+
+    out.write(cacheMagic, sizeof(cacheMagic));
+    writeArray(out, verts_);
+    writeArray(out, uv_);
+    writeArray(out, normals_);
+
+    std::vector<int> faceSizes;
+    std::vector<VertexInfo> corners;
+    for (const std::vector<VertexInfo>& face : faces_) {
+        faceSizes.push_back((int)face.size());
+        corners.insert(corners.end(), face.begin(), face.end());
+    }
+    writeArray(out, faceSizes);
+    writeArray(out, corners);
+
+    writeArray(out, vertices_);
+    writeArray(out, indices_);
+    out.write((const char*)&bounds_, sizeof(bounds_));
+    writeArray(out, clusters_);
+
+    std::vector<float> lodErrors;
+    for (const LevelOfDetail& lod : lods_) lodErrors.push_back(lod.Error);
+    writeArray(out, lodErrors);
+    for (const LevelOfDetail& lod : lods_) writeArray(out, lod.Indices);
+
+    return (bool)out;
+}
+
+bool Model::readCache(const std::string& path) {
+    std::ifstream in(path.c_str(), std::ios::binary);
+    char magic[sizeof(cacheMagic)];
+    if (!in.read(magic, sizeof(magic)) || !std::equal(magic, magic + sizeof(magic), cacheMagic)) return false;
+
+    std::vector<int> faceSizes;
+    std::vector<VertexInfo> corners;
+    std::vector<float> lodErrors;
+    bool ok = readArray(in, verts_) && readArray(in, uv_) && readArray(in, normals_)
+        && readArray(in, faceSizes) && readArray(in, corners)
+        && readArray(in, vertices_) && readArray(in, indices_)
+        && in.read((char*)&bounds_, sizeof(bounds_))
+        && readArray(in, clusters_) && readArray(in, lodErrors);
+
+    ok = ok && lodErrors.size() <= (size_t)maxLods;
+    lods_.resize(ok ? lodErrors.size() : 0);
+    for (size_t i = 0; ok && i < lods_.size(); i++) {
+        lods_[i].Error = lodErrors[i];
+        ok = readArray(in, lods_[i].Indices) && indicesInRange(lods_[i].Indices, vertices_.size());
+    }
+
+    // Everything the cache indexes must be within what it holds: it may be stale, truncated or corrupt, and the mesh
+    // is drawn without further checks. Faces have at least three corners, the first three of each are indexed. UVs
+    // and normals may be missing, -1, as weld allows.
+    for (size_t i = 0; ok && i < corners.size(); i++) {
+        const VertexInfo& info = corners[i];
+        ok = info.VertexId >= 0 && (size_t)info.VertexId < verts_.size()
+            && info.TexCoordId >= -1 && info.TexCoordId < (int64_t)uv_.size()
+            && info.NormalId >= -1 && info.NormalId < (int64_t)normals_.size();
+    }
+    ok = ok && indices_.size() == faceSizes.size() * 3 && indicesInRange(indices_, vertices_.size());
+    for (size_t i = 0; ok && i < clusters_.size(); i++) {
+        const Cluster& cluster = clusters_[i];
+        ok = cluster.FirstFace >= 0 && cluster.FaceCount >= 0 && (int64_t)cluster.FirstFace + cluster.FaceCount <= (int64_t)faceSizes.size();
+    }
+
+    faces_.clear();
+    size_t corner = 0;
+    for (size_t i = 0; ok && i < faceSizes.size(); i++) {
+        ok = faceSizes[i] >= 3 && corner + faceSizes[i] <= corners.size();
+        if (ok) faces_.push_back(std::vector<VertexInfo>(corners.begin() + corner, corners.begin() + corner + faceSizes[i]));
+        corner += faceSizes[i];
+    }
+
+    if (!ok) {
+        // Start over from the OBJ file.
+        verts_.clear(); uv_.clear(); normals_.clear(); faces_.clear();
+        vertices_.clear(); indices_.clear(); clusters_.clear(); lods_.clear();
+        bounds_ = AABB();
+    }
+    return ok;
+}
+
+void IndexBuffer::Assign(const std::vector<int>& indices, int vertexCount) {
+    Short.clear();
+    Long.clear();
+    if (vertexCount <= 0x10000) Short.assign(indices.begin(), indices.end());
+    else Long.assign(indices.begin(), indices.end());
+}
+
+static uint16_t quantizeUnit(float value, float offset, float scale) {
+    if (scale <= 0.0f) return 0;
+    float q = (value - offset) / scale + 0.5f;
+    return (uint16_t)std::min(std::max(q, 0.0f), 65535.0f);
+}
+
+static int16_t quantizeSigned(float value) {
+    float q = std::min(std::max(value, -1.0f), 1.0f) * 32767.0f;
+    return (int16_t)(q < 0.0f ? q - 0.5f : q + 0.5f);
+}
+
+Vertex QuantizedMesh::Decode(const PackedVertex& vertex) const {
+    Vertex result;
+    for (int i = 0; i < 3; i++) result.Pos.raw[i] = PosOffset.raw[i] + vertex.Pos[i] * PosScale.raw[i];
+    for (int i = 0; i < 2; i++) result.UV.raw[i] = UVOffset.raw[i] + vertex.UV[i] * UVScale.raw[i];
+
+    // Unfold the octahedron: the lower half was mirrored over the diagonals.
+    float x = vertex.Normal[0] * (1.0f / 32767.0f);
+    float y = vertex.Normal[1] * (1.0f / 32767.0f);
+    float z = 1.0f - std::fabs(x) - std::fabs(y);
+    float t = std::max(-z, 0.0f);
+    x += x >= 0.0f ? -t : t;
+    y += y >= 0.0f ? -t : t;
+    result.Normal = Vec3f(x, y, z).normalize();
+    return result;
+}
+
+void Model::quantize() {
+    if (quantized() || vertices_.empty()) return;
+
+    AABB posBounds;
+    Vec2f uvMin(std::numeric_limits<float>::max(), std::numeric_limits<float>::max());
+    Vec2f uvMax(std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest());
+    for (const Vertex& vertex : vertices_) {
+        posBounds.Extend(vertex.Pos);
+        for (int i = 0; i < 2; i++) {
+            uvMin.raw[i] = std::min(uvMin.raw[i], vertex.UV.raw[i]);
+            uvMax.raw[i] = std::max(uvMax.raw[i], vertex.UV.raw[i]);
+        }
+    }
+
+    quantized_.PosOffset = posBounds.Min;
+    quantized_.PosScale = (posBounds.Max - posBounds.Min) * (1.0f / 65535.0f);
+    quantized_.UVOffset = uvMin;
+    quantized_.UVScale = (uvMax - uvMin) * (1.0f / 65535.0f);
+
+    quantized_.Vertices.resize(vertices_.size());
+    for (size_t v = 0; v < vertices_.size(); v++) {
+        const Vertex& vertex = vertices_[v];
+        PackedVertex& packed = quantized_.Vertices[v];
+        for (int i = 0; i < 3; i++) packed.Pos[i] = quantizeUnit(vertex.Pos.raw[i], quantized_.PosOffset.raw[i], quantized_.PosScale.raw[i]);
+        for (int i = 0; i < 2; i++) packed.UV[i] = quantizeUnit(vertex.UV.raw[i], quantized_.UVOffset.raw[i], quantized_.UVScale.raw[i]);
+
+        // Project onto the octahedron |x| + |y| + |z| = 1, folding the lower half over the diagonals of the upper one.
+        Vec3f n = vertex.Normal;
+        float l1 = std::fabs(n.x) + std::fabs(n.y) + std::fabs(n.z);
+        float x = l1 > 0.0f ? n.x / l1 : 0.0f;
+        float y = l1 > 0.0f ? n.y / l1 : 0.0f;
+        if (n.z < 0.0f) {
+            float foldedX = (1.0f - std::fabs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+            float foldedY = (1.0f - std::fabs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+            x = foldedX;
+            y = foldedY;
+        }
+        packed.Normal[0] = quantizeSigned(x);
+        packed.Normal[1] = quantizeSigned(y);
+    }
+
+    int vertexCount = (int)vertices_.size();
+    quantized_.Indices.Assign(indices_, vertexCount);
+    quantized_.LodIndices.resize(lods_.size());
+    for (size_t i = 0; i < lods_.size(); i++) {
+        quantized_.LodIndices[i].Assign(lods_[i].Indices, vertexCount);
+        std::vector<int>().swap(lods_[i].Indices);
+    }
+
+    std::vector<Vertex>().swap(vertices_);
+    std::vector<int>().swap(indices_);
+
+    // Bounds and clusters were built from the OBJ arrays, nothing draws from them anymore.
+    std::vector<Vec3f>().swap(verts_);
+    std::vector<std::vector<VertexInfo> >().swap(faces_);
+    std::vector<Vec2f>().swap(uv_);
+    std::vector<Vec3f>().swap(normals_);
+}
@@ -1,9 +1,12 @@
 #ifndef __MODEL_H__
 #define __MODEL_H__
 
+#include <cstdint>
+#include <string>
 #include <vector>
 #include "tgaimage.h"
 #include "geometry.h"
+#include "culling.h"
 
 struct VertexInfo
 {
@@ -12,6 +15,53 @@ struct VertexInfo
 	int NormalId;
 };
 
+struct Vertex
+{
+	Vec3f Pos;
+	Vec3f Normal;
+	Vec2f UV;
+};
+
+// Vertex in 14 bytes instead of 32: position and UV as 16-bit fractions of the mesh and UV bounds, normal as an
+// octahedral projection in two 16-bit values.
+struct PackedVertex
+{
+	uint16_t Pos[3];
+	int16_t Normal[2];
+	uint16_t UV[2];
+};
+
+// Indices in 16 bits when every vertex can be addressed with them, 32 otherwise. Only one of the two is filled.
+struct IndexBuffer
+{
+	std::vector<uint16_t> Short;
+	std::vector<uint32_t> Long;
+
+	void Assign(const std::vector<int>& indices, int vertexCount);
+	size_t Size() const { return Short.empty() ? Long.size() : Short.size(); }
+};
+
+struct QuantizedMesh
+{
+	Vec3f PosOffset;
+	Vec3f PosScale;
+	Vec2f UVOffset;
+	Vec2f UVScale;
+	std::vector<PackedVertex> Vertices;
+	IndexBuffer Indices;
+	std::vector<IndexBuffer> LodIndices;
+
+	Vertex Decode(const PackedVertex& vertex) const;
+};
+
+// Simplified version of a mesh, indexing the same vertices. Error is how far, in model units, its surface may be
+// from the full detail one.
+struct LevelOfDetail
+{
+	std::vector<int> Indices;
+	float Error;
+};
+
 class Model {
 private:
 	std::vector<Vec3f> verts_;
@@ -26,16 +76,68 @@ private:
 	bool diffuseLoaded_;
 	bool normalLoaded_;
 	bool specularLoaded_;
+
+	// One entry per distinct VertexInfo, three indices per face.
+	std::vector<Vertex> vertices_;
+	std::vector<int> indices_;
+
+	AABB bounds_;
+	bool closed_ = false;
+	std::vector<Cluster> clusters_;
+	BVH clusterTree_;
+
+	std::vector<LevelOfDetail> lods_;
+	QuantizedMesh quantized_;
+
+	bool readObj(const std::string& path);
+	void weld();
+	void reorderFaces(const std::vector<int>& order);
+	void buildClusters();
+	void optimize();
+	void buildClusterTree();
+	void buildLods();
+	void findClosed();
+
+	static bool cacheIsCurrent(const std::string& objPath, const std::string& cachePath);
+	bool readCache(const std::string& path);
+	bool writeCache(const std::string& path) const;
 public:
-	Model(const char* filename);
+	// Loads filename.obj, or the processed mesh cached next to it in filename.mesh when that is newer. The cache
+	// is written after processing the OBJ file.
+	Model(const char* filename, bool useCache = true);
+	Model(const std::vector<Vec3f>& verts, const std::vector<Vec2f>& uv, const std::vector<Vec3f>& normals, const std::vector<std::vector<VertexInfo> >& faces);
 	~Model();
+	// nfaces() counts the triangles drawn, the others read the arrays of the OBJ file, empty once quantized.
 	int nverts();
 	int nfaces();
 	int nuv();
 	Vec3f vert(int i);
 	Vec2f uv(int i);
 	Vec3f normal(int i);
-	std::vector<VertexInfo> face(int idx);
+	const std::vector<VertexInfo>& face(int idx);
+
+	// Indexed copy of the faces, triangle i uses indices 3i..3i+2 and matches face(i).
+	const std::vector<Vertex>& vertices() const { return vertices_; }
+	const std::vector<int>& indices() const { return indices_; }
+
+	// Faces are reordered at load so that each cluster is a contiguous range, with clusters likely to hide others
+	// first and triangles within a cluster ordered for vertex reuse.
+	const AABB& bounds() const { return bounds_; }
+	const std::vector<Cluster>& clusters() const { return clusters_; }
+	const BVH& clusterTree() const { return clusterTree_; }
+
+	// Every edge between two triangles of opposite winding, vertices at the same position being one. Only closed
+	// meshes hide the triangles facing away from the eye.
+	bool closed() const { return closed_; }
+
+	// Coarser and coarser simplifications of the mesh, not including the full detail one.
+	const std::vector<LevelOfDetail>& lods() const { return lods_; }
+
+	// Replaces the vertex and index buffers, including those of the LODs, with quantized ones. vertices(), indices(),
+	// the LOD indices and the OBJ arrays are empty afterwards and the mesh is drawn from quantizedMesh().
+	void quantize();
+	bool quantized() const { return !quantized_.Vertices.empty(); }
+	const QuantizedMesh& quantizedMesh() const { return quantized_; }
 
 	bool diffuseLoaded() const { return diffuseLoaded_; }
 	bool normalLoaded() const { return normalLoaded_; }
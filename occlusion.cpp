@@ -0,0 +1,219 @@
+#include "occlusion.h"
+#include "raster.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+OcclusionBuffer::OcclusionBuffer(int screenWidth, int screenHeight) :
+    width((screenWidth + Scale - 1) / Scale),
+    height((screenHeight + Scale - 1) / Scale),
+    screenWidth(screenWidth),
+    screenHeight(screenHeight),
+    depth((size_t)width * height),
+    coverage((size_t)width * height),
+    partialDepth((size_t)width * height),
+    clearedCoverage((size_t)width * height)
+{
+    // Samples past the edges of the screen count as covered, they can't show anything.
+    for (int y = 0; y < height; ++y)
+    {
+        for (int x = 0; x < width; ++x)
+        {
+            uint16_t mask = 0;
+            for (int sy = 0; sy < Scale; ++sy)
+                for (int sx = 0; sx < Scale; ++sx)
+                    if (x * Scale + sx >= screenWidth || y * Scale + sy >= screenHeight)
+                        mask |= (uint16_t)(1 << (sy * Scale + sx));
+            clearedCoverage[y * width + x] = mask;
+        }
+    }
+
+    Clear();
+}
+
+void OcclusionBuffer::Clear()
+{
+    std::fill(depth.begin(), depth.end(), std::numeric_limits<float>::lowest());
+    std::fill(partialDepth.begin(), partialDepth.end(), std::numeric_limits<float>::max());
+    coverage = clearedCoverage;
+}
+
+void OcclusionBuffer::RenderOccluder(Model& model, const Mat4& toScreen)
+{
+    // The indexed mesh, quantized or not, is what is drawn and what is left of the model once it is quantized.
+    if (model.quantized())
+    {
+        const QuantizedMesh& mesh = model.quantizedMesh();
+        positions.resize(mesh.Vertices.size());
+        for (size_t i = 0; i < mesh.Vertices.size(); ++i)
+        {
+            for (int j = 0; j < 3; ++j)
+                positions[i].raw[j] = mesh.PosOffset.raw[j] + mesh.Vertices[i].Pos[j] * mesh.PosScale.raw[j];
+        }
+    }
+    else
+    {
+        positions.resize(model.vertices().size());
+        for (size_t i = 0; i < model.vertices().size(); ++i)
+            positions[i] = model.vertices()[i].Pos;
+    }
+    int count = (int)positions.size();
+    projected.resize(count);
+    toScreen.TransformPoints(positions.data(), projected.data(), count);
+
+    const uint16_t fullCoverage = (uint16_t)((1u << (Scale * Scale)) - 1);
+
+    Vec3f eye = EyePosition(toScreen);
+    if (!model.quantized())
+        rasterizeClusters(model.clusters(), model.indices().data(), eye, fullCoverage);
+    else if (!model.quantizedMesh().Indices.Short.empty())
+        rasterizeClusters(model.clusters(), model.quantizedMesh().Indices.Short.data(), eye, fullCoverage);
+    else
+        rasterizeClusters(model.clusters(), model.quantizedMesh().Indices.Long.data(), eye, fullCoverage);
+}
+
+template <class Index>
+void OcclusionBuffer::rasterizeClusters(const std::vector<Cluster>& clusters, const Index* indices, const Vec3f& eye, uint16_t fullCoverage)
+{
+    // Faces turned away from the eye are behind the front ones of a closed mesh, and leaving them out only makes the
+    // buffer farther.
+    for (const Cluster& cluster : clusters)
+    {
+        if (IsBackfacing(cluster, eye))
+            continue;
+
+        for (int f = cluster.FirstFace; f < cluster.FirstFace + cluster.FaceCount; ++f)
+            rasterize((int)indices[3 * f], (int)indices[3 * f + 1], (int)indices[3 * f + 2], fullCoverage);
+    }
+}
+
+void OcclusionBuffer::rasterize(int ia, int ib, int ic, uint16_t fullCoverage)
+{
+    const Vec4f& pa = projected[ia];
+    const Vec4f& pb = projected[ib];
+    const Vec4f& pc = projected[ic];
+    if (pa.w <= 0.0f || pb.w <= 0.0f || pc.w <= 0.0f)
+        return;
+
+    Vec3f a(pa.x / pa.w, pa.y / pa.w, pa.z / pa.w);
+    Vec3f b(pb.x / pb.w, pb.y / pb.w, pb.z / pb.w);
+    Vec3f c(pc.x / pc.w, pc.y / pc.w, pc.z / pc.w);
+
+    // Screen samples are covered exactly as by GraphicsLibrary::Triangle.
+    FixedTriangle fixed;
+    if (!fixed.Setup(a, b, c))
+        return;
+
+    int minX, minY, maxX, maxY;
+    if (!fixed.Bounds(screenWidth, screenHeight, 0, minX, minY, maxX, maxY))
+        return;
+
+    float denominator = (b.y - a.y) * (c.x - a.x) - (b.x - a.x) * (c.y - a.y);
+    float alphaDx = -(c.y - a.y) / denominator;
+    float betaDx = (b.y - a.y) / denominator;
+
+    for (int by = minY / Scale; by <= maxY / Scale; ++by)
+    {
+        // Covered samples of each screen row in this row of pixels.
+        int spanMin[Scale], spanMax[Scale];
+        for (int sy = 0; sy < Scale; ++sy)
+        {
+            int y = by * Scale + sy;
+            spanMin[sy] = minX;
+            spanMax[sy] = maxX;
+            if (y < minY || y > maxY || !fixed.Span(y, 0, 0, spanMin[sy], spanMax[sy]))
+                spanMax[sy] = spanMin[sy] - 1;
+        }
+
+        for (int bx = minX / Scale; bx <= maxX / Scale; ++bx)
+        {
+            uint16_t mask = 0;
+            float farthest = std::numeric_limits<float>::max();
+
+            for (int sy = 0; sy < Scale; ++sy)
+            {
+                float y = (float)(by * Scale + sy);
+                float alphaY = ((y - a.y) * (c.x - a.x) + a.x * (c.y - a.y)) / denominator;
+                float betaY = -((y - a.y) * (b.x - a.x) + a.x * (b.y - a.y)) / denominator;
+
+                for (int sx = 0; sx < Scale; ++sx)
+                {
+                    int sampleX = bx * Scale + sx;
+                    if (sampleX < spanMin[sy] || sampleX > spanMax[sy])
+                        continue;
+
+                    float x = (float)sampleX;
+                    float alpha = alphaY + x * alphaDx;
+                    float beta = betaY + x * betaDx;
+                    float sigma = (1.0f - alpha) - beta;
+
+                    mask |= (uint16_t)(1 << (sy * Scale + sx));
+                    farthest = std::min(farthest, a.z * sigma + alpha * b.z + beta * c.z);
+                }
+            }
+
+            if (!mask)
+                continue;
+
+            int index = by * width + bx;
+            coverage[index] |= mask;
+            partialDepth[index] = std::min(partialDepth[index], farthest);
+
+            if (coverage[index] == fullCoverage)
+            {
+                depth[index] = std::max(depth[index], partialDepth[index]);
+                coverage[index] = clearedCoverage[index];
+                partialDepth[index] = std::numeric_limits<float>::max();
+            }
+        }
+    }
+}
+
+bool OcclusionBuffer::IsOccluded(const AABB& box, const Mat4& toScreen) const
+{
+    if (box.Empty())
+        return false;
+
+    float minX = std::numeric_limits<float>::max(), maxX = std::numeric_limits<float>::lowest();
+    float minY = minX, maxY = maxX;
+    float nearest = std::numeric_limits<float>::lowest();
+
+    for (int i = 0; i < 8; ++i)
+    {
+        Vec3f corner((i & 1) ? box.Max.x : box.Min.x, (i & 2) ? box.Max.y : box.Min.y, (i & 4) ? box.Max.z : box.Min.z);
+        Vec4f p = toScreen * Vec4f(corner);
+        if (p.w <= 0.0f)
+            return false;
+
+        float x = p.x / p.w, y = p.y / p.w;
+        minX = std::min(minX, x);
+        maxX = std::max(maxX, x);
+        minY = std::min(minY, y);
+        maxY = std::max(maxY, y);
+        nearest = std::max(nearest, p.z / p.w);
+    }
+
+    // The corners and the occluder depths are transformed and divided along different paths that round differently,
+    // a box no deeper than an occluder, such as one of its own flat clusters, must not be hidden by it.
+    nearest += std::max(std::fabs(nearest), 1.0f) * 1e-5f;
+
+    // Screen samples the box can reach, then the buffer pixels holding them.
+    float x0 = std::max(0.0f, std::ceil(minX));
+    float x1 = std::min((float)screenWidth - 1, std::floor(maxX));
+    float y0 = std::max(0.0f, std::ceil(minY));
+    float y1 = std::min((float)screenHeight - 1, std::floor(maxY));
+    if (x0 > x1 || y0 > y1)
+        return false;
+
+    for (int y = (int)y0 / Scale; y <= (int)y1 / Scale; ++y)
+    {
+        const float* row = depth.data() + y * width;
+        for (int x = (int)x0 / Scale; x <= (int)x1 / Scale; ++x)
+        {
+            if (row[x] <= nearest)
+                return false;
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "culling.h"
+#include "model.h"
+#include <cstdint>
+#include <vector>
+
+// Low resolution depth buffer of the occluders, used to reject objects hidden behind them before they are drawn.
+// Each pixel covers Scale x Scale screen pixels. Occluder triangles mark the screen samples they cover in a mask, and
+// once every sample of a pixel is covered it takes the farthest depth of the triangles that covered it, so the buffer
+// never claims an occluder is closer than it is. Occluders must be opaque.
+class OcclusionBuffer
+{
+public:
+    static constexpr int Scale = 4;
+    static_assert(Scale * Scale <= 16, "Coverage masks hold one bit per screen sample");
+
+    // Sized for a screen of the given resolution.
+    OcclusionBuffer(int screenWidth, int screenHeight);
+
+    int Width() const { return width; }
+    int Height() const { return height; }
+    const float* Depth() const { return depth.data(); }
+
+    void Clear();
+
+    // toScreen is Viewport * Projection * ModelView for the model. Triangles crossing the eye plane are skipped.
+    void RenderOccluder(Model& model, const Mat4& toScreen);
+
+    // True when the whole box is behind what the occluders cover, by more than a depth bias for rounding.
+    bool IsOccluded(const AABB& box, const Mat4& toScreen) const;
+
+private:
+    // Triangle f of the clusters' ranges uses indices 3f..3f+2 into projected.
+    template <class Index>
+    void rasterizeClusters(const std::vector<Cluster>& clusters, const Index* indices, const Vec3f& eye, uint16_t fullCoverage);
+    void rasterize(int ia, int ib, int ic, uint16_t fullCoverage);
+
+    int width;
+    int height;
+    int screenWidth;
+    int screenHeight;
+    std::vector<float> depth;
+
+    // Samples covered since depth was last raised, and the farthest depth of the triangles that covered them.
+    std::vector<uint16_t> coverage;
+    std::vector<float> partialDepth;
+    std::vector<uint16_t> clearedCoverage;
+
+    std::vector<Vec3f> positions;
+    std::vector<Vec4f> projected;
+};
@@ -0,0 +1,82 @@
+#include "pipeline.h"
+#include <thread>
+
+FramePipeline::FramePipeline(GraphicsLibrary& geometry, GraphicsLibrary& raster) : geometry(geometry), raster(raster), failed(false)
+{
+}
+
+bool FramePipeline::Run(int frameCount, const Stages& stages)
+{
+    failed = false;
+    for (Slot& slot : slots)
+        slot.Ready = false;
+
+    std::thread rasterThread(&FramePipeline::rasterLoop, this, frameCount, std::cref(stages));
+
+    for (int frame = 0; frame < frameCount; ++frame)
+    {
+        Slot& slot = slots[frame & 1];
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            condition.wait(lock, [&] { return !slot.Ready || failed; });
+            if (failed)
+                break;
+        }
+
+        // Nothing is drawn into the geometry context, it has no covered pixels to count.
+        geometry.BeginFrame();
+        geometry.BeginBinning(slot.Bins);
+        stages.Geometry(geometry, frame);
+        geometry.EndBinning();
+        geometry.EndFrame();
+        slot.Geometry = geometry.Profile.Last;
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            slot.Ready = true;
+        }
+        condition.notify_all();
+    }
+
+    rasterThread.join();
+    return !failed;
+}
+
+void FramePipeline::rasterLoop(int frameCount, const Stages& stages)
+{
+    for (int frame = 0; frame < frameCount; ++frame)
+    {
+        Slot& slot = slots[frame & 1];
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            condition.wait(lock, [&] { return slot.Ready; });
+        }
+
+        raster.BeginFrame();
+        raster.Clear();
+        raster.RasterizeBins(slot.Bins);
+
+        bool ok;
+        {
+            PROFILE_SCOPE(raster.Profile, Output);
+            ok = stages.Output(raster, frame);
+        }
+
+        raster.EndFrame();
+        FrameStats stats = raster.Profile.Last;
+        stats.Add(slot.Geometry);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            slot.Ready = false;
+            failed = !ok;
+        }
+        condition.notify_all();
+
+        if (stages.Report)
+            stages.Report(stats);
+
+        if (!ok)
+            return;
+    }
+}
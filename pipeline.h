@@ -0,0 +1,52 @@
+#pragma once
+
+#include "GL.h"
+#include "bins.h"
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+
+// Runs frames through two contexts at once: the geometry of frame N is culled, transformed and binned on the calling
+// thread while a raster thread draws the bins of frame N - 1 and hands the image to the output stage, which may in
+// turn overlap the writing of frame N - 2 (FrameStream does). Two sets of bins are used, so geometry never gets more
+// than one frame ahead of rasterization.
+class FramePipeline
+{
+public:
+    struct Stages
+    {
+        // Draws a frame with the geometry context, whose triangles are binned. Shaders must be deferrable.
+        std::function<void(GraphicsLibrary& GL, int frame)> Geometry;
+
+        // Receives each frame once drawn by the raster context, on the raster thread. Returning false stops the pipeline.
+        std::function<bool(GraphicsLibrary& GL, int frame)> Output;
+
+        // Optional, called on the raster thread with the profile of each frame, both contexts' work summed.
+        std::function<void(const FrameStats& stats)> Report;
+    };
+
+    // Both contexts must have the same size. Sample count and kernels are those of raster.
+    FramePipeline(GraphicsLibrary& geometry, GraphicsLibrary& raster);
+
+    // Returns false when the output stage stopped the pipeline.
+    bool Run(int frameCount, const Stages& stages);
+
+private:
+    struct Slot
+    {
+        FrameBins Bins;
+        FrameStats Geometry;
+        bool Ready = false;
+    };
+
+    void rasterLoop(int frameCount, const Stages& stages);
+
+    GraphicsLibrary& geometry;
+    GraphicsLibrary& raster;
+
+    Slot slots[2];
+    bool failed;
+
+    std::mutex mutex;
+    std::condition_variable condition;
+};
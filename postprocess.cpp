@@ -0,0 +1,260 @@
+#include "postprocess.h"
+#include "kernels.h"
+#include "profiler.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+PostProcess::PostProcess(int threadCount) : workers(threadCount)
+{
+}
+
+void PostProcess::Clear()
+{
+    operators.clear();
+    luts.clear();
+    baked = false;
+}
+
+void PostProcess::Gamma(float gamma)
+{
+    operators.push_back({ Operation::Gamma, gamma, 0 });
+    baked = false;
+}
+
+void PostProcess::ToneMap(float exposure)
+{
+    operators.push_back({ Operation::ToneMap, exposure, 0 });
+    baked = false;
+}
+
+void PostProcess::Lut(const unsigned char* red, const unsigned char* green, const unsigned char* blue)
+{
+    // In the order of the channels in memory.
+    operators.push_back({ Operation::Lut, 0.0f, luts.size() });
+    luts.insert(luts.end(), blue, blue + 256);
+    luts.insert(luts.end(), green, green + 256);
+    luts.insert(luts.end(), red, red + 256);
+    baked = false;
+}
+
+void PostProcess::Downsample()
+{
+    operators.push_back({ Operation::Downsample, 0.0f, 0 });
+    baked = false;
+}
+
+void PostProcess::bake()
+{
+    // Every run of value operators is evaluated in float for all 256 inputs, then rounded once.
+    levels = 0;
+    tables.clear();
+    identity.clear();
+    size_t first = 0;
+    for (size_t end = 0; end <= operators.size(); ++end)
+    {
+        if (end < operators.size() && operators[end].Kind != Operation::Downsample)
+            continue;
+
+        bool unchanged = true;
+        for (int channel = 0; channel < 3; ++channel)
+        {
+            for (int input = 0; input < 256; ++input)
+            {
+                float c = input / 255.0f;
+                for (size_t i = first; i < end; ++i)
+                {
+                    const Operator& op = operators[i];
+                    if (op.Kind == Operation::Gamma)
+                        c = op.Value > 0.0f ? std::pow(c, 1.0f / op.Value) : c;
+                    else if (op.Kind == Operation::ToneMap)
+                    {
+                        float white = std::max(op.Value, 1e-6f);
+                        float x = c * white;
+                        c = x * (1.0f + x / (white * white)) / (1.0f + x);
+                    }
+                    else
+                    {
+                        const unsigned char* curve = luts.data() + op.Curves + channel * 256;
+                        float position = c * 255.0f;
+                        int index = std::min(std::max((int)position, 0), 254);
+                        float t = std::min(std::max(position - index, 0.0f), 1.0f);
+                        c = (curve[index] + (curve[index + 1] - curve[index]) * t) / 255.0f;
+                    }
+                    c = std::min(std::max(c, 0.0f), 1.0f);
+                }
+
+                uint32_t output = (uint32_t)std::lround(c * 255.0f);
+                unchanged = unchanged && output == (uint32_t)input;
+                tables.push_back(output << (8 * channel));
+            }
+        }
+        identity.push_back(unchanged);
+
+        if (end < operators.size())
+            ++levels;
+        first = end + 1;
+    }
+    baked = true;
+}
+
+void PostProcess::resize(int width, int height)
+{
+    widths.assign(1, width);
+    heights.assign(1, height);
+    for (int level = 1; level <= levels; ++level)
+    {
+        widths.push_back((widths.back() + 1) / 2);
+        heights.push_back((heights.back() + 1) / 2);
+    }
+
+    // A pair of rows per level that is downsampled, then the row being stored.
+    rowOffsets.clear();
+    rowsPerThread = 0;
+    for (int level = 0; level < levels; ++level)
+    {
+        rowOffsets.push_back(rowsPerThread);
+        rowsPerThread += 2 * ((size_t)widths[level] + 1);
+    }
+    rowOffsets.push_back(rowsPerThread);
+    rowsPerThread += (size_t)widths[levels] + 1;
+
+    size_t size = rowsPerThread * workers.ThreadCount();
+    if (rows.size() < size)
+        rows.resize(size);
+    size = (size_t)width * workers.ThreadCount();
+    if (depths.size() < size)
+        depths.resize(size);
+}
+
+void PostProcess::sourceRow(GraphicsLibrary& GL, int y, uint32_t* out, float* rowDepths) const
+{
+    int width = widths[0];
+    if (Source == PostSource::Depth)
+    {
+        const float* row = GL.ZBuffer + (size_t)y * width;
+        if (GL.GetDepthFormat() != DepthFormat::Float32)
+        {
+            GL.DepthRow(y, rowDepths);
+            row = rowDepths;
+        }
+        GL.Kernels->DepthToGrayRow(row, depthOffset, depthScale, out, (size_t)width);
+        return;
+    }
+
+    const unsigned char* pixels = GL.Output.buffer() + (size_t)y * width * GL.Output.get_bytespp();
+    switch (GL.Output.get_bytespp())
+    {
+    case 4:
+        std::memcpy(out, pixels, (size_t)width * 4);
+        break;
+    case 3:
+        for (int x = 0; x < width; ++x, pixels += 3)
+            out[x] = 0xff000000u | pixels[0] | (uint32_t)pixels[1] << 8 | (uint32_t)pixels[2] << 16;
+        break;
+    default:
+        for (int x = 0; x < width; ++x)
+            out[x] = 0xff000000u | pixels[x] * 0x010101u;
+        break;
+    }
+}
+
+void PostProcess::processRow(GraphicsLibrary& GL, int level, int y, uint32_t* out, uint32_t* scratch, float* rowDepths) const
+{
+    int width = widths[level];
+    if (level == 0)
+        sourceRow(GL, y, out, rowDepths);
+    else
+    {
+        int sourceWidth = widths[level - 1];
+        uint32_t* row0 = scratch + rowOffsets[level - 1];
+        uint32_t* row1 = row0 + sourceWidth + 1;
+        processRow(GL, level - 1, 2 * y, row0, scratch, rowDepths);
+        processRow(GL, level - 1, std::min(2 * y + 1, heights[level - 1] - 1), row1, scratch, rowDepths);
+        row0[sourceWidth] = row0[sourceWidth - 1];
+        row1[sourceWidth] = row1[sourceWidth - 1];
+        GL.Kernels->DownsampleRow(row0, row1, out, (size_t)width);
+    }
+
+    if (identity[level])
+        return;
+
+    const uint32_t* blue = tables.data() + (size_t)level * 768;
+    const uint32_t* green = blue + 256;
+    const uint32_t* red = blue + 512;
+    for (int x = 0; x < width; ++x)
+    {
+        uint32_t pixel = out[x];
+        out[x] = (pixel & 0xff000000u) | blue[pixel & 0xff] | green[(pixel >> 8) & 0xff] | red[(pixel >> 16) & 0xff];
+    }
+}
+
+void PostProcess::Apply(GraphicsLibrary& GL, TGAImage& target)
+{
+    PROFILE_SCOPE(GL.Profile, Post);
+
+    if (!baked)
+        bake();
+
+    int bytespp = GL.Output.get_bytespp();
+    resize(GL.Output.get_width(), GL.Output.get_height());
+    int width = widths[levels];
+    int height = heights[levels];
+    if (target.get_width() != width || target.get_height() != height || target.get_bytespp() != bytespp)
+        target = TGAImage(width, height, bytespp);
+
+    if (Source == PostSource::Depth)
+    {
+        // Bounds are read from the compressed blocks. Unorm bounds at the ends of the range stand for anything beyond
+        // it, the depths read back are clamped to it.
+        float farthest, nearest;
+        if (!GL.DepthBounds(0, 0, widths[0] - 1, heights[0] - 1, farthest, nearest))
+        {
+            depthOffset = 0.0f;
+            depthScale = 0.0f;
+        }
+        else
+        {
+            if (GL.GetDepthFormat() != DepthFormat::Float32)
+            {
+                farthest = std::max(farthest, 0.0f);
+                nearest = std::min(nearest, GL.ViewportDepth());
+            }
+            depthOffset = nearest > farthest ? farthest : farthest - 1.0f;
+            depthScale = 255.0f / (nearest - depthOffset);
+        }
+        GL.DecompressDepth();
+    }
+
+    unsigned char* pixels = target.buffer();
+    workers.ParallelFor(height, 8, [&](int begin, int end, int thread)
+    {
+        uint32_t* scratch = rows.data() + (size_t)thread * rowsPerThread;
+        uint32_t* out = scratch + rowOffsets[levels];
+        float* rowDepths = depths.data() + (size_t)thread * widths[0];
+        for (int y = begin; y < end; ++y)
+        {
+            processRow(GL, levels, y, out, scratch, rowDepths);
+
+            unsigned char* row = pixels + (size_t)y * width * bytespp;
+            switch (bytespp)
+            {
+            case 4:
+                std::memcpy(row, out, (size_t)width * 4);
+                break;
+            case 3:
+                for (int x = 0; x < width; ++x, row += 3)
+                {
+                    row[0] = (unsigned char)out[x];
+                    row[1] = (unsigned char)(out[x] >> 8);
+                    row[2] = (unsigned char)(out[x] >> 16);
+                }
+                break;
+            default:
+                for (int x = 0; x < width; ++x)
+                    row[x] = (unsigned char)out[x];
+                break;
+            }
+        }
+    });
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include "GL.h"
+#include "tgaimage.h"
+#include "workers.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// What a post-processing chain starts from.
+enum class PostSource
+{
+    // Output's colors.
+    Color,
+    // Grey levels of the depths, ranging from black at the farthest drawn depth to white at the nearest. What was not
+    // drawn is black.
+    Depth
+};
+
+// A chain of full frame operators turning GL's colors or depths into an image. Operators that only depend on the value
+// of a channel are baked together into a 256 entry table per channel, so a run of them costs one lookup per channel.
+// Downsamplings split the chain into such runs. Rows of the result are computed in a single pass shared by worker
+// threads: each row reads its source rows, goes through every table and downsampling, then is stored. Conversions and
+// downsamplings go through the SIMD kernels of GL.
+class PostProcess
+{
+public:
+    PostSource Source = PostSource::Color;
+
+    // threadCount as for WorkerPool.
+    explicit PostProcess(int threadCount = 0);
+
+    // Operators apply in the order they are added, to channels valued from 0 to 1. Alpha is left alone.
+    void Clear();
+    // c^(1 / gamma).
+    void Gamma(float gamma);
+    // Extended Reinhard curve of c * exposure with exposure as its white point. 1 stays 1, darker values are raised
+    // more as exposure grows, 1 changes nothing.
+    void ToneMap(float exposure);
+    // Color grading through a curve of 256 values per channel, interpolated linearly.
+    void Lut(const unsigned char* red, const unsigned char* green, const unsigned char* blue);
+    // Halves the size by averaging blocks of 2x2 pixels. The last column or row of an odd size is repeated.
+    void Downsample();
+
+    // Runs the chain over GL, which must have been resolved. target is reallocated to the size of the result, in
+    // Output's format, and must not be Output.
+    void Apply(GraphicsLibrary& GL, TGAImage& target);
+
+private:
+    enum class Operation
+    {
+        Gamma,
+        ToneMap,
+        Lut,
+        Downsample
+    };
+
+    struct Operator
+    {
+        Operation Kind;
+        float Value;
+        // Index of the curves in luts.
+        size_t Curves;
+    };
+
+    void bake();
+    void resize(int width, int height);
+    void sourceRow(GraphicsLibrary& GL, int y, uint32_t* out, float* depths) const;
+    void processRow(GraphicsLibrary& GL, int level, int y, uint32_t* out, uint32_t* rows, float* depths) const;
+
+    WorkerPool workers;
+    std::vector<Operator> operators;
+    std::vector<unsigned char> luts;
+
+    // Per run, tables of the blue, green and red channels, already shifted into place.
+    bool baked = false;
+    int levels = 0;
+    std::vector<uint32_t> tables;
+    std::vector<bool> identity;
+
+    // Per level, its size and the offset of its pair of rows in a thread's scratch rows. Rows hold one more pixel
+    // repeating the last one, which odd widths average with.
+    std::vector<int> widths;
+    std::vector<int> heights;
+    std::vector<size_t> rowOffsets;
+    size_t rowsPerThread = 0;
+    std::vector<uint32_t> rows;
+    std::vector<float> depths;
+
+    float depthOffset = 0.0f;
+    float depthScale = 0.0f;
+};
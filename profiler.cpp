@@ -0,0 +1,116 @@
+#include "profiler.h"
+#include <iomanip>
+
+static const char* stageNames[(int)ProfileStage::Count] = { "load", "cull", "vertex", "setup", "raster", "shade", "post", "output" };
+
+static const char* counterNames[(int)ProfileCounter::Count] = {
+    "instances_culled",
+    "clusters_culled",
+    "instances_occluded",
+    "clusters_occluded",
+    "triangles_submitted",
+    "triangles_culled",
+    "triangles_rasterized",
+    "pixels_tested",
+    "pixels_passed",
+    "pixels_shaded",
+    "pixels_covered",
+    "depth_blocks_cleared",
+    "depth_blocks_plane",
+    "depth_blocks_pixels",
+    "depth_blocks_expanded",
+    "depth_bytes_stored",
+    "depth_bytes_full"
+};
+
+double FrameStats::Overdraw() const
+{
+    uint64_t covered = Get(ProfileCounter::PixelsCovered);
+    if (covered == 0)
+        return 0.0;
+
+    return (double)Get(ProfileCounter::PixelsShaded) / covered;
+}
+
+double FrameStats::DepthCompression() const
+{
+    uint64_t stored = Get(ProfileCounter::DepthBytesStored);
+    if (stored == 0)
+        return 0.0;
+
+    return (double)Get(ProfileCounter::DepthBytesFull) / stored;
+}
+
+void FrameStats::Add(const FrameStats& other)
+{
+    for (int i = 0; i < (int)ProfileStage::Count; ++i)
+        StageMs[i] += other.StageMs[i];
+    for (int i = 0; i < (int)ProfileCounter::Count; ++i)
+        Counters[i] += other.Counters[i];
+}
+
+void FrameStats::WriteText(std::ostream& s) const
+{
+    double total = 0.0;
+    for (double ms : StageMs)
+        total += ms;
+
+    s << "frame " << Frame << "\n";
+    for (int i = 0; i < (int)ProfileStage::Count; ++i)
+        s << "  " << std::left << std::setw(22) << stageNames[i] << std::right << std::fixed << std::setprecision(3) << std::setw(10) << StageMs[i] << " ms\n";
+    s << "  " << std::left << std::setw(22) << "total" << std::right << std::setw(10) << total << " ms\n";
+
+    for (int i = 0; i < (int)ProfileCounter::Count; ++i)
+        s << "  " << std::left << std::setw(22) << counterNames[i] << std::right << std::setw(10) << Counters[i] << "\n";
+    s << "  " << std::left << std::setw(22) << "overdraw" << std::right << std::setprecision(2) << std::setw(10) << Overdraw() << "\n";
+    s << "  " << std::left << std::setw(22) << "depth_compression" << std::right << std::setw(10) << DepthCompression() << "\n";
+    s << std::defaultfloat << std::left;
+}
+
+void FrameStats::WriteJson(std::ostream& s) const
+{
+    s << "{\"frame\":" << Frame << ",\"stages_ms\":{";
+    for (int i = 0; i < (int)ProfileStage::Count; ++i)
+        s << (i ? "," : "") << "\"" << stageNames[i] << "\":" << StageMs[i];
+
+    s << "},\"counters\":{";
+    for (int i = 0; i < (int)ProfileCounter::Count; ++i)
+        s << (i ? "," : "") << "\"" << counterNames[i] << "\":" << Counters[i];
+
+    s << "},\"overdraw\":" << Overdraw() << ",\"depth_compression\":" << DepthCompression() << "}";
+}
+
+void Profiler::BeginFrame()
+{
+    Current = FrameStats();
+    Current.Frame = frameIndex;
+    activeSince = Clock::now();
+}
+
+void Profiler::EndFrame(uint64_t coveredPixels)
+{
+    Charge(Clock::now());
+    Current.Counters[(int)ProfileCounter::PixelsCovered] = coveredPixels;
+    Last = Current;
+    ++frameIndex;
+}
+
+void Profiler::Charge(Clock::time_point now)
+{
+    if (activeStage >= 0)
+        Current.StageMs[activeStage] += std::chrono::duration<double, std::milli>(now - activeSince).count();
+
+    activeSince = now;
+}
+
+Profiler::Scope::Scope(Profiler& profiler, ProfileStage stage) : profiler(profiler), previous(profiler.activeStage)
+{
+    profiler.Charge(Clock::now());
+    profiler.activeStage = (int)stage;
+}
+
+Profiler::Scope::~Scope()
+{
+    profiler.Charge(Clock::now());
+    profiler.activeStage = previous;
+}
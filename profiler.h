@@ -0,0 +1,113 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+
+// Frame profiler. Compiled in only when ENABLE_PROFILER is defined, otherwise the PROFILE_* macros expand to nothing
+// and every report is empty.
+
+enum class ProfileStage
+{
+    Load,
+    Cull,
+    Vertex,
+    Setup,
+    Raster,
+    Shade,
+    Post,
+    Output,
+    Count
+};
+
+enum class ProfileCounter
+{
+    InstancesCulled,
+    ClustersCulled,
+    InstancesOccluded,
+    ClustersOccluded,
+    TrianglesSubmitted,
+    TrianglesCulled,
+    TrianglesRasterized,
+    PixelsTested,
+    PixelsPassed,
+    PixelsShaded,
+    PixelsCovered,
+    DepthBlocksCleared,
+    DepthBlocksPlane,
+    DepthBlocksPixels,
+    DepthBlocksExpanded,
+    DepthBytesStored,
+    DepthBytesFull,
+    Count
+};
+
+struct FrameStats
+{
+    int Frame = 0;
+    double StageMs[(int)ProfileStage::Count] = {};
+    uint64_t Counters[(int)ProfileCounter::Count] = {};
+
+    uint64_t Get(ProfileCounter counter) const { return Counters[(int)counter]; }
+
+    // Average number of shaded fragments per covered pixel.
+    double Overdraw() const;
+
+    // Size of the depth buffer over the size of its compressed blocks at the end of the frame.
+    double DepthCompression() const;
+
+    // Adds the stage times and counters of other, for frames whose work is split between threads.
+    void Add(const FrameStats& other);
+
+    void WriteText(std::ostream& s) const;
+    void WriteJson(std::ostream& s) const;
+};
+
+class Profiler
+{
+public:
+#ifdef ENABLE_PROFILER
+    static constexpr bool Enabled = true;
+#else
+    static constexpr bool Enabled = false;
+#endif
+
+    using Clock = std::chrono::steady_clock;
+
+    FrameStats Current;
+    FrameStats Last;
+
+    void BeginFrame();
+    void EndFrame(uint64_t coveredPixels);
+
+    void Count(ProfileCounter counter, uint64_t amount = 1) { Current.Counters[(int)counter] += amount; }
+
+    // Stage scopes nest: time spent in an inner stage is not charged to the outer one.
+    class Scope
+    {
+    public:
+        Scope(Profiler& profiler, ProfileStage stage);
+        ~Scope();
+
+    private:
+        Profiler& profiler;
+        int previous;
+    };
+
+private:
+    void Charge(Clock::time_point now);
+
+    int activeStage = -1;
+    Clock::time_point activeSince;
+    int frameIndex = 0;
+};
+
+#ifdef ENABLE_PROFILER
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_SCOPE(profiler, stage) Profiler::Scope PROFILE_CONCAT(profileScope, __LINE__)(profiler, ProfileStage::stage)
+#define PROFILE_COUNT(profiler, counter, amount) (profiler).Count(ProfileCounter::counter, amount)
+#else
+#define PROFILE_SCOPE(profiler, stage) ((void)0)
+#define PROFILE_COUNT(profiler, counter, amount) ((void)0)
+#endif
@@ -0,0 +1,128 @@
+#include "raster.h"
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    int64_t floorDiv(int64_t n, int64_t d)
+    {
+        int64_t q = n / d;
+        return (n % d != 0 && n < 0) ? q - 1 : q;
+    }
+
+    int64_t ceilDiv(int64_t n, int64_t d)
+    {
+        return -floorDiv(-n, d);
+    }
+}
+
+bool FixedTriangle::Setup(Vec3f& a, Vec3f& b, Vec3f& c)
+{
+    Vec3f* vertices[3] = { &a, &b, &c };
+    int64_t x[3], y[3];
+    for (int i = 0; i < 3; ++i)
+    {
+        // Also rejects NaN.
+        if (!(std::abs(vertices[i]->x) < GuardBand && std::abs(vertices[i]->y) < GuardBand))
+            return false;
+
+        x[i] = std::lround(vertices[i]->x * SubpixelScale);
+        y[i] = std::lround(vertices[i]->y * SubpixelScale);
+        vertices[i]->x = (float)x[i] / SubpixelScale;
+        vertices[i]->y = (float)y[i] / SubpixelScale;
+    }
+
+    int64_t area = (x[1] - x[0]) * (y[2] - y[0]) - (y[1] - y[0]) * (x[2] - x[0]);
+    if (area == 0)
+        return false;
+
+    // Edges go counterclockwise so that the inside is where every edge function is positive.
+    int order[3] = { 0, 1, 2 };
+    if (area < 0)
+        std::swap(order[1], order[2]);
+
+    for (int i = 0; i < 3; ++i)
+    {
+        int from = order[i];
+        int to = order[(i + 1) % 3];
+        edgeA[i] = y[from] - y[to];
+        edgeB[i] = x[to] - x[from];
+        edgeC[i] = -edgeA[i] * x[from] - edgeB[i] * y[from];
+
+        // y points up: left edges have the inside towards +x, top edges are horizontal with the inside towards -y.
+        bool topLeft = edgeA[i] > 0 || (edgeA[i] == 0 && edgeB[i] < 0);
+        if (!topLeft)
+            edgeC[i] -= 1;
+    }
+
+    minX = (int32_t)std::min({ x[0], x[1], x[2] });
+    minY = (int32_t)std::min({ y[0], y[1], y[2] });
+    maxX = (int32_t)std::max({ x[0], x[1], x[2] });
+    maxY = (int32_t)std::max({ y[0], y[1], y[2] });
+    return true;
+}
+
+bool FixedTriangle::Bounds(int width, int height, int reach, int& outMinX, int& outMinY, int& outMaxX, int& outMaxY) const
+{
+    outMinX = (int)std::max<int64_t>(ceilDiv(minX - reach, SubpixelScale), 0);
+    outMinY = (int)std::max<int64_t>(ceilDiv(minY - reach, SubpixelScale), 0);
+    outMaxX = (int)std::min<int64_t>(floorDiv(maxX + reach, SubpixelScale), width - 1);
+    outMaxY = (int)std::min<int64_t>(floorDiv(maxY + reach, SubpixelScale), height - 1);
+    return outMinX <= outMaxX && outMinY <= outMaxY;
+}
+
+bool FixedTriangle::Span(int y, int dx, int dy, int& spanMinX, int& spanMaxX) const
+{
+    int64_t sampleY = (int64_t)y * SubpixelScale + dy;
+    int64_t first = spanMinX;
+    int64_t last = spanMaxX;
+
+    // Along the row each edge function is value + step * x.
+    for (int i = 0; i < 3 && first <= last; ++i)
+    {
+        int64_t value = edgeA[i] * dx + edgeB[i] * sampleY + edgeC[i];
+        int64_t step = edgeA[i] * SubpixelScale;
+
+        if (step > 0)
+            first = std::max(first, ceilDiv(-value, step));
+        else if (step < 0)
+            last = std::min(last, floorDiv(value, -step));
+        else if (value < 0)
+            return false;
+    }
+
+    spanMinX = (int)first;
+    spanMaxX = (int)last;
+    return first <= last;
+}
+
+Visibility FixedTriangle::ClassifyBlock(int x0, int y0, int x1, int y1) const
+{
+    int64_t left = (int64_t)x0 * SubpixelScale, right = (int64_t)x1 * SubpixelScale;
+    int64_t bottom = (int64_t)y0 * SubpixelScale, top = (int64_t)y1 * SubpixelScale;
+    bool inside = true;
+
+    // Edge functions are largest and smallest at opposite corners. A block outside the triangle but not entirely
+    // behind one of its edges is reported as intersecting it.
+    for (int i = 0; i < 3; ++i)
+    {
+        int64_t largest = edgeA[i] * (edgeA[i] > 0 ? right : left) + edgeB[i] * (edgeB[i] > 0 ? top : bottom) + edgeC[i];
+        int64_t smallest = edgeA[i] * (edgeA[i] > 0 ? left : right) + edgeB[i] * (edgeB[i] > 0 ? bottom : top) + edgeC[i];
+        if (largest < 0)
+            return Visibility::Outside;
+        if (smallest < 0)
+            inside = false;
+    }
+
+    return inside ? Visibility::Inside : Visibility::Intersecting;
+}
+
+bool FixedTriangle::Covers(int64_t x, int64_t y) const
+{
+    for (int i = 0; i < 3; ++i)
+    {
+        if (edgeA[i] * x + edgeB[i] * y + edgeC[i] < 0)
+            return false;
+    }
+    return true;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "geometry.h"
+#include "culling.h"
+#include <cstdint>
+
+// Triangle snapped to fixed point screen coordinates with SubpixelBits fractional bits. Coverage is decided with
+// exact integer edge functions and a top-left fill rule: a sample on an edge shared by two triangles belongs to
+// exactly one of them, so meshes neither crack nor shade pixels twice whatever the order triangles are drawn in.
+// Samples are at integer pixel coordinates plus an optional offset in subpixels.
+class FixedTriangle
+{
+public:
+    static constexpr int SubpixelBits = 8;
+    static constexpr int SubpixelScale = 1 << SubpixelBits;
+
+    // Vertices further than this from the origin, in pixels, are rejected so that edge functions can't overflow.
+    static constexpr float GuardBand = 16384.0f;
+
+    // Snaps the x and y of a, b and c, which are replaced by the snapped values. Returns false when the triangle
+    // has no area once snapped or leaves the guard band.
+    bool Setup(Vec3f& a, Vec3f& b, Vec3f& c);
+
+    // Pixels whose samples, up to reach subpixels away, can be covered, clamped to [0, width) x [0, height).
+    // Returns false when there are none.
+    bool Bounds(int width, int height, int reach, int& minX, int& minY, int& maxX, int& maxY) const;
+
+    // Narrows [minX, maxX] to the pixels of row y whose sample, offset by (dx, dy) subpixels, is covered. Returns
+    // false when none are.
+    bool Span(int y, int dx, int dy, int& minX, int& maxX) const;
+
+    // Whether the pixels [x0, x1] x [y0, y1] are all covered, none are, or some may be.
+    Visibility ClassifyBlock(int x0, int y0, int x1, int y1) const;
+
+    // True when sample (x, y), in subpixels, is covered.
+    bool Covers(int64_t x, int64_t y) const;
+
+private:
+    // Edge i is inside where A * x + B * y + C >= 0, x and y in subpixels. Edges the fill rule leaves to the
+    // neighbouring triangle have 1 taken off C so that samples exactly on them are outside.
+    int64_t edgeA[3];
+    int64_t edgeB[3];
+    int64_t edgeC[3];
+
+    int32_t minX;
+    int32_t minY;
+    int32_t maxX;
+    int32_t maxY;
+};
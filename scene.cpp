@@ -0,0 +1,89 @@
+#include "scene.h"
+#include <algorithm>
+
+int Scene::AddNode(const Mat4& local, int parent)
+{
+    SceneNode node;
+    node.Local = local;
+    node.World = local;
+    node.Parent = parent;
+    node.Dirty = true;
+
+    ++version;
+    nodes.push_back(node);
+    return (int)nodes.size() - 1;
+}
+
+void Scene::SetLocalTransform(int node, const Mat4& local)
+{
+    nodes[node].Local = local;
+    nodes[node].Dirty = true;
+    ++version;
+}
+
+int Scene::AddInstance(Model& mesh, int node, const Material& material, bool occluder)
+{
+    instances.push_back({ &mesh, node, material, occluder });
+    drawOrderDirty = true;
+    instanceTreeDirty = true;
+    ++version;
+    return (int)instances.size() - 1;
+}
+
+void Scene::UpdateTransforms()
+{
+    // Parents precede children, so one pass sees every parent updated before its children.
+    updated.assign(nodes.size(), 0);
+
+    for (size_t i = 0; i < nodes.size(); ++i)
+    {
+        SceneNode& node = nodes[i];
+        bool parentUpdated = node.Parent >= 0 && updated[node.Parent];
+
+        if (!node.Dirty && !parentUpdated)
+            continue;
+
+        node.World = node.Parent >= 0 ? nodes[node.Parent].World * node.Local : node.Local;
+        node.Dirty = false;
+        updated[i] = 1;
+        instanceTreeDirty = true;
+    }
+}
+
+const std::vector<int>& Scene::DrawOrder()
+{
+    if (drawOrderDirty || drawOrder.size() != instances.size())
+    {
+        drawOrder.resize(instances.size());
+        for (size_t i = 0; i < drawOrder.size(); ++i)
+            drawOrder[i] = (int)i;
+
+        std::stable_sort(drawOrder.begin(), drawOrder.end(), [this](int a, int b)
+        {
+            const Instance& ia = instances[a];
+            const Instance& ib = instances[b];
+            if (ia.Mesh != ib.Mesh)
+                return std::less<Model*>()(ia.Mesh, ib.Mesh);
+            return std::less<IShader*>()(ia.Mat.Shader, ib.Mat.Shader);
+        });
+
+        drawOrderDirty = false;
+    }
+
+    return drawOrder;
+}
+
+const BVH& Scene::InstanceTree()
+{
+    if (instanceTreeDirty)
+    {
+        instanceBounds.resize(instances.size());
+        for (size_t i = 0; i < instances.size(); ++i)
+            instanceBounds[i] = instances[i].Mesh->bounds().Transform(nodes[instances[i].Node].World);
+
+        instanceTree.Build(instanceBounds);
+        instanceTreeDirty = false;
+    }
+
+    return instanceTree;
+}
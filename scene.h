@@ -0,0 +1,69 @@
+#pragma once
+
+#include "GL.h"
+#include <vector>
+
+struct Material
+{
+    IShader* Shader;
+};
+
+// Node of the transform hierarchy. Parents always come before their children.
+struct SceneNode
+{
+    Mat4 Local;
+    Mat4 World;
+    int Parent;
+    bool Dirty;
+};
+
+// A mesh placed in the scene. Meshes are shared, so memory grows with unique meshes rather than instances.
+// Occluders are also drawn into the occlusion buffer, to hide what is behind them.
+struct Instance
+{
+    Model* Mesh;
+    int Node;
+    Material Mat;
+    bool Occluder;
+};
+
+class Scene
+{
+public:
+    // parent must be an existing node or -1 for a root.
+    int AddNode(const Mat4& local, int parent = -1);
+    void SetLocalTransform(int node, const Mat4& local);
+
+    int AddInstance(Model& mesh, int node, const Material& material, bool occluder = false);
+
+    // Recomputes the world transforms of dirty nodes and their descendants.
+    void UpdateTransforms();
+
+    // Changes whenever a node or an instance is added or a transform is set, caches of the drawn scene compare it.
+    uint64_t Version() const { return version; }
+
+    const Mat4& WorldTransform(int node) const { return nodes[node].World; }
+
+    const std::vector<SceneNode>& Nodes() const { return nodes; }
+    const std::vector<Instance>& Instances() const { return instances; }
+
+    // Instance indices grouped by mesh then shader, so each mesh is drawn for all its instances while it is hot in cache.
+    const std::vector<int>& DrawOrder();
+
+    // Hierarchy over the world space bounds of the instances, rebuilt when instances or transforms change.
+    const BVH& InstanceTree();
+
+    // World space bounds of an instance, as of the last InstanceTree call.
+    const AABB& InstanceBounds(int instance) const { return instanceBounds[instance]; }
+
+private:
+    std::vector<SceneNode> nodes;
+    std::vector<Instance> instances;
+    std::vector<int> drawOrder;
+    bool drawOrderDirty = false;
+    std::vector<char> updated;
+    BVH instanceTree;
+    std::vector<AABB> instanceBounds;
+    bool instanceTreeDirty = false;
+    uint64_t version = 0;
+};
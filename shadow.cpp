@@ -0,0 +1,55 @@
+#include "shadow.h"
+#include <algorithm>
+#include <cmath>
+
+ShadowMap::ShadowMap(int size, SimdLevel simd) : map(size, size, simd), size(size)
+{
+    map.DepthOnly = true;
+    map.SetViewport(0, 0, size, size, 255.f);
+}
+
+bool ShadowMap::Update(const Vec3f& light, const Vec3f& target, float extent, uint64_t version,
+    const std::function<void(GraphicsLibrary& GL)>& draw)
+{
+    if (valid && light.x == lightDirection.x && light.y == lightDirection.y && light.z == lightDirection.z
+        && target.x == center.x && target.y == center.y && target.z == center.z && extent == radius && version == geometryVersion)
+        return false;
+
+    // Any up does as long as it isn't parallel to the light.
+    Vec3f up = std::fabs(light.y) > 0.99f * light.norm() ? Vec3f(1.f, 0.f, 0.f) : Vec3f(0.f, 1.f, 0.f);
+    map.LookAt(target + light, target, up);
+    map.SetOrthographic(extent);
+
+    map.BeginFrame();
+    map.Clear();
+    draw(map);
+    map.DecompressDepth();
+    map.EndFrame();
+
+    worldToMap = map.Viewport * map.Projection * map.View;
+    lightDirection = light;
+    center = target;
+    radius = extent;
+    geometryVersion = version;
+    valid = true;
+    return true;
+}
+
+float ShadowMap::Visibility(const Vec3f& mapPosition) const
+{
+    int x = (int)std::floor(mapPosition.x);
+    int y = (int)std::floor(mapPosition.y);
+    if (x < 0 || y < 0 || x >= size || y >= size)
+        return 1.f;
+
+    // Greater depths are closer to the light, texels of the border are clamped.
+    float depth = mapPosition.z + Bias;
+    int lit = 0;
+    for (int dy = -1; dy <= 1; ++dy)
+    {
+        const float* row = map.ZBuffer + (size_t)std::min(std::max(y + dy, 0), size - 1) * size;
+        for (int dx = -1; dx <= 1; ++dx)
+            lit += row[std::min(std::max(x + dx, 0), size - 1)] <= depth;
+    }
+    return lit / 9.f;
+}
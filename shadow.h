@@ -0,0 +1,45 @@
+#pragma once
+
+#include "GL.h"
+#include "matrix.h"
+#include <cstdint>
+#include <functional>
+
+// Depth map of a directional light, drawn depth only with a parallel projection. The map covers the sphere of the
+// given radius around center, and is kept across frames for as long as the light, that volume and the geometry
+// version passed to Update stay the same.
+class ShadowMap
+{
+public:
+    // Depth units a fragment can be behind the map and still be lit, hides the acne of surfaces facing the light.
+    float Bias = 2.0f;
+
+    ShadowMap(int size, SimdLevel simd = SimdLevel::Auto);
+
+    // Redraws the map with draw unless it's still valid, lightDirection points toward the light. geometryVersion
+    // must change whenever what draw draws does, Scene::Version for instance. Returns whether the map was redrawn.
+    bool Update(const Vec3f& lightDirection, const Vec3f& center, float radius, uint64_t geometryVersion,
+        const std::function<void(GraphicsLibrary& GL)>& draw);
+
+    // The next Update redraws the map.
+    void Invalidate() { valid = false; }
+
+    // From world space to the map's pixels and depths.
+    const Mat4& WorldToMap() const { return worldToMap; }
+
+    // Lit fraction of the 3x3 texels around a point given in map space, 1 outside the map.
+    float Visibility(const Vec3f& mapPosition) const;
+
+    const GraphicsLibrary& Map() const { return map; }
+
+private:
+    GraphicsLibrary map;
+    int size;
+    Mat4 worldToMap;
+
+    bool valid = false;
+    Vec3f lightDirection;
+    Vec3f center;
+    float radius = 0;
+    uint64_t geometryVersion = 0;
+};
@@ -0,0 +1,243 @@
+#include "simplify.h"
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    // Sum of squared distances to a set of planes, as the symmetric matrix of (x, y, z, 1).
+    struct Quadric
+    {
+        double A2 = 0, AB = 0, AC = 0, AD = 0;
+        double B2 = 0, BC = 0, BD = 0;
+        double C2 = 0, CD = 0;
+        double D2 = 0;
+
+        void AddPlane(double a, double b, double c, double d)
+        {
+            A2 += a * a; AB += a * b; AC += a * c; AD += a * d;
+            B2 += b * b; BC += b * c; BD += b * d;
+            C2 += c * c; CD += c * d;
+            D2 += d * d;
+        }
+
+        void Add(const Quadric& q)
+        {
+            A2 += q.A2; AB += q.AB; AC += q.AC; AD += q.AD;
+            B2 += q.B2; BC += q.BC; BD += q.BD;
+            C2 += q.C2; CD += q.CD;
+            D2 += q.D2;
+        }
+
+        double Evaluate(const Vec3f& p) const
+        {
+            double x = p.x, y = p.y, z = p.z;
+            double result = A2 * x * x + B2 * y * y + C2 * z * z + D2
+                + 2.0 * (AB * x * y + AC * x * z + BC * y * z + AD * x + BD * y + CD * z);
+            return std::max(result, 0.0);
+        }
+    };
+
+    struct Collapse
+    {
+        int From;
+        int To;
+        double Cost;
+    };
+
+    Vec3f faceNormal(const Vec3f& a, const Vec3f& b, const Vec3f& c)
+    {
+        return (b - a) ^ (c - a);
+    }
+}
+
+std::vector<int> SimplifyMesh(const std::vector<int>& indices, const std::vector<Vertex>& vertices, int targetTriangles, float& error)
+{
+    int vertexCount = (int)vertices.size();
+    std::vector<int> result(indices);
+
+    std::vector<Quadric> quadrics(vertexCount);
+    for (size_t i = 0; i + 2 < result.size(); i += 3)
+    {
+        Vec3f n = faceNormal(vertices[result[i]].Pos, vertices[result[i + 1]].Pos, vertices[result[i + 2]].Pos);
+        float length = n.norm();
+        if (length <= 0.0f)
+            continue;
+
+        n = n * (1.0f / length);
+        double d = -(n * vertices[result[i]].Pos);
+        for (int j = 0; j < 3; ++j)
+            quadrics[result[i + j]].AddPlane(n.x, n.y, n.z, d);
+    }
+
+    // Edges used by one triangle are borders, which includes attribute seams since welded vertices on either side
+    // differ. Edges used by more than two triangles are not manifold. Either way their vertices are kept.
+    std::vector<char> locked(vertexCount, 0);
+    {
+        std::vector<std::pair<int, int> > edges;
+        edges.reserve(result.size());
+        for (size_t i = 0; i + 2 < result.size(); i += 3)
+        {
+            for (int j = 0; j < 3; ++j)
+            {
+                int a = result[i + j], b = result[i + (j + 1) % 3];
+                edges.push_back(std::make_pair(std::min(a, b), std::max(a, b)));
+            }
+        }
+        std::sort(edges.begin(), edges.end());
+
+        for (size_t i = 0; i < edges.size();)
+        {
+            size_t j = i;
+            while (j < edges.size() && edges[j] == edges[i])
+                ++j;
+            if (j - i != 2)
+                locked[edges[i].first] = locked[edges[i].second] = 1;
+            i = j;
+        }
+    }
+
+    std::vector<int> offsets(vertexCount + 1), adjacency;
+    std::vector<Collapse> collapses;
+    std::vector<char> touched(vertexCount);
+    std::vector<int> ring;
+    double maxCost = (double)error * error;
+
+    while ((int)result.size() / 3 > targetTriangles)
+    {
+        int triangleCount = (int)result.size() / 3;
+
+        // Triangles around each vertex.
+        std::fill(offsets.begin(), offsets.end(), 0);
+        for (int index : result)
+            ++offsets[index + 1];
+        for (int v = 0; v < vertexCount; ++v)
+            offsets[v + 1] += offsets[v];
+        adjacency.resize(result.size());
+        std::vector<int> filled(offsets.begin(), offsets.end() - 1);
+        for (size_t i = 0; i < result.size(); ++i)
+            adjacency[filled[result[i]]++] = (int)i / 3;
+
+        collapses.clear();
+        for (size_t i = 0; i < result.size(); i += 3)
+        {
+            for (int j = 0; j < 3; ++j)
+            {
+                int a = result[i + j], b = result[i + (j + 1) % 3];
+                Quadric q = quadrics[a];
+                q.Add(quadrics[b]);
+                if (!locked[a])
+                    collapses.push_back({ a, b, q.Evaluate(vertices[b].Pos) });
+                if (!locked[b])
+                    collapses.push_back({ b, a, q.Evaluate(vertices[a].Pos) });
+            }
+        }
+        std::sort(collapses.begin(), collapses.end(), [](const Collapse& x, const Collapse& y) { return x.Cost < y.Cost; });
+
+        // Each pass collapses edges whose surroundings haven't changed yet, so adjacency stays valid within it.
+        std::fill(touched.begin(), touched.end(), 0);
+        int goal = triangleCount - targetTriangles;
+        int removed = 0;
+
+        for (const Collapse& collapse : collapses)
+        {
+            if (removed >= goal)
+                break;
+            if (touched[collapse.From] || touched[collapse.To])
+                continue;
+
+            const int* begin = adjacency.data() + offsets[collapse.From];
+            const int* end = adjacency.data() + offsets[collapse.From + 1];
+
+            // Collapsing an edge (u, v) keeps the surface manifold when u and v share exactly the neighbours of the
+            // two triangles on the edge.
+            ring.clear();
+            int shared = 0;
+            for (const int* t = begin; t != end; ++t)
+            {
+                const int* triangle = result.data() + *t * 3;
+                if (triangle[0] == collapse.To || triangle[1] == collapse.To || triangle[2] == collapse.To)
+                    ++shared;
+                for (int j = 0; j < 3; ++j)
+                    if (triangle[j] != collapse.From)
+                        ring.push_back(triangle[j]);
+            }
+            std::sort(ring.begin(), ring.end());
+            ring.erase(std::unique(ring.begin(), ring.end()), ring.end());
+
+            int common = 0;
+            for (int t = offsets[collapse.To]; t < offsets[collapse.To + 1]; ++t)
+            {
+                const int* triangle = result.data() + adjacency[t] * 3;
+                for (int j = 0; j < 3; ++j)
+                {
+                    int v = triangle[j];
+                    if (v != collapse.To && v != collapse.From && std::binary_search(ring.begin(), ring.end(), v))
+                        ++common;
+                }
+            }
+            // Each common neighbour is seen from two triangles around To.
+            if (shared != 2 || common != 4)
+                continue;
+
+            // Triangles that stay must not flip.
+            bool flips = false;
+            for (const int* t = begin; t != end && !flips; ++t)
+            {
+                const int* triangle = result.data() + *t * 3;
+                if (triangle[0] == collapse.To || triangle[1] == collapse.To || triangle[2] == collapse.To)
+                    continue;
+
+                Vec3f p[3], q[3];
+                for (int j = 0; j < 3; ++j)
+                {
+                    p[j] = vertices[triangle[j]].Pos;
+                    q[j] = triangle[j] == collapse.From ? vertices[collapse.To].Pos : p[j];
+                }
+                if (faceNormal(p[0], p[1], p[2]) * faceNormal(q[0], q[1], q[2]) <= 0.0f)
+                    flips = true;
+            }
+            if (flips)
+                continue;
+
+            for (const int* t = begin; t != end; ++t)
+            {
+                int* triangle = result.data() + *t * 3;
+                bool degenerate = false;
+                for (int j = 0; j < 3; ++j)
+                {
+                    if (triangle[j] == collapse.To)
+                        degenerate = true;
+                    if (triangle[j] == collapse.From)
+                        triangle[j] = collapse.To;
+                }
+                if (degenerate)
+                    ++removed;
+            }
+
+            quadrics[collapse.To].Add(quadrics[collapse.From]);
+            maxCost = std::max(maxCost, collapse.Cost);
+
+            touched[collapse.From] = touched[collapse.To] = 1;
+            for (int v : ring)
+                touched[v] = 1;
+        }
+
+        if (removed == 0)
+            break;
+
+        size_t kept = 0;
+        for (size_t i = 0; i < result.size(); i += 3)
+        {
+            int a = result[i], b = result[i + 1], c = result[i + 2];
+            if (a == b || b == c || a == c)
+                continue;
+            result[kept++] = a;
+            result[kept++] = b;
+            result[kept++] = c;
+        }
+        result.resize(kept);
+    }
+
+    error = (float)std::sqrt(maxCost);
+    return result;
+}
@@ -0,0 +1,10 @@
+#pragma once
+
+#include "model.h"
+#include <vector>
+
+// Reduces a triangle list towards targetTriangles by collapsing edges onto one of their vertices, cheapest first
+// by quadric error (Garland and Heckbert). Vertices on borders and attribute seams stay in place, so the result
+// indexes the same vertices and may keep more triangles than asked for. error is raised to the largest distance
+// estimate, in model units, of the collapses made.
+std::vector<int> SimplifyMesh(const std::vector<int>& indices, const std::vector<Vertex>& vertices, int targetTriangles, float& error);
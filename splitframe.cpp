@@ -0,0 +1,219 @@
+#include "splitframe.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace
+{
+    // Sent by a worker before the pixels of its region, bottom row first like Output.
+    struct RegionHeader
+    {
+        int32_t X;
+        int32_t Y;
+        int32_t Width;
+        int32_t Height;
+        int32_t Bytespp;
+    };
+
+    // Along one axis, the part [Begin, End) of the frame a region keeps and where the region starts.
+    struct Span
+    {
+        int Begin;
+        int End;
+        int Origin;
+    };
+
+    struct Worker
+    {
+        pid_t Pid;
+        int Pipe;
+        Span Columns;
+        Span Rows;
+    };
+
+    // Regions of size pixels covering frame pixels, each keeping what lies more than overlap pixels from its sides,
+    // except on the frame's sides. Without overlap the regions are side by side, the last one may reach beyond the
+    // frame. With one, steps and origins are even and the last region is moved back within the frame, unless that
+    // would make its origin odd.
+    std::vector<Span> splitAxis(int frame, int size, int overlap)
+    {
+        int step = overlap > 0 ? (size - 2 * overlap) & ~1 : size;
+        int last = std::max(frame - size, 0);
+        if (overlap > 0)
+            last += last & 1;
+
+        std::vector<Span> spans;
+        for (int begin = 0; begin < frame;)
+        {
+            int origin = std::min(std::max(begin - overlap, 0), last);
+            int end = origin + size >= frame ? frame : begin + step;
+            spans.push_back({ begin, end, origin });
+            begin = end;
+        }
+        return spans;
+    }
+
+    bool writeAll(int fd, const void* data, size_t size)
+    {
+        const unsigned char* bytes = (const unsigned char*)data;
+        while (size > 0)
+        {
+            ssize_t written = write(fd, bytes, size);
+            if (written < 0 && errno == EINTR)
+                continue;
+            if (written <= 0)
+                return false;
+            bytes += written;
+            size -= (size_t)written;
+        }
+        return true;
+    }
+
+    bool readAll(int fd, void* data, size_t size)
+    {
+        unsigned char* bytes = (unsigned char*)data;
+        while (size > 0)
+        {
+            ssize_t read = ::read(fd, bytes, size);
+            if (read < 0 && errno == EINTR)
+                continue;
+            if (read <= 0)
+                return false;
+            bytes += read;
+            size -= (size_t)read;
+        }
+        return true;
+    }
+
+    [[noreturn]] void runWorker(GraphicsLibrary& GL, const std::function<void(GraphicsLibrary& GL)>& draw,
+        const std::function<void(GraphicsLibrary& GL)>& post, int x, int y, int pipe)
+    {
+        GL.SetRegion(x, y);
+        GL.Clear();
+        draw(GL);
+        GL.Resolve();
+        if (post)
+            post(GL);
+
+        RegionHeader header = { x, y, GL.Output.get_width(), GL.Output.get_height(), GL.Output.get_bytespp() };
+        size_t size = (size_t)header.Width * header.Height * header.Bytespp;
+        bool sent = writeAll(pipe, &header, sizeof(header)) && writeAll(pipe, GL.Output.buffer(), size);
+
+        // Skips the destructors and exit handlers of the coordinator's state.
+        _exit(sent ? 0 : 1);
+    }
+}
+#endif
+
+bool RenderSplitFrame(GraphicsLibrary& GL, const std::function<void(GraphicsLibrary& GL)>& draw, TGAImage& image,
+    const std::function<void(GraphicsLibrary& GL)>& post, int overlap)
+{
+#ifdef _WIN32
+    std::cerr << "split frame rendering needs fork, which Windows doesn't have\n";
+    return false;
+#else
+    int regionWidth = GL.Output.get_width();
+    int regionHeight = GL.Output.get_height();
+    int bytespp = GL.Output.get_bytespp();
+    if (image.get_bytespp() != bytespp)
+    {
+        std::cerr << "split frame image and context formats differ\n";
+        return false;
+    }
+
+    // Even, so that regions keep the 2x2 blocks of the frame.
+    overlap = std::max(overlap, 0);
+    overlap += overlap & 1;
+    if (overlap > 0 && ((regionWidth < image.get_width() && regionWidth - 2 * overlap < 2)
+        || (regionHeight < image.get_height() && regionHeight - 2 * overlap < 2)))
+    {
+        std::cerr << "split frame regions are too small for an overlap of " << overlap << "\n";
+        return false;
+    }
+    std::vector<Span> columns = splitAxis(image.get_width(), regionWidth, overlap);
+    std::vector<Span> rows = splitAxis(image.get_height(), regionHeight, overlap);
+
+    // Buffered output would be written again by every worker.
+    std::cout.flush();
+    std::cerr.flush();
+    std::fflush(nullptr);
+
+    std::vector<Worker> workers;
+    bool ok = true;
+    for (size_t j = 0; j < rows.size() && ok; ++j)
+    {
+        for (size_t i = 0; i < columns.size() && ok; ++i)
+        {
+            int fds[2];
+            if (pipe(fds) != 0)
+            {
+                std::cerr << "can't create a pipe for a split frame worker\n";
+                ok = false;
+                break;
+            }
+
+            pid_t pid = fork();
+            if (pid == 0)
+            {
+                close(fds[0]);
+                for (const Worker& worker : workers)
+                    close(worker.Pipe);
+                runWorker(GL, draw, post, columns[i].Origin, rows[j].Origin, fds[1]);
+            }
+
+            close(fds[1]);
+            if (pid < 0)
+            {
+                std::cerr << "can't start a split frame worker\n";
+                close(fds[0]);
+                ok = false;
+                break;
+            }
+
+            workers.push_back({ pid, fds[0], columns[i], rows[j] });
+        }
+    }
+
+    // Workers draw concurrently, the coordinator collects their regions in order and copies the part each keeps.
+    std::vector<unsigned char> pixels((size_t)regionWidth * regionHeight * bytespp);
+    for (const Worker& worker : workers)
+    {
+        RegionHeader header;
+        bool received = ok && readAll(worker.Pipe, &header, sizeof(header))
+            && header.X == worker.Columns.Origin && header.Y == worker.Rows.Origin && header.Width == regionWidth && header.Height == regionHeight
+            && header.Bytespp == bytespp && readAll(worker.Pipe, pixels.data(), pixels.size());
+        close(worker.Pipe);
+
+        int status = 0;
+        while (waitpid(worker.Pid, &status, 0) < 0 && errno == EINTR)
+            continue;
+
+        if (!received || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        {
+            if (ok)
+                std::cerr << "split frame worker for region " << worker.Columns.Origin << ", " << worker.Rows.Origin << " failed\n";
+            ok = false;
+            continue;
+        }
+
+        const Span& kept = worker.Columns;
+        int left = kept.Begin - kept.Origin;
+        for (int row = worker.Rows.Begin; row < worker.Rows.End; ++row)
+        {
+            std::memcpy(image.buffer() + ((size_t)row * image.get_width() + kept.Begin) * bytespp,
+                pixels.data() + ((size_t)(row - worker.Rows.Origin) * regionWidth + left) * bytespp,
+                (size_t)(kept.End - kept.Begin) * bytespp);
+        }
+    }
+
+    return ok;
+#endif
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include "GL.h"
+#include "tgaimage.h"
+#include <functional>
+
+// Renders a frame bigger than GL by splitting it into regions of GL's size, one worker process per region. Workers are
+// forked from the caller, so they share everything loaded so far, each sets its region, clears, calls draw and
+// resolves, calls post when given, then sends Output back through a pipe. The coordinator stitches the regions into
+// image, whose size is the frame's and whose format must match Output. A worker's memory grows with GL's size, not
+// with the frame's. Needs fork, always fails on Windows.
+// overlap is how far post reads around the pixels it writes. Regions then also draw that many pixels of their
+// neighbours on every side, which are dropped when stitching, and start on even pixels within the frame.
+bool RenderSplitFrame(GraphicsLibrary& GL, const std::function<void(GraphicsLibrary& GL)>& draw, TGAImage& image,
+    const std::function<void(GraphicsLibrary& GL)>& post = nullptr, int overlap = 0);
@@ -0,0 +1,426 @@
+#include "test.h"
+#include "GL.h"
+#include "kernels.h"
+#include "model.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <vector>
+
+namespace
+{
+    // Positions are already in screen space.
+    struct ScreenSpaceShader : public IShader
+    {
+        virtual Vec4f VertexStage(const Vertex& vec, int vertexId) override
+        {
+            return Vec4f(vec.Pos);
+        }
+
+        virtual bool FragmentStage(const Vec3f& bar, TGAColor& color) override
+        {
+            color = TGAColor(255, 255, 255, 255);
+            return true;
+        }
+    };
+
+    // Colored by barycentrics, discarding a corner of some triangles.
+    struct BarycentricShader : public ScreenSpaceShader
+    {
+        bool Discard = false;
+
+        virtual bool FragmentStage(const Vec3f& bar, TGAColor& color) override
+        {
+            color = TGAColor((unsigned char)(bar.x * 255.0f), (unsigned char)(bar.y * 255.0f), (unsigned char)(bar.z * 255.0f), 255);
+            return !Discard || bar.x < 0.9f;
+        }
+    };
+
+    // Float framebuffer color of its own, for every fragment.
+    struct HdrShader : public ScreenSpaceShader
+    {
+        Vec4f Color;
+
+        virtual bool FragmentStageHdr(const Vec3f& bar, Vec4f& color) override
+        {
+            color = Color;
+            return true;
+        }
+    };
+
+    // Positions are model ones.
+    struct ModelShader : public ScreenSpaceShader
+    {
+        virtual Vec4f VertexStage(const Vertex& vec, int vertexId) override
+        {
+            return GL->Viewport * GL->Projection * GL->ModelView * Vec4f(vec.Pos);
+        }
+    };
+
+    void drawTriangle(GraphicsLibrary& GL, const Vec3f& a, const Vec3f& b, const Vec3f& c, IShader& shader)
+    {
+        Model empty{ std::vector<Vec3f>(), std::vector<Vec2f>(), std::vector<Vec3f>(), std::vector<std::vector<VertexInfo> >() };
+        Vertex vertices[3];
+        vertices[0].Pos = a;
+        vertices[1].Pos = b;
+        vertices[2].Pos = c;
+        GL.Triangle(vertices, empty, shader, Vec3f(0.0f, 0.0f, 1.0f));
+    }
+
+    void drawTriangle(GraphicsLibrary& GL, const Vec3f& a, const Vec3f& b, const Vec3f& c)
+    {
+        ScreenSpaceShader shader;
+        drawTriangle(GL, a, b, c, shader);
+    }
+
+    // Triangles from a few pixels to larger than the screen, so that blocks are cleared, planes of one triangle,
+    // planes replaced by nearer ones and expanded.
+    void drawRandomTriangles(GraphicsLibrary& GL, unsigned seed)
+    {
+        std::mt19937 rng(seed);
+        std::uniform_real_distribution<float> position(-40.0f, 200.0f);
+        std::uniform_real_distribution<float> depth(0.0f, 255.0f);
+        BarycentricShader shader;
+        for (int i = 0; i < 200; ++i)
+        {
+            Vec3f a(position(rng), position(rng), depth(rng));
+            float size = i % 4 == 0 ? 150.0f : 12.0f;
+            std::uniform_real_distribution<float> offset(-size, size);
+            Vec3f b(a.x + offset(rng), a.y + offset(rng), i % 3 == 0 ? a.z : depth(rng));
+            Vec3f c(a.x + offset(rng), a.y + offset(rng), i % 3 == 0 ? a.z : depth(rng));
+            shader.Discard = i % 7 == 0;
+            GL.StencilReference = (uint8_t)(i % 5 == 0);
+            GL.StencilWriteMask = (uint8_t)(i % 5 == 0);
+            drawTriangle(GL, a, b, c, shader);
+        }
+    }
+}
+
+TEST(GLDrawsTriangleInside)
+{
+    GraphicsLibrary GL(128, 128);
+    GL.BackfaceCulling = false;
+    GL.Clear();
+    drawTriangle(GL, Vec3f(10.0f, 10.0f, 10.0f), Vec3f(100.0f, 10.0f, 10.0f), Vec3f(10.0f, 100.0f, 10.0f));
+
+    CHECK(GL.Output.get(20, 20).r == 255);
+    CHECK(GL.Output.get(90, 90).r == 0);
+    CHECK(GL.Output.get(5, 20).r == 0);
+    CHECK_NEAR(GL.Depth(20, 20), 10.0f, 1e-4);
+    CHECK(GL.Depth(90, 90) < -1e30f);
+}
+
+TEST(GLKeepsClosestTriangle)
+{
+    GraphicsLibrary GL(64, 64);
+    GL.BackfaceCulling = false;
+    GL.Clear();
+    drawTriangle(GL, Vec3f(0.0f, 0.0f, 20.0f), Vec3f(64.0f, 0.0f, 20.0f), Vec3f(0.0f, 64.0f, 20.0f));
+    drawTriangle(GL, Vec3f(0.0f, 0.0f, 5.0f), Vec3f(64.0f, 0.0f, 5.0f), Vec3f(0.0f, 64.0f, 5.0f));
+
+    CHECK_NEAR(GL.Depth(10, 10), 20.0f, 1e-4);
+}
+
+// Compressed depth blocks give the same images and depths as drawing every pixel into ZBuffer.
+TEST(GLDepthCompressionMatchesPixels)
+{
+    for (DepthFormat format : { DepthFormat::Float32, DepthFormat::Unorm16, DepthFormat::Unorm24Stencil8 })
+    {
+        GraphicsLibrary compressed(160, 144);
+        GraphicsLibrary pixels(160, 144);
+        pixels.DepthCompression = false;
+        for (GraphicsLibrary* GL : { &compressed, &pixels })
+        {
+            GL->BackfaceCulling = false;
+            GL->SetViewport(0, 0, 160, 144, 255.0f);
+            CHECK(GL->SetDepthFormat(format));
+            GL->Clear();
+        }
+
+        for (unsigned frame = 0; frame < 4; ++frame)
+        {
+            compressed.Clear();
+            pixels.Clear();
+            drawRandomTriangles(compressed, frame);
+            drawRandomTriangles(pixels, frame);
+
+            CHECK(std::memcmp(compressed.Output.buffer(), pixels.Output.buffer(), 160 * 144 * compressed.Output.get_bytespp()) == 0);
+            std::vector<float> compressedRow(160), pixelsRow(160);
+            compressed.DecompressDepth();
+            for (int y = 0; y < 144; ++y)
+            {
+                compressed.DepthRow(y, compressedRow.data());
+                pixels.DepthRow(y, pixelsRow.data());
+                CHECK(std::memcmp(compressedRow.data(), pixelsRow.data(), 160 * sizeof(float)) == 0);
+            }
+        }
+    }
+}
+
+// Triangles sharing edges, added into a float framebuffer: samples inside their union are written exactly once, none
+// twice on a shared edge or skipped between two. Edges run through samples, where the fill rule decides.
+TEST(GLSharedEdgesWriteEverySampleOnce)
+{
+    const int size = 128;
+    // Convex outlines, CCW, and the triangles filling them: a quad split along its diagonal, a fan around its center.
+    const std::vector<Vec2f> quad = { Vec2f(20.0f, 16.0f), Vec2f(100.0f, 16.0f), Vec2f(100.0f, 80.0f), Vec2f(20.0f, 80.0f) };
+    const std::vector<Vec2f> octagon = { Vec2f(104.0f, 64.0f), Vec2f(92.0f, 92.0f), Vec2f(64.0f, 104.0f), Vec2f(36.0f, 92.0f),
+        Vec2f(24.0f, 64.0f), Vec2f(36.0f, 36.0f), Vec2f(64.0f, 24.0f), Vec2f(92.0f, 36.0f) };
+    struct Mesh
+    {
+        std::vector<Vec2f> Outline;
+        std::vector<std::array<Vec2f, 3> > Triangles;
+    };
+    std::vector<Mesh> meshes(2);
+    meshes[0].Outline = quad;
+    meshes[0].Triangles = { { quad[0], quad[1], quad[2] }, { quad[0], quad[2], quad[3] } };
+    meshes[1].Outline = octagon;
+    for (size_t i = 0; i < octagon.size(); ++i)
+        meshes[1].Triangles.push_back({ Vec2f(64.0f, 64.0f), octagon[i], octagon[(i + 1) % octagon.size()] });
+
+    for (SimdLevel level : { SimdLevel::Scalar, SimdLevel::SSE2, SimdLevel::AVX2, SimdLevel::AVX512 })
+    {
+        for (const Mesh& mesh : meshes)
+        {
+            for (bool reversed : { false, true })
+            {
+                GraphicsLibrary GL(size, size, level);
+                GL.BackfaceCulling = false;
+                CHECK(GL.SetColorFormat(ColorFormat::Rgba32F));
+                GL.Blend = BlendMode::Add;
+                GL.Clear();
+
+                // Each triangle nearer than the previous ones, so that the depth test passes wherever it is drawn.
+                float depth = 1.0f;
+                for (const std::array<Vec2f, 3>& t : mesh.Triangles)
+                {
+                    Vec3f a(t[0].x, t[0].y, depth), b(t[1].x, t[1].y, depth), c(t[2].x, t[2].y, depth);
+                    if (reversed)
+                        drawTriangle(GL, a, c, b);
+                    else
+                        drawTriangle(GL, a, b, c);
+                    depth += 1.0f;
+                }
+                GL.Resolve();
+
+                // Written once, 1 tone mapped.
+                const int once = (int)(255.0f * (1.0f + 1.0f / (GL.WhitePoint * GL.WhitePoint)) / 2.0f + 0.5f);
+                int inside = 0;
+                for (int y = 0; y < size; ++y)
+                {
+                    for (int x = 0; x < size; ++x)
+                    {
+                        // Distance of the sample inside the outline, negative outside it.
+                        float distance = 1e30f;
+                        for (size_t i = 0; i < mesh.Outline.size(); ++i)
+                        {
+                            Vec2f p = mesh.Outline[i], q = mesh.Outline[(i + 1) % mesh.Outline.size()];
+                            float ex = q.x - p.x, ey = q.y - p.y;
+                            distance = std::min(distance, (ex * (y - p.y) - ey * (x - p.x)) / std::sqrt(ex * ex + ey * ey));
+                        }
+                        int value = GL.Output.get(x, y).r;
+                        if (distance > 0.01f)
+                        {
+                            ++inside;
+                            CHECK(value == once);
+                        }
+                        else if (distance < -0.01f)
+                            CHECK(value == 0);
+                        else
+                            CHECK(value == 0 || value == once);
+                    }
+                }
+                CHECK(inside > 1000);
+            }
+        }
+    }
+}
+
+// Multisampling: a pixel whose samples a vertical edge splits in half resolves halfway, pixels covered whole are shaded
+// at the pixel position and match single sampling.
+TEST(GLMultisampleResolvesCoverage)
+{
+    const int width = 96, height = 64;
+    const Vec3f a(10.3f, 5.7f, 10.0f), b(88.1f, 20.2f, 30.0f), c(30.6f, 60.9f, 20.0f);
+
+    GraphicsLibrary single(width, height);
+    single.BackfaceCulling = false;
+    single.Clear();
+    BarycentricShader shader;
+    drawTriangle(single, a, b, c, shader);
+
+    for (int samples : { 2, 4, 8 })
+    {
+        GraphicsLibrary GL(width, height);
+        GL.BackfaceCulling = false;
+        CHECK(GL.SetSampleCount(samples));
+
+        // Every pattern has as many samples on each side of the pixel position.
+        GL.Clear();
+        drawTriangle(GL, Vec3f(40.0f, 2.0f, 10.0f), Vec3f(40.0f, 62.0f, 10.0f), Vec3f(95.0f, 32.0f, 10.0f));
+        GL.Resolve();
+        for (int y = 20; y <= 44; ++y)
+        {
+            CHECK(GL.Output.get(39, y).r == 0);
+            CHECK(GL.Output.get(40, y).r == 128);
+            CHECK(GL.Output.get(41, y).r == 255);
+        }
+
+        GL.Clear();
+        drawTriangle(GL, a, b, c, shader);
+        GL.Resolve();
+        int whole = 0;
+        for (int y = 0; y < height; ++y)
+        {
+            for (int x = 0; x < width; ++x)
+            {
+                // Samples lie within half a pixel of the pixel position.
+                bool inside = true;
+                const Vec3f* corners[3] = { &a, &b, &c };
+                for (int i = 0; i < 3; ++i)
+                {
+                    const Vec3f& p = *corners[i];
+                    const Vec3f& q = *corners[(i + 1) % 3];
+                    float ex = q.x - p.x, ey = q.y - p.y;
+                    inside = inside && (ex * (y - p.y) - ey * (x - p.x)) / std::sqrt(ex * ex + ey * ey) > 0.75f;
+                }
+                if (!inside)
+                    continue;
+                ++whole;
+                TGAColor expected = single.Output.get(x, y), resolved = GL.Output.get(x, y);
+                CHECK(expected.r == resolved.r && expected.g == resolved.g && expected.b == resolved.b);
+            }
+        }
+        CHECK(whole > 1000);
+    }
+}
+
+// Clusters facing away from the eye are only skipped for closed meshes, the back of an open square is drawn.
+TEST(GLDrawsBackFacesOfOpenMeshes)
+{
+    std::vector<Vec3f> verts = { Vec3f(-1.0f, -1.0f, 0.0f), Vec3f(1.0f, -1.0f, 0.0f), Vec3f(1.0f, 1.0f, 0.0f), Vec3f(-1.0f, 1.0f, 0.0f) };
+    std::vector<Vec2f> uv(1);
+    std::vector<Vec3f> normals(1, Vec3f(0.0f, 0.0f, 1.0f));
+    std::vector<std::vector<VertexInfo> > faces = { { { 0, 0, 0 }, { 1, 0, 0 }, { 2, 0, 0 } }, { { 0, 0, 0 }, { 2, 0, 0 }, { 3, 0, 0 } } };
+    Model square(verts, uv, normals, faces);
+    CHECK(!square.closed());
+
+    GraphicsLibrary GL(64, 64);
+    CHECK(GL.BackfaceCulling);
+    GL.SetViewport(0, 0, 64, 64, 255.0f);
+    GL.SetProjection(3.0f);
+    GL.LookAt(Vec3f(0.0f, 0.0f, -3.0f), Vec3f(0.0f, 0.0f, 0.0f), Vec3f(0.0f, 1.0f, 0.0f));
+    GL.Clear();
+    ModelShader shader;
+    GL.DrawModel(square, shader);
+    CHECK(GL.Output.get(32, 32).r == 255);
+}
+
+// Overlapping triangles added or alpha blended into float framebuffers, then resolved, against blending and tone
+// mapping the colors of the triangles covering each pixel. Halves are rounded after every blend, like the buffer.
+TEST(GLHdrBlendsAndToneMaps)
+{
+    const int width = 96, height = 80;
+    const Vec3f corners[4][3] = {
+        { Vec3f(4.0f, 6.0f, 1.0f), Vec3f(80.0f, 10.0f, 1.0f), Vec3f(30.0f, 70.0f, 1.0f) },
+        { Vec3f(20.0f, 4.0f, 2.0f), Vec3f(92.0f, 40.0f, 2.0f), Vec3f(40.0f, 76.0f, 2.0f) },
+        { Vec3f(2.0f, 40.0f, 3.0f), Vec3f(70.0f, 30.0f, 3.0f), Vec3f(60.0f, 78.0f, 3.0f) },
+        { Vec3f(10.0f, 10.0f, 4.0f), Vec3f(90.0f, 70.0f, 4.0f), Vec3f(50.0f, 60.0f, 4.0f) } };
+    const Vec4f colors[4] = { Vec4f(2.5f, 0.5f, 0.1f, 0.6f), Vec4f(0.2f, 1.7f, 0.9f, 0.3f), Vec4f(0.05f, 0.4f, 3.2f, 0.8f),
+        Vec4f(1.0f, 1.0f, 1.0f, 0.5f) };
+
+    // Pixels each triangle covers, drawn alone.
+    std::vector<std::vector<bool> > covered(4, std::vector<bool>(width * height));
+    for (int t = 0; t < 4; ++t)
+    {
+        GraphicsLibrary GL(width, height);
+        GL.BackfaceCulling = false;
+        GL.Clear();
+        drawTriangle(GL, corners[t][0], corners[t][1], corners[t][2]);
+        for (int y = 0; y < height; ++y)
+        {
+            for (int x = 0; x < width; ++x)
+                covered[t][y * width + x] = GL.Output.get(x, y).r == 255;
+        }
+    }
+
+    for (ColorFormat format : { ColorFormat::Rgba16F, ColorFormat::Rgba32F })
+    {
+        for (BlendMode blend : { BlendMode::Add, BlendMode::Alpha })
+        {
+            for (SimdLevel level : { SimdLevel::Scalar, SimdLevel::SSE2, SimdLevel::AVX2, SimdLevel::AVX512 })
+            {
+                GraphicsLibrary GL(width, height, level);
+                GL.BackfaceCulling = false;
+                CHECK(GL.SetColorFormat(format));
+                GL.Blend = blend;
+                GL.Exposure = 1.5f;
+                GL.WhitePoint = 3.0f;
+                GL.Clear();
+                HdrShader shader;
+                for (int t = 0; t < 4; ++t)
+                {
+                    shader.Color = colors[t];
+                    drawTriangle(GL, corners[t][0], corners[t][1], corners[t][2], shader);
+                }
+                GL.Resolve();
+
+                int mismatches = 0;
+                for (int y = 0; y < height; ++y)
+                {
+                    for (int x = 0; x < width; ++x)
+                    {
+                        float pixel[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+                        for (int t = 0; t < 4; ++t)
+                        {
+                            if (!covered[t][y * width + x])
+                                continue;
+                            const float source[4] = { colors[t].x, colors[t].y, colors[t].z, colors[t].w };
+                            for (int c = 0; c < 4; ++c)
+                            {
+                                float alpha = source[3];
+                                pixel[c] = blend == BlendMode::Add ? pixel[c] + source[c]
+                                    : (c == 3 ? alpha : source[c] * alpha) + pixel[c] * (1.0f - alpha);
+                                if (format == ColorFormat::Rgba16F)
+                                    pixel[c] = HalfToFloat(FloatToHalf(pixel[c]));
+                            }
+                        }
+
+                        int expected[3];
+                        for (int c = 0; c < 3; ++c)
+                        {
+                            float v = pixel[c] * GL.Exposure;
+                            v = v * (1.0f + v / (GL.WhitePoint * GL.WhitePoint)) / (1.0f + v);
+                            expected[c] = (int)std::min(std::max(v * 255.0f + 0.5f, 0.0f), 255.0f);
+                        }
+                        TGAColor resolved = GL.Output.get(x, y);
+                        mismatches += resolved.r != expected[0] || resolved.g != expected[1] || resolved.b != expected[2];
+                    }
+                }
+                CHECK(mismatches == 0);
+            }
+        }
+    }
+}
+
+// Float framebuffers hold one sample per pixel: either order of setting them up is refused.
+TEST(GLHdrRefusesMultisampling)
+{
+    for (ColorFormat format : { ColorFormat::Rgba16F, ColorFormat::Rgba32F })
+    {
+        GraphicsLibrary multisampled(32, 32);
+        CHECK(multisampled.SetSampleCount(4));
+        CHECK(!multisampled.SetColorFormat(format));
+        CHECK(multisampled.GetColorFormat() == ColorFormat::Rgba8);
+        CHECK(multisampled.SetSampleCount(1));
+        CHECK(multisampled.SetColorFormat(format));
+
+        GraphicsLibrary hdr(32, 32);
+        CHECK(hdr.SetColorFormat(format));
+        CHECK(!hdr.SetSampleCount(2));
+        CHECK(hdr.SetColorFormat(ColorFormat::Rgba8));
+        CHECK(hdr.SetSampleCount(2));
+    }
+}
@@ -0,0 +1,409 @@
+#include "test.h"
+#include "kernels.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <vector>
+
+#ifdef KERNELS_X86
+#include <immintrin.h>
+#endif
+
+// Every level of the kernel tables the CPU runs against the scalar one, bit for bit.
+
+namespace
+{
+    // Levels above scalar that this CPU supports.
+    std::vector<const KernelTable*> simdTables()
+    {
+        std::vector<const KernelTable*> tables;
+        for (const KernelTable* table : { GetSSE2Kernels(), GetAVX2Kernels(), GetAVX512Kernels() })
+        {
+            if (table)
+                tables.push_back(table);
+        }
+        return tables;
+    }
+
+#ifdef KERNELS_X86
+#ifdef _MSC_VER
+#define F16C_FUNCTION
+#else
+#define F16C_FUNCTION __attribute__((target("f16c")))
+#endif
+    // Only called when the AVX2 table exists, it requires F16C.
+    F16C_FUNCTION uint16_t hardwareFloatToHalf(float value)
+    {
+        return (uint16_t)_cvtss_sh(value, _MM_FROUND_TO_NEAREST_INT);
+    }
+#endif
+
+    template <class T>
+    bool sameBits(const std::vector<T>& a, const std::vector<T>& b)
+    {
+        return a.size() == b.size() && std::memcmp(a.data(), b.data(), a.size() * sizeof(T)) == 0;
+    }
+
+    // Fragments written by one raster row kernel, the slots past the returned count included.
+    struct Fragments
+    {
+        std::vector<int> X;
+        std::vector<float> Alpha;
+        std::vector<float> Beta;
+        std::vector<float> Depth;
+        int Count = 0;
+
+        explicit Fragments(int width) : X(width, -1), Alpha(width), Beta(width), Depth(width) {}
+
+        RowFragments Out() { return { X.data(), Alpha.data(), Beta.data(), Depth.data() }; }
+
+        bool operator==(const Fragments& other) const
+        {
+            return Count == other.Count && X == other.X && sameBits(Alpha, other.Alpha) && sameBits(Beta, other.Beta) && sameBits(Depth, other.Depth);
+        }
+    };
+
+    // A row of width pixels starting anywhere in the first few, in front of and behind the buffer in places.
+    RasterRow randomRow(std::mt19937& rng, int width, bool unorm16)
+    {
+        std::uniform_real_distribution<float> value(-0.2f, 1.2f);
+        RasterRow row;
+        row.MinX = std::min((int)(rng() % 5), width - 1);
+        row.MaxX = width - 1;
+        row.AlphaY = value(rng);
+        row.AlphaDx = value(rng) / width;
+        row.BetaY = value(rng);
+        row.BetaDx = -value(rng) / width;
+        row.ZA = value(rng) * 300.0f;
+        row.ZB = value(rng) * 300.0f;
+        row.ZC = value(rng) * 300.0f;
+        row.DepthScale = (unorm16 ? 65534.0f : 16777214.0f) / 255.0f;
+        row.DepthMax = unorm16 ? 65535.0f : 16777215.0f;
+        row.StencilMask = (uint32_t)(rng() & 0xff) << 24;
+        row.StencilReference = ((uint32_t)(rng() & 0xff) << 24) & row.StencilMask;
+        return row;
+    }
+}
+
+TEST(RasterRowLevelsMatch)
+{
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> depth(-60.0f, 360.0f);
+    for (int i = 0; i < 2000; ++i)
+    {
+        int width = 1 + rng() % 70;
+        RasterRow row = randomRow(rng, width, false);
+        std::vector<float> depthRow(width);
+        for (float& d : depthRow)
+            d = rng() % 8 == 0 ? std::numeric_limits<float>::lowest() : depth(rng);
+
+        Fragments scalar(width);
+        RowFragments out = scalar.Out();
+        scalar.Count = GetScalarKernels()->RasterRow(row, depthRow.data(), out);
+        for (const KernelTable* table : simdTables())
+        {
+            Fragments level(width);
+            out = level.Out();
+            level.Count = table->RasterRow(row, depthRow.data(), out);
+            CHECK(level == scalar);
+        }
+    }
+}
+
+TEST(RasterRowUnorm16LevelsMatch)
+{
+    std::mt19937 rng(2);
+    for (int i = 0; i < 2000; ++i)
+    {
+        int width = 1 + rng() % 70;
+        RasterRow row = randomRow(rng, width, true);
+        std::vector<uint16_t> depthRow(width);
+        for (uint16_t& d : depthRow)
+            d = (uint16_t)(rng() & 0xffff);
+
+        Fragments scalar(width);
+        RowFragments out = scalar.Out();
+        scalar.Count = GetScalarKernels()->RasterRowUnorm16(row, depthRow.data(), out);
+        for (const KernelTable* table : simdTables())
+        {
+            Fragments level(width);
+            out = level.Out();
+            level.Count = table->RasterRowUnorm16(row, depthRow.data(), out);
+            CHECK(level == scalar);
+        }
+    }
+}
+
+TEST(RasterRowUnorm24Stencil8LevelsMatch)
+{
+    std::mt19937 rng(3);
+    for (int i = 0; i < 2000; ++i)
+    {
+        int width = 1 + rng() % 70;
+        RasterRow row = randomRow(rng, width, false);
+        std::vector<uint32_t> depthRow(width);
+        for (uint32_t& d : depthRow)
+            d = (rng() & 0x3000000) | (rng() & 0xffffff);
+
+        Fragments scalar(width);
+        RowFragments out = scalar.Out();
+        scalar.Count = GetScalarKernels()->RasterRowUnorm24Stencil8(row, depthRow.data(), out);
+        for (const KernelTable* table : simdTables())
+        {
+            Fragments level(width);
+            out = level.Out();
+            level.Count = table->RasterRowUnorm24Stencil8(row, depthRow.data(), out);
+            CHECK(level == scalar);
+        }
+    }
+}
+
+TEST(OcclusionRowLevelsMatch)
+{
+    std::mt19937 rng(4);
+    std::uniform_real_distribution<float> depth(0.0f, 255.0f);
+    std::uniform_int_distribution<int> offset(-8, 8);
+    const int pad = 9, width = 64, height = 4;
+    const ptrdiff_t stride = width + 2 * pad;
+
+    for (int i = 0; i < 500; ++i)
+    {
+        // Smooth depths with steps and cleared pixels, the padding cleared as around a frame.
+        std::vector<float> depths(stride * (height + 2 * pad), std::numeric_limits<float>::lowest());
+        float base = depth(rng);
+        for (int y = 0; y < height + 2; ++y)
+        {
+            for (int x = 0; x < width + 2; ++x)
+            {
+                float d = rng() % 16 == 0 ? depth(rng) : base + 0.3f * x - 0.2f * y;
+                depths[(pad - 1 + y) * stride + pad - 1 + x] = rng() % 32 == 0 ? std::numeric_limits<float>::lowest() : d;
+            }
+        }
+
+        int sampleCount = 1 + rng() % 16;
+        std::vector<ptrdiff_t> samples(sampleCount);
+        std::vector<float> sampleX(sampleCount), sampleY(sampleCount);
+        for (int s = 0; s < sampleCount; ++s)
+        {
+            int dx = offset(rng), dy = offset(rng);
+            samples[s] = dy * stride + dx;
+            sampleX[s] = (float)dx;
+            sampleY[s] = (float)dy;
+        }
+
+        OcclusionRow row;
+        row.Depth = depths.data() + (pad + rng() % height) * stride + pad;
+        row.Stride = stride;
+        row.Samples = samples.data();
+        row.SampleX = sampleX.data();
+        row.SampleY = sampleY.data();
+        row.SampleCount = sampleCount;
+        row.Width = 1 + rng() % width;
+        row.Bias = 0.05f * (rng() % 8);
+        row.InverseRange = 1.0f / (0.5f + rng() % 20);
+        row.Scale = 1.0f / sampleCount;
+
+        std::vector<float> scalar(width);
+        row.Out = scalar.data();
+        GetScalarKernels()->OcclusionRow(row);
+        for (const KernelTable* table : simdTables())
+        {
+            std::vector<float> level(width);
+            row.Out = level.data();
+            table->OcclusionRow(row);
+            CHECK(sameBits(level, scalar));
+        }
+    }
+}
+
+TEST(UpsampleRowLevelsMatch)
+{
+    std::mt19937 rng(5);
+    std::uniform_real_distribution<float> depth(0.0f, 255.0f);
+    std::uniform_real_distribution<float> occlusion(0.0f, 1.0f);
+    const int width = 70;
+    const int coarseWidth = (width + 1) / 2 + 2;
+
+    for (int i = 0; i < 1000; ++i)
+    {
+        auto randomDepth = [&]() { return rng() % 16 == 0 ? std::numeric_limits<float>::lowest() : depth(rng); };
+        std::vector<float> depths(width), coarse[4];
+        for (float& d : depths)
+            d = randomDepth();
+        for (int r = 0; r < 4; ++r)
+        {
+            coarse[r].resize(coarseWidth);
+            for (float& v : coarse[r])
+                v = r % 2 == 0 ? randomDepth() : occlusion(rng);
+        }
+
+        UpsampleRow row;
+        row.Depth = depths.data();
+        row.CoarseDepth0 = coarse[0].data() + 1;
+        row.CoarseOcclusion0 = coarse[1].data() + 1;
+        row.CoarseDepth1 = coarse[2].data() + 1;
+        row.CoarseOcclusion1 = coarse[3].data() + 1;
+        row.Width = 1 + rng() % width;
+        row.Weight0 = rng() % 2 ? 0.75f : 0.25f;
+        row.Weight1 = 1.0f - row.Weight0;
+        row.Sharpness = rng() % 4 == 0 ? 1e9f : 0.1f * (rng() % 50);
+
+        std::vector<float> scalar(width);
+        row.Out = scalar.data();
+        GetScalarKernels()->UpsampleRow(row);
+        for (const KernelTable* table : simdTables())
+        {
+            std::vector<float> level(width);
+            row.Out = level.data();
+            table->UpsampleRow(row);
+            CHECK(sameBits(level, scalar));
+        }
+    }
+}
+
+TEST(DepthToGrayRowLevelsMatch)
+{
+    std::mt19937 rng(6);
+    std::uniform_real_distribution<float> depth(-10.0f, 300.0f);
+    for (int i = 0; i < 1000; ++i)
+    {
+        size_t count = rng() % 80;
+        std::vector<float> depths(count);
+        for (float& d : depths)
+            d = rng() % 8 == 0 ? std::numeric_limits<float>::lowest() : depth(rng);
+        float offset = depth(rng) * 0.5f;
+        float scale = rng() % 8 == 0 ? 0.0f : 255.0f / (1.0f + rng() % 300);
+
+        // As documented.
+        std::vector<uint32_t> expected(count);
+        for (size_t x = 0; x < count; ++x)
+        {
+            int g = (int)std::min(std::max((depths[x] - offset) * scale + 0.5f, 0.0f), 255.0f);
+            expected[x] = 0xff000000u | (uint32_t)g * 0x010101u;
+        }
+
+        for (const KernelTable* table : { GetScalarKernels(), GetSSE2Kernels(), GetAVX2Kernels(), GetAVX512Kernels() })
+        {
+            if (!table)
+                continue;
+            std::vector<uint32_t> out(count);
+            table->DepthToGrayRow(depths.data(), offset, scale, out.data(), count);
+            CHECK(out == expected);
+        }
+    }
+}
+
+TEST(DownsampleRowLevelsMatch)
+{
+    std::mt19937 rng(7);
+    for (int i = 0; i < 1000; ++i)
+    {
+        size_t count = rng() % 80;
+        std::vector<uint32_t> row0(2 * count), row1(2 * count);
+        for (size_t x = 0; x < 2 * count; ++x)
+        {
+            row0[x] = rng();
+            row1[x] = rng() % 4 == 0 ? row0[x] ^ 0x01010101u : rng();
+        }
+
+        // Each byte averaged, rounding to nearest, ties up.
+        std::vector<uint32_t> expected(count);
+        for (size_t x = 0; x < count; ++x)
+        {
+            for (int shift = 0; shift < 32; shift += 8)
+            {
+                uint32_t sum = ((row0[2 * x] >> shift) & 0xff) + ((row0[2 * x + 1] >> shift) & 0xff)
+                    + ((row1[2 * x] >> shift) & 0xff) + ((row1[2 * x + 1] >> shift) & 0xff);
+                expected[x] |= ((sum + 2) >> 2) << shift;
+            }
+        }
+
+        for (const KernelTable* table : { GetScalarKernels(), GetSSE2Kernels(), GetAVX2Kernels(), GetAVX512Kernels() })
+        {
+            if (!table)
+                continue;
+            std::vector<uint32_t> out(count);
+            table->DownsampleRow(row0.data(), row1.data(), out.data(), count);
+            CHECK(out == expected);
+        }
+    }
+}
+
+// The AVX2 and AVX-512 rows convert with F16C, every half gives the same float as HalfToFloat.
+TEST(HalfToFloatRowLevelsMatch)
+{
+    std::vector<uint16_t> halves(65536);
+    for (size_t i = 0; i < halves.size(); ++i)
+        halves[i] = (uint16_t)i;
+    std::vector<float> expected(halves.size());
+    for (size_t i = 0; i < halves.size(); ++i)
+        expected[i] = HalfToFloat(halves[i]);
+
+    for (const KernelTable* table : { GetScalarKernels(), GetSSE2Kernels(), GetAVX2Kernels(), GetAVX512Kernels() })
+    {
+        if (!table)
+            continue;
+        std::vector<float> out(halves.size());
+        table->HalfToFloatRow(halves.data(), out.data(), halves.size());
+        CHECK(sameBits(out, expected));
+
+        // Every count, nothing written past it.
+        for (size_t count = 0; count < 70; ++count)
+        {
+            std::vector<float> row(count + 1, 7.0f);
+            table->HalfToFloatRow(halves.data() + 31000, row.data(), count);
+            CHECK(std::memcmp(row.data(), expected.data() + 31000, count * sizeof(float)) == 0 && row[count] == 7.0f);
+        }
+    }
+}
+
+// Rounding to nearest even like F16C, including on every tie between two halves.
+TEST(FloatToHalfMatchesF16C)
+{
+#ifdef KERNELS_X86
+    if (!GetAVX2Kernels())
+        return;
+
+    for (uint64_t bits = 0; bits < 0x100000000ull; bits += 4093)
+    {
+        float value;
+        uint32_t word = (uint32_t)bits;
+        std::memcpy(&value, &word, sizeof(value));
+        CHECK(FloatToHalf(value) == hardwareFloatToHalf(value));
+    }
+    for (uint32_t half = 0; half < 0x7c00; ++half)
+    {
+        float tie = (HalfToFloat((uint16_t)half) + HalfToFloat((uint16_t)(half + 1))) * 0.5f;
+        CHECK(FloatToHalf(tie) == hardwareFloatToHalf(tie));
+        CHECK(FloatToHalf(-tie) == hardwareFloatToHalf(-tie));
+    }
+#endif
+}
+
+TEST(ToneMapRowLevelsMatch)
+{
+    std::mt19937 rng(9);
+    for (size_t count : { 0, 1, 2, 3, 4, 5, 7, 8, 9, 15, 16, 17, 31, 33, 400, 401 })
+    {
+        // Negative, NaN, infinite and huge colors as well as ordinary ones.
+        std::vector<float> pixels(count * 4);
+        for (float& v : pixels)
+        {
+            int kind = rng() % 12;
+            v = kind == 0 ? -1.0f : kind == 1 ? std::numeric_limits<float>::quiet_NaN() : kind == 2 ? 1e30f
+                : kind == 3 ? std::numeric_limits<float>::infinity() : (rng() % 100000) / 10000.0f;
+        }
+
+        std::vector<uint32_t> scalar(count + 1, 7);
+        GetScalarKernels()->ToneMapRow(pixels.data(), 1.7f, 1.0f / 16.0f, scalar.data(), count);
+        CHECK(scalar[count] == 7);
+        for (const KernelTable* table : simdTables())
+        {
+            std::vector<uint32_t> level(count + 1, 7);
+            table->ToneMapRow(pixels.data(), 1.7f, 1.0f / 16.0f, level.data(), count);
+            CHECK(level == scalar);
+        }
+    }
+}
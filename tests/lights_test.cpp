@@ -0,0 +1,141 @@
+#include "test.h"
+#include "GL.h"
+#include "lights.h"
+#include "matrix.h"
+#include "model.h"
+#include <cmath>
+#include <limits>
+#include <random>
+#include <vector>
+
+// TiledLights against going through every light for every pixel drawn.
+
+namespace
+{
+    struct DepthShader : public IShader
+    {
+        virtual Vec4f VertexStage(const Vertex& vec, int vertexId) override
+        {
+            return GL->Viewport * GL->Projection * GL->ModelView * Vec4f(vec.Pos);
+        }
+
+        virtual bool FragmentStage(const Vec3f& bar, TGAColor& color) override
+        {
+            return true;
+        }
+    };
+
+    // Rolling surface over [-1, 1] x [-1, 1], so that tiles hold different depth ranges.
+    Model makeTerrain(int cells)
+    {
+        std::vector<Vec3f> verts;
+        std::vector<Vec2f> uv;
+        std::vector<Vec3f> normals(1, Vec3f(0.0f, 0.0f, 1.0f));
+        std::vector<std::vector<VertexInfo> > faces;
+        for (int y = 0; y <= cells; ++y)
+        {
+            for (int x = 0; x <= cells; ++x)
+            {
+                float px = -1.0f + 2.0f * x / cells;
+                float py = -1.0f + 2.0f * y / cells;
+                verts.push_back(Vec3f(px, py, 0.3f * std::sin(3.0f * px) * std::cos(2.0f * py)));
+                uv.push_back(Vec2f((float)x / cells, (float)y / cells));
+            }
+        }
+        for (int y = 0; y < cells; ++y)
+        {
+            for (int x = 0; x < cells; ++x)
+            {
+                int a = y * (cells + 1) + x;
+                int b = a + cells + 1;
+                faces.push_back({ { a, a, 0 }, { a + 1, a + 1, 0 }, { b, b, 0 } });
+                faces.push_back({ { a + 1, a + 1, 0 }, { b + 1, b + 1, 0 }, { b, b, 0 } });
+            }
+        }
+        return Model(verts, uv, normals, faces);
+    }
+
+    // The same sum as TiledLights::Shade, over every light.
+    Vec3f shadeAll(const std::vector<PointLight>& lights, const Vec3f& position, const Vec3f& normal)
+    {
+        Vec3f received;
+        for (const PointLight& light : lights)
+        {
+            Vec3f toLight = light.Position - position;
+            float distance2 = toLight * toLight;
+            float radius2 = light.Radius * light.Radius;
+            float facing = normal * toLight;
+            if (distance2 >= radius2 || facing <= 0.0f)
+                continue;
+            float falloff = 1.0f - distance2 / radius2;
+            received = received + light.Color * (facing / std::sqrt(distance2) * falloff * falloff);
+        }
+        return received;
+    }
+}
+
+// Every light reaching the surface drawn in a pixel is listed in its tile, and shading with the tile's lights is
+// shading with all of them.
+TEST(TiledLightsListEveryLightReachingPixels)
+{
+    const int width = 192, height = 160;
+    GraphicsLibrary GL(width, height);
+    GL.DepthOnly = true;
+    GL.BackfaceCulling = false;
+    GL.SetViewport(0, 0, width, height, 255.0f);
+    GL.SetProjection(3.0f);
+    GL.LookAt(Vec3f(0.4f, 0.8f, 3.0f), Vec3f(0.0f, 0.0f, 0.0f), Vec3f(0.0f, 1.0f, 0.0f));
+
+    Model terrain = makeTerrain(32);
+    DepthShader shader;
+    GL.Clear();
+    GL.DrawModel(terrain, shader);
+
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> position(-1.3f, 1.3f);
+    std::uniform_real_distribution<float> radius(0.05f, 0.5f);
+    std::vector<PointLight> lights;
+    for (int i = 0; i < 300; ++i)
+        lights.push_back({ Vec3f(position(rng), position(rng), position(rng) * 0.5f), radius(rng), Vec3f(1.0f, 0.5f, 0.25f) });
+    // Around the eye, reaching behind it.
+    lights.push_back({ Vec3f(0.4f, 0.8f, 3.2f), 3.0f, Vec3f(0.1f, 0.1f, 0.1f) });
+
+    TiledLights tiles;
+    tiles.Build(GL, lights);
+    CHECK(tiles.ListedCount() > 0 && tiles.ListedCount() < lights.size() * (size_t)tiles.TileCount());
+
+    // Pixels back to world space, within a pixel or two of the surface drawn, lights reaching them with that margin.
+    Mat4 toWorld = (GL.Viewport * GL.Projection * GL.View).Inverse();
+    const Vec3f normal(0.0f, 0.0f, 1.0f);
+    int drawn = 0;
+    for (int y = 0; y < height; ++y)
+    {
+        for (int x = 0; x < width; ++x)
+        {
+            float depth = GL.Depth(x, y);
+            if (depth == std::numeric_limits<float>::lowest())
+                continue;
+            ++drawn;
+
+            Vec4f world = toWorld * Vec4f((float)x, (float)y, depth, 1.0f);
+            Vec3f surface(world.x / world.w, world.y / world.w, world.z / world.w);
+
+            TiledLights::TileList tile = tiles.Tile(x, y);
+            std::vector<bool> listed(lights.size(), false);
+            for (int i = 0; i < tile.Count; ++i)
+                listed[tile.Indices[i]] = true;
+            for (size_t i = 0; i < lights.size(); ++i)
+            {
+                Vec3f toLight = lights[i].Position - surface;
+                if (std::sqrt(toLight * toLight) < lights[i].Radius - 0.03f)
+                    CHECK(listed[i]);
+            }
+
+            Vec3f expected = shadeAll(lights, surface, normal);
+            Vec3f shaded = tiles.Shade(x, y, surface, normal);
+            for (int c = 0; c < 3; ++c)
+                CHECK_NEAR(shaded.raw[c], expected.raw[c], 1e-3);
+        }
+    }
+    CHECK(drawn > width * height / 4);
+}
@@ -0,0 +1,54 @@
+#include "test.h"
+#include <cstring>
+#include <iostream>
+
+namespace
+{
+    TestCase* firstCase = nullptr;
+    TestCase** lastCase = &firstCase;
+}
+
+int TestFailures = 0;
+
+// In the order of registration, which is the order of the definitions within a file.
+TestCase::TestCase(const char* name, void (*run)()) : Name(name), Run(run), Next(nullptr)
+{
+    *lastCase = this;
+    lastCase = &Next;
+}
+
+void ReportFailure(const char* file, int line, const char* expression)
+{
+    // A failing CHECK in a loop reports its first few iterations only.
+    if (++TestFailures <= 5)
+        std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", file, line, expression);
+}
+
+int main(int argc, char** argv)
+{
+    const char* filter = argc > 1 ? argv[1] : "";
+
+    // Model and TGAImage log every load, keep that out of the report.
+    std::streambuf* log = std::cerr.rdbuf();
+
+    int run = 0;
+    int failed = 0;
+    for (TestCase* test = firstCase; test; test = test->Next)
+    {
+        if (!std::strstr(test->Name, filter))
+            continue;
+
+        TestFailures = 0;
+        std::cerr.rdbuf(nullptr);
+        test->Run();
+        std::cerr.rdbuf(log);
+        std::cerr.clear();
+
+        ++run;
+        failed += TestFailures > 0;
+        std::fprintf(stderr, "%-48s %s\n", test->Name, TestFailures > 0 ? "FAILED" : "ok");
+    }
+
+    std::fprintf(stderr, "%d tests, %d failed\n", run, failed);
+    return failed > 0 || run == 0 ? 1 : 0;
+}
@@ -0,0 +1,276 @@
+#include "test.h"
+#include "geometry.h"
+#include "kernels.h"
+#include "matrix.h"
+#include <algorithm>
+#include <limits>
+#include <random>
+#include <vector>
+
+// The closed form and SSE versions of Mat4 against the cofactor expansion and Get/Set products they replaced.
+
+namespace
+{
+    float referenceDeterminant3(const float m[9])
+    {
+        return m[0] * m[4] * m[8] + m[1] * m[5] * m[6] + m[2] * m[3] * m[7]
+            - m[2] * m[4] * m[6] - m[1] * m[3] * m[8] - m[0] * m[5] * m[7];
+    }
+
+    // Determinant of mat without column `column` and row `line`.
+    float referenceMinor(int column, int line, const Mat4& mat)
+    {
+        float minor[9];
+        int i = 0;
+        for (int y = 0; y < 4; ++y)
+        {
+            if (y == line)
+                continue;
+            for (int x = 0; x < 4; ++x)
+            {
+                if (x != column)
+                    minor[i++] = mat.Get(x, y);
+            }
+        }
+        return referenceDeterminant3(minor);
+    }
+
+    float referenceDeterminant(const Mat4& mat)
+    {
+        float determinant = 0.0f;
+        float sign = 1.0f;
+        for (int i = 0; i < 4; ++i)
+        {
+            determinant += sign * mat.Get(0, i) * referenceMinor(0, i, mat);
+            sign = -sign;
+        }
+        return determinant;
+    }
+
+    Mat4 referenceInverse(const Mat4& mat)
+    {
+        float determinant = referenceDeterminant(mat);
+
+        // Transposed cofactors.
+        Mat4 inverse;
+        for (int y = 0; y < 4; ++y)
+        {
+            for (int x = 0; x < 4; ++x)
+                inverse.Set(y, x, ((x + y) % 2 == 0 ? 1.0f : -1.0f) * referenceMinor(x, y, mat) / determinant);
+        }
+        return inverse;
+    }
+
+    Vec4f referenceProduct(const Mat4& mat, const Vec4f& vec)
+    {
+        Vec4f result;
+        for (int y = 0; y < 4; ++y)
+        {
+            for (int x = 0; x < 4; ++x)
+                result.raw[y] += mat.Get(x, y) * vec.raw[x];
+        }
+        return result;
+    }
+
+    Mat4 referenceProduct(const Mat4& a, const Mat4& b)
+    {
+        Mat4 result;
+        for (int x = 0; x < 4; ++x)
+        {
+            for (int y = 0; y < 4; ++y)
+            {
+                float value = 0.0f;
+                for (int i = 0; i < 4; ++i)
+                    value += a.Get(i, y) * b.Get(x, i);
+                result.Set(x, y, value);
+            }
+        }
+        return result;
+    }
+
+    Mat4 randomMatrix(std::mt19937& rng, bool affine)
+    {
+        std::uniform_real_distribution<float> value(-2.0f, 2.0f);
+        Mat4 m;
+        for (float& v : m.data)
+            v = value(rng);
+        if (affine)
+        {
+            m.data[12] = m.data[13] = m.data[14] = 0.0f;
+            m.data[15] = 1.0f;
+        }
+        return m;
+    }
+
+    // A row replaced by a combination of two others, off by epsilon.
+    Mat4 nearlySingular(std::mt19937& rng, float epsilon, bool affine)
+    {
+        std::uniform_real_distribution<float> value(-1.0f, 1.0f);
+        Mat4 m = randomMatrix(rng, affine);
+        float a = value(rng);
+        float b = value(rng);
+        for (int x = 0; x < 3; ++x)
+            m.data[8 + x] = a * m.data[x] + b * m.data[4 + x] + epsilon * value(rng);
+        m.data[11] = a * m.data[3] + b * m.data[7] + epsilon * value(rng);
+        return m;
+    }
+
+    float largest(const Mat4& m)
+    {
+        float result = 0.0f;
+        for (float v : m.data)
+            result = std::max(result, std::fabs(v));
+        return result;
+    }
+
+    // Both inverses lose digits with the conditioning of the matrix, the product of its size and its inverse's.
+    float inverseTolerance(const Mat4& m, const Mat4& inverse)
+    {
+        return 16.0f * std::numeric_limits<float>::epsilon() * std::max(largest(m) * largest(inverse), 1.0f);
+    }
+
+    // Entries within tolerance of the reference, relative to its largest one.
+    bool near(const Mat4& actual, const Mat4& reference, float tolerance)
+    {
+        float scale = std::max(largest(reference), 1.0f);
+        for (int i = 0; i < 16; ++i)
+        {
+            if (!(std::fabs(actual.data[i] - reference.data[i]) <= tolerance * scale))
+                return false;
+        }
+        return true;
+    }
+
+    bool near(const Vec4f& actual, const Vec4f& reference, float tolerance)
+    {
+        float scale = 1.0f;
+        for (int i = 0; i < 4; ++i)
+            scale = std::max(scale, std::fabs(reference.raw[i]));
+        for (int i = 0; i < 4; ++i)
+        {
+            if (!(std::fabs(actual.raw[i] - reference.raw[i]) <= tolerance * scale))
+                return false;
+        }
+        return true;
+    }
+}
+
+TEST(MatrixProductsMatchReference)
+{
+    std::mt19937 rng(1);
+    for (int i = 0; i < 1000; ++i)
+    {
+        Mat4 a = randomMatrix(rng, i % 2 == 1);
+        Mat4 b = randomMatrix(rng, i % 3 == 1);
+        CHECK(near(a * b, referenceProduct(a, b), 1e-5f));
+
+        Vec4f v(a.data[3], b.data[7], a.data[11], i % 2 ? 1.0f : b.data[0]);
+        CHECK(near(a * v, referenceProduct(a, v), 1e-5f));
+    }
+}
+
+TEST(MatrixTransformMatchesReference)
+{
+    std::mt19937 rng(2);
+    std::uniform_real_distribution<float> value(-10.0f, 10.0f);
+    for (int count : { 0, 1, 3, 4, 7, 64 })
+    {
+        Mat4 m = randomMatrix(rng, count % 2 == 1);
+        std::vector<Vec4f> in(count);
+        for (Vec4f& v : in)
+            v = Vec4f(value(rng), value(rng), value(rng), value(rng));
+
+        std::vector<Vec4f> out(count);
+        m.Transform(in.data(), out.data(), count);
+        for (int i = 0; i < count; ++i)
+            CHECK(near(out[i], referenceProduct(m, in[i]), 1e-5f));
+
+        // In place.
+        std::vector<Vec4f> inPlace = in;
+        m.Transform(inPlace.data(), inPlace.data(), count);
+        for (int i = 0; i < count; ++i)
+            CHECK(near(inPlace[i], referenceProduct(m, in[i]), 1e-5f));
+    }
+}
+
+TEST(MatrixTransformPointsMatchesReference)
+{
+    std::mt19937 rng(3);
+    std::uniform_real_distribution<float> value(-10.0f, 10.0f);
+    const KernelTable* tables[] = { GetScalarKernels(), GetSSE2Kernels(), GetAVX2Kernels(), GetAVX512Kernels() };
+    for (int count : { 0, 1, 3, 4, 5, 8, 15, 16, 17, 100 })
+    {
+        Mat4 m = randomMatrix(rng, false);
+        std::vector<Vec3f> in(count);
+        for (Vec3f& p : in)
+            p = Vec3f(value(rng), value(rng), value(rng));
+
+        std::vector<Vec4f> out(count);
+        m.TransformPoints(in.data(), out.data(), count);
+        for (int i = 0; i < count; ++i)
+            CHECK(near(out[i], referenceProduct(m, Vec4f(in[i])), 1e-5f));
+
+        // Every level the CPU runs gives the same bits.
+        std::vector<Vec4f> scalar(count + 1);
+        if (count > 0)
+            tables[0]->TransformPoints(m.data, in[0].raw, scalar[0].raw, count);
+        for (const KernelTable* table : tables)
+        {
+            if (!table || count == 0)
+                continue;
+            std::vector<Vec4f> levelOut(count + 1);
+            table->TransformPoints(m.data, in[0].raw, levelOut[0].raw, count);
+            CHECK(std::equal(&levelOut[0].x, &levelOut[count].x, &scalar[0].x));
+            CHECK(levelOut[count].x == 0.0f && levelOut[count].w == 0.0f);
+        }
+    }
+}
+
+TEST(MatrixInverseMatchesReference)
+{
+    std::mt19937 rng(4);
+    Mat4 identity;
+    for (int i = 0; i < 1000; ++i)
+    {
+        Mat4 m = randomMatrix(rng, false);
+        Mat4 inverse = m.Inverse();
+        Mat4 reference = referenceInverse(m);
+
+        float tolerance = inverseTolerance(m, reference);
+        CHECK(near(inverse, reference, tolerance));
+        CHECK(near(m * inverse, identity, tolerance));
+        CHECK_NEAR(m.Determinant(), referenceDeterminant(m), 1e-5 * std::max(1.0f, std::fabs(referenceDeterminant(m))));
+    }
+}
+
+TEST(MatrixInverseNearlySingular)
+{
+    std::mt19937 rng(5);
+    for (float epsilon : { 1e-2f, 1e-3f, 1e-4f })
+    {
+        for (int i = 0; i < 300; ++i)
+        {
+            Mat4 m = nearlySingular(rng, epsilon, false);
+            Mat4 reference = referenceInverse(m);
+            CHECK(near(m.Inverse(), reference, inverseTolerance(m, reference)));
+        }
+    }
+}
+
+TEST(MatrixInverseAffineMatchesReference)
+{
+    std::mt19937 rng(6);
+    Mat4 identity;
+    for (int i = 0; i < 1000; ++i)
+    {
+        Mat4 m = i % 4 == 3 ? nearlySingular(rng, 1e-3f, true) : randomMatrix(rng, true);
+        Mat4 inverse = m.InverseAffine();
+        Mat4 reference = referenceInverse(m);
+
+        float tolerance = inverseTolerance(m, reference);
+        CHECK(near(inverse, reference, tolerance));
+        CHECK(near(inverse, m.Inverse(), tolerance));
+        CHECK(near(m * inverse, identity, tolerance));
+        CHECK(inverse.data[12] == 0.0f && inverse.data[13] == 0.0f && inverse.data[14] == 0.0f && inverse.data[15] == 1.0f);
+    }
+}
@@ -0,0 +1,235 @@
+#include "test.h"
+#include "model.h"
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace
+{
+    // Grid of cells x cells quads in a directory of its own, removed with it.
+    struct ObjFixture
+    {
+        std::filesystem::path Directory;
+        std::string Name;
+
+        // Without attributes, faces index positions only.
+        explicit ObjFixture(int cells, bool attributes = true)
+        {
+            Directory = std::filesystem::temp_directory_path() / "software-renderer-model-test";
+            std::filesystem::create_directories(Directory);
+            Name = (Directory / "grid").string();
+
+            std::ofstream out(Name + ".obj");
+            for (int y = 0; y <= cells; ++y)
+            {
+                for (int x = 0; x <= cells; ++x)
+                    out << "v " << (float)x / cells << " " << (float)y / cells << " 0\n";
+            }
+            if (attributes)
+            {
+                for (int y = 0; y <= cells; ++y)
+                {
+                    for (int x = 0; x <= cells; ++x)
+                        out << "vt  " << (float)x / cells << " " << (float)y / cells << " 0.0\n";
+                }
+                out << "vn  0 0 1\n";
+            }
+            auto corner = [&](int i) { return attributes ? std::to_string(i) + "/" + std::to_string(i) + "/1" : std::to_string(i); };
+            for (int y = 0; y < cells; ++y)
+            {
+                for (int x = 0; x < cells; ++x)
+                {
+                    int a = y * (cells + 1) + x + 1;
+                    int b = a + cells + 1;
+                    out << "f " << corner(a) << " " << corner(a + 1) << " " << corner(b) << "\n";
+                    out << "f " << corner(a + 1) << " " << corner(b + 1) << " " << corner(b) << "\n";
+                }
+            }
+        }
+
+        ~ObjFixture()
+        {
+            std::error_code error;
+            std::filesystem::remove_all(Directory, error);
+        }
+
+        std::vector<char> ReadCache() const
+        {
+            std::ifstream in(Name + ".mesh", std::ios::binary);
+            return std::vector<char>(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        }
+
+        // Written after the OBJ file, so that it is read instead of it.
+        void WriteCache(const std::vector<char>& bytes, size_t size) const
+        {
+            std::ofstream out(Name + ".mesh", std::ios::binary | std::ios::trunc);
+            out.write(bytes.data(), (std::streamsize)size);
+        }
+    };
+
+    bool inRange(const std::vector<int>& indices, size_t count)
+    {
+        for (int index : indices)
+        {
+            if (index < 0 || (size_t)index >= count)
+                return false;
+        }
+        return true;
+    }
+
+    // What drawing the model relies on, for a model of faceCount faces.
+    bool consistent(Model& model, int faceCount)
+    {
+        if (model.nfaces() != faceCount || model.indices().size() != (size_t)faceCount * 3)
+            return false;
+        if (!inRange(model.indices(), model.vertices().size()))
+            return false;
+        for (const LevelOfDetail& lod : model.lods())
+        {
+            if (lod.Indices.size() % 3 != 0 || !inRange(lod.Indices, model.vertices().size()))
+                return false;
+        }
+        for (const Cluster& cluster : model.clusters())
+        {
+            if (cluster.FirstFace < 0 || cluster.FaceCount < 0 || cluster.FirstFace + cluster.FaceCount > faceCount)
+                return false;
+        }
+        for (int i = 0; i < model.nfaces(); ++i)
+        {
+            const std::vector<VertexInfo>& face = model.face(i);
+            if (face.size() < 3)
+                return false;
+            for (const VertexInfo& corner : face)
+            {
+                if (corner.VertexId < 0 || corner.VertexId >= model.nverts() || corner.TexCoordId < -1 || corner.TexCoordId >= model.nuv())
+                    return false;
+            }
+        }
+        return true;
+    }
+}
+
+TEST(ModelCacheRoundTrip)
+{
+    ObjFixture fixture(24);
+    Model fromObj(fixture.Name.c_str());
+    Model fromCache(fixture.Name.c_str());
+
+    CHECK(fromObj.nfaces() == 24 * 24 * 2);
+    CHECK(fromCache.indices() == fromObj.indices());
+    CHECK(fromCache.lods().size() == fromObj.lods().size());
+    CHECK(consistent(fromCache, fromObj.nfaces()));
+}
+
+// Missing UVs and normals are kept missing in the cache, which is read back instead of the OBJ file: emptied, that
+// would have no faces.
+TEST(ModelCacheRoundTripWithoutAttributes)
+{
+    ObjFixture fixture(24, false);
+    Model fromObj(fixture.Name.c_str());
+    CHECK(fromObj.nfaces() == 24 * 24 * 2 && fromObj.nuv() == 0);
+    CHECK(!fromObj.vertices().empty() && fromObj.vertices()[0].UV.x == 0.0f && fromObj.vertices()[0].Normal.z == 0.0f);
+
+    std::filesystem::path obj = fixture.Name + ".obj";
+    auto objTime = std::filesystem::last_write_time(obj);
+    std::ofstream(obj, std::ios::trunc).close();
+    std::filesystem::last_write_time(obj, objTime);
+
+    Model fromCache(fixture.Name.c_str());
+    CHECK(fromCache.nfaces() == fromObj.nfaces());
+    CHECK(fromCache.indices() == fromObj.indices());
+    CHECK(consistent(fromCache, fromObj.nfaces()));
+    for (int i = 0; i < fromCache.nfaces(); ++i)
+    {
+        for (const VertexInfo& corner : fromCache.face(i))
+            CHECK(corner.TexCoordId == -1 && corner.NormalId == -1);
+    }
+}
+
+// Every truncation of the cache is refused, the model is loaded from the OBJ file instead.
+TEST(ModelCacheTruncated)
+{
+    ObjFixture fixture(24);
+    int faceCount = Model(fixture.Name.c_str()).nfaces();
+    std::vector<char> cache = fixture.ReadCache();
+    CHECK(!cache.empty());
+
+    for (size_t size = 0; size < cache.size(); size += 1 + size / 8)
+    {
+        fixture.WriteCache(cache, size);
+        Model model(fixture.Name.c_str());
+        CHECK(consistent(model, faceCount));
+    }
+}
+
+// Words overwritten with values out of any range: the model is the OBJ's, or a cache whose floats changed.
+TEST(ModelCacheCorrupt)
+{
+    ObjFixture fixture(24);
+    int faceCount = Model(fixture.Name.c_str()).nfaces();
+    std::vector<char> cache = fixture.ReadCache();
+
+    std::mt19937 rng(7);
+    const int32_t values[] = { -1, 2, 0x7fffffff, (int32_t)0x80000000, 1 << 20 };
+    for (int i = 0; i < 300; ++i)
+    {
+        std::vector<char> corrupt = cache;
+        size_t offset = 8 + rng() % (cache.size() - 12) / 4 * 4;
+        int32_t value = values[rng() % 5];
+        std::memcpy(corrupt.data() + offset, &value, sizeof(value));
+        fixture.WriteCache(corrupt, corrupt.size());
+
+        Model model(fixture.Name.c_str());
+        CHECK(consistent(model, faceCount));
+    }
+}
+
+// Only the quantized mesh is left, and it holds the same triangles.
+TEST(ModelQuantizeKeepsTriangles)
+{
+    ObjFixture fixture(24);
+    Model model(fixture.Name.c_str(), false);
+    std::vector<int> indices = model.indices();
+    model.quantize();
+
+    CHECK(model.quantized());
+    CHECK(model.nfaces() == 24 * 24 * 2);
+    CHECK(model.nverts() == 0 && model.nuv() == 0);
+    CHECK(model.vertices().empty() && model.indices().empty());
+
+    const IndexBuffer& buffer = model.quantizedMesh().Indices;
+    CHECK(buffer.Size() == indices.size() && buffer.Long.empty());
+    for (size_t i = 0; i < buffer.Short.size(); ++i)
+        CHECK(buffer.Short[i] == indices[i]);
+}
+
+// An octahedron is closed, also with a vertex split by a seam, and no longer once a face is missing or flipped. The
+// grid is open.
+TEST(ModelClosedWhenEveryEdgeIsShared)
+{
+    std::vector<Vec3f> verts = { Vec3f(1.0f, 0.0f, 0.0f), Vec3f(-1.0f, 0.0f, 0.0f), Vec3f(0.0f, 1.0f, 0.0f),
+        Vec3f(0.0f, -1.0f, 0.0f), Vec3f(0.0f, 0.0f, 1.0f), Vec3f(0.0f, 0.0f, -1.0f), Vec3f(1.0f, 0.0f, 0.0f) };
+    std::vector<Vec2f> uv = { Vec2f(0.0f, 0.0f), Vec2f(1.0f, 0.0f) };
+    std::vector<Vec3f> normals;
+    auto corner = [](int vertex, int texCoord) { return VertexInfo{ vertex, texCoord, -1 }; };
+    std::vector<std::vector<VertexInfo> > faces = {
+        { corner(0, 0), corner(2, 0), corner(4, 0) }, { corner(2, 0), corner(1, 0), corner(4, 0) },
+        { corner(1, 0), corner(3, 0), corner(4, 0) }, { corner(3, 0), corner(6, 1), corner(4, 0) },
+        { corner(2, 0), corner(6, 1), corner(5, 0) }, { corner(1, 0), corner(2, 0), corner(5, 0) },
+        { corner(3, 0), corner(1, 0), corner(5, 0) }, { corner(0, 0), corner(3, 0), corner(5, 0) } };
+    CHECK(Model(verts, uv, normals, faces).closed());
+
+    std::vector<std::vector<VertexInfo> > missing(faces.begin(), faces.end() - 1);
+    CHECK(!Model(verts, uv, normals, missing).closed());
+    std::vector<std::vector<VertexInfo> > flipped = faces;
+    std::swap(flipped[2][0], flipped[2][1]);
+    CHECK(!Model(verts, uv, normals, flipped).closed());
+
+    ObjFixture fixture(4);
+    CHECK(!Model(fixture.Name.c_str(), false).closed());
+}
@@ -0,0 +1,132 @@
+#include "test.h"
+#include "GL.h"
+#include "model.h"
+#include "occlusion.h"
+#include "scene.h"
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+    struct WhiteShader : public IShader
+    {
+        virtual Vec4f VertexStage(const Vertex& vec, int vertexId) override
+        {
+            return GL->Viewport * GL->Projection * GL->ModelView * Vec4f(vec.Pos);
+        }
+
+        virtual bool FragmentStage(const Vec3f& bar, TGAColor& color) override
+        {
+            color = TGAColor(255, 255, 255, 255);
+            return true;
+        }
+    };
+
+    // Flat square of cells x cells quads in the z = depth plane, spanning [-size, size] in x and y.
+    Model makeWall(int cells, float size, float depth)
+    {
+        std::vector<Vec3f> verts;
+        std::vector<Vec2f> uv;
+        std::vector<Vec3f> normals(1, Vec3f(0.0f, 0.0f, 1.0f));
+        std::vector<std::vector<VertexInfo> > faces;
+        for (int y = 0; y <= cells; ++y)
+        {
+            for (int x = 0; x <= cells; ++x)
+            {
+                verts.push_back(Vec3f(size * (-1.0f + 2.0f * x / cells), size * (-1.0f + 2.0f * y / cells), depth));
+                uv.push_back(Vec2f((float)x / cells, (float)y / cells));
+            }
+        }
+        for (int y = 0; y < cells; ++y)
+        {
+            for (int x = 0; x < cells; ++x)
+            {
+                int a = y * (cells + 1) + x;
+                int b = a + cells + 1;
+                faces.push_back({ { a, a, 0 }, { a + 1, a + 1, 0 }, { b, b, 0 } });
+                faces.push_back({ { a + 1, a + 1, 0 }, { b + 1, b + 1, 0 }, { b, b, 0 } });
+            }
+        }
+        return Model(verts, uv, normals, faces);
+    }
+
+    void setCamera(GraphicsLibrary& GL, int width, int height)
+    {
+        GL.SetViewport(0, 0, width, height, 255.0f);
+        GL.SetProjection(3.0f);
+        GL.LookAt(Vec3f(0.0f, 0.0f, 3.0f), Vec3f(0.0f, 0.0f, 0.0f), Vec3f(0.0f, 1.0f, 0.0f));
+    }
+}
+
+// The flat clusters of a wall facing the camera are as deep as what the wall put in the buffer, they must not hide
+// behind themselves. What is well behind the wall is still hidden.
+TEST(OcclusionBufferKeepsOccluderClusters)
+{
+    const int width = 256, height = 192;
+    GraphicsLibrary GL(width, height);
+    setCamera(GL, width, height);
+    Model wall = makeWall(24, 1.0f, 0.0f);
+
+    // Seen from around, the wall kept perpendicular to the view direction so that all its points are as deep on
+    // screen.
+    for (int i = 0; i < 100; ++i)
+    {
+        Vec3f eye(2.0f * std::sin(0.7f * i), std::cos(1.1f * i), 3.0f);
+        Vec3f center(0.1f * std::sin(1.3f * i), 0.1f * std::cos(0.3f * i), -0.5f + 0.01f * i);
+        GL.LookAt(eye, Vec3f(0.0f, 0.0f, 0.0f), Vec3f(0.0f, 1.0f, 0.0f));
+
+        Vec3f n = Vec3f(eye).normalize();
+        Vec3f u = (Vec3f(0.0f, 1.0f, 0.0f) ^ n).normalize();
+        Vec3f v = n ^ u;
+        Mat4 world;
+        for (int row = 0; row < 3; ++row)
+        {
+            world.Set(0, row, u.raw[row]);
+            world.Set(1, row, v.raw[row]);
+            world.Set(2, row, n.raw[row]);
+            world.Set(3, row, center.raw[row]);
+        }
+        Mat4 toScreen = GL.Viewport * GL.Projection * GL.View * world;
+
+        OcclusionBuffer occlusion(width, height);
+        occlusion.Clear();
+        occlusion.RenderOccluder(wall, toScreen);
+
+        for (const Cluster& cluster : wall.clusters())
+            CHECK(!occlusion.IsOccluded(cluster.Box, toScreen));
+        CHECK(!occlusion.IsOccluded(wall.bounds(), toScreen));
+
+        AABB behind;
+        behind.Extend(Vec3f(-0.2f, -0.2f, -0.5f));
+        behind.Extend(Vec3f(0.2f, 0.2f, -0.3f));
+        CHECK(occlusion.IsOccluded(behind, toScreen));
+    }
+}
+
+// A scene of a wall occluder drawn with and without occlusion culling.
+TEST(OcclusionCullingKeepsOccluders)
+{
+    const int width = 256, height = 192;
+    Model wall = makeWall(24, 0.8f, 0.2f);
+    Model hidden = makeWall(4, 0.3f, -0.5f);
+    WhiteShader shader;
+
+    std::vector<unsigned char> images[2];
+    for (bool culling : { false, true })
+    {
+        Scene scene;
+        int root = scene.AddNode(Mat4());
+        scene.AddInstance(wall, root, { &shader }, true);
+        scene.AddInstance(hidden, root, { &shader });
+
+        GraphicsLibrary GL(width, height);
+        setCamera(GL, width, height);
+        GL.OcclusionCulling = culling;
+        GL.Clear();
+        GL.DrawScene(scene);
+
+        images[culling].assign(GL.Output.buffer(), GL.Output.buffer() + width * height * GL.Output.get_bytespp());
+    }
+    CHECK(images[0] == images[1]);
+}
@@ -0,0 +1,157 @@
+#include "test.h"
+#include "GL.h"
+#include "model.h"
+#include "pipeline.h"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+// Frames drawn by FramePipeline, binned by one context and rasterized by another, against drawing them directly.
+
+namespace
+{
+    struct TintUniforms
+    {
+        Vec3f Tint;
+    };
+
+    struct PositionVaryings
+    {
+        Vec3f Pos[3];
+    };
+
+    // Colored by the interpolated model position, scaled by a tint that differs between models.
+    struct PositionShader : public DeferrableShader<TintUniforms, PositionVaryings>
+    {
+        Vec3f Tint;
+
+        explicit PositionShader(const Vec3f& tint) : Tint(tint)
+        {
+        }
+
+        virtual void BeginDraw() override
+        {
+            Uniforms.Tint = Tint;
+        }
+
+        virtual Vec4f VertexStage(const Vertex& vec, int vertexId) override
+        {
+            Varyings.Pos[vertexId] = vec.Pos;
+            return GL->Viewport * GL->Projection * GL->ModelView * Vec4f(vec.Pos);
+        }
+
+        virtual bool Shade(const TintUniforms& uniforms, const PositionVaryings& varyings, const Vec3f& bar, TGAColor& color) const override
+        {
+            Vec3f p = varyings.Pos[0] * bar.x + varyings.Pos[1] * bar.y + varyings.Pos[2] * bar.z;
+            float r = (p.x * 0.5f + 0.5f) * uniforms.Tint.x;
+            float g = (p.y * 0.5f + 0.5f) * uniforms.Tint.y;
+            float b = (p.z + 0.5f) * uniforms.Tint.z;
+            color = TGAColor((unsigned char)(std::fmin(std::fmax(r, 0.0f), 1.0f) * 255.0f),
+                (unsigned char)(std::fmin(std::fmax(g, 0.0f), 1.0f) * 255.0f),
+                (unsigned char)(std::fmin(std::fmax(b, 0.0f), 1.0f) * 255.0f), 255);
+            return true;
+        }
+    };
+
+    // Rolling surface over [-size, size] x [-size, size] around height z.
+    Model makeSurface(int cells, float size, float z)
+    {
+        std::vector<Vec3f> verts;
+        std::vector<Vec2f> uv;
+        std::vector<Vec3f> normals(1, Vec3f(0.0f, 0.0f, 1.0f));
+        std::vector<std::vector<VertexInfo> > faces;
+        for (int y = 0; y <= cells; ++y)
+        {
+            for (int x = 0; x <= cells; ++x)
+            {
+                float px = size * (-1.0f + 2.0f * x / cells);
+                float py = size * (-1.0f + 2.0f * y / cells);
+                verts.push_back(Vec3f(px, py, z + 0.2f * std::sin(4.0f * px) * std::cos(3.0f * py)));
+                uv.push_back(Vec2f((float)x / cells, (float)y / cells));
+            }
+        }
+        for (int y = 0; y < cells; ++y)
+        {
+            for (int x = 0; x < cells; ++x)
+            {
+                int a = y * (cells + 1) + x;
+                int b = a + cells + 1;
+                faces.push_back({ { a, a, 0 }, { a + 1, a + 1, 0 }, { b, b, 0 } });
+                faces.push_back({ { a + 1, a + 1, 0 }, { b + 1, b + 1, 0 }, { b, b, 0 } });
+            }
+        }
+        return Model(verts, uv, normals, faces);
+    }
+
+    void setUp(GraphicsLibrary& GL, int width, int height, int samples, DepthFormat depthFormat)
+    {
+        CHECK(GL.SetSampleCount(samples));
+        CHECK(GL.SetDepthFormat(depthFormat));
+        GL.SetViewport(width / 8, height / 8, width * 3 / 4, height * 3 / 4, 255.0f);
+        GL.SetProjection(3.0f);
+    }
+}
+
+// Frames of an orbiting camera, byte for byte the same through the pipeline, for the depth formats and sample counts
+// it rasterizes.
+TEST(FramePipelineMatchesDirectDrawing)
+{
+    const int width = 200, height = 150, frameCount = 5;
+    Model ground = makeSurface(32, 1.0f, 0.0f);
+    Model panel = makeSurface(8, 0.4f, 0.4f);
+    PositionShader groundShader(Vec3f(1.0f, 0.8f, 0.6f));
+    PositionShader panelShader(Vec3f(0.3f, 1.0f, 1.0f));
+
+    auto draw = [&](GraphicsLibrary& GL, int frame)
+    {
+        float angle = 0.6f * frame;
+        GL.LookAt(Vec3f(2.0f * std::sin(angle), 2.0f * std::cos(angle), 2.5f), Vec3f(0.0f, 0.0f, 0.0f), Vec3f(0.0f, 0.0f, 1.0f));
+        GL.DrawModel(ground, groundShader);
+        GL.DrawModel(panel, panelShader);
+    };
+
+    struct Config
+    {
+        int Samples;
+        DepthFormat Depth;
+    };
+    for (Config config : { Config{ 1, DepthFormat::Float32 }, Config{ 1, DepthFormat::Unorm16 }, Config{ 4, DepthFormat::Float32 } })
+    {
+        std::vector<std::vector<unsigned char> > expected(frameCount);
+        GraphicsLibrary direct(width, height);
+        setUp(direct, width, height, config.Samples, config.Depth);
+        for (int frame = 0; frame < frameCount; ++frame)
+        {
+            direct.BeginFrame();
+            direct.Clear();
+            draw(direct, frame);
+            direct.Resolve();
+            direct.EndFrame();
+            expected[frame].assign(direct.Output.buffer(), direct.Output.buffer() + width * height * direct.Output.get_bytespp());
+            // Drawn, and moving.
+            CHECK(std::count(expected[frame].begin(), expected[frame].end(), 0) < (std::ptrdiff_t)expected[frame].size() * 3 / 4);
+            CHECK(frame == 0 || expected[frame] != expected[frame - 1]);
+        }
+
+        GraphicsLibrary geometry(width, height), raster(width, height);
+        setUp(geometry, width, height, config.Samples, config.Depth);
+        setUp(raster, width, height, config.Samples, config.Depth);
+
+        FramePipeline::Stages stages;
+        int received = 0;
+        stages.Geometry = draw;
+        stages.Output = [&](GraphicsLibrary& GL, int frame)
+        {
+            GL.Resolve();
+            CHECK(frame == received);
+            CHECK(std::equal(expected[frame].begin(), expected[frame].end(), GL.Output.buffer()));
+            ++received;
+            return true;
+        };
+
+        FramePipeline pipeline(geometry, raster);
+        CHECK(pipeline.Run(frameCount, stages));
+        CHECK(received == frameCount);
+    }
+}
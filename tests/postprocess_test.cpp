@@ -0,0 +1,137 @@
+#include "test.h"
+#include "GL.h"
+#include "postprocess.h"
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+// The fused post-processing chain against applying each operator to every pixel in turn.
+
+namespace
+{
+    unsigned char curve(int channel, int i)
+    {
+        return channel == 2 ? (unsigned char)(255 - i) : channel == 1 ? (unsigned char)(i / 2) : (unsigned char)i;
+    }
+
+    enum class Step
+    {
+        ToneMap2,
+        Gamma22,
+        Lut,
+        Gamma08
+    };
+
+    // A run of value operators on channel `channel` of value i, in float and rounded once like PostProcess's tables.
+    int applySteps(const std::vector<Step>& steps, int channel, int i)
+    {
+        float c = i / 255.0f;
+        for (Step step : steps)
+        {
+            if (step == Step::ToneMap2)
+            {
+                float x = c * 2.0f;
+                c = x * (1.0f + x / 4.0f) / (1.0f + x);
+            }
+            else if (step == Step::Gamma22)
+                c = std::pow(c, 1.0f / 2.2f);
+            else if (step == Step::Gamma08)
+                c = std::pow(c, 1.0f / 0.8f);
+            else
+            {
+                float position = c * 255.0f;
+                int k = std::min((int)position, 254);
+                c = (curve(channel, k) + (curve(channel, k + 1) - curve(channel, k)) * (position - k)) / 255.0f;
+            }
+            c = std::min(std::max(c, 0.0f), 1.0f);
+        }
+        return (int)std::lround(c * 255.0f);
+    }
+
+    // Color channels through the steps, alpha kept.
+    std::vector<int> applySteps(const std::vector<Step>& steps, const std::vector<int>& image, int bpp)
+    {
+        std::vector<int> result(image.size());
+        for (size_t i = 0; i < image.size(); ++i)
+            result[i] = (int)(i % bpp) < 3 ? applySteps(steps, (int)(i % bpp), image[i]) : image[i];
+        return result;
+    }
+
+    // Every channel of 2x2 blocks averaged, the last column and row repeated for odd sizes.
+    std::vector<int> downsample(const std::vector<int>& image, int& width, int& height, int bpp)
+    {
+        int halfWidth = (width + 1) / 2, halfHeight = (height + 1) / 2;
+        std::vector<int> result((size_t)halfWidth * halfHeight * bpp);
+        for (int y = 0; y < halfHeight; ++y)
+        {
+            for (int x = 0; x < halfWidth; ++x)
+            {
+                int x0 = 2 * x, x1 = std::min(2 * x + 1, width - 1);
+                int y0 = 2 * y, y1 = std::min(2 * y + 1, height - 1);
+                for (int c = 0; c < bpp; ++c)
+                {
+                    int sum = image[(y0 * width + x0) * bpp + c] + image[(y0 * width + x1) * bpp + c]
+                        + image[(y1 * width + x0) * bpp + c] + image[(y1 * width + x1) * bpp + c];
+                    result[(y * halfWidth + x) * bpp + c] = (sum + 2) >> 2;
+                }
+            }
+        }
+        width = halfWidth;
+        height = halfHeight;
+        return result;
+    }
+}
+
+// ToneMap(2), Gamma(2.2), Lut, Downsample, Gamma(0.8), Downsample on odd sizes, for every level and thread count.
+TEST(PostProcessMatchesPerPixelChain)
+{
+    const int width = 161, height = 119;
+    unsigned char red[256], green[256], blue[256];
+    for (int i = 0; i < 256; ++i)
+    {
+        red[i] = curve(2, i);
+        green[i] = curve(1, i);
+        blue[i] = curve(0, i);
+    }
+
+    for (int bpp : { 3, 4 })
+    {
+        std::mt19937 rng(8);
+        std::vector<int> source((size_t)width * height * bpp);
+        for (int& value : source)
+            value = (int)(rng() & 0xff);
+
+        int expectedWidth = width, expectedHeight = height;
+        std::vector<int> expected = applySteps({ Step::ToneMap2, Step::Gamma22, Step::Lut }, source, bpp);
+        expected = downsample(expected, expectedWidth, expectedHeight, bpp);
+        expected = applySteps({ Step::Gamma08 }, expected, bpp);
+        expected = downsample(expected, expectedWidth, expectedHeight, bpp);
+
+        for (SimdLevel level : { SimdLevel::Scalar, SimdLevel::SSE2, SimdLevel::AVX2, SimdLevel::AVX512 })
+        {
+            for (int threads : { 1, 3 })
+            {
+                GraphicsLibrary GL(width, height, level);
+                GL.Output = TGAImage(width, height, bpp);
+                for (size_t i = 0; i < source.size(); ++i)
+                    GL.Output.buffer()[i] = (unsigned char)source[i];
+
+                PostProcess post(threads);
+                post.ToneMap(2.0f);
+                post.Gamma(2.2f);
+                post.Lut(red, green, blue);
+                post.Downsample();
+                post.Gamma(0.8f);
+                post.Downsample();
+
+                TGAImage target;
+                post.Apply(GL, target);
+                CHECK(target.get_width() == expectedWidth && target.get_height() == expectedHeight && target.get_bytespp() == bpp);
+                if (target.get_width() != expectedWidth || target.get_height() != expectedHeight || target.get_bytespp() != bpp)
+                    continue;
+                CHECK(std::equal(expected.begin(), expected.end(), target.buffer()));
+            }
+        }
+    }
+}
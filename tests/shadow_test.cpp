@@ -0,0 +1,102 @@
+#include "test.h"
+#include "GL.h"
+#include "model.h"
+#include "shadow.h"
+#include <vector>
+
+// ShadowMap lookups of a square hovering over a ground square, and when the map is drawn again.
+
+namespace
+{
+    struct DepthShader : public IShader
+    {
+        virtual Vec4f VertexStage(const Vertex& vec, int vertexId) override
+        {
+            return GL->Viewport * GL->Projection * GL->ModelView * Vec4f(vec.Pos);
+        }
+
+        virtual bool FragmentStage(const Vec3f& bar, TGAColor& color) override
+        {
+            return true;
+        }
+    };
+
+    // Square [-size, size] x [-size, size] at height z, facing +z.
+    Model makeSquare(float size, float z)
+    {
+        std::vector<Vec3f> verts = { Vec3f(-size, -size, z), Vec3f(size, -size, z), Vec3f(size, size, z), Vec3f(-size, size, z) };
+        std::vector<Vec2f> uv = { Vec2f(0.0f, 0.0f), Vec2f(1.0f, 0.0f), Vec2f(1.0f, 1.0f), Vec2f(0.0f, 1.0f) };
+        std::vector<Vec3f> normals(1, Vec3f(0.0f, 0.0f, 1.0f));
+        std::vector<std::vector<VertexInfo> > faces = { { { 0, 0, 0 }, { 1, 1, 0 }, { 2, 2, 0 } }, { { 0, 0, 0 }, { 2, 2, 0 }, { 3, 3, 0 } } };
+        return Model(verts, uv, normals, faces);
+    }
+
+    float visibility(const ShadowMap& shadows, const Vec3f& world)
+    {
+        Vec4f p = shadows.WorldToMap() * Vec4f(world);
+        return shadows.Visibility(Vec3f(p.x / p.w, p.y / p.w, p.z / p.w));
+    }
+}
+
+// Ground under the occluder is in its shadow, ground beside it and the occluder itself are lit, from above and from
+// an angle that moves the shadow.
+TEST(ShadowMapShadowsBehindOccluder)
+{
+    Model ground = makeSquare(1.0f, 0.0f);
+    Model occluder = makeSquare(0.3f, 0.5f);
+    DepthShader shader;
+    auto draw = [&](GraphicsLibrary& GL)
+    {
+        GL.DrawModel(ground, shader);
+        GL.DrawModel(occluder, shader);
+    };
+
+    ShadowMap shadows(256);
+    CHECK(shadows.Update(Vec3f(0.0f, 0.0f, 1.0f), Vec3f(0.0f, 0.0f, 0.0f), 1.5f, 1, draw));
+    CHECK(visibility(shadows, Vec3f(0.0f, 0.0f, 0.0f)) == 0.0f);
+    CHECK(visibility(shadows, Vec3f(0.2f, -0.2f, 0.0f)) == 0.0f);
+    CHECK(visibility(shadows, Vec3f(0.7f, 0.0f, 0.0f)) == 1.0f);
+    CHECK(visibility(shadows, Vec3f(-0.6f, 0.8f, 0.0f)) == 1.0f);
+    CHECK(visibility(shadows, Vec3f(0.1f, 0.1f, 0.5f)) == 1.0f);
+    // Beyond the map.
+    CHECK(visibility(shadows, Vec3f(5.0f, 0.0f, 0.0f)) == 1.0f);
+
+    // At 45 degrees toward +x, the shadow falls 0.5 toward -x.
+    CHECK(shadows.Update(Vec3f(1.0f, 0.0f, 1.0f), Vec3f(0.0f, 0.0f, 0.0f), 1.5f, 1, draw));
+    CHECK(visibility(shadows, Vec3f(-0.5f, 0.0f, 0.0f)) == 0.0f);
+    CHECK(visibility(shadows, Vec3f(0.3f, 0.0f, 0.0f)) == 1.0f);
+    CHECK(visibility(shadows, Vec3f(0.1f, 0.1f, 0.5f)) == 1.0f);
+}
+
+// The map is drawn again when the geometry version, light, center or radius changes, or once invalidated.
+TEST(ShadowMapRedrawsOnlyWhenStale)
+{
+    Model ground = makeSquare(1.0f, 0.0f);
+    DepthShader shader;
+    int draws = 0;
+    auto draw = [&](GraphicsLibrary& GL)
+    {
+        ++draws;
+        GL.DrawModel(ground, shader);
+    };
+
+    ShadowMap shadows(64);
+    Vec3f light(0.0f, 0.0f, 1.0f), center(0.0f, 0.0f, 0.0f);
+    CHECK(shadows.Update(light, center, 1.5f, 1, draw));
+    CHECK(!shadows.Update(light, center, 1.5f, 1, draw));
+    CHECK(draws == 1);
+
+    CHECK(shadows.Update(light, center, 1.5f, 2, draw));
+    CHECK(!shadows.Update(light, center, 1.5f, 2, draw));
+    CHECK(shadows.Update(Vec3f(0.0f, 0.1f, 1.0f), center, 1.5f, 2, draw));
+    CHECK(!shadows.Update(Vec3f(0.0f, 0.1f, 1.0f), center, 1.5f, 2, draw));
+    CHECK(shadows.Update(Vec3f(0.0f, 0.1f, 1.0f), Vec3f(0.0f, 0.0f, 0.2f), 1.5f, 2, draw));
+    CHECK(!shadows.Update(Vec3f(0.0f, 0.1f, 1.0f), Vec3f(0.0f, 0.0f, 0.2f), 1.5f, 2, draw));
+    CHECK(shadows.Update(Vec3f(0.0f, 0.1f, 1.0f), Vec3f(0.0f, 0.0f, 0.2f), 2.0f, 2, draw));
+    CHECK(!shadows.Update(Vec3f(0.0f, 0.1f, 1.0f), Vec3f(0.0f, 0.0f, 0.2f), 2.0f, 2, draw));
+    CHECK(draws == 5);
+
+    shadows.Invalidate();
+    CHECK(shadows.Update(Vec3f(0.0f, 0.1f, 1.0f), Vec3f(0.0f, 0.0f, 0.2f), 2.0f, 2, draw));
+    CHECK(draws == 6);
+}
@@ -0,0 +1,102 @@
+#include "test.h"
+#include "GL.h"
+#include "ambientocclusion.h"
+#include "model.h"
+#include "splitframe.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// A frame drawn in bands by RenderSplitFrame against the same frame drawn at once.
+
+#ifndef _WIN32
+namespace
+{
+    struct GrayShader : public IShader
+    {
+        virtual Vec4f VertexStage(const Vertex& vec, int vertexId) override
+        {
+            return GL->Viewport * GL->Projection * GL->ModelView * Vec4f(vec.Pos);
+        }
+
+        virtual bool FragmentStage(const Vec3f& bar, TGAColor& color) override
+        {
+            color = TGAColor(200, 180, 160, 255);
+            return true;
+        }
+    };
+
+    // Rolling surface over [-1, 1] x [-1, 1], creased enough for every band border to cross occluded pixels.
+    Model makeTerrain(int cells)
+    {
+        std::vector<Vec3f> verts;
+        std::vector<Vec2f> uv;
+        std::vector<Vec3f> normals(1, Vec3f(0.0f, 0.0f, 1.0f));
+        std::vector<std::vector<VertexInfo> > faces;
+        for (int y = 0; y <= cells; ++y)
+        {
+            for (int x = 0; x <= cells; ++x)
+            {
+                float px = -1.0f + 2.0f * x / cells;
+                float py = -1.0f + 2.0f * y / cells;
+                verts.push_back(Vec3f(px, py, 0.2f * std::sin(9.0f * px) * std::cos(7.0f * py)));
+                uv.push_back(Vec2f((float)x / cells, (float)y / cells));
+            }
+        }
+        for (int y = 0; y < cells; ++y)
+        {
+            for (int x = 0; x < cells; ++x)
+            {
+                int a = y * (cells + 1) + x;
+                int b = a + cells + 1;
+                faces.push_back({ { a, a, 0 }, { a + 1, a + 1, 0 }, { b, b, 0 } });
+                faces.push_back({ { a + 1, a + 1, 0 }, { b + 1, b + 1, 0 }, { b, b, 0 } });
+            }
+        }
+        return Model(verts, uv, normals, faces);
+    }
+}
+
+// Ambient occlusion samples around every pixel, bands drawn with the rows it reaches give the whole frame's result.
+TEST(SplitFrameAmbientOcclusionMatchesWholeFrame)
+{
+    const int width = 160, height = 128;
+    Model terrain = makeTerrain(48);
+    GrayShader shader;
+    AmbientOcclusion ambientOcclusion(1);
+
+    auto draw = [&](GraphicsLibrary& GL)
+    {
+        GL.SetProjection(3.0f);
+        GL.LookAt(Vec3f(0.3f, 0.9f, 2.2f), Vec3f(0.0f, 0.0f, 0.0f), Vec3f(0.0f, 1.0f, 0.0f));
+        GL.DrawModel(terrain, shader);
+    };
+    auto post = [&](GraphicsLibrary& GL) { ambientOcclusion.Apply(GL); };
+
+    GraphicsLibrary whole(width, height);
+    whole.SetViewport(0, 0, width, height, 255.0f);
+    whole.Clear();
+    draw(whole);
+    whole.Resolve();
+    post(whole);
+    size_t size = (size_t)width * height * whole.Output.get_bytespp();
+
+    for (int bands : { 2, 3, 5 })
+    {
+        int overlap = ambientOcclusion.Reach();
+        int bandHeight = (height + bands - 1) / bands;
+        GraphicsLibrary GL(width, std::min(bandHeight + (bandHeight & 1) + 2 * overlap, height));
+        GL.SetViewport(0, 0, width, height, 255.0f);
+
+        TGAImage image(width, height, GL.Output.get_bytespp());
+        CHECK(RenderSplitFrame(GL, draw, image, post, overlap));
+        CHECK(std::equal(image.buffer(), image.buffer() + size, whole.Output.buffer()));
+
+        // Without the overlap, the bands' borders show.
+        GraphicsLibrary band(width, bandHeight);
+        band.SetViewport(0, 0, width, height, 255.0f);
+        CHECK(RenderSplitFrame(band, draw, image, post));
+        CHECK(!std::equal(image.buffer(), image.buffer() + size, whole.Output.buffer()));
+    }
+}
+#endif
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cmath>
+#include <cstdio>
+
+// Minimal test registry: TEST defines a function that runs once, CHECK records a failure without stopping it.
+// Every *_test.cpp file registers its tests at static initialization, main.cpp runs those matching its filter.
+
+struct TestCase
+{
+    const char* Name;
+    void (*Run)();
+    TestCase* Next;
+
+    TestCase(const char* name, void (*run)());
+};
+
+// Failed CHECKs of the test being run.
+extern int TestFailures;
+
+void ReportFailure(const char* file, int line, const char* expression);
+
+#define TEST(name) \
+    static void name(); \
+    static TestCase name##Case(#name, name); \
+    static void name()
+
+#define CHECK(condition) \
+    do { if (!(condition)) ReportFailure(__FILE__, __LINE__, #condition); } while (false)
+
+#define CHECK_NEAR(a, b, tolerance) \
+    do { if (!(std::fabs((double)(a) - (double)(b)) <= (tolerance))) ReportFailure(__FILE__, __LINE__, #a " ~ " #b); } while (false)
@@ -89,9 +89,9 @@ public:
 	bool set(int x, int y, TGAColor c);
 	~TGAImage();
 	TGAImage & operator =(const TGAImage &img);
-	int get_width();
-	int get_height();
-	int get_bytespp();
+	int get_width() const;
+	int get_height() const;
+	int get_bytespp() const;
 	unsigned char *buffer();
 	void clear();
 };
@@ -0,0 +1,92 @@
+#include "workers.h"
+#include <algorithm>
+
+WorkerPool::WorkerPool(int threads) : threadCount(threads), next(0)
+{
+    if (threadCount <= 0)
+        threadCount = std::max(1, (int)std::thread::hardware_concurrency());
+}
+
+WorkerPool::~WorkerPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    started.notify_all();
+    for (std::thread& thread : threads)
+        thread.join();
+}
+
+void WorkerPool::run(int rowCount, int rowChunk, Invoke rowInvoke, const void* rowContext)
+{
+    if (rowCount <= 0)
+        return;
+
+    // Not worth waking anyone for a single chunk.
+    rowChunk = std::max(rowChunk, 1);
+    if (threadCount == 1 || rowCount <= rowChunk)
+    {
+        rowInvoke(rowContext, 0, rowCount, 0);
+        return;
+    }
+
+    if (threads.empty())
+    {
+        for (int thread = 1; thread < threadCount; ++thread)
+            threads.emplace_back(&WorkerPool::workerLoop, this, thread);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        invoke = rowInvoke;
+        context = rowContext;
+        count = rowCount;
+        chunk = rowChunk;
+        next = 0;
+        busy = threadCount - 1;
+        ++generation;
+    }
+    started.notify_all();
+
+    runChunks(0);
+
+    std::unique_lock<std::mutex> lock(mutex);
+    finished.wait(lock, [&] { return busy == 0; });
+    invoke = nullptr;
+    context = nullptr;
+}
+
+void WorkerPool::runChunks(int thread)
+{
+    for (;;)
+    {
+        int begin = next.fetch_add(chunk);
+        if (begin >= count)
+            return;
+        invoke(context, begin, std::min(begin + chunk, count), thread);
+    }
+}
+
+void WorkerPool::workerLoop(int thread)
+{
+    uint64_t seen = 0;
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            started.wait(lock, [&] { return stopping || generation != seen; });
+            if (stopping)
+                return;
+            seen = generation;
+        }
+
+        runChunks(thread);
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            --busy;
+        }
+        finished.notify_one();
+    }
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Threads kept across calls that split a range of rows with the calling thread, for passes over whole images.
+// Threads are only started by the first ParallelFor, a pool may be copied into forked processes before being used.
+class WorkerPool
+{
+public:
+    // 0 takes one thread per hardware thread, the calling thread included.
+    explicit WorkerPool(int threadCount = 0);
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    // Threads working on a ParallelFor, the calling thread included.
+    int ThreadCount() const { return threadCount; }
+
+    // Calls work(begin, end, thread) over consecutive ranges of at most chunk rows covering 0..count, and returns once
+    // they are all done. thread is below ThreadCount and no two ranges run at once with the same one, it can index
+    // per thread scratch buffers. Not reentrant. work is called through a pointer rather than a std::function, which
+    // could allocate every call.
+    template <class Work>
+    void ParallelFor(int count, int chunk, const Work& work)
+    {
+        Invoke invoke = [](const void* context, int begin, int end, int thread) { (*(const Work*)context)(begin, end, thread); };
+        run(count, chunk, invoke, &work);
+    }
+
+private:
+    using Invoke = void (*)(const void* context, int begin, int end, int thread);
+
+    void run(int count, int chunk, Invoke invoke, const void* context);
+    void workerLoop(int thread);
+    void runChunks(int thread);
+
+    int threadCount;
+    std::vector<std::thread> threads;
+
+    std::mutex mutex;
+    std::condition_variable started;
+    std::condition_variable finished;
+    uint64_t generation = 0;
+    int busy = 0;
+    bool stopping = false;
+
+    Invoke invoke = nullptr;
+    const void* context = nullptr;
+    int count = 0;
+    int chunk = 1;
+    std::atomic<int> next;
+};